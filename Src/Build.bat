@@ -69,6 +69,7 @@ set CompileSwitches=/EHa /GR- /Oi /MT /Z7 /W4 /wd4201 /wd4505 /O2
 set Defnes=
 
 set CompileFlags=%CompileSwitches% /Fo%BinDir%\%ProjectName% /Fd%BinDir%\%ProjectName% /Fe%BinDir%\%ProjectName%
+set BenchFlags=%CompileSwitches% /Fo%BinDir%\WPDBench /Fd%BinDir%\WPDBench /Fe%BinDir%\WPDBench
 set DLLFlags=%CompileSwitches% /Fo%BinDir%\%ProjectNameDLL% /Fe%BinDir%\%ProjectNameDLL%
 
 REM // Include Directories/Link Libraries
@@ -77,9 +78,10 @@ REM incremental:no, turn incremental builds off
 REM opt:ref,        try to remove functions from libs that are not referenced at all
 set LinkFlags=/LIBPATH:External/ffmpeg/lib /opt:ref /machine:x64 /nologo /DEBUG /NATVIS:External\Dqn.natvis
 set IncludeFiles=/I External/ffmpeg/include
-set FFmpegLibraryDependencies=libavcodec.a libavformat.a libavutil.a libswresample.a Ws2_32.lib Secur32.lib BCrypt.lib
+set FFmpegLibraryDependencies=libavcodec.a libavformat.a libavutil.a libswresample.a libswscale.a Ws2_32.lib Secur32.lib BCrypt.lib
 set LinkLibraries=user32.lib Ole32.lib PortableDeviceGuids.lib %FFmpegLibraryDependencies%
 set DLLLinkLibraries=
+set BenchLinkLibraries=Psapi.lib
 
 REM Clean time necessary for hours <10, which produces  H:MM:SS.SS where the
 REM first character of time is an empty space. CleanTime will pad a 0 if
@@ -100,6 +102,12 @@ if %LastError%==0 (
 	set LastError=%ERRORLEVEL%
 )
 
+REM Synthetic library generator and end-to-end benchmark, see WPDBench.cpp for usage
+if %LastError%==0 (
+	cl %BenchFlags% %Defines% UnityBuildBench.cpp /link /opt:ref /machine:x64 /nologo /DEBUG %BenchLinkLibraries%
+	set LastError=%ERRORLEVEL%
+)
+
 :end
 REM popd
 if %HaveCTimeBinary%==1 ctime -end %ProjectName%.ctm %LastError%
@@ -0,0 +1,8 @@
+#!/bin/bash
+# Build the parts of the project that are portable to Unix. WPDPlayground itself is Win32 only (see
+# Build.bat), WPDBench can generate a library on any box and drive the pipeline, i.e. under wine.
+BinDir=../Bin
+mkdir -p ${BinDir}
+
+CompileFlags="-std=c++14 -O2 -g -Wall -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-parentheses"
+g++ ${CompileFlags} UnityBuildBench.cpp -o ${BinDir}/WPDBench -lpthread
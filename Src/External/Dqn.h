@@ -58,10 +58,14 @@
 // #DqnVArray     Array backed by virtual memory
 // #DqnVHashTable Hash Table using templates backed by virtual memory
 // #DqnFile       File I/O (Read, Write, Delete)
+// #DqnFileWatch  Directory change notifications (ReadDirectoryChangesW on Win32, inotify on Linux)
+// #DqnFileBatch  Batched async Stat/MakeDir/Link/Open (io_uring on Linux, thread pool fallback)
 // #DqnTimer      High Resolution Timer
 // #DqnLock       Mutex Synchronisation
+// #DqnRWLock     Reader-Writer Lock
 // #DqnJobQueue   Multithreaded Job Queue
 // #DqnAtomic     Interlocks/Atomic Operations
+// #DqnCatalog    Hot reloaded assets (double buffered, reloads on file change events)
 // #DqnOS         Common Platform API helpers
 
 // #Platform
@@ -218,6 +222,41 @@ u32    const OPEN_EXISTING                 = 3;
 u32    const OPEN_ALWAYS                   = 4;
 u32    const TRUNCATE_EXISTING             = 5;
 u32    const FILE_ATTRIBUTE_NORMAL         = 0x00000080;
+u32    const ERROR_ALREADY_EXISTS          = 183L;
+u32    const FILE_SHARE_READ               = 0x00000001;
+u32    const PAGE_READONLY                 = 0x02;
+u32    const FILE_MAP_READ                 = 0x0004;
+u32    const FILE_ATTRIBUTE_DIRECTORY      = 0x00000010;
+u32    const FILE_ATTRIBUTE_REPARSE_POINT  = 0x00000400;
+u32    const IO_REPARSE_TAG_MOUNT_POINT    = 0xA0000003L;
+u32    const IO_REPARSE_TAG_SYMLINK        = 0xA000000CL;
+u32    const FIND_FIRST_EX_LARGE_FETCH     = 0x00000002;
+u32    const FILE_SHARE_WRITE              = 0x00000002;
+u32    const FILE_SHARE_DELETE             = 0x00000004;
+u32    const FILE_LIST_DIRECTORY           = 0x0001;
+u32    const FILE_FLAG_BACKUP_SEMANTICS    = 0x02000000;
+u32    const FILE_FLAG_OVERLAPPED          = 0x40000000;
+u32    const FILE_NOTIFY_CHANGE_FILE_NAME  = 0x00000001;
+u32    const FILE_NOTIFY_CHANGE_DIR_NAME   = 0x00000002;
+u32    const FILE_NOTIFY_CHANGE_SIZE       = 0x00000008;
+u32    const FILE_NOTIFY_CHANGE_LAST_WRITE = 0x00000010;
+u32    const FILE_ACTION_ADDED             = 0x00000001;
+u32    const FILE_ACTION_REMOVED           = 0x00000002;
+u32    const FILE_ACTION_MODIFIED          = 0x00000003;
+u32    const FILE_ACTION_RENAMED_OLD_NAME  = 0x00000004;
+u32    const FILE_ACTION_RENAMED_NEW_NAME  = 0x00000005;
+u32    const WAIT_OBJECT_0                 = 0x00000000L;
+u32    const WAIT_TIMEOUT                  = 258L;
+u32    const MAXIMUM_WAIT_OBJECTS          = 64;
+u32    const FILE_FLAG_SEQUENTIAL_SCAN     = 0x08000000;
+u32    const COPY_FILE_FAIL_IF_EXISTS      = 0x00000001;
+u32    const ERROR_INVALID_FUNCTION        = 1L;
+u32    const ERROR_NOT_SAME_DEVICE         = 17L;
+u32    const ERROR_HANDLE_EOF              = 38L;
+u32    const ERROR_NOT_SUPPORTED           = 50L;
+u32    const ERROR_INVALID_PARAMETER       = 87L;
+u32    const ERROR_IO_PENDING              = 997L;
+u32    const ERROR_TOO_MANY_LINKS          = 1142L;
 
 struct RECT
 {
@@ -279,6 +318,21 @@ enum GET_FILEEX_INFO_LEVELS
     GetFileExMaxInfoLevel
 };
 
+enum FINDEX_INFO_LEVELS
+{
+    FindExInfoStandard,
+    FindExInfoBasic,
+    FindExInfoMaxInfoLevel
+};
+
+enum FINDEX_SEARCH_OPS
+{
+    FindExSearchNameMatch,
+    FindExSearchLimitToDirectories,
+    FindExSearchLimitToDevices,
+    FindExSearchMaxSearchOp
+};
+
 struct WIN32_FIND_DATAW
 {
   DWORD    dwFileAttributes;
@@ -298,6 +352,11 @@ struct LIST_ENTRY {
    struct LIST_ENTRY *Blink;
 };
 
+struct SRWLOCK
+{
+    void *Ptr;
+};
+
 struct RTL_CRITICAL_SECTION_DEBUG
 {
     WORD Type;
@@ -453,52 +512,84 @@ struct FILETIME
     DWORD dwHighDateTime;
 };
 
+struct FILE_NOTIFY_INFORMATION
+{
+    DWORD   NextEntryOffset;
+    DWORD   Action;
+    DWORD   FileNameLength;
+    wchar_t FileName[1];
+};
+
 typedef DWORD (*LPTHREAD_START_ROUTINE)(void *lpThreadParameter);
+typedef void  (*LPOVERLAPPED_COMPLETION_ROUTINE)(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, OVERLAPPED *lpOverlapped);
 
 DWORD64 __rdtsc();
 
+BOOL    CancelIoEx                      (HANDLE hFile, OVERLAPPED *lpOverlapped);
 void    DeleteCriticalSection           (CRITICAL_SECTION *lpCriticalSection);
 BOOL    DeleteFileA                     (char    const *lpFileName); // TODO(doyle): Wide versions only
 BOOL    DeleteFileW                     (wchar_t const *lpFileName);
 BOOL    CloseHandle                     (HANDLE hObject);
 BOOL    CopyFileA                       (char    const *lpExistingFileName, char const *lpNewFileName, BOOL bFailIfExists);
 BOOL    CopyFileW                       (wchar_t const *lpExistingFileName, wchar_t const *lpNewFileName, BOOL bFailIfExists);
+BOOL    CopyFileExW                     (wchar_t const *lpExistingFileName, wchar_t const *lpNewFileName, void *lpProgressRoutine, void *lpData,
+                                         BOOL *pbCancel, DWORD dwCopyFlags);
 BOOL    CloseHandle                     (HANDLE *hObject);
+BOOL    CreateDirectoryW                (wchar_t const *lpPathName, SECURITY_ATTRIBUTES *lpSecurityAttributes);
+HANDLE  CreateEventW                    (SECURITY_ATTRIBUTES *lpEventAttributes, BOOL bManualReset, BOOL bInitialState, wchar_t const *lpName);
+HANDLE  CreateFileMappingW              (HANDLE hFile, SECURITY_ATTRIBUTES *lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh,
+                                         DWORD dwMaximumSizeLow, wchar_t const *lpName);
 HANDLE  CreateFileW                     (wchar_t const *lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, SECURITY_ATTRIBUTES *lpSecurityAttributes,
                                          DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+BOOL    CreateHardLinkW                 (wchar_t const *lpFileName, wchar_t const *lpExistingFileName, SECURITY_ATTRIBUTES *lpSecurityAttributes);
 HANDLE  CreateSemaphoreA                (SECURITY_ATTRIBUTES *lpSemaphoreAttributes, long lInitialCount, long lMaximumCount, char const *lpName);
 HANDLE  CreateThread                    (SECURITY_ATTRIBUTES *lpThreadAttributes, size_t dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress,
                                          void *lpParameter, DWORD dwCreationFlags, DWORD *lpThreadId);
+void    AcquireSRWLockExclusive         (SRWLOCK *SRWLock);
+void    AcquireSRWLockShared            (SRWLOCK *SRWLock);
 void    EnterCriticalSection            (CRITICAL_SECTION *lpCriticalSection);
 BOOL    FindClose                       (HANDLE hFindFile);
 HANDLE  FindFirstFileW                  (wchar_t const *lpFileName, WIN32_FIND_DATAW *lpFindFileData);
+HANDLE  FindFirstFileExW                (wchar_t const *lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, void *lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+                                         void *lpSearchFilter, DWORD dwAdditionalFlags);
 BOOL    FindNextFileW                   (HANDLE hFindFile, WIN32_FIND_DATAW *lpFindFileData);
 DWORD   FormatMessageA                  (DWORD dwFlags, void const *lpSource, DWORD dwMessageId, DWORD dwLanguageId, char *lpBuffer, DWORD nSize, va_list *Arguments);
 BOOL    GetClientRect                   (HWND hWnd, RECT *lpRect);
 BOOL    GetExitCodeProcess              (HANDLE *hProcess, DWORD *lpExitCode);
 BOOL    GetFileSizeEx                   (HANDLE hFile, LARGE_INTEGER *lpFileSize);
+BOOL    GetFileTime                     (HANDLE hFile, FILETIME *lpCreationTime, FILETIME *lpLastAccessTime, FILETIME *lpLastWriteTime);
 BOOL    GetFileAttributesExW            (wchar_t const *lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, void *lpFileInformation);
 DWORD   GetLastError                    (void);
 void    GetLocalTime                    (SYSTEMTIME *lpSystemTime);
 DWORD   GetModuleFileNameA              (HMODULE hModule, char *lpFilename, DWORD nSize);
+BOOL    GetOverlappedResult             (HANDLE hFile, OVERLAPPED *lpOverlapped, DWORD *lpNumberOfBytesTransferred, BOOL bWait);
 void    GetNativeSystemInfo             (SYSTEM_INFO *lpSystemInfo);
 BOOL    GetLogicalProcessorInformationEx(LOGICAL_PROCESSOR_RELATIONSHIP RelationshipType, SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *Buffer, DWORD *ReturnedLength);
 BOOL    InitializeCriticalSectionEx     (CRITICAL_SECTION *lpCriticalSection, DWORD dwSpinCount, DWORD Flags);
+void    InitializeSRWLock               (SRWLOCK *SRWLock);
 long    InterlockedAdd                  (long volatile *Addend, long Value);
 long    InterlockedCompareExchange      (long volatile *Destination, long Exchange, long Comparand);
 void    LeaveCriticalSection            (CRITICAL_SECTION *lpCriticalSection);
+void   *MapViewOfFile                   (HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, size_t dwNumberOfBytesToMap);
 int     MessageBoxA                     (HWND hWnd, char const *lpText, char const *lpCaption, UINT uType);
 int     MultiByteToWideChar             (unsigned int CodePage, DWORD dwFlags, char const *lpMultiByteStr, int cbMultiByte, wchar_t *lpWideCharStr, int cchWideChar);
 void    OutputDebugStringA              (char const *lpOutputString);
+BOOL    ReadDirectoryChangesW           (HANDLE hDirectory, void *lpBuffer, DWORD nBufferLength, BOOL bWatchSubtree, DWORD dwNotifyFilter,
+                                         DWORD *lpBytesReturned, OVERLAPPED *lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
 BOOL    ReadFile                        (HANDLE hFile, void *lpBuffer, DWORD nNumberOfBytesToRead, DWORD *lpNumberOfBytesRead, OVERLAPPED *lpOverlapped);
 BOOL    ReleaseSemaphore                (HANDLE hSemaphore, long lReleaseCount, long *lpPreviousCount);
+void    ReleaseSRWLockExclusive         (SRWLOCK *SRWLock);
+void    ReleaseSRWLockShared            (SRWLOCK *SRWLock);
 BOOL    QueryPerformanceFrequency       (LARGE_INTEGER *lpFrequency);
 BOOL    QueryPerformanceCounter         (LARGE_INTEGER *lpPerformanceCount);
+DWORD   WaitForMultipleObjects          (DWORD nCount, HANDLE const *lpHandles, BOOL bWaitAll, DWORD dwMilliseconds);
 DWORD   WaitForSingleObject             (HANDLE *hHandle, DWORD dwMilliseconds);
 DWORD   WaitForSingleObjectEx           (HANDLE hHandle, DWORD dwMilliseconds, BOOL bAlertable);
 int     WideCharToMultiByte             (unsigned int CodePage, DWORD dwFlags, wchar_t const *lpWideCharStr, int cchWideChar,
                                          char *lpMultiByteStr, int cbMultiByte, char const *lpDefaultChar, BOOL *lpUsedDefaultChar);
+BOOL    SetFileTime                     (HANDLE hFile, FILETIME const *lpCreationTime, FILETIME const *lpLastAccessTime, FILETIME const *lpLastWriteTime);
 void    Sleep                           (DWORD dwMilliseconds);
+BOOL    UnmapViewOfFile                 (void const *lpBaseAddress);
 BOOL    WriteFile                       (HANDLE hFile, void *const lpBuffer, DWORD nNumberOfBytesToWrite, DWORD *lpNumberOfBytesWritten, OVERLAPPED *lpOverlapped);
 void   *VirtualAlloc                    (void *lpAddress, size_t dwSize, DWORD  flAllocationType, DWORD  flProtect);
 BOOL    VirtualFree                     (void *lpAddress, size_t dwSize, DWORD  dwFreeType);
@@ -766,6 +857,20 @@ struct DqnAllocator
     void  Free   (void *ptr, size_t old_size);
 };
 
+// #DqnMem
+// =================================================================================================
+// TODO(doyle): Use platform allocation, fallback to malloc if platform not defined
+DQN_FILE_SCOPE void *DqnMem_Alloc   (usize size);
+DQN_FILE_SCOPE void *DqnMem_XAlloc  (usize size);
+DQN_FILE_SCOPE void *DqnMem_XCalloc (usize size);
+DQN_FILE_SCOPE void  DqnMem_Clear   (void *memory, u8 clear_val, usize size);
+DQN_FILE_SCOPE void *DqnMem_Realloc (void *memory, usize new_size);
+DQN_FILE_SCOPE void *DqnMem_XRealloc(void *memory, usize new_size);
+DQN_FILE_SCOPE void  DqnMem_Free    (void *memory);
+DQN_FILE_SCOPE void  DqnMem_Copy    (void *dest, void const *src, usize num_bytes_to_copy);
+DQN_FILE_SCOPE void *DqnMem_Set     (void *dest, u8 value,        usize num_bytes_to_set);
+DQN_FILE_SCOPE int   DqnMem_Cmp     (void const *src, void const *dest, usize num_bytes);
+
 // #DqnSlice/#DqnBuffer
 // =================================================================================================
 // NOTE: A slice and buffer is the same thing but, slices have the pre-existing concepts of being a
@@ -852,14 +957,7 @@ struct DqnFixedString
     void NullTerminate   () { str[len] = 0; } // NOTE: If you modify the storage directly, this can be handy.
     void Clear           (Dqn::ZeroMem clear = Dqn::ZeroMem::No) { if (clear == Dqn::ZeroMem::Yes) DqnMem_Set(str, 0, MAX); *this = {}; }
 
-    int VSprintfAtOffset(char const *fmt, va_list va, int offset)
-    {
-        if (Dqn::is_debug) { DQN_ASSERT(Dqn_vsnprintf(nullptr, 0, fmt, va) < MAX); }
-        char *start = str + offset;
-        int result  = Dqn_vsnprintf(start, static_cast<int>((str + MAX) - start), fmt, va);
-        len         = (offset + result);
-        return result;
-    }
+    int VSprintfAtOffset(char const *fmt, va_list va, int offset);
 };
 
 using DqnFixedString16   = DqnFixedString<16>;
@@ -871,20 +969,6 @@ using DqnFixedString512  = DqnFixedString<512>;
 using DqnFixedString1024 = DqnFixedString<1024>;
 using DqnFixedString2048 = DqnFixedString<2048>;
 
-// #DqnMem
-// =================================================================================================
-// TODO(doyle): Use platform allocation, fallback to malloc if platform not defined
-DQN_FILE_SCOPE void *DqnMem_Alloc   (usize size);
-DQN_FILE_SCOPE void *DqnMem_XAlloc  (usize size);
-DQN_FILE_SCOPE void *DqnMem_XCalloc (usize size);
-DQN_FILE_SCOPE void  DqnMem_Clear   (void *memory, u8 clear_val, usize size);
-DQN_FILE_SCOPE void *DqnMem_Realloc (void *memory, usize new_size);
-DQN_FILE_SCOPE void *DqnMem_XRealloc(void *memory, usize new_size);
-DQN_FILE_SCOPE void  DqnMem_Free    (void *memory);
-DQN_FILE_SCOPE void  DqnMem_Copy    (void *dest, void const *src, usize num_bytes_to_copy);
-DQN_FILE_SCOPE void *DqnMem_Set     (void *dest, u8 value,        usize num_bytes_to_set);
-DQN_FILE_SCOPE int   DqnMem_Cmp     (void const *src, void const *dest, usize num_bytes);
-
 // #DqnMemTracker
 // =================================================================================================
 // Allocation Layout
@@ -1193,6 +1277,24 @@ struct DqnLogger
     char const *LogVA       (Type type, Context log_context, char const *fmt, va_list va);
 };
 
+// NOTE: Defined out of line since DQN_ASSERT requires the complete DqnLogger type.
+template <int MAX>
+int DqnFixedString<MAX>::VSprintfAtOffset(char const *fmt, va_list va, int offset)
+{
+    if (Dqn::is_debug)
+    {
+        // NOTE: va_list is consumed on use on some platforms (i.e. x64 SysV), copy before measuring.
+        va_list va_copy_;
+        va_copy(va_copy_, va);
+        DQN_ASSERT(Dqn_vsnprintf(nullptr, 0, fmt, va_copy_) < MAX);
+        va_end(va_copy_);
+    }
+    char *start = str + offset;
+    int result  = Dqn_vsnprintf(start, static_cast<int>((str + MAX) - start), fmt, va);
+    len         = (offset + result);
+    return result;
+}
+
 // #DqnArray
 // =================================================================================================
 template<typename T>
@@ -2246,7 +2348,7 @@ struct DqnVHashTable
     DqnVHashTable       (isize size)                       { LazyInit(size); }
 
     void       LazyInit (isize size = DQN_MAX(DQN_MEGABYTE(1)/sizeof(Bucket), 1024) );
-    void       Free     ()                                 { if (buckets) DqnOS_VFree(buckets, sizeof(buckets) * num_buckets); *this = {}; }
+    void       Free     ()                                 { if (buckets) { DqnOS_VFree(buckets, sizeof(*buckets) * num_buckets); DqnOS_VFree(indexes_of_used_buckets, sizeof(*indexes_of_used_buckets) * num_buckets); } *this = {}; }
 
     void       Erase    (Key const &key);                           // Delete the element matching key, does nothing if key not found.
     Entry     *GetEntry (Key const &key);                           // return: The (key, item) entry associated with the key, nullptr if key not in table yet.
@@ -2476,10 +2578,27 @@ struct DqnFile
     // return: The number of bytes read. 0 if invalid args or it failed to read.
     usize  Read (u8 *buf, usize const num_bytes_to_read);
 
+    // Read from an absolute offset in the file, moves the file pointer.
+    // return: The number of bytes read, less than requested if the read went past the end of the file.
+    usize  ReadAt(u8 *buf, usize const num_bytes_to_read, usize const file_offset);
+
     // File close invalidates the handle after it is called.
     void   Close();
 };
 
+// Read only view of an entire file, for random access over files without a syscall per read.
+struct DqnFileMap
+{
+    u8    *data;
+    usize  size;
+    void  *handle; // Win32: The file mapping handle
+
+    // return: False if the file could not be opened, is empty or could not be mapped.
+    bool Map  (char    const *path);
+    bool Map  (wchar_t const *path);
+    void Unmap();
+};
+
 struct DqnFileInfo
 {
     usize size;
@@ -2523,6 +2642,27 @@ DQN_FILE_SCOPE bool   DqnFile_Delete (wchar_t const *path);
 DQN_FILE_SCOPE bool   DqnFile_Copy   (char    const *src, char    const *dest);
 DQN_FILE_SCOPE bool   DqnFile_Copy   (wchar_t const *src, wchar_t const *dest);
 
+// The ways DqnFile_Materialize() can make a file, cheapest first
+enum struct DqnFileCopyTier
+{
+    None,       // Every tier failed
+    HardLink,   // Same file, only within a volume
+    Reflink,    // Linux: FICLONE, copy-on-write clone of the extents (Btrfs, XFS). Win32: Not available
+    KernelCopy, // Linux: copy_file_range() then sendfile(). Win32: CopyFileExW(). Data never enters user space
+    StreamCopy, // Read/write through the caller's buffer, reading the next chunk whilst writing the last
+    Count,
+};
+
+DQN_FILE_SCOPE char const     *DqnFileCopyTier_Name(DqnFileCopyTier tier);
+
+// Make dest have the contents of src, trying every tier from first_tier onwards. A tier falls through
+// to the next if the OS or file system doesn't support it, e.g. hard links across volumes. Copies keep
+// src's last write time so dest stats the same as a hard link would. Fails if dest already exists.
+// buf:    Used by DqnFileCopyTier::StreamCopy, split in two halves to overlap reads and writes.
+// error:  (Optional) errno on Unix, GetLastError() on Win32 of the failing call, 0 if successful.
+// return: The tier that made dest, None if it failed (a partially written dest is deleted).
+DQN_FILE_SCOPE DqnFileCopyTier DqnFile_Materialize (char const *src, char const *dest, u8 *buf, usize buf_size, DqnFileCopyTier first_tier = DqnFileCopyTier::HardLink, i32 *error = nullptr);
+
 // NOTE: Win32: Current directory is "*", Unix: "."
 // num_files: Pass in a ref to a i32. The function fills it out with the number of entries.
 // return:   An array of strings of the files in the directory in UTF-8. The directory lisiting is
@@ -2530,132 +2670,201 @@ DQN_FILE_SCOPE bool   DqnFile_Copy   (wchar_t const *src, wchar_t const *dest);
 DQN_FILE_SCOPE char **DqnFile_ListDir       (char const *dir, i32 *num_files, DqnAllocator *allocator = dqn_lib_context_.allocator);
 DQN_FILE_SCOPE void   DqnFile_ListDirFree   (char **file_list, i32 num_files, DqnAllocator *allocator = dqn_lib_context_.allocator);
 
-// XPlatform > #DqnCatalog
-// =================================================================================================
-using DqnCatalogPath = DqnFixedString1024;
-template <typename T> using DqnCatalogLoadProc = bool (*)(DqnCatalogPath const &file, T *data);
-#define DQN_CATALOG_LOAD_PROC(name, type) bool name(DqnCatalogPath const &file, type *data)
+struct DqnFileDirEntry
+{
+    enum struct Type
+    {
+        File,
+        Directory,
+        Symlink,
+        Other,   // Devices, pipes, sockets
+    };
 
-#define DQN_CATALOG_TEMPLATE template <typename T, DqnCatalogLoadProc<T> LoadAsset>
-#define DQN_CATALOG_DECL DqnCatalog<T, LoadAsset>
+    char const *name;     // UTF-8, null-terminated, only valid for the duration of the callback
+    i32         name_len;
+    Type        type;
 
-#if 0
-struct RawBuf { char *buffer; int len; };
-DQN_CATALOG_LOAD_PROC(CatalogRawLoad, RawBuf)
-{
-    size_t buf_size;
-    uint8_t *buf = DqnFile_ReadAll(file.str, &buf_size);
-    if (!buf) return false;
-    data->buffer = reinterpret_cast<char *>(buf);
-    data->len    = static_cast<int>(buf_size);
-    return true;
-}
+    // NOTE: Only filled when has_info is set, i.e. the OS returned it with the listing (always on
+    // Win32, on Unix only if the entry had to be stat'ed for its type).
+    bool        has_info;
+    usize       size;
+    u64         last_write_time_in_s;
+};
 
-int main(int, char)
-{
-    DqnCatalog<RawBuf, CatalogRawLoad> catalog = {};
-    RawBuf *file = catalog.GetIfUpdated("path/to/file/");
-    if (file) { (void)file; // do work on file }
-    else      { // file not updated since last query }
+// return: False to stop iterating
+typedef bool DqnFile_IterateDirCallback(DqnFileDirEntry const *entry, void *user_data);
 
-    while (true) // Or event loop, poll the assets in the catalog
-    {
-        catalog.PollAssets();
-    }
-    catalog.Free();
-}
-#endif
+// Enumerate the entries of a directory, excluding "." and "..", in the order the OS returns them. Types
+// come from the directory listing itself (d_type via getdents64 on Linux, FindFirstFileExW on Win32),
+// the file is only stat'ed if the file system doesn't report the type.
+// dir:    The directory path, no wildcard
+// return: False if the directory could not be opened or read.
+DQN_FILE_SCOPE bool   DqnFile_IterateDir    (char const *dir, DqnFile_IterateDirCallback *callback, void *user_data);
 
-DQN_CATALOG_TEMPLATE struct DqnCatalog
+struct DqnFileDirList
 {
+    enum Flag
+    {
+        Sort = (1 << 0), // Sort entries by name, byte-wise so UTF-8 sorts by code point
+        Info = (1 << 1), // Fill size and last_write_time_in_s. Free on Win32, one stat per entry on Unix
+    };
+
     struct Entry
     {
-        T    data;
-        u64  last_write_time_in_s;
-        bool updated;
+        DqnSlice<char>        name; // UTF-8, null-terminated, names are packed back to back in the stack
+        DqnFileDirEntry::Type type;
+        usize                 size;
+        u64                   last_write_time_in_s;
     };
 
-    DqnVHashTable<DqnCatalogPath, Entry> asset_table;
+    Entry *entries;
+    isize  len;
 
-    // Adds the file to the catalog if it has not been added yet.
-    // return: Asset if an update has been detected and not consumed yet otherwise nullptr. Update is consumed after called.
-    T     *GetIfUpdated(DqnCatalogPath const &file);
-    Entry *GetEntry    (DqnCatalogPath const &file) { Entry *entry = asset_table.Get(file); return entry; }
-    T     *Get         (DqnCatalogPath const &file) { Entry *entry = asset_table.Get(file); return (entry) ? &entry->data : nullptr; }
-    void   Erase       (DqnCatalogPath const &file) { asset_table.Erase(file); };
+    Entry *begin() const { return entries; }
+    Entry *end  () const { return entries + len; }
+};
 
-    // return: Iterate all loaded assets for updates, true if atleast 1 asset was updated.
-    bool   PollAssets  ();
-    void   Free        () { asset_table.Free(); }
+// Single pass directory listing into a memory stack, the entries array and the packed names are the
+// only allocations made on the stack, release them with a MemRegion.
+// dir:    The directory path, no wildcard
+// flags:  DqnFileDirList::Flag
+// glob:   Optional, only list names matching the pattern. '*' matches any run of bytes, '?' a single
+//         byte. Case-insensitive on Win32 to match the file system.
+// batch:  Optional, on Unix the stats for DqnFileDirList::Info are submitted as one batch through it
+//         instead of one blocking stat per entry.
+// return: False if the directory could not be opened or read.
+DQN_FILE_SCOPE bool   DqnFile_ListDir       (char const *dir, DqnMemStack *stack, DqnFileDirList *list, u32 flags = 0, char const *glob = nullptr, struct DqnFileBatch *batch = nullptr);
+
+// XPlatform > #DqnFileWatch
+// =================================================================================================
+// Change notifications for directory trees from the OS instead of polling with stats. Win32 issues one
+// ReadDirectoryChangesW per tree (at most 64 trees), Linux has an inotify watch on every directory of
+// the tree and watches directories as they are created or moved in.
 
-    // NOTE: Unlikely you will need to use. Prefer GetIfUpdated.
-    // Manually invoke an update on the entry by querying its last write time on disk and updating accordingly.
-    bool QueryAndUpdateAsset(DqnCatalogPath const &file, Entry *entry);
+// Usage
+// 1. Init() then Add() the directory trees to watch.
+// 2. Wait() blocks until something changed, or the timeout elapses, and returns the events since the
+//    last Wait(). The same path may be reported several times, i.e. once per write, coalesce them.
+// A directory reported as Changed was created or moved in, files already in it may not be reported.
+struct DqnFileWatchEvent
+{
+    enum struct Type
+    {
+        Changed,  // Created, written to or moved into the tree
+        Removed,  // Deleted or moved out of the tree
+        Overflow, // The OS dropped events, path is the watched tree and anything in it may have changed
+    };
+
+    Type           type;
+    bool           is_dir;   // Only known for Changed events on Win32
+    DqnSlice<char> path;     // UTF-8, null-terminated, the tree's directory as given to Add() joined with the name
 };
 
-DQN_CATALOG_TEMPLATE bool DQN_CATALOG_DECL::QueryAndUpdateAsset(DqnCatalogPath const &file, Entry *entry)
+struct DqnFileWatchEvents
 {
-    DqnFileInfo info = {};
-    if (!DqnFile_GetInfo(file.str, &info))
-    {
-        DQN_LOGGER_W(dqn_lib_context_.logger, "Catalog could not get file info for: %s\n", file.str);
-        return false;
-    }
+    DqnFileWatchEvent *events;
+    isize              len;
 
-    if (entry->last_write_time_in_s == info.last_write_time_in_s)
-        return true;
+    DqnFileWatchEvent *begin() const { return events; }
+    DqnFileWatchEvent *end  () const { return events + len; }
+};
 
-    T newData = {};
-    if (LoadAsset(file, &newData))
-    {
-        entry->last_write_time_in_s = info.last_write_time_in_s;
-        entry->data             = newData;
-        entry->updated          = true;
-    }
-    else
-    {
-        DQN_LOGGER_W(dqn_lib_context_.logger, "Catalog could not load file: %s\n", file.str);
-        return false;
-    }
+struct DqnFileWatch
+{
+    struct Dir;         // Platform specific, one per watched tree on Win32, per watched directory on Linux
+    DqnArray<Dir *> dirs;
+    int             fd; // Linux: The inotify instance
 
-    return true;
-}
+    bool Init();
+    void Free();
 
-DQN_CATALOG_TEMPLATE T *DQN_CATALOG_DECL::GetIfUpdated(DqnCatalogPath const &file)
+    // dir:    Directory to watch, including every directory below it
+    // return: False if the directory could not be watched
+    bool Add (char const *dir);
+
+    // Wait at most timeout_ms for changes. The events array and paths are the only allocations made on
+    // the stack, release them with a MemRegion.
+    // timeout_ms: 0 to only return events that are already pending, INFINITE (0xFFFFFFFF) to block
+    // return:     False if waiting failed. Events is empty if the timeout elapsed.
+    bool Wait(u32 timeout_ms, DqnMemStack *stack, DqnFileWatchEvents *events);
+};
+
+// XPlatform > #DqnFileBatch
+// =================================================================================================
+// Batched, asynchronous Stat/MakeDir/Link/Open for workloads of many small independent file system
+// calls. On Linux ops are submitted through an io_uring, hundreds per io_uring_enter() syscall. On
+// Win32, or if io_uring is unavailable (old kernel, seccomp, missing opcodes), ops are executed by
+// worker threads on a DqnJobQueue using the blocking equivalents. Pass the program's own queue to
+// Init() so the batch doesn't start a second pool of threads competing with it.
+
+// Usage
+// 1. Init() the batch, then Push() ops. Pushed ops are queued and sent to the OS in batches.
+// 2. Reap() completed ops in completion order (NOT push order) and check DqnFileOp::success. Push()
+//    fails once max_in_flight ops are pushed and not yet reaped, Reap() to make room.
+// Or use Execute() to push an array of ops and wait until they've all completed.
+
+// IMPORTANT: Paths and the op itself must remain valid until the op has been reaped.
+struct DqnFileOp
 {
-    Entry *entry = this->asset_table.GetOrMake(file);
-    if (QueryAndUpdateAsset(file, entry))
-    {
-        if (entry->updated) entry->updated = false;
-        else                entry          = nullptr;
-    }
-    else
+    enum struct Type
     {
-        entry = nullptr;
-    }
+        Stat,    // Fills info. Fails if the file does not exist.
+        MakeDir, // Not recursive, succeeds if the directory already exists.
+        Link,    // Create hard link at path pointing to src_path
+        Open,    // Fills file, opened read only
+    };
 
-    return &entry->data;
-}
+    Type         type;
+    char const  *path;      // UTF-8
+    char const  *src_path;  // Link only
+    void        *user_data;
 
-DQN_CATALOG_TEMPLATE bool DQN_CATALOG_DECL::PollAssets()
+    // NOTE: Outputs, valid once reaped
+    bool         success;
+    i32          error;     // errno on Unix, GetLastError() on Win32. 0 if successful.
+    DqnFileInfo  info;
+    DqnFile      file;
+};
+
+struct DqnFileBatch
 {
-    bool result = false;
-    for (auto it = this->asset_table.begin(); it != this->asset_table.end(); ++it)
+    enum struct Backend
     {
-        DqnCatalogPath const *file = &it.entry->key;
-        Entry *entry               = &it.entry->item;
-        result |= QueryAndUpdateAsset(*file, entry);
-    }
-
-    return result;
-}
+        Auto,       // io_uring if possible, otherwise ThreadPool
+        IoUring,    // Linux only, Init() fails if unavailable
+        ThreadPool,
+    };
 
+    Backend  backend;
+    isize    max_in_flight;
+    isize    num_in_flight; // Pushed and not yet reaped
+    void    *internal;
+
+    // max_in_flight_: Upper bound of ops outstanding at once, also the io_uring submission queue size.
+    // job_queue_:     (Optional) Queue the thread pool backend runs ops on, otherwise it starts a pool
+    //                 of its own shared by every batch. Its workers should be oversubscribed since the
+    //                 ops block on I/O.
+    // return:         False if the requested backend could not be initialised.
+    bool       Init   (isize max_in_flight_ = 256, Backend backend_ = Backend::Auto, struct DqnJobQueue *job_queue_ = nullptr);
+    void       Free   ();
+
+    bool       Push   (DqnFileOp *op); // return: False if max_in_flight ops are outstanding, op was not queued.
+    void       Submit ();          // Send queued ops to the OS now rather than waiting for a full batch
+    DqnFileOp *Reap   (bool wait); // return: Next completed op or nullptr if none have completed (or none in flight if wait).
+    void       Execute(DqnFileOp *ops, isize num_ops);
+
+    char const *BackendName() const;
+};
 
 // XPlatform > #DqnTimer
 // =================================================================================================
 DQN_FILE_SCOPE f64  DqnTimer_NowInMs();
 DQN_FILE_SCOPE f64  DqnTimer_NowInS ();
 
+// Monotonic timestamp in nanoseconds for profiling, not affected by f64 precision loss over long
+// uptimes. Only the difference between two timestamps is meaningful.
+DQN_FILE_SCOPE u64  DqnTimer_NowInNs();
+
 // XPlatform > #DqnLock
 // =================================================================================================
 struct DqnLock
@@ -2688,6 +2897,26 @@ struct DqnLock
     Guard_ Guard() { return Guard_(this); }
 };
 
+// XPlatform > #DqnRWLock
+// =================================================================================================
+// Any number of readers or a single writer. Not recursive, a thread holding the lock in either mode
+// must not acquire it again.
+struct DqnRWLock
+{
+#if defined(DQN_IS_WIN32)
+    SRWLOCK          win32_handle;
+#else
+    pthread_rwlock_t unix_handle;
+#endif
+
+    bool Init            ();
+    void AcquireShared   ();
+    void ReleaseShared   ();
+    void AcquireExclusive();
+    void ReleaseExclusive();
+    void Delete          ();
+};
+
 // XPlatform > #DqnJobQueue
 // =================================================================================================
 // DqnJobQueue is a platform abstracted "lockless" multithreaded work queue. It will create threads
@@ -2779,55 +3008,379 @@ DQN_FILE_SCOPE i32 DqnAtomic_CompareSwap32(i32 volatile *const dest, const i32 s
 // return: The new value at src
 DQN_FILE_SCOPE i32 DqnAtomic_Add32(i32 volatile *const src, const i32 value);
 
-// #Platform Specific
+// XPlatform > #DqnCatalog
 // =================================================================================================
-// Functions here are only available for the #defined sections (i.e. all functions in
-// DQN_IS_WIN32 only have a valid implementation in Win32.
+// Hot reloading of assets loaded from files. Assets are reloaded when their file changes on disk and
+// readers pick up the new data the next time they Get() it.
+
+// Backends
+// - Polling (zero initialised catalog): PollAssets() stats every asset, reloads run on the caller.
+// - Events (Init() called): The OS reports changes to the assets' directories (DqnFileWatch) so
+//   PollAssets() costs nothing until something changed. Reloads run on the job queue if one is given.
+// Every asset is double buffered, a reload loads into the unpublished copy and publishes it with an
+// atomic swap so readers never block or see a partially loaded asset. A pointer from Get() stays valid
+// across the next reload, not the one after it since that reuses its buffer.
+using DqnCatalogPath = DqnFixedString1024;
+template <typename T> using DqnCatalogLoadProc = bool (*)(DqnCatalogPath const &file, T *data);
+#define DQN_CATALOG_LOAD_PROC(name, type) bool name(DqnCatalogPath const &file, type *data)
 
-#if defined(DQN_IS_WIN32)
-// Platform > #DqnWin32
-// =================================================================================================
-#define DQN__WIN32_ERROR_BOX(text, title) MessageBoxA(nullptr, text, title, MB_OK);
+#define DQN_CATALOG_TEMPLATE template <typename T, DqnCatalogLoadProc<T> LoadAsset>
+#define DQN_CATALOG_DECL DqnCatalog<T, LoadAsset>
 
-// The function automatically null-terminates the output string.
-// out:    A pointer to the buffer to receive the characters.
-// out_len: The length/capacity of the buffer "out". If 0, the function returns the required length including null terminator.
-// return: -1 if invalid, or if out_len is 0 the required buffer length.
-DQN_FILE_SCOPE i32 DqnWin32_UTF8ToWChar(const char    *const in, wchar_t *const out, const i32 out_len);
-DQN_FILE_SCOPE i32 DqnWin32_WCharToUTF8(const wchar_t *const in, char    *const out, const i32 out_len);
+#if 0
+struct RawBuf { char *buffer; int len; };
+DQN_CATALOG_LOAD_PROC(CatalogRawLoad, RawBuf)
+{
+    size_t buf_size;
+    uint8_t *buf = DqnFile_ReadAll(file.str, &buf_size);
+    if (!buf) return false;
+    data->buffer = reinterpret_cast<char *>(buf);
+    data->len    = static_cast<int>(buf_size);
+    return true;
+}
 
-// "width" and "height" are optional and won't be used if not given by user.
-// width & height: Pass in a pointer for function to fill out.
-DQN_FILE_SCOPE void DqnWin32_GetClientDim     (HWND const window, LONG *width, LONG *height);
-DQN_FILE_SCOPE void DqnWin32_GetRectDim       (RECT const rect,   LONG *width, LONG *height);
+int main(int, char)
+{
+    DqnCatalog<RawBuf, CatalogRawLoad> catalog = {};
+    catalog.Init(&job_queue); // Optional, event driven and reloads on the job queue instead of polling
+    RawBuf *file = catalog.GetIfUpdated("path/to/file/");
+    if (file) { (void)file; // do work on file }
+    else      { // file not updated since last query }
 
-DQN_FILE_SCOPE char const *DqnWin32_GetLastError();
+    while (true) // Or event loop, poll the assets in the catalog
+    {
+        catalog.PollAssets();
+    }
+    catalog.Free();
+}
+#endif
 
-// TODO(doyle): #deprecate #delete Display Last Error is mostly useless.
-// Displays error in the format <err_prefix>: <Win32 Error Message> in a Win32 Dialog Box.
-// err_prefix: The message before the Win32 error, can be nullptr
-DQN_FILE_SCOPE void DqnWin32_DisplayLastError (const char *const err_prefix);
+// NOTE: Paths are keyed with '/' separators so they match the paths the file watch reports on Win32,
+// and without leading "./" since the watch on "." reports "./file" for an asset added as "file".
+FILE_SCOPE DqnCatalogPath DqnCatalog__Key(DqnCatalogPath const &file)
+{
+    char const *str = file.str;
+    int len         = file.len;
+    while (len >= 2 && str[0] == '.' && (str[1] == '/' || str[1] == '\\'))
+    {
+        str += 2;
+        len -= 2;
+    }
+    if (len == 1 && str[0] == '.') len = 0;
 
-// Asimilar to DqnWin32_DisplayLastError() a particular error can be specified in a Win32 Dialog Box.
-DQN_FILE_SCOPE void DqnWin32_DisplayErrorCode (const DWORD error, const char *const err_prefix);
+    DqnCatalogPath result(str, len);
+    for (int index = 0; index < result.len; index++)
+    {
+        if (result.str[index] == '\\') result.str[index] = '/';
+    }
+    return result;
+}
 
-// Output text to the debug console. For visual studio this is the output window and not the console.
-// ...: Variable args alike printf, powered by stb_sprintf
-DQN_FILE_SCOPE void DqnWin32_OutputDebugString(const char *const fmt_str, ...);
+DQN_CATALOG_TEMPLATE struct DqnCatalog
+{
+    struct Entry
+    {
+        T              data[2];
+        i32 volatile   front;    // Index of the published data
+        i32 volatile   updated;  // Published data not yet consumed by GetIfUpdated()
+        i32 volatile   loading;  // A reload is queued or running
+        i32 volatile   dirty;    // Changed since the running reload started, it's reloaded again after
+        u64            last_write_time_in_s;
+        bool           polled;   // Events backend: The directory could not be watched, stat it instead
+        DqnCatalogPath file;
+        DqnCatalog    *catalog;
+    };
 
-DQN_FILE_SCOPE void DqnWin32_GetExeNameAndDirectory(DqnMemStack *allocator, DqnBuffer<wchar_t> *exe_name, DqnBuffer<wchar_t> *exe_directory);
-DQN_FILE_SCOPE u64  DqnWin32_EpochTimeUTC          ();
-DQN_FILE_SCOPE u64  DqnWin32_EpochTimeLocal        ();
-#endif // DQN_IS_WIN32
-#endif // DQN_PLATFORM_H
-#endif // DQN_PLATFORM_HEADER
+    DqnVHashTable<DqnCatalogPath, Entry> asset_table;
+    DqnJobQueue                         *job_queue;    // Events backend: (Optional) Reloads run on it
+    DqnFileWatch                         watch;
+    bool                                 watching;     // Init() succeeded, using the events backend
+    DqnArray<DqnCatalogPath>             watched_dirs;
+    DqnMemStack                          watch_stack;
+
+    // Optional, use the events backend.
+    // job_queue_: (Optional) Run reloads on the queue instead of the thread calling PollAssets()
+    // return:     False if the OS can't report changes, the catalog keeps polling.
+    bool   Init        (DqnJobQueue *job_queue_ = nullptr);
+
+    // Adds the file to the catalog if it has not been added yet, the first load is on the caller.
+    // return: Asset if an update has been detected and not consumed yet otherwise nullptr. Update is consumed after called.
+    T     *GetIfUpdated(DqnCatalogPath const &file);
+    Entry *GetEntry    (DqnCatalogPath const &file) { Entry *entry = asset_table.Get(DqnCatalog__Key(file)); return entry; }
+    T     *Get         (DqnCatalogPath const &file) { Entry *entry = asset_table.Get(DqnCatalog__Key(file)); return (entry) ? &entry->data[entry->front] : nullptr; }
+    void   Erase       (DqnCatalogPath const &file);
 
+    // return: Check assets for changes and reload them, true if atleast 1 asset is being reloaded.
+    bool   PollAssets  ();
+    void   Free        ();
 
-#ifdef DQN_IMPLEMENTATION
-// DQN_IMPLEMENTATION
-// =================================================================================================
-#include <math.h>    // TODO(doyle): For trigonometry functions (for now)
-#include <stdlib.h>  // For calloc, malloc, free
+    // NOTE: Unlikely you will need to use. Prefer GetIfUpdated.
+    // Manually invoke an update on the entry by querying its last write time on disk and updating accordingly.
+    bool QueryAndUpdateAsset(DqnCatalogPath const &file, Entry *entry);
+
+    // Reload the entry on the job queue, or now if there is none. Changes while it's being reloaded are
+    // reloaded once it's done.
+    void ReloadAsset        (Entry *entry);
+    void WaitForReload      (Entry *entry);
+};
+
+DQN_CATALOG_TEMPLATE void DqnCatalog__LoadJob(DqnJobQueue *, void *user_data)
+{
+    auto *entry = static_cast<typename DQN_CATALOG_DECL::Entry *>(user_data);
+    do
+    {
+        DqnAtomic_CompareSwap32(&entry->dirty, 0, 1);
+
+        // NOTE: Only this job writes to the back buffer and swaps, readers only ever see the front
+        i32 back = 1 - entry->front;
+        T new_data = {};
+        if (LoadAsset(entry->file, &new_data))
+        {
+            entry->data[back] = new_data;
+            DqnAtomic_CompareSwap32(&entry->front, back, 1 - back);
+            DqnAtomic_CompareSwap32(&entry->updated, 1, 0);
+        }
+        else
+        {
+            DQN_LOGGER_W(dqn_lib_context_.logger, "Catalog could not load file: %s\n", entry->file.str);
+        }
+
+        // NOTE: A change that came in after dirty was cleared either sees loading set and leaves the
+        // reload to us, or sees it cleared and reloads it itself.
+        DqnAtomic_CompareSwap32(&entry->loading, 0, 1);
+    } while (entry->dirty && DqnAtomic_CompareSwap32(&entry->loading, 1, 0) == 0);
+}
+
+DQN_CATALOG_TEMPLATE bool DQN_CATALOG_DECL::Init(DqnJobQueue *job_queue_)
+{
+    job_queue = job_queue_;
+    watching  = watch.Init();
+    if (watching && !watch_stack.block)
+        watch_stack.LazyInit(DqnMemStack::MINIMUM_BLOCK_SIZE, Dqn::ZeroMem::No, 0, DqnMemTracker::None);
+    return watching;
+}
+
+DQN_CATALOG_TEMPLATE void DQN_CATALOG_DECL::ReloadAsset(Entry *entry)
+{
+    DqnAtomic_CompareSwap32(&entry->dirty, 1, 0);
+    if (DqnAtomic_CompareSwap32(&entry->loading, 1, 0) != 0)
+        return;
+
+    DqnJob job = {DqnCatalog__LoadJob<T, LoadAsset>, entry};
+    if (!job_queue || !job_queue->AddJob(job))
+        job.callback(job_queue, job.user_data);
+}
+
+DQN_CATALOG_TEMPLATE void DQN_CATALOG_DECL::WaitForReload(Entry *entry)
+{
+    // NOTE: Without a queue reloads run on the caller, there is never one in flight to wait for
+    if (!job_queue)
+        return;
+
+    // NOTE: Help the queue out while the reload is pending, it only spins while a worker runs it
+    while (entry->loading)
+        job_queue->TryExecuteNextJob();
+}
+
+DQN_CATALOG_TEMPLATE bool DQN_CATALOG_DECL::QueryAndUpdateAsset(DqnCatalogPath const &file, Entry *entry)
+{
+    DqnFileInfo info = {};
+    if (!DqnFile_GetInfo(file.str, &info))
+    {
+        DQN_LOGGER_W(dqn_lib_context_.logger, "Catalog could not get file info for: %s\n", file.str);
+        return false;
+    }
+
+    if (entry->last_write_time_in_s == info.last_write_time_in_s)
+        return true;
+
+    entry->last_write_time_in_s = info.last_write_time_in_s;
+    ReloadAsset(entry);
+    return true;
+}
+
+DQN_CATALOG_TEMPLATE T *DQN_CATALOG_DECL::GetIfUpdated(DqnCatalogPath const &file)
+{
+    DqnCatalogPath key = DqnCatalog__Key(file);
+    Entry *entry       = this->asset_table.Get(key);
+    if (!entry)
+    {
+        entry          = this->asset_table.GetOrMake(key);
+        *entry         = {};
+        entry->file    = key;
+        entry->catalog = this;
+
+        if (watching)
+        {
+            // NOTE: Watches cover every directory below them, only watch directories not covered yet
+            DqnCatalogPath dir = key;
+            while (dir.len > 0 && dir.str[dir.len - 1] != '/') dir.len--;
+            if (dir.len > 1) dir.len--;
+            if (dir.len == 0) dir = ".";
+            dir.NullTerminate();
+
+            bool covered = false;
+            for (DqnCatalogPath const &watched_dir : watched_dirs)
+            {
+                if (watched_dir.len <= dir.len && DqnStr_Cmp(dir.str, watched_dir.str, watched_dir.len) == 0 &&
+                    (dir.str[watched_dir.len] == 0 || dir.str[watched_dir.len] == '/'))
+                {
+                    covered = true;
+                    break;
+                }
+            }
+
+            if (!covered)
+            {
+                if (watch.Add(dir.str)) watched_dirs.Push(dir);
+                else                    entry->polled = true;
+            }
+        }
+
+        // NOTE: The first load is on the caller so the asset is ready as soon as it's added
+        DqnFileInfo info = {};
+        if (DqnFile_GetInfo(key.str, &info))
+            entry->last_write_time_in_s = info.last_write_time_in_s;
+
+        DqnCatalog__LoadJob<T, LoadAsset>(nullptr, entry);
+    }
+
+    if (DqnAtomic_CompareSwap32(&entry->updated, 0, 1) == 1)
+        return &entry->data[entry->front];
+
+    return nullptr;
+}
+
+DQN_CATALOG_TEMPLATE void DQN_CATALOG_DECL::Erase(DqnCatalogPath const &file)
+{
+    DqnCatalogPath key = DqnCatalog__Key(file);
+    if (Entry *entry = asset_table.Get(key))
+    {
+        WaitForReload(entry);
+        asset_table.Erase(key);
+    }
+}
+
+DQN_CATALOG_TEMPLATE bool DQN_CATALOG_DECL::PollAssets()
+{
+    bool result = false;
+    if (!watching)
+    {
+        for (auto it = this->asset_table.begin(); it != this->asset_table.end(); ++it)
+        {
+            u64 last_write_time_in_s = it.entry->item.last_write_time_in_s;
+            QueryAndUpdateAsset(it.entry->key, &it.entry->item);
+            result |= (last_write_time_in_s != it.entry->item.last_write_time_in_s);
+        }
+        return result;
+    }
+
+    auto mem_region           = watch_stack.MemRegionScope();
+    DqnFileWatchEvents events = {};
+    watch.Wait(0 /*timeout_ms*/, &watch_stack, &events);
+    for (DqnFileWatchEvent &event : events)
+    {
+        if (event.type == DqnFileWatchEvent::Type::Removed)
+            continue;
+
+        DqnCatalogPath key = DqnCatalog__Key(DqnCatalogPath(event.path));
+        if (event.type == DqnFileWatchEvent::Type::Overflow)
+        {
+            // NOTE: Anything under the directory may have changed, fall back to checking write times. The
+            // key of "." is empty and matches every asset.
+            for (auto it = this->asset_table.begin(); it != this->asset_table.end(); ++it)
+            {
+                DqnCatalogPath const &asset_key = it.entry->key;
+                if (key.len == 0 || (asset_key.len > key.len && asset_key.str[key.len] == '/' &&
+                                     DqnStr_Cmp(asset_key.str, key.str, key.len) == 0))
+                {
+                    u64 last_write_time_in_s = it.entry->item.last_write_time_in_s;
+                    QueryAndUpdateAsset(it.entry->key, &it.entry->item);
+                    result |= (last_write_time_in_s != it.entry->item.last_write_time_in_s);
+                }
+            }
+            continue;
+        }
+
+        if (Entry *entry = asset_table.Get(key))
+        {
+            ReloadAsset(entry);
+            result = true;
+        }
+    }
+
+    for (auto it = this->asset_table.begin(); it != this->asset_table.end(); ++it)
+    {
+        if (!it.entry->item.polled) continue;
+        u64 last_write_time_in_s = it.entry->item.last_write_time_in_s;
+        QueryAndUpdateAsset(it.entry->key, &it.entry->item);
+        result |= (last_write_time_in_s != it.entry->item.last_write_time_in_s);
+    }
+
+    return result;
+}
+
+DQN_CATALOG_TEMPLATE void DQN_CATALOG_DECL::Free()
+{
+    for (auto it = this->asset_table.begin(); it != this->asset_table.end(); ++it)
+        WaitForReload(&it.entry->item);
+
+    asset_table.Free();
+    watch.Free();
+    watched_dirs.Free();
+    watch_stack.Free();
+    watching = false;
+}
+
+// #Platform Specific
+// =================================================================================================
+// Functions here are only available for the #defined sections (i.e. all functions in
+// DQN_IS_WIN32 only have a valid implementation in Win32.
+
+#if defined(DQN_IS_WIN32)
+// Platform > #DqnWin32
+// =================================================================================================
+#define DQN__WIN32_ERROR_BOX(text, title) MessageBoxA(nullptr, text, title, MB_OK);
+
+// The function automatically null-terminates the output string.
+// out:    A pointer to the buffer to receive the characters.
+// out_len: The length/capacity of the buffer "out". If 0, the function returns the required length including null terminator.
+// return: -1 if invalid, or if out_len is 0 the required buffer length.
+DQN_FILE_SCOPE i32 DqnWin32_UTF8ToWChar(const char    *const in, wchar_t *const out, const i32 out_len);
+DQN_FILE_SCOPE i32 DqnWin32_WCharToUTF8(const wchar_t *const in, char    *const out, const i32 out_len);
+
+// "width" and "height" are optional and won't be used if not given by user.
+// width & height: Pass in a pointer for function to fill out.
+DQN_FILE_SCOPE void DqnWin32_GetClientDim     (HWND const window, LONG *width, LONG *height);
+DQN_FILE_SCOPE void DqnWin32_GetRectDim       (RECT const rect,   LONG *width, LONG *height);
+
+DQN_FILE_SCOPE char const *DqnWin32_GetLastError();
+
+// TODO(doyle): #deprecate #delete Display Last Error is mostly useless.
+// Displays error in the format <err_prefix>: <Win32 Error Message> in a Win32 Dialog Box.
+// err_prefix: The message before the Win32 error, can be nullptr
+DQN_FILE_SCOPE void DqnWin32_DisplayLastError (const char *const err_prefix);
+
+// Asimilar to DqnWin32_DisplayLastError() a particular error can be specified in a Win32 Dialog Box.
+DQN_FILE_SCOPE void DqnWin32_DisplayErrorCode (const DWORD error, const char *const err_prefix);
+
+// Output text to the debug console. For visual studio this is the output window and not the console.
+// ...: Variable args alike printf, powered by stb_sprintf
+DQN_FILE_SCOPE void DqnWin32_OutputDebugString(const char *const fmt_str, ...);
+
+DQN_FILE_SCOPE void DqnWin32_GetExeNameAndDirectory(DqnMemStack *allocator, DqnBuffer<wchar_t> *exe_name, DqnBuffer<wchar_t> *exe_directory);
+DQN_FILE_SCOPE u64  DqnWin32_EpochTimeUTC          ();
+DQN_FILE_SCOPE u64  DqnWin32_EpochTimeLocal        ();
+#endif // DQN_IS_WIN32
+#endif // DQN_PLATFORM_H
+#endif // DQN_PLATFORM_HEADER
+
+
+#ifdef DQN_IMPLEMENTATION
+// DQN_IMPLEMENTATION
+// =================================================================================================
+#include <math.h>    // TODO(doyle): For trigonometry functions (for now)
+#include <stdlib.h>  // For calloc, malloc, free
 #include <stdio.h>   // For printf
 
 DqnAllocator xallocator_;
@@ -2939,10 +3492,10 @@ DQN_FILE_SCOPE void *DqnAllocator::Malloc(size_t size, Dqn::ZeroMem zero)
     void *result = nullptr;
     switch(this->type)
     {
-        case Type::Default:    (zero == Dqn::ZeroMem::Yes) ? result = DqnMem_Alloc(size) : result = DqnMem_Calloc(size); break;
+        case Type::Default:    (zero == Dqn::ZeroMem::Yes) ? result = DqnMem_Calloc(size) : result = DqnMem_Alloc(size); break;
         case Type::XAllocator:
         {
-            (zero == Dqn::ZeroMem::Yes) ? result = DqnMem_Alloc(size) : result = DqnMem_Calloc(size);
+            (zero == Dqn::ZeroMem::Yes) ? result = DqnMem_Calloc(size) : result = DqnMem_Alloc(size);
             DQN_ASSERT(result);
         }
         break;
@@ -7472,6 +8025,17 @@ static stbsp__int32 stbsp__real_to_str(char const **start, stbsp__uint32 *len, c
     #include <sys/time.h> // high resolution timer
     #include <time.h>     // timespec
     #include <unistd.h>   // unlink()
+    #include <errno.h>    // errno
+    #include <fcntl.h>    // AT_FDCWD, O_RDONLY
+    #include <sys/mman.h> // mmap() for DqnFileMap and io_uring rings
+
+    #if defined(__linux__)
+        #define DQN__IO_URING 1
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>  // io_uring_setup()/io_uring_enter()/io_uring_register(), copy_file_range()
+        #include <sys/ioctl.h>    // FICLONE
+        #include <sys/sendfile.h> // sendfile()
+    #endif
 #endif
 
 #define DQN_FILE__LIST_DIR(name) DQN_FILE_SCOPE char **name(char const *dir, i32 *num_files, DqnAllocator *allocator)
@@ -7645,7 +8209,9 @@ DQN_FILE__LIST_DIR(DqnFile__PlatformListDir)
 FILE_SCOPE bool DqnFile__UnixGetFileSize(char const *path, usize *size)
 {
     struct stat file_stat = {};
-    stat(path, &file_stat);
+    if (stat(path, &file_stat) != 0)
+      return false;
+
     if (size) *size = file_stat.st_size;
 
     if (file_stat.st_size != 0)
@@ -7653,12 +8219,15 @@ FILE_SCOPE bool DqnFile__UnixGetFileSize(char const *path, usize *size)
 
     // NOTE: Can occur in some instances where files are generated on demand, i.e. /proc/cpuinfo.
     // But there can also be zero-byte files, we can't be sure. So manual check by counting bytes
-    if (size && FILE *file = fopen(path, "rb"))
+    if (size)
     {
-        DQN_DEFER { fclose(file); };
-        while (fgetc(file) != EOF)
+        if (FILE *file = fopen(path, "rb"))
         {
-            (*size)++;
+            DQN_DEFER { fclose(file); };
+            while (fgetc(file) != EOF)
+            {
+                (*size)++;
+            }
         }
     }
 
@@ -7716,12 +8285,13 @@ DqnFile__UnixOpen(char const *path, DqnFile *file, u32 flags, DqnFile::Action ac
 
     // TODO(doyle): Use open syscall
     // TODO(doyle): Query errno
-    if (!DqnFile__UnixGetFileSize(path, &file->size))
+    file->handle = fopen(path, mode);
+    if (!file->handle)
     {
         return false;
     }
 
-    file->handle = fopen(path, mode);
+    DqnFile__UnixGetFileSize(path, &file->size);
     file->flags = flags;
     return true;
 }
@@ -7757,10 +8327,10 @@ DQN_FILE__LIST_DIR(DqnFile__PlatformListDir)
         if (!dir_handle) return nullptr;
         DQN_DEFER { closedir(dir_handle); };
 
-        char **list = (char **)allocator->Calloc(1, sizeof(*list) * curr_num_files);
+        char **list = (char **)allocator->Malloc(sizeof(*list) * curr_num_files, Dqn::ZeroMem::Yes);
         if (!list)
         {
-            DQN_LOGE("Memory allocation failed, required: %$_d", sizeof(*list) * curr_num_files);
+            DQN_LOGGER_E(dqn_lib_context_.logger, "Memory allocation failed, required: %$_d", sizeof(*list) * curr_num_files);
             *num_files = 0;
             return nullptr;
         }
@@ -7768,12 +8338,13 @@ DQN_FILE__LIST_DIR(DqnFile__PlatformListDir)
         struct dirent *dir_file = readdir(dir_handle);
         for (auto i = 0; i < curr_num_files; i++)
         {
-            list[i] = (char *)allocator->Calloc(1, sizeof(**list) * DQN_ARRAY_COUNT(dir_file->d_name));
+            size_t bytes_required = sizeof(**list) * DQN_ARRAY_COUNT(dir_file->d_name);
+            list[i] = (char *)allocator->Malloc(bytes_required, Dqn::ZeroMem::Yes);
             if (!list[i])
             {
-                for (auto j = 0; j < i; j++) api->Free(list[j]);
+                for (auto j = 0; j < i; j++) allocator->Free(list[j], bytes_required);
 
-                DQN_LOGE("Memory allocation failed, required: %$_d", sizeof(**list) * DQN_ARRAY_COUNT(dir_file->d_name));
+                DQN_LOGGER_E(dqn_lib_context_.logger, "Memory allocation failed, required: %$_d", bytes_required);
                 *num_files = 0;
                 return nullptr;
             }
@@ -7885,6 +8456,111 @@ usize DqnFile::Read(u8 *buf, usize num_bytes_to_read)
     return num_bytes_read;
 }
 
+usize DqnFile::ReadAt(u8 *buf, usize num_bytes_to_read, usize file_offset)
+{
+    usize num_bytes_read = 0;
+    if (buf && this->handle)
+    {
+#if defined(DQN_IS_WIN32)
+        // NOTE: Synchronous handles read at the overlapped offset and block till completion
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = (DWORD)(file_offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)((u64)file_offset >> 32);
+
+        DWORD bytes_read = 0;
+        ReadFile(this->handle, (void *)buf, (DWORD)num_bytes_to_read, &bytes_read, &overlapped);
+        num_bytes_read = (usize)bytes_read;
+
+#else
+        auto *file = (FILE *)this->handle;
+        if (fseek(file, (long)file_offset, SEEK_SET) == 0)
+            num_bytes_read = fread(buf, 1, num_bytes_to_read, file);
+#endif
+    }
+    return num_bytes_read;
+}
+
+bool DqnFileMap::Map(wchar_t const *path)
+{
+    *this = {};
+#if defined(DQN_IS_WIN32)
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // NOTE: The mapping keeps its own reference to the file
+    DQN_DEFER { CloseHandle(file); };
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return false;
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    this->data   = static_cast<u8 *>(view);
+    this->size   = (usize)size.QuadPart;
+    this->handle = mapping;
+    return true;
+
+#else
+    // NOTE: Wide char not supported on unix
+    (void)path;
+    DQN_ASSERT(DQN_INVALID_CODE_PATH);
+    return false;
+#endif
+}
+
+bool DqnFileMap::Map(char const *path)
+{
+#if defined(DQN_IS_WIN32)
+    // TODO(doyle): MAX PATH is baad
+    wchar_t wide_path[MAX_PATH] = {};
+    DqnWin32_UTF8ToWChar(path, wide_path, DQN_ARRAY_COUNT(wide_path));
+    return this->Map(wide_path);
+
+#else
+    *this  = {};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    DQN_DEFER { close(fd); };
+    struct stat file_stat = {};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+        return false;
+
+    void *view = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+        return false;
+
+    this->data = static_cast<u8 *>(view);
+    this->size = (usize)file_stat.st_size;
+    return true;
+#endif
+}
+
+void DqnFileMap::Unmap()
+{
+    if (!this->data)
+        return;
+
+#if defined(DQN_IS_WIN32)
+    UnmapViewOfFile(this->data);
+    CloseHandle(this->handle);
+#else
+    munmap(this->data, this->size);
+#endif
+    *this = {};
+}
+
 u8 *DqnFile_ReadAll(wchar_t const *path, usize *buf_size, DqnAllocator *allocator)
 {
     // TODO(doyle): Logging
@@ -8101,7 +8777,8 @@ bool DqnFile_MakeDir(char const *path)
     CreateDirectoryA(path, nullptr /*lpSecurityAttributes*/);
     return true;
 #else
-    return false;
+    bool result = (mkdir(path, 0755) == 0 || errno == EEXIST);
+    return result;
 #endif
 }
 
@@ -8226,30 +8903,1842 @@ bool DqnFile_Copy(wchar_t const *src, wchar_t const *dest)
 #endif
 }
 
-char **DqnFile_ListDir(char const *dir, i32 *num_files, DqnAllocator *allocator)
+char const *DqnFileCopyTier_Name(DqnFileCopyTier tier)
 {
-    char **result = DqnFile__PlatformListDir(dir, num_files, allocator);
+    switch (tier)
+    {
+        case DqnFileCopyTier::HardLink:   return "hard_link";
+        case DqnFileCopyTier::Reflink:    return "reflink";
+        case DqnFileCopyTier::KernelCopy: return "kernel_copy";
+        case DqnFileCopyTier::StreamCopy: return "stream_copy";
+        default:                          return "none";
+    }
+}
+
+// return: True if the error means the tier can't be used for these files, as opposed to the copy failing
+FILE_SCOPE bool DqnFile__CopyTierUnsupported(i32 error)
+{
+#if defined(DQN_IS_WIN32)
+    bool result = (error == ERROR_NOT_SAME_DEVICE || error == ERROR_INVALID_FUNCTION || error == ERROR_NOT_SUPPORTED ||
+                   error == ERROR_INVALID_PARAMETER || error == ERROR_TOO_MANY_LINKS);
+#else
+    bool result = (error == EXDEV || error == EPERM || error == EMLINK || error == EOPNOTSUPP || error == EINVAL ||
+                   error == ENOSYS || error == ENOTTY);
+#endif
     return result;
 }
 
-void DqnFile_ListDirFree(char **file_list, i32 num_files, DqnAllocator *allocator)
+#if defined(DQN_IS_WIN32)
+FILE_SCOPE DqnFileCopyTier DqnFile__Win32StreamCopy(wchar_t const *src, wchar_t const *dest, u8 *buf, usize buf_size, i32 *error)
 {
-    if (file_list)
+    HANDLE src_handle = CreateFileW(src, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED, nullptr);
+    if (src_handle == INVALID_HANDLE_VALUE)
     {
-        for (isize i = 0; i < num_files; i++)
-        {
-            // TODO(doyle): Free needs size? Thanks to munmap on linux
-            if (file_list[i]) allocator->Free(file_list[i], DqnStr_Len(file_list[i]));
-            file_list[i] = nullptr;
-        }
+        *error = (i32)GetLastError();
+        return DqnFileCopyTier::None;
+    }
+    DQN_DEFER { CloseHandle(src_handle); };
 
-        allocator->Free(file_list, num_files * sizeof(file_list));
+    HANDLE dest_handle = CreateFileW(dest, GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (dest_handle == INVALID_HANDLE_VALUE)
+    {
+        *error = (i32)GetLastError();
+        return DqnFileCopyTier::None;
     }
-}
 
-// XPlatform > #DqnTimer
-// =================================================================================================
-#if defined (DQN_IS_WIN32)
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent     = CreateEventW(nullptr, true /*bManualReset*/, false /*bInitialState*/, nullptr);
+    DQN_DEFER { if (overlapped.hEvent) CloseHandle(overlapped.hEvent); };
+
+    // NOTE: Read the next chunk into one half of the buffer whilst the other half is written out
+    DWORD half_size  = (DWORD)DQN_MIN(buf_size / 2, (usize)DQN_MEGABYTE(64));
+    u8   *halves[2]  = {buf, buf + half_size};
+    u64   offset     = 0;
+    bool  success    = (overlapped.hEvent && half_size > 0);
+    bool  pending    = false;
+    auto  ReadAsync  = [&](u8 *dest_buf) -> bool {
+        overlapped.Offset     = (DWORD)(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        pending               = ReadFile(src_handle, dest_buf, half_size, nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING;
+        return pending || GetLastError() == ERROR_HANDLE_EOF;
+    };
+
+    if (success) success = ReadAsync(halves[0]);
+    for (int half = 0; success && pending; half = 1 - half)
+    {
+        DWORD bytes_read = 0;
+        pending          = false;
+        if (!GetOverlappedResult(src_handle, &overlapped, &bytes_read, true /*bWait*/))
+        {
+            success = (GetLastError() == ERROR_HANDLE_EOF);
+            break;
+        }
+
+        if (bytes_read == 0)
+            break;
+
+        offset += bytes_read;
+        if (!ReadAsync(halves[1 - half]))
+            success = false;
+
+        DWORD bytes_written = 0;
+        if (!WriteFile(dest_handle, halves[half], bytes_read, &bytes_written, nullptr) || bytes_written != bytes_read)
+            success = false;
+    }
+
+    if (pending)
+    {
+        DWORD bytes_read = 0;
+        CancelIoEx(src_handle, &overlapped);
+        GetOverlappedResult(src_handle, &overlapped, &bytes_read, true /*bWait*/);
+    }
+
+    if (success)
+    {
+        FILETIME access_time = {}, write_time = {};
+        if (GetFileTime(src_handle, nullptr, &access_time, &write_time))
+            SetFileTime(dest_handle, nullptr, &access_time, &write_time);
+    }
+    else
+    {
+        *error = (i32)GetLastError();
+    }
+
+    CloseHandle(dest_handle);
+    if (!success)
+    {
+        DeleteFileW(dest);
+        return DqnFileCopyTier::None;
+    }
+
+    return DqnFileCopyTier::StreamCopy;
+}
+
+#else
+#if defined(__linux__)
+#define DQN_FILE__FICLONE _IOW(0x94, 9, int)
+#endif
+
+// Copy src_fd into the empty dest_fd, each tier picks up from where the previous one stopped
+FILE_SCOPE DqnFileCopyTier DqnFile__UnixCopy(int src_fd, int dest_fd, usize size, u8 *buf, usize buf_size, DqnFileCopyTier first_tier, i32 *error)
+{
+    usize offset = 0;
+#if defined(__linux__)
+    if (first_tier <= DqnFileCopyTier::Reflink)
+    {
+        if (ioctl(dest_fd, DQN_FILE__FICLONE, src_fd) == 0)
+            return DqnFileCopyTier::Reflink;
+
+        if (!DqnFile__CopyTierUnsupported(errno))
+        {
+            *error = errno;
+            return DqnFileCopyTier::None;
+        }
+    }
+
+    if (first_tier <= DqnFileCopyTier::KernelCopy)
+    {
+        // NOTE: copy_file_range() only works across file systems since Linux 5.3, sendfile() makes the
+        // same in kernel copy on anything older.
+        bool use_sendfile = false;
+        while (offset < size)
+        {
+            ssize_t copied = 0;
+            if (use_sendfile)
+            {
+                off_t src_offset = (off_t)offset;
+                copied           = sendfile(dest_fd, src_fd, &src_offset, size - offset);
+            }
+            else
+            {
+                loff_t src_offset = (loff_t)offset, dest_offset = (loff_t)offset;
+                copied = (ssize_t)syscall(__NR_copy_file_range, src_fd, &src_offset, dest_fd, &dest_offset, size - offset, 0);
+            }
+
+            if (copied > 0)
+            {
+                offset += (usize)copied;
+            }
+            else if (copied == 0)
+            {
+                break; // NOTE: File was truncated underneath us
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (!DqnFile__CopyTierUnsupported(errno))
+            {
+                *error = errno;
+                return DqnFileCopyTier::None;
+            }
+            else if (!use_sendfile)
+            {
+                // NOTE: sendfile() writes at the file position rather than an offset
+                use_sendfile = (lseek(dest_fd, (off_t)offset, SEEK_SET) == (off_t)offset);
+                if (!use_sendfile) break;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (offset >= size)
+            return DqnFileCopyTier::KernelCopy;
+    }
+#else
+    (void)first_tier;
+#endif
+
+    // NOTE: Hint the kernel to read the next chunk in whilst the current one is being written out
+    usize chunk_size = buf_size;
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while (offset < size && chunk_size > 0)
+    {
+        if (offset + chunk_size < size)
+            posix_fadvise(src_fd, (off_t)(offset + chunk_size), (off_t)chunk_size, POSIX_FADV_WILLNEED);
+
+        ssize_t bytes_read = pread(src_fd, buf, DQN_MIN(chunk_size, size - offset), (off_t)offset);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read < 0)
+        {
+            *error = errno;
+            return DqnFileCopyTier::None;
+        }
+
+        if (bytes_read == 0)
+            break;
+
+        for (ssize_t written = 0; written < bytes_read;)
+        {
+            ssize_t result = pwrite(dest_fd, buf + written, (usize)(bytes_read - written), (off_t)(offset + written));
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0)
+            {
+                *error = (result < 0) ? errno : EIO;
+                return DqnFileCopyTier::None;
+            }
+            written += result;
+        }
+
+        offset += (usize)bytes_read;
+    }
+
+    if (offset < size && chunk_size == 0)
+    {
+        *error = EINVAL;
+        return DqnFileCopyTier::None;
+    }
+
+    return DqnFileCopyTier::StreamCopy;
+}
+#endif
+
+DqnFileCopyTier DqnFile_Materialize(char const *src, char const *dest, u8 *buf, usize buf_size, DqnFileCopyTier first_tier, i32 *error)
+{
+    i32 error_ = 0;
+    if (!error) error = &error_;
+    *error = 0;
+
+#if defined(DQN_IS_WIN32)
+    // TODO(doyle): MAX PATH is baad
+    wchar_t src_w[MAX_PATH]  = {};
+    wchar_t dest_w[MAX_PATH] = {};
+    DqnWin32_UTF8ToWChar(src,  src_w,  DQN_ARRAY_COUNT(src_w));
+    DqnWin32_UTF8ToWChar(dest, dest_w, DQN_ARRAY_COUNT(dest_w));
+
+    if (first_tier <= DqnFileCopyTier::HardLink)
+    {
+        if (CreateHardLinkW(dest_w, src_w, nullptr))
+            return DqnFileCopyTier::HardLink;
+
+        *error = (i32)GetLastError();
+        if (!DqnFile__CopyTierUnsupported(*error))
+            return DqnFileCopyTier::None;
+    }
+
+    // NOTE: There's no reflink, CopyFileExW() clones blocks itself on ReFS and Dev Drives (Windows 11)
+    if (first_tier <= DqnFileCopyTier::KernelCopy)
+    {
+        if (CopyFileExW(src_w, dest_w, nullptr, nullptr, nullptr, COPY_FILE_FAIL_IF_EXISTS))
+        {
+            *error = 0;
+            return DqnFileCopyTier::KernelCopy;
+        }
+
+        *error = (i32)GetLastError();
+        if (!DqnFile__CopyTierUnsupported(*error))
+            return DqnFileCopyTier::None;
+    }
+
+    *error                 = 0;
+    DqnFileCopyTier result = DqnFile__Win32StreamCopy(src_w, dest_w, buf, buf_size, error);
+    return result;
+
+#else
+    if (first_tier <= DqnFileCopyTier::HardLink)
+    {
+        if (link(src, dest) == 0)
+            return DqnFileCopyTier::HardLink;
+
+        if (!DqnFile__CopyTierUnsupported(errno))
+        {
+            *error = errno;
+            return DqnFileCopyTier::None;
+        }
+    }
+
+    int src_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (src_fd == -1)
+    {
+        *error = errno;
+        return DqnFileCopyTier::None;
+    }
+    DQN_DEFER { close(src_fd); };
+
+    struct stat src_stat = {};
+    if (fstat(src_fd, &src_stat) != 0)
+    {
+        *error = errno;
+        return DqnFileCopyTier::None;
+    }
+
+    int dest_fd = open(dest, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, src_stat.st_mode & 0777);
+    if (dest_fd == -1)
+    {
+        *error = errno;
+        return DqnFileCopyTier::None;
+    }
+
+    DqnFileCopyTier result = DqnFile__UnixCopy(src_fd, dest_fd, (usize)src_stat.st_size, buf, buf_size, first_tier, error);
+    if (result != DqnFileCopyTier::None)
+    {
+        struct timespec times[2] = {src_stat.st_atim, src_stat.st_mtim};
+        futimens(dest_fd, times);
+        *error = 0;
+    }
+
+    if (close(dest_fd) != 0 && result != DqnFileCopyTier::None)
+    {
+        *error = errno;
+        result = DqnFileCopyTier::None;
+    }
+
+    if (result == DqnFileCopyTier::None)
+        unlink(dest);
+
+    return result;
+#endif
+}
+
+char **DqnFile_ListDir(char const *dir, i32 *num_files, DqnAllocator *allocator)
+{
+    char **result = DqnFile__PlatformListDir(dir, num_files, allocator);
+    return result;
+}
+
+void DqnFile_ListDirFree(char **file_list, i32 num_files, DqnAllocator *allocator)
+{
+    if (file_list)
+    {
+        for (isize i = 0; i < num_files; i++)
+        {
+            // TODO(doyle): Free needs size? Thanks to munmap on linux
+            if (file_list[i]) allocator->Free(file_list[i], DqnStr_Len(file_list[i]));
+            file_list[i] = nullptr;
+        }
+
+        allocator->Free(file_list, num_files * sizeof(file_list));
+    }
+}
+
+bool DqnFile_IterateDir(char const *dir, DqnFile_IterateDirCallback *callback, void *user_data)
+{
+    if (!dir || !callback) return false;
+
+#if defined(DQN_IS_WIN32)
+    // TODO(doyle): MAX PATH is baad
+    wchar_t wide_dir[MAX_PATH] = {};
+    i32 wide_dir_len           = DqnWin32_UTF8ToWChar(dir, wide_dir, DQN_ARRAY_COUNT(wide_dir) - 2);
+    if (wide_dir_len <= 0) return false;
+
+    // NOTE: Length includes the null-terminator
+    wide_dir_len--;
+    if (wide_dir_len > 0 && wide_dir[wide_dir_len - 1] != '\\') wide_dir[wide_dir_len++] = '\\';
+    wide_dir[wide_dir_len++] = '*';
+    wide_dir[wide_dir_len]   = 0;
+
+    // NOTE: Basic info skips the 8.3 short name lookup and large fetch batches entries per syscall
+    WIN32_FIND_DATAW find_data = {};
+    HANDLE find_handle         = FindFirstFileExW(wide_dir, FindExInfoBasic, &find_data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    DQN_DEFER { FindClose(find_handle); };
+    char name[MAX_PATH * 3];
+    do
+    {
+        wchar_t const *wname = find_data.cFileName;
+        if (wname[0] == '.' && (wname[1] == 0 || (wname[1] == '.' && wname[2] == 0)))
+            continue;
+
+        DqnFileDirEntry entry = {};
+        entry.name            = name;
+        entry.name_len        = DqnWin32_WCharToUTF8(wname, name, DQN_ARRAY_COUNT(name)) - 1;
+        // NOTE: Only links are reported as such. Other reparse points (cloud placeholders, deduplicated
+        // files) are plain files and directories as far as callers are concerned.
+        bool is_link = (find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) &&
+                       (find_data.dwReserved0 == IO_REPARSE_TAG_SYMLINK || find_data.dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT);
+        if      (is_link)                                                   entry.type = DqnFileDirEntry::Type::Symlink;
+        else if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)     entry.type = DqnFileDirEntry::Type::Directory;
+        else                                                                entry.type = DqnFileDirEntry::Type::File;
+
+        ULARGE_INTEGER write_time     = {};
+        write_time.LowPart            = find_data.ftLastWriteTime.dwLowDateTime;
+        write_time.HighPart           = find_data.ftLastWriteTime.dwHighDateTime;
+        entry.has_info                = true;
+        entry.size                    = ((usize)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+        entry.last_write_time_in_s    = (write_time.QuadPart / 10000000ULL) - 11644473600ULL;
+
+        if (!callback(&entry, user_data))
+            break;
+    } while (FindNextFileW(find_handle, &find_data));
+
+    return true;
+
+#elif defined(__linux__)
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    DQN_DEFER { close(fd); };
+    struct DirEnt64
+    {
+        u64  d_ino;
+        i64  d_off;
+        u16  d_reclen;
+        u8   d_type;
+        char d_name[1];
+    };
+
+    // NOTE: One getdents64 returns as many entries as fit, so large buffers mean few syscalls even
+    // for huge directories.
+    alignas(8) u8 buf[DQN_KILOBYTE(64)];
+    for (;;)
+    {
+        long bytes_read = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (bytes_read == 0) break;
+        if (bytes_read < 0)  return false;
+
+        for (long offset = 0; offset < bytes_read;)
+        {
+            auto *dirent = reinterpret_cast<DirEnt64 *>(buf + offset);
+            offset      += dirent->d_reclen;
+
+            char const *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+                continue;
+
+            DqnFileDirEntry entry = {};
+            u8 type               = dirent->d_type;
+            if (type == DT_UNKNOWN)
+            {
+                struct stat file_stat = {};
+                if (fstatat(fd, name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                type                       = IFTODT(file_stat.st_mode);
+                entry.has_info             = true;
+                entry.size                 = file_stat.st_size;
+                entry.last_write_time_in_s = file_stat.st_mtime;
+            }
+
+            entry.name     = name;
+            entry.name_len = DqnStr_Len(name);
+            switch (type)
+            {
+                case DT_REG: entry.type = DqnFileDirEntry::Type::File;      break;
+                case DT_DIR: entry.type = DqnFileDirEntry::Type::Directory; break;
+                case DT_LNK: entry.type = DqnFileDirEntry::Type::Symlink;   break;
+                default:     entry.type = DqnFileDirEntry::Type::Other;     break;
+            }
+
+            if (!callback(&entry, user_data))
+                return true;
+        }
+    }
+
+    return true;
+
+#else
+    DIR *dir_handle = opendir(dir);
+    if (!dir_handle)
+        return false;
+
+    DQN_DEFER { closedir(dir_handle); };
+    while (struct dirent *dirent = readdir(dir_handle))
+    {
+        char const *name = dirent->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+            continue;
+
+        DqnFileDirEntry entry = {};
+        u8 type               = dirent->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat file_stat = {};
+            if (fstatat(dirfd(dir_handle), name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            type                       = IFTODT(file_stat.st_mode);
+            entry.has_info             = true;
+            entry.size                 = file_stat.st_size;
+            entry.last_write_time_in_s = file_stat.st_mtime;
+        }
+
+        entry.name     = name;
+        entry.name_len = DqnStr_Len(name);
+        switch (type)
+        {
+            case DT_REG: entry.type = DqnFileDirEntry::Type::File;      break;
+            case DT_DIR: entry.type = DqnFileDirEntry::Type::Directory; break;
+            case DT_LNK: entry.type = DqnFileDirEntry::Type::Symlink;   break;
+            default:     entry.type = DqnFileDirEntry::Type::Other;     break;
+        }
+
+        if (!callback(&entry, user_data))
+            break;
+    }
+
+    return true;
+#endif
+}
+
+FILE_SCOPE bool DqnFile__GlobMatch(char const *glob, char const *name)
+{
+#if defined(DQN_IS_WIN32)
+    auto CharEquals = [](char a, char b) -> bool { return DqnChar_ToLower(a) == DqnChar_ToLower(b); };
+#else
+    auto CharEquals = [](char a, char b) -> bool { return a == b; };
+#endif
+
+    // NOTE: On mismatch only the most recent '*' needs to be retried, consuming one more byte of the
+    // name, earlier stars can never do better.
+    char const *star      = nullptr;
+    char const *star_name = nullptr;
+    while (*name)
+    {
+        if (*glob == '*')
+        {
+            star      = glob++;
+            star_name = name;
+        }
+        else if (*glob && (*glob == '?' || CharEquals(*glob, *name)))
+        {
+            glob++;
+            name++;
+        }
+        else if (star)
+        {
+            glob = star + 1;
+            name = ++star_name;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*glob == '*') glob++;
+    return (*glob == 0);
+}
+
+struct DqnFile__ListDirContext
+{
+    char const                     *glob;
+    DqnArray<DqnFileDirList::Entry> entries; // name.data is unset until the names are packed
+    DqnArray<bool>                  has_info;
+    DqnArray<char>                  names;   // Null-terminated names back to back, in entry order
+};
+
+FILE_SCOPE bool DqnFile__ListDirCallback(DqnFileDirEntry const *entry, void *user_data)
+{
+    auto *context = static_cast<DqnFile__ListDirContext *>(user_data);
+    if (context->glob && !DqnFile__GlobMatch(context->glob, entry->name))
+        return true;
+
+    DqnFileDirList::Entry list_entry = {};
+    list_entry.name.len              = entry->name_len;
+    list_entry.type                  = entry->type;
+    list_entry.size                  = entry->size;
+    list_entry.last_write_time_in_s  = entry->last_write_time_in_s;
+    context->entries.Push(list_entry);
+    context->has_info.Push(entry->has_info);
+    context->names.Push(entry->name, entry->name_len + 1);
+    return true;
+}
+
+FILE_SCOPE bool DqnFile__DirListEntryLessThan(DqnFileDirList::Entry const &a, DqnFileDirList::Entry const &b, void *)
+{
+    bool result = DqnStr_Cmp(a.name.data, b.name.data) < 0;
+    return result;
+}
+
+bool DqnFile_ListDir(char const *dir, DqnMemStack *stack, DqnFileDirList *list, u32 flags, char const *glob, DqnFileBatch *batch)
+{
+    *list = {};
+    if (!dir || !stack) return false;
+
+    DqnFile__ListDirContext context = {};
+    context.glob                    = glob;
+    DQN_DEFER
+    {
+        context.entries.Free();
+        context.has_info.Free();
+        context.names.Free();
+    };
+
+    if (!DqnFile_IterateDir(dir, DqnFile__ListDirCallback, &context))
+        return false;
+
+    if (context.entries.len == 0)
+        return true;
+
+    list->entries = DQN_MEMSTACK_PUSH_ARRAY(stack, DqnFileDirList::Entry, context.entries.len);
+    char *names   = DQN_MEMSTACK_PUSH_ARRAY(stack, char, context.names.len);
+    if (!list->entries || !names)
+    {
+        *list = {};
+        return false;
+    }
+
+    list->len = context.entries.len;
+    DqnMem_Copy(list->entries, context.entries.data, sizeof(*list->entries) * list->len);
+    DqnMem_Copy(names, context.names.data, context.names.len);
+    for (DqnFileDirList::Entry &entry : *list)
+    {
+        entry.name.data = names;
+        names          += entry.name.len + 1;
+    }
+
+    if (flags & DqnFileDirList::Info)
+    {
+        isize dir_len      = DqnStr_Len(dir);
+        bool has_separator = (dir_len > 0 && (dir[dir_len - 1] == '/' || dir[dir_len - 1] == '\\'));
+
+        DqnArray<DqnFileOp> ops = {};
+        DqnArray<char> paths    = {};
+        DqnArray<isize> indexes = {};
+        DQN_DEFER
+        {
+            ops.Free();
+            paths.Free();
+            indexes.Free();
+        };
+
+        DQN_FOR_EACH(entry_index, list->len)
+        {
+            if (context.has_info.data[entry_index])
+                continue;
+
+            DqnFileDirList::Entry const *entry = list->entries + entry_index;
+            indexes.Push(paths.len);
+            paths.Push(dir, dir_len);
+            if (!has_separator) paths.Push('/');
+            paths.Push(entry->name.data, entry->name.len + 1);
+        }
+
+        // NOTE: Paths are only stable once every path has been pushed, the array may have moved
+        ops.Resize(indexes.len);
+        isize op_index = 0;
+        DQN_FOR_EACH(entry_index, list->len)
+        {
+            if (context.has_info.data[entry_index])
+                continue;
+
+            DqnFileOp *op  = ops.data + op_index;
+            *op            = {};
+            op->type       = DqnFileOp::Type::Stat;
+            op->path       = paths.data + indexes.data[op_index];
+            op->user_data  = list->entries + entry_index;
+            op_index++;
+        }
+
+        if (batch)
+        {
+            batch->Execute(ops.data, ops.len);
+        }
+        else
+        {
+            for (DqnFileOp &op : ops)
+                op.success = DqnFile_GetInfo(op.path, &op.info);
+        }
+
+        for (DqnFileOp const &op : ops)
+        {
+            if (!op.success)
+                continue;
+
+            auto *entry                 = static_cast<DqnFileDirList::Entry *>(op.user_data);
+            entry->size                 = op.info.size;
+            entry->last_write_time_in_s = op.info.last_write_time_in_s;
+        }
+    }
+
+    if (flags & DqnFileDirList::Sort)
+        DqnQuickSort<DqnFileDirList::Entry, DqnFile__DirListEntryLessThan>(list->entries, list->len, nullptr);
+
+    return true;
+}
+
+// XPlatform > #DqnFileWatch
+// =================================================================================================
+#if defined(DQN_IS_WIN32)
+struct DqnFileWatch::Dir
+{
+    HANDLE        handle;
+    OVERLAPPED    overlapped;
+    char         *path;     // UTF-8, heap allocated, no trailing separator
+    i32           path_len;
+    alignas(8) u8 buf[DQN_KILOBYTE(64)]; // NOTE: ReadDirectoryChangesW fails on network shares with more than 64k
+};
+#elif defined(__linux__)
+    #include <sys/inotify.h>
+    #include <poll.h>
+
+struct DqnFileWatch::Dir
+{
+    int   wd;
+    bool  is_root;  // Passed to Add(), overflows are reported for the roots
+    char *path;     // UTF-8, heap allocated, no trailing separator
+    i32   path_len;
+};
+#else
+struct DqnFileWatch::Dir
+{
+    char *path;
+};
+#endif
+
+struct DqnFileWatch__Events
+{
+    DqnArray<DqnFileWatchEvent> events; // path.data is unset until the paths are packed
+    DqnArray<char>              paths;  // Null-terminated paths back to back, in event order
+};
+
+// return: The joined path, valid until the next push
+FILE_SCOPE char *DqnFileWatch__PushEvent(DqnFileWatch__Events *context, DqnFileWatchEvent::Type type, bool is_dir,
+                                         char const *dir, i32 dir_len, char const *name, i32 name_len)
+{
+#if defined(DQN_IS_WIN32)
+    char const separator = '\\';
+#else
+    char const separator = '/';
+#endif
+
+    DqnFileWatchEvent event = {};
+    event.type              = type;
+    event.is_dir            = is_dir;
+    event.path.len          = dir_len + ((name_len > 0) ? 1 + name_len : 0);
+    context->events.Push(event);
+
+    char *result = context->paths.Make(event.path.len + 1);
+    DqnMem_Copy(result, dir, dir_len);
+    if (name_len > 0)
+    {
+        result[dir_len] = separator;
+        DqnMem_Copy(result + dir_len + 1, name, name_len);
+    }
+    result[event.path.len] = 0;
+    return result;
+}
+
+FILE_SCOPE char *DqnFileWatch__CopyPath(char const *dir, i32 *len)
+{
+    i32 dir_len = DqnStr_Len(dir);
+    while (dir_len > 1 && (dir[dir_len - 1] == '\\' || dir[dir_len - 1] == '/'))
+        dir_len--;
+
+    auto *result = static_cast<char *>(DqnMem_XAlloc(dir_len + 1));
+    DqnMem_Copy(result, dir, dir_len);
+    result[dir_len] = 0;
+    *len            = dir_len;
+    return result;
+}
+
+#if defined(DQN_IS_WIN32)
+FILE_SCOPE bool DqnFileWatch__Win32Read(DqnFileWatch::Dir *dir)
+{
+    u32 const filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+    BOOL result      = ReadDirectoryChangesW(dir->handle, dir->buf, sizeof(dir->buf), true /*bWatchSubtree*/, filter, nullptr, &dir->overlapped, nullptr);
+    return (result != 0);
+}
+
+FILE_SCOPE void DqnFileWatch__Win32FreeDir(DqnFileWatch::Dir *dir)
+{
+    // NOTE: The buffer is written to until the cancel completes
+    DWORD bytes = 0;
+    if (CancelIoEx(dir->handle, &dir->overlapped))
+        GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, true /*bWait*/);
+
+    CloseHandle(dir->overlapped.hEvent);
+    CloseHandle(dir->handle);
+    DqnMem_Free(dir->path);
+    DqnMem_Free(dir);
+}
+
+#elif defined(__linux__)
+u32 const DQN_FILE_WATCH__INOTIFY_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+FILE_SCOPE isize DqnFileWatch__LinuxFind(DqnFileWatch const *watch, int wd)
+{
+    // NOTE: Watch descriptors are handed out in increasing order so dirs stays sorted by appending
+    isize lo = 0, hi = watch->dirs.len;
+    while (lo < hi)
+    {
+        isize mid = lo + ((hi - lo) / 2);
+        if (watch->dirs.data[mid]->wd < wd) lo = mid + 1;
+        else                                hi = mid;
+    }
+    return lo;
+}
+
+FILE_SCOPE void DqnFileWatch__LinuxRemove(DqnFileWatch *watch, isize index)
+{
+    DqnFileWatch::Dir *dir = watch->dirs.data[index];
+    DqnMem_Free(dir->path);
+    DqnMem_Free(dir);
+    watch->dirs.EraseStable(index);
+}
+
+struct DqnFileWatch__LinuxSubdirs
+{
+    DqnArray<char *> pending; // Heap allocated paths of directories still to be watched
+    char const      *dir;
+    i32              dir_len;
+};
+
+FILE_SCOPE bool DqnFileWatch__LinuxSubdirCallback(DqnFileDirEntry const *entry, void *user_data)
+{
+    auto *context = static_cast<DqnFileWatch__LinuxSubdirs *>(user_data);
+    if (entry->type != DqnFileDirEntry::Type::Directory)
+        return true;
+
+    auto *path = static_cast<char *>(DqnMem_XAlloc(context->dir_len + 1 + entry->name_len + 1));
+    DqnMem_Copy(path, context->dir, context->dir_len);
+    path[context->dir_len] = '/';
+    DqnMem_Copy(path + context->dir_len + 1, entry->name, entry->name_len + 1);
+    context->pending.Push(path);
+    return true;
+}
+
+// Watch the directory and every directory below it
+// return: False if the directory itself could not be watched
+FILE_SCOPE bool DqnFileWatch__LinuxAddTree(DqnFileWatch *watch, char const *root, bool is_root)
+{
+    DqnFileWatch__LinuxSubdirs context = {};
+    DQN_DEFER
+    {
+        for (char *path : context.pending) DqnMem_Free(path);
+        context.pending.Free();
+    };
+
+    i32 root_len = 0;
+    context.pending.Push(DqnFileWatch__CopyPath(root, &root_len));
+
+    bool result = false;
+    for (bool first = true; context.pending.len > 0; first = false)
+    {
+        char *path = context.pending.data[--context.pending.len];
+        int wd     = inotify_add_watch(watch->fd, path, DQN_FILE_WATCH__INOTIFY_MASK);
+        if (wd == -1)
+        {
+            DqnMem_Free(path);
+            continue;
+        }
+
+        if (first) result = true;
+        isize index = DqnFileWatch__LinuxFind(watch, wd);
+        DqnFileWatch::Dir *dir = nullptr;
+        if (index < watch->dirs.len && watch->dirs.data[index]->wd == wd)
+        {
+            // NOTE: Already watched, i.e. it was moved, the watch follows the directory so update its path
+            dir = watch->dirs.data[index];
+            DqnMem_Free(dir->path);
+        }
+        else
+        {
+            dir     = static_cast<DqnFileWatch::Dir *>(DqnMem_XCalloc(sizeof(*dir)));
+            dir->wd = wd;
+            watch->dirs.Insert(index, dir);
+        }
+
+        dir->path     = path;
+        dir->path_len = DqnStr_Len(path);
+        dir->is_root |= (first && is_root);
+
+        context.dir     = dir->path;
+        context.dir_len = dir->path_len;
+        DqnFile_IterateDir(dir->path, DqnFileWatch__LinuxSubdirCallback, &context);
+    }
+
+    return result;
+}
+#endif
+
+bool DqnFileWatch::Init()
+{
+    *this = {};
+#if defined(DQN_IS_WIN32)
+    return true;
+#elif defined(__linux__)
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return (fd != -1);
+#else
+    return false;
+#endif
+}
+
+void DqnFileWatch::Free()
+{
+#if defined(DQN_IS_WIN32)
+    for (Dir *dir : dirs)
+        DqnFileWatch__Win32FreeDir(dir);
+#elif defined(__linux__)
+    if (fd != -1) close(fd);
+    for (Dir *dir : dirs)
+    {
+        DqnMem_Free(dir->path);
+        DqnMem_Free(dir);
+    }
+#endif
+
+    dirs.Free();
+    *this = {};
+}
+
+bool DqnFileWatch::Add(char const *dir)
+{
+    if (!dir) return false;
+
+#if defined(DQN_IS_WIN32)
+    if (dirs.len >= MAXIMUM_WAIT_OBJECTS)
+        return false;
+
+    // TODO(doyle): MAX PATH is baad
+    wchar_t wide_dir[MAX_PATH] = {};
+    if (DqnWin32_UTF8ToWChar(dir, wide_dir, DQN_ARRAY_COUNT(wide_dir)) <= 0)
+        return false;
+
+    HANDLE handle = CreateFileW(wide_dir, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    auto *watch_dir               = static_cast<Dir *>(DqnMem_XCalloc(sizeof(Dir)));
+    watch_dir->handle             = handle;
+    watch_dir->overlapped.hEvent  = CreateEventW(nullptr, true /*bManualReset*/, false /*bInitialState*/, nullptr);
+    watch_dir->path               = DqnFileWatch__CopyPath(dir, &watch_dir->path_len);
+    if (!watch_dir->overlapped.hEvent || !DqnFileWatch__Win32Read(watch_dir))
+    {
+        if (watch_dir->overlapped.hEvent) CloseHandle(watch_dir->overlapped.hEvent);
+        CloseHandle(handle);
+        DqnMem_Free(watch_dir->path);
+        DqnMem_Free(watch_dir);
+        return false;
+    }
+
+    dirs.Push(watch_dir);
+    return true;
+
+#elif defined(__linux__)
+    if (fd == -1) return false;
+    return DqnFileWatch__LinuxAddTree(this, dir, true /*is_root*/);
+
+#else
+    return false;
+#endif
+}
+
+bool DqnFileWatch::Wait(u32 timeout_ms, DqnMemStack *stack, DqnFileWatchEvents *events)
+{
+    *events = {};
+    if (!stack) return false;
+
+    DqnFileWatch__Events context = {};
+    DQN_DEFER
+    {
+        context.events.Free();
+        context.paths.Free();
+    };
+
+#if defined(DQN_IS_WIN32)
+    if (dirs.len == 0)
+    {
+        Sleep(timeout_ms);
+        return true;
+    }
+
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    DQN_FOR_EACH(dir_index, dirs.len)
+        handles[dir_index] = dirs.data[dir_index]->overlapped.hEvent;
+
+    DWORD wait_result = WaitForMultipleObjects((DWORD)dirs.len, handles, false /*bWaitAll*/, timeout_ms);
+    if (wait_result == WAIT_TIMEOUT)
+        return true;
+
+    if (wait_result >= WAIT_OBJECT_0 + (DWORD)dirs.len)
+        return false;
+
+    char name[MAX_PATH * 3];
+    for (isize dir_index = 0; dir_index < dirs.len;)
+    {
+        Dir *dir    = dirs.data[dir_index];
+        DWORD bytes = 0;
+        if (WaitForSingleObjectEx(dir->overlapped.hEvent, 0, false /*bAlertable*/) != WAIT_OBJECT_0)
+        {
+            dir_index++;
+            continue;
+        }
+
+        bool read_ok = GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, false /*bWait*/);
+        if (read_ok && bytes == 0)
+        {
+            // NOTE: The changes didn't fit in the buffer, the OS only tells us something changed
+            DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Overflow, true /*is_dir*/, dir->path, dir->path_len, nullptr, 0);
+        }
+
+        for (u8 const *ptr = dir->buf; read_ok && bytes > 0;)
+        {
+            auto const *info = reinterpret_cast<FILE_NOTIFY_INFORMATION const *>(ptr);
+            i32 name_len     = WideCharToMultiByte(CP_UTF8, 0, info->FileName, (int)(info->FileNameLength / sizeof(wchar_t)),
+                                                   name, DQN_ARRAY_COUNT(name), nullptr, nullptr);
+            if (name_len > 0)
+            {
+                bool removed = (info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME);
+                auto type    = (removed) ? DqnFileWatchEvent::Type::Removed : DqnFileWatchEvent::Type::Changed;
+                char *path   = DqnFileWatch__PushEvent(&context, type, false /*is_dir*/, dir->path, dir->path_len, name, name_len);
+
+                wchar_t wide_path[MAX_PATH];
+                WIN32_FILE_ATTRIBUTE_DATA attrib_data = {};
+                if (!removed && DqnWin32_UTF8ToWChar(path, wide_path, DQN_ARRAY_COUNT(wide_path)) > 0 &&
+                    GetFileAttributesExW(wide_path, GetFileExInfoStandard, &attrib_data))
+                {
+                    context.events.Back()->is_dir = (attrib_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+                }
+            }
+
+            if (info->NextEntryOffset == 0) break;
+            ptr += info->NextEntryOffset;
+        }
+
+        // NOTE: The tree can't be watched anymore, i.e. it was deleted
+        if (!read_ok || !DqnFileWatch__Win32Read(dir))
+        {
+            DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Removed, true /*is_dir*/, dir->path, dir->path_len, nullptr, 0);
+            DqnFileWatch__Win32FreeDir(dir);
+            dirs.EraseStable(dir_index);
+            continue;
+        }
+
+        dir_index++;
+    }
+
+#elif defined(__linux__)
+    if (fd == -1) return false;
+
+    pollfd poll_fd = {};
+    poll_fd.fd     = fd;
+    poll_fd.events = POLLIN;
+    int poll_result = poll(&poll_fd, 1, (timeout_ms == 0xFFFFFFFF) ? -1 : (int)DQN_MIN(timeout_ms, (u32)0x7FFFFFFF));
+    if (poll_result == -1)
+        return (errno == EINTR);
+
+    if (poll_result == 0)
+        return true;
+
+    alignas(inotify_event) char buf[DQN_KILOBYTE(64)];
+    for (;;)
+    {
+        ssize_t bytes_read = read(fd, buf, sizeof(buf));
+        if (bytes_read == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            return false;
+        }
+
+        for (ssize_t offset = 0; offset < bytes_read;)
+        {
+            auto const *event = reinterpret_cast<inotify_event const *>(buf + offset);
+            offset           += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                for (Dir const *dir : dirs)
+                {
+                    if (dir->is_root)
+                        DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Overflow, true /*is_dir*/, dir->path, dir->path_len, nullptr, 0);
+                }
+                continue;
+            }
+
+            isize dir_index = DqnFileWatch__LinuxFind(this, event->wd);
+            if (dir_index >= dirs.len || dirs.data[dir_index]->wd != event->wd)
+                continue;
+
+            Dir *dir = dirs.data[dir_index];
+            if (event->mask & IN_IGNORED)
+            {
+                DqnFileWatch__LinuxRemove(this, dir_index);
+                continue;
+            }
+
+            // NOTE: Events about the watched directory itself have no name, the parent's watch reports them
+            if (event->len == 0 || event->name[0] == 0)
+                continue;
+
+            bool is_dir  = (event->mask & IN_ISDIR);
+            i32 name_len = DqnStr_Len(event->name);
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                char *path = DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Removed, is_dir, dir->path, dir->path_len, event->name, name_len);
+                if (is_dir && (event->mask & IN_MOVED_FROM))
+                {
+                    // NOTE: Watches follow a directory that's moved, unwatch its tree as it's gone from our paths.
+                    // If it was moved elsewhere in the tree, IN_MOVED_TO watches it again under its new path.
+                    i32 path_len = DqnStr_Len(path);
+                    for (isize index = dirs.len - 1; index >= 0; index--)
+                    {
+                        Dir *check = dirs.data[index];
+                        if (check->path_len >= path_len && DqnMem_Cmp(check->path, path, path_len) == 0 &&
+                            (check->path[path_len] == '/' || check->path[path_len] == 0))
+                        {
+                            inotify_rm_watch(fd, check->wd);
+                            DqnFileWatch__LinuxRemove(this, index);
+                        }
+                    }
+                }
+            }
+            else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            {
+                // NOTE: A created file is reported once it's closed after writing instead, it may be incomplete
+                if (!is_dir && (event->mask & IN_CREATE))
+                    continue;
+
+                char *path = DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Changed, is_dir, dir->path, dir->path_len, event->name, name_len);
+                if (is_dir)
+                    DqnFileWatch__LinuxAddTree(this, path, false /*is_root*/);
+            }
+            else if (event->mask & IN_CLOSE_WRITE)
+            {
+                DqnFileWatch__PushEvent(&context, DqnFileWatchEvent::Type::Changed, is_dir, dir->path, dir->path_len, event->name, name_len);
+            }
+        }
+    }
+
+#else
+    (void)timeout_ms;
+    return false;
+#endif
+
+    if (context.events.len == 0)
+        return true;
+
+    events->events = DQN_MEMSTACK_PUSH_ARRAY(stack, DqnFileWatchEvent, context.events.len);
+    char *paths    = DQN_MEMSTACK_PUSH_ARRAY(stack, char, context.paths.len);
+    if (!events->events || !paths)
+    {
+        *events = {};
+        return false;
+    }
+
+    events->len = context.events.len;
+    DqnMem_Copy(events->events, context.events.data, sizeof(*events->events) * events->len);
+    DqnMem_Copy(paths, context.paths.data, context.paths.len);
+    for (DqnFileWatchEvent &event : *events)
+    {
+        event.path.data = paths;
+        paths          += event.path.len + 1;
+    }
+
+    return true;
+}
+
+// XPlatform > #DqnFileBatch
+// =================================================================================================
+#define DQN_FILE_BATCH__OPS_PER_JOB      8
+#define DQN_FILE_BATCH__SUBMIT_THRESHOLD 64
+
+struct DqnFileBatch__Job
+{
+    struct DqnFileBatch__Internal *internal;
+    DqnFileOp                     *ops[DQN_FILE_BATCH__OPS_PER_JOB];
+    i32                            num_ops;
+    i32 volatile                   in_use;
+};
+
+#if defined(DQN__IO_URING)
+struct DqnFileBatch__Uring
+{
+    int                  fd;
+    u32                  sq_entries;
+    u32                 *sq_head;
+    u32                 *sq_tail;
+    u32                 *sq_mask;
+    u32                 *sq_array;
+    u32                 *cq_head;
+    u32                 *cq_tail;
+    u32                 *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    void                *sq_ring;
+    usize                sq_ring_size;
+    void                *cq_ring; // Same as sq_ring if the kernel supports IORING_FEAT_SINGLE_MMAP
+    usize                cq_ring_size;
+    usize                sqes_size;
+
+    u32                  num_unsubmitted;
+
+    // NOTE: Per-op kernel state is indexed by slot, the slot index is the sqe's user_data
+    DqnFileOp          **slot_ops;
+    struct statx        *slot_statx;
+    i32                 *free_slots;
+    isize                num_free_slots;
+};
+#endif
+
+struct DqnFileBatch__Internal
+{
+    usize               alloc_size;
+
+    // NOTE: Ring buffer of completed ops waiting to be reaped. Bounded by max_in_flight since an op
+    // stays in flight until it's reaped. Lock is only needed by the thread pool backend.
+    DqnLock             completed_lock;
+    DqnFileOp         **completed;
+    isize               completed_head;
+    isize               completed_count;
+    isize               completed_max;
+
+    // Backend::ThreadPool
+    DqnJobQueue        *job_queue;
+    DqnFileBatch__Job  *jobs;
+    isize               num_jobs;
+    isize               job_cursor;
+    DqnFileBatch__Job  *curr_job;
+
+#if defined(DQN__IO_URING)
+    DqnFileBatch__Uring uring;
+#endif
+};
+
+FILE_SCOPE void DqnFile__ExecuteOpBlocking(DqnFileOp *op)
+{
+    op->success = false;
+    op->error   = 0;
+
+#if defined(DQN_IS_WIN32)
+    // TODO(doyle): MAX PATH is baad
+    wchar_t path[MAX_PATH] = {};
+    DqnWin32_UTF8ToWChar(op->path, path, DQN_ARRAY_COUNT(path));
+    switch (op->type)
+    {
+        case DqnFileOp::Type::Stat:    op->success = DqnFile_GetInfo(path, &op->info); break;
+        case DqnFileOp::Type::MakeDir: op->success = CreateDirectoryW(path, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS; break;
+        case DqnFileOp::Type::Open:    op->success = op->file.Open(path, DqnFile::Flag::FileRead, DqnFile::Action::OpenOnly); break;
+        case DqnFileOp::Type::Link:
+        {
+            wchar_t src_path[MAX_PATH] = {};
+            DqnWin32_UTF8ToWChar(op->src_path, src_path, DQN_ARRAY_COUNT(src_path));
+            op->success = CreateHardLinkW(path, src_path, nullptr);
+        }
+        break;
+    }
+    if (!op->success) op->error = (i32)GetLastError();
+
+#else
+    switch (op->type)
+    {
+        case DqnFileOp::Type::Stat:    op->success = DqnFile_GetInfo(op->path, &op->info); break;
+        case DqnFileOp::Type::MakeDir: op->success = (mkdir(op->path, 0755) == 0 || errno == EEXIST); break;
+        case DqnFileOp::Type::Link:    op->success = (link(op->src_path, op->path) == 0); break;
+        case DqnFileOp::Type::Open:    op->success = op->file.Open(op->path, DqnFile::Flag::FileRead, DqnFile::Action::OpenOnly); break;
+    }
+    if (!op->success) op->error = errno;
+#endif
+}
+
+FILE_SCOPE void DqnFileBatch__PushCompleted(DqnFileBatch__Internal *internal, DqnFileOp *op)
+{
+    DQN_ASSERT(internal->completed_count < internal->completed_max);
+    isize index                 = (internal->completed_head + internal->completed_count) % internal->completed_max;
+    internal->completed[index]  = op;
+    internal->completed_count++;
+}
+
+FILE_SCOPE DqnFileOp *DqnFileBatch__PopCompleted(DqnFileBatch__Internal *internal)
+{
+    if (internal->completed_count == 0)
+        return nullptr;
+
+    DqnFileOp *result        = internal->completed[internal->completed_head];
+    internal->completed_head = (internal->completed_head + 1) % internal->completed_max;
+    internal->completed_count--;
+    return result;
+}
+
+// XPlatform > #DqnFileBatch > ThreadPool
+// =================================================================================================
+FILE_SCOPE DqnJobQueue *DqnFileBatch__SharedJobQueue()
+{
+    // NOTE: Only for batches not given a queue. Threads are never torn down (see DqnJobQueue TODO), so
+    // all of them share one pool. The work is I/O bound, oversubscribe the logical cores so blocked
+    // threads don't starve the queue.
+    LOCAL_PERSIST DqnJob      job_list[512];
+    LOCAL_PERSIST DqnJobQueue queue;
+    LOCAL_PERSIST bool        initialised;
+    if (!initialised)
+    {
+        u32 num_cores = 0, num_threads_per_core = 0;
+        DqnOS_GetThreadsAndCores(&num_cores, &num_threads_per_core);
+        u32 num_threads = DQN_MAX(4u, num_cores * DQN_MAX(num_threads_per_core, 1u) * 2);
+        initialised     = queue.Init(job_list, DQN_ARRAY_COUNT(job_list), num_threads);
+    }
+
+    return (initialised) ? &queue : nullptr;
+}
+
+FILE_SCOPE void DqnFileBatch__ThreadPoolJobCallback(DqnJobQueue *, void *user_data)
+{
+    auto *job = static_cast<DqnFileBatch__Job *>(user_data);
+    DQN_FOR_EACH(op_index, job->num_ops)
+        DqnFile__ExecuteOpBlocking(job->ops[op_index]);
+
+    DqnFileBatch__Internal *internal = job->internal;
+    {
+        auto guard = internal->completed_lock.Guard();
+        DQN_FOR_EACH(op_index, job->num_ops)
+            DqnFileBatch__PushCompleted(internal, job->ops[op_index]);
+    }
+
+    DqnAtomic_CompareSwap32(&job->in_use, 0, 1);
+}
+
+FILE_SCOPE void DqnFileBatch__ThreadPoolSubmit(DqnFileBatch__Internal *internal)
+{
+    DqnFileBatch__Job *job = internal->curr_job;
+    if (!job) return;
+
+    internal->curr_job = nullptr;
+    DqnJob dqn_job     = {DqnFileBatch__ThreadPoolJobCallback, job};
+    while (!internal->job_queue->AddJob(dqn_job))
+        internal->job_queue->TryExecuteNextJob();
+}
+
+FILE_SCOPE void DqnFileBatch__ThreadPoolPush(DqnFileBatch__Internal *internal, DqnFileOp *op)
+{
+    if (!internal->curr_job)
+    {
+        // NOTE: There are as many jobs as max_in_flight and a job holds atleast 1 op, so a free one
+        // always exists whilst the batch is under max_in_flight.
+        for (isize i = 0; i < internal->num_jobs && !internal->curr_job; i++)
+        {
+            DqnFileBatch__Job *job = internal->jobs + internal->job_cursor;
+            internal->job_cursor   = (internal->job_cursor + 1) % internal->num_jobs;
+            if (job->in_use == 0)
+            {
+                job->in_use        = 1;
+                job->num_ops       = 0;
+                internal->curr_job = job;
+            }
+        }
+        DQN_ASSERT(internal->curr_job);
+    }
+
+    DqnFileBatch__Job *job   = internal->curr_job;
+    job->ops[job->num_ops++] = op;
+    if (job->num_ops == DQN_ARRAY_COUNT(job->ops))
+        DqnFileBatch__ThreadPoolSubmit(internal);
+}
+
+// XPlatform > #DqnFileBatch > io_uring
+// =================================================================================================
+#if defined(DQN__IO_URING)
+FILE_SCOPE int DqnFileBatch__UringEnter(int fd, u32 to_submit, u32 min_complete, u32 flags)
+{
+    int result = (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    return result;
+}
+
+FILE_SCOPE void DqnFileBatch__UringFree(DqnFileBatch__Uring *uring)
+{
+    if (uring->sqes)                                     munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring && uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring)                                  munmap(uring->sq_ring, uring->sq_ring_size);
+    if (uring->fd > 0)                                   close(uring->fd);
+    uring->fd      = -1;
+    uring->sqes    = nullptr;
+    uring->sq_ring = nullptr;
+    uring->cq_ring = nullptr;
+}
+
+FILE_SCOPE bool DqnFileBatch__UringInit(DqnFileBatch__Uring *uring, u32 num_entries)
+{
+    struct io_uring_params params = {};
+    uring->fd = (int)syscall(__NR_io_uring_setup, num_entries, &params);
+    if (uring->fd < 0)
+        return false;
+
+    // NOTE: Path based ops were added in stages (statx/openat 5.6, mkdirat/linkat 5.15), check the
+    // kernel supports every op we may issue, otherwise fall back for everything.
+    {
+        u8 probe_mem[sizeof(struct io_uring_probe) + sizeof(struct io_uring_probe_op) * 256] = {};
+        auto *probe = reinterpret_cast<struct io_uring_probe *>(probe_mem);
+        if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        {
+            DqnFileBatch__UringFree(uring);
+            return false;
+        }
+
+        u8 const required_ops[] = {IORING_OP_STATX, IORING_OP_MKDIRAT, IORING_OP_LINKAT, IORING_OP_OPENAT};
+        for (u8 op : required_ops)
+        {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                DqnFileBatch__UringFree(uring);
+                return false;
+            }
+        }
+    }
+
+    uring->sq_entries   = params.sq_entries;
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    uring->cq_ring_size = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size    = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap)
+    {
+        uring->sq_ring_size = DQN_MAX(uring->sq_ring_size, uring->cq_ring_size);
+        uring->cq_ring_size = uring->sq_ring_size;
+    }
+
+    uring->sq_ring = mmap(nullptr, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED)
+    {
+        uring->sq_ring = nullptr;
+        DqnFileBatch__UringFree(uring);
+        return false;
+    }
+
+    if (single_mmap)
+    {
+        uring->cq_ring = uring->sq_ring;
+    }
+    else
+    {
+        uring->cq_ring = mmap(nullptr, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED)
+        {
+            uring->cq_ring = nullptr;
+            DqnFileBatch__UringFree(uring);
+            return false;
+        }
+    }
+
+    uring->sqes = (struct io_uring_sqe *)mmap(nullptr, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED)
+    {
+        uring->sqes = nullptr;
+        DqnFileBatch__UringFree(uring);
+        return false;
+    }
+
+    auto *sq_ring   = static_cast<u8 *>(uring->sq_ring);
+    auto *cq_ring   = static_cast<u8 *>(uring->cq_ring);
+    uring->sq_head  = (u32 *)(sq_ring + params.sq_off.head);
+    uring->sq_tail  = (u32 *)(sq_ring + params.sq_off.tail);
+    uring->sq_mask  = (u32 *)(sq_ring + params.sq_off.ring_mask);
+    uring->sq_array = (u32 *)(sq_ring + params.sq_off.array);
+    uring->cq_head  = (u32 *)(cq_ring + params.cq_off.head);
+    uring->cq_tail  = (u32 *)(cq_ring + params.cq_off.tail);
+    uring->cq_mask  = (u32 *)(cq_ring + params.cq_off.ring_mask);
+    uring->cqes     = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+    return true;
+}
+
+// return: The number of completions moved from the completion queue onto the completed list
+FILE_SCOPE isize DqnFileBatch__UringDrainCompletions(DqnFileBatch__Internal *internal)
+{
+    DqnFileBatch__Uring *uring = &internal->uring;
+    u32 head                   = *uring->cq_head;
+    u32 tail                   = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    isize result               = tail - head;
+
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe const *cqe = uring->cqes + (head & *uring->cq_mask);
+        i32 slot                       = (i32)cqe->user_data;
+        DqnFileOp *op                  = uring->slot_ops[slot];
+
+        op->success = (cqe->res >= 0);
+        op->error   = (op->success) ? 0 : -cqe->res;
+        switch (op->type)
+        {
+            case DqnFileOp::Type::Link: break;
+            case DqnFileOp::Type::MakeDir:
+            {
+                if (op->error == EEXIST)
+                {
+                    op->success = true;
+                    op->error   = 0;
+                }
+            }
+            break;
+
+            case DqnFileOp::Type::Stat:
+            {
+                if (!op->success) break;
+                struct statx const *stx         = uring->slot_statx + slot;
+                op->info.size                  = (usize)stx->stx_size;
+                op->info.create_time_in_s      = (stx->stx_mask & STATX_BTIME) ? stx->stx_btime.tv_sec : 0;
+                op->info.last_write_time_in_s  = stx->stx_mtime.tv_sec;
+                op->info.last_access_time_in_s = stx->stx_atime.tv_sec;
+            }
+            break;
+
+            case DqnFileOp::Type::Open:
+            {
+                if (!op->success) break;
+                int fd                = cqe->res;
+                struct stat file_stat = {};
+                FILE *handle          = (fstat(fd, &file_stat) == 0) ? fdopen(fd, "rb") : nullptr;
+                if (handle)
+                {
+                    op->file        = {};
+                    op->file.handle = handle;
+                    op->file.size   = file_stat.st_size;
+                    op->file.flags  = DqnFile::Flag::FileRead;
+                }
+                else
+                {
+                    op->success = false;
+                    op->error   = errno;
+                    close(fd);
+                }
+            }
+            break;
+        }
+
+        uring->slot_ops[slot]                      = nullptr;
+        uring->free_slots[uring->num_free_slots++] = slot;
+        DqnFileBatch__PushCompleted(internal, op);
+    }
+
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return result;
+}
+
+FILE_SCOPE void DqnFileBatch__UringSubmit(DqnFileBatch__Internal *internal)
+{
+    DqnFileBatch__Uring *uring = &internal->uring;
+    while (uring->num_unsubmitted > 0)
+    {
+        int submitted = DqnFileBatch__UringEnter(uring->fd, uring->num_unsubmitted, 0, 0);
+        if (submitted >= 0)
+        {
+            uring->num_unsubmitted -= submitted;
+        }
+        else if (errno == EAGAIN || errno == EBUSY)
+        {
+            // NOTE: Kernel is out of resources for new requests, wait for something to complete
+            DqnFileBatch__UringEnter(uring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+            DqnFileBatch__UringDrainCompletions(internal);
+        }
+        else if (errno != EINTR)
+        {
+            DQN_LOGGER_E(dqn_lib_context_.logger, "io_uring_enter failed: errno=%d", errno);
+            DQN_ASSERT(DQN_INVALID_CODE_PATH);
+            return;
+        }
+    }
+}
+
+FILE_SCOPE void DqnFileBatch__UringPush(DqnFileBatch__Internal *internal, DqnFileOp *op)
+{
+    DqnFileBatch__Uring *uring = &internal->uring;
+    DQN_ASSERT(uring->num_free_slots > 0);
+    i32 slot              = uring->free_slots[--uring->num_free_slots];
+    uring->slot_ops[slot] = op;
+
+    u32 tail                 = *uring->sq_tail;
+    u32 index                = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = uring->sqes + index;
+    *sqe                     = {};
+    sqe->fd                  = AT_FDCWD;
+    sqe->addr                = (u64)op->path;
+    sqe->user_data           = (u64)slot;
+    switch (op->type)
+    {
+        case DqnFileOp::Type::Stat:
+        {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->len    = STATX_BASIC_STATS | STATX_BTIME;
+            sqe->off    = (u64)(uring->slot_statx + slot);
+        }
+        break;
+
+        case DqnFileOp::Type::MakeDir:
+        {
+            sqe->opcode = IORING_OP_MKDIRAT;
+            sqe->len    = 0755;
+        }
+        break;
+
+        case DqnFileOp::Type::Link:
+        {
+            sqe->opcode = IORING_OP_LINKAT;
+            sqe->addr   = (u64)op->src_path;
+            sqe->len    = (u32)AT_FDCWD;
+            sqe->addr2  = (u64)op->path;
+        }
+        break;
+
+        case DqnFileOp::Type::Open:
+        {
+            sqe->opcode     = IORING_OP_OPENAT;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        break;
+    }
+
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    if (++uring->num_unsubmitted >= DQN_FILE_BATCH__SUBMIT_THRESHOLD)
+        DqnFileBatch__UringSubmit(internal);
+}
+#endif // defined(DQN__IO_URING)
+
+// XPlatform > #DqnFileBatch > API
+// =================================================================================================
+bool DqnFileBatch::Init(isize max_in_flight_, Backend backend_, DqnJobQueue *job_queue_)
+{
+    *this = {};
+    if (max_in_flight_ <= 0)
+        return false;
+
+#if !defined(DQN__IO_URING)
+    if (backend_ == Backend::IoUring)
+        return false;
+#endif
+
+    // NOTE: Single allocation, internal state followed by the arrays sized by max_in_flight
+    usize completed_size = sizeof(DqnFileOp *)        * max_in_flight_;
+    usize jobs_size      = sizeof(DqnFileBatch__Job)  * max_in_flight_;
+#if defined(DQN__IO_URING)
+    usize slot_ops_size   = sizeof(DqnFileOp *)       * max_in_flight_;
+    usize slot_statx_size = sizeof(struct statx)      * max_in_flight_;
+    usize free_slots_size = sizeof(i32)               * max_in_flight_;
+#else
+    usize slot_ops_size = 0, slot_statx_size = 0, free_slots_size = 0;
+#endif
+
+    usize alloc_size = sizeof(DqnFileBatch__Internal) + completed_size + jobs_size + slot_ops_size + slot_statx_size + free_slots_size;
+    auto *mem        = static_cast<u8 *>(dqn_lib_context_.allocator->Malloc(alloc_size, Dqn::ZeroMem::Yes));
+    if (!mem)
+        return false;
+
+    auto *result          = reinterpret_cast<DqnFileBatch__Internal *>(mem);
+    result->alloc_size    = alloc_size;
+    result->completed_max = max_in_flight_;
+    mem += sizeof(*result);
+
+    result->completed = reinterpret_cast<DqnFileOp **>(mem);  mem += completed_size;
+    result->jobs      = reinterpret_cast<DqnFileBatch__Job *>(mem); mem += jobs_size;
+    result->num_jobs  = max_in_flight_;
+    DQN_FOR_EACH(job_index, result->num_jobs)
+        result->jobs[job_index].internal = result;
+
+    Backend chosen = Backend::ThreadPool;
+#if defined(DQN__IO_URING)
+    DqnFileBatch__Uring *uring = &result->uring;
+    uring->slot_ops            = reinterpret_cast<DqnFileOp **>(mem);    mem += slot_ops_size;
+    uring->slot_statx          = reinterpret_cast<struct statx *>(mem);  mem += slot_statx_size;
+    uring->free_slots          = reinterpret_cast<i32 *>(mem);           mem += free_slots_size;
+    uring->num_free_slots      = max_in_flight_;
+    DQN_FOR_EACH(slot_index, max_in_flight_)
+        uring->free_slots[slot_index] = (i32)(max_in_flight_ - 1 - slot_index);
+
+    if (backend_ != Backend::ThreadPool)
+    {
+        if (DqnFileBatch__UringInit(uring, (u32)max_in_flight_))
+        {
+            chosen = Backend::IoUring;
+        }
+        else if (backend_ == Backend::IoUring)
+        {
+            dqn_lib_context_.allocator->Free(result, alloc_size);
+            return false;
+        }
+    }
+#endif
+
+    if (chosen == Backend::ThreadPool)
+    {
+        result->job_queue = (job_queue_) ? job_queue_ : DqnFileBatch__SharedJobQueue();
+        if (!result->job_queue || !result->completed_lock.Init())
+        {
+            dqn_lib_context_.allocator->Free(result, alloc_size);
+            return false;
+        }
+    }
+
+    this->backend       = chosen;
+    this->max_in_flight = max_in_flight_;
+    this->internal      = result;
+    return true;
+}
+
+void DqnFileBatch::Free()
+{
+    auto *internal_ = static_cast<DqnFileBatch__Internal *>(this->internal);
+    if (!internal_)
+        return;
+
+    while (this->Reap(true /*wait*/))
+        ;
+
+    if (this->backend == Backend::ThreadPool)
+    {
+        // NOTE: Workers touch the job after publishing completions, wait till they let go of it
+        DQN_FOR_EACH(job_index, internal_->num_jobs)
+        {
+            while (internal_->jobs[job_index].in_use)
+                internal_->job_queue->TryExecuteNextJob();
+        }
+        internal_->completed_lock.Delete();
+    }
+#if defined(DQN__IO_URING)
+    else
+    {
+        DqnFileBatch__UringFree(&internal_->uring);
+    }
+#endif
+
+    dqn_lib_context_.allocator->Free(internal_, internal_->alloc_size);
+    *this = {};
+}
+
+bool DqnFileBatch::Push(DqnFileOp *op)
+{
+    auto *internal_ = static_cast<DqnFileBatch__Internal *>(this->internal);
+    DQN_ASSERT(internal_ && op);
+    if (this->num_in_flight >= this->max_in_flight)
+        return false;
+
+    this->num_in_flight++;
+#if defined(DQN__IO_URING)
+    if (this->backend == Backend::IoUring)
+    {
+        DqnFileBatch__UringPush(internal_, op);
+        return true;
+    }
+#endif
+
+    DqnFileBatch__ThreadPoolPush(internal_, op);
+    return true;
+}
+
+void DqnFileBatch::Submit()
+{
+    auto *internal_ = static_cast<DqnFileBatch__Internal *>(this->internal);
+#if defined(DQN__IO_URING)
+    if (this->backend == Backend::IoUring)
+    {
+        DqnFileBatch__UringSubmit(internal_);
+        return;
+    }
+#endif
+
+    DqnFileBatch__ThreadPoolSubmit(internal_);
+}
+
+DqnFileOp *DqnFileBatch::Reap(bool wait)
+{
+    auto *internal_ = static_cast<DqnFileBatch__Internal *>(this->internal);
+    if (!internal_ || this->num_in_flight == 0)
+        return nullptr;
+
+    this->Submit();
+    DqnFileOp *result = nullptr;
+#if defined(DQN__IO_URING)
+    if (this->backend == Backend::IoUring)
+    {
+        for (;;)
+        {
+            if ((result = DqnFileBatch__PopCompleted(internal_)) != nullptr) break;
+            if (DqnFileBatch__UringDrainCompletions(internal_) > 0)          continue;
+            if (!wait)                                                        break;
+
+            if (DqnFileBatch__UringEnter(internal_->uring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                DQN_LOGGER_E(dqn_lib_context_.logger, "io_uring_enter failed waiting on completions: errno=%d", errno);
+                break;
+            }
+        }
+    }
+    else
+#endif
+    {
+        for (;;)
+        {
+            {
+                auto guard = internal_->completed_lock.Guard();
+                result     = DqnFileBatch__PopCompleted(internal_);
+            }
+
+            if (result || !wait)
+                break;
+
+            // NOTE: Help the workers out rather than sleep, the ops we're waiting on may be queued
+            if (!internal_->job_queue->TryExecuteNextJob())
+            {
+#if defined(DQN_IS_WIN32)
+                Sleep(0);
+#else
+                sched_yield();
+#endif
+            }
+        }
+    }
+
+    if (result) this->num_in_flight--;
+    return result;
+}
+
+void DqnFileBatch::Execute(DqnFileOp *ops, isize num_ops)
+{
+    for (isize op_index = 0; op_index < num_ops;)
+    {
+        if (this->Push(ops + op_index)) op_index++;
+        else                            this->Reap(true /*wait*/);
+    }
+
+    while (this->Reap(true /*wait*/))
+        ;
+}
+
+char const *DqnFileBatch::BackendName() const
+{
+    switch (this->backend)
+    {
+        case Backend::IoUring:    return "io_uring";
+        case Backend::ThreadPool: return "thread_pool";
+        default:                  return "none";
+    }
+}
+
+// XPlatform > #DqnTimer
+// =================================================================================================
+#if defined (DQN_IS_WIN32)
 FILE_SCOPE f64 DqnTimerInternal_Win32QueryPerfCounterTimeInMs()
 {
     LOCAL_PERSIST LARGE_INTEGER query_perf_freq = {0};
@@ -8294,6 +10783,39 @@ DQN_FILE_SCOPE f64 DqnTimer_NowInMs()
 
 DQN_FILE_SCOPE f64 DqnTimer_NowInS() { return DqnTimer_NowInMs() / 1000.0f; }
 
+DQN_FILE_SCOPE u64 DqnTimer_NowInNs()
+{
+    u64 result = 0;
+#if defined(DQN_IS_WIN32)
+    LOCAL_PERSIST LARGE_INTEGER query_perf_freq = {0};
+    if (query_perf_freq.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&query_perf_freq);
+        DQN_ASSERT(query_perf_freq.QuadPart != 0);
+    }
+
+    LARGE_INTEGER qpc_result;
+    QueryPerformanceCounter(&qpc_result);
+
+    // NOTE: Split into whole seconds and remainder, ticks * 1e9 overflows u64 after a few hours uptime
+    u64 const ticks = (u64)qpc_result.QuadPart;
+    u64 const freq  = (u64)query_perf_freq.QuadPart;
+    result          = ((ticks / freq) * 1000000000ULL) + (((ticks % freq) * 1000000000ULL) / freq);
+
+#else
+    struct timespec time_spec = {0};
+    if (clock_gettime(CLOCK_MONOTONIC, &time_spec))
+    {
+        DQN_ASSERT(DQN_INVALID_CODE_PATH);
+    }
+    else
+    {
+        result = ((u64)time_spec.tv_sec * 1000000000ULL) + (u64)time_spec.tv_nsec;
+    }
+#endif
+    return result;
+}
+
 // XPlatform > #DqnLock
 // =================================================================================================
 bool DqnLock::Init()
@@ -8347,6 +10869,68 @@ void DqnLock::Delete()
 #endif
 }
 
+// XPlatform > #DqnRWLock
+// =================================================================================================
+bool DqnRWLock::Init()
+{
+#if defined(DQN_IS_WIN32)
+    InitializeSRWLock(&this->win32_handle);
+    return true;
+#else
+    return pthread_rwlock_init(&this->unix_handle, nullptr) == 0;
+#endif
+}
+
+void DqnRWLock::AcquireShared()
+{
+#if defined(DQN_IS_WIN32)
+    AcquireSRWLockShared(&this->win32_handle);
+#else
+    i32 error = pthread_rwlock_rdlock(&this->unix_handle);
+    DQN_ASSERT(error == 0);
+#endif
+}
+
+void DqnRWLock::ReleaseShared()
+{
+#if defined(DQN_IS_WIN32)
+    ReleaseSRWLockShared(&this->win32_handle);
+#else
+    i32 error = pthread_rwlock_unlock(&this->unix_handle);
+    DQN_ASSERT(error == 0);
+#endif
+}
+
+void DqnRWLock::AcquireExclusive()
+{
+#if defined(DQN_IS_WIN32)
+    AcquireSRWLockExclusive(&this->win32_handle);
+#else
+    i32 error = pthread_rwlock_wrlock(&this->unix_handle);
+    DQN_ASSERT(error == 0);
+#endif
+}
+
+void DqnRWLock::ReleaseExclusive()
+{
+#if defined(DQN_IS_WIN32)
+    ReleaseSRWLockExclusive(&this->win32_handle);
+#else
+    i32 error = pthread_rwlock_unlock(&this->unix_handle);
+    DQN_ASSERT(error == 0);
+#endif
+}
+
+void DqnRWLock::Delete()
+{
+#if defined(DQN_IS_WIN32)
+    // NOTE: SRW locks have nothing to free
+#else
+    i32 error = pthread_rwlock_destroy(&this->unix_handle);
+    DQN_ASSERT(error == 0);
+#endif
+}
+
 // XPlatform > #DqnJobQueue
 // =================================================================================================
 typedef void *DqnThreadCallbackInternal(void *thread_param);
@@ -8591,7 +11175,7 @@ void DqnOS_VFree(void *address, isize size)
     DQN_ASSERT(result);
 #else
     int result = munmap(address, size);
-    DQN_ASSERT(result != 0);
+    DQN_ASSERT(result == 0);
 #endif
 }
 
@@ -8653,7 +11237,7 @@ DQN_OS_GET_THREADS_AND_CORES(DqnOS_GetThreadsAndCores)
             // Read num cores value, i.e. physical cores
             *num_cores = Dqn_StrToI64(src_ptr, src_len);
         }
-        DQN_DEFAULT_HEAP_ALLOCATOR->Free(read_buffer);
+        dqn_lib_context_.allocator->Free(read_buffer, fileSize);
     }
     else
     {
@@ -0,0 +1,5 @@
+#include "WPDBench.cpp"
+
+#define DQN_IMPLEMENTATION
+#define DQN_PLATFORM_IMPLEMENTATION
+#include "External/Dqn.h"
@@ -0,0 +1,1021 @@
+// WPDBench: Generate a deterministic synthetic music library and a set of playlists over it, then run
+// WPDPlayground over the result and report wall time, peak memory and I/O/syscall counts. Each run also
+// writes WPDPlayground's per-stage breakdown to <root>/WPDBenchStats_run<N>.json.
+//
+// Usage: WPDBench [options]
+//   --root <dir>          Directory to generate into, the pipeline is run with this as the working directory (default: WPDBench)
+//   --tracks <n>          Number of tracks in the library                        (default: 2000)
+//   --playlists <n>       Number of playlists written to <root>/Input            (default: 20)
+//   --playlist-size <n>   Number of entries per playlist                         (default: 500)
+//   --overlap <0..1>      Fraction of each playlist drawn from a shared hot set  (default: 0.5)
+//   --seed <n>            Seed for the generator, same seed gives the same bytes (default: 1)
+//   --exe <cmd>           Command to run the pipeline, i.e. "wine /path/WPDPlayground.exe". Win32 defaults to WPDPlayground.exe next to WPDBench.exe
+//   --runs <n>            Number of times to run the pipeline, later runs measure the warm path (default: 1)
+//   --strace              Unix only, wrap the pipeline in "strace -f -c" and report the syscall total
+//   --no-generate         Reuse a previously generated library in <root>
+//   --no-run              Only generate the library
+//   --check-catalog       Check that a DqnCatalog asset added by its bare file name reloads when the file changes, then exit
+
+#if defined(_WIN32)
+    #define WIN32_MEAN_AND_LEAN
+    #include <Windows.h>
+    #include <Psapi.h>
+#else
+    #include <stdlib.h>       // realpath
+    #include <sys/resource.h> // rusage
+    #include <sys/stat.h>     // mkdir
+    #include <sys/wait.h>     // wait4
+    #include <unistd.h>       // fork, exec
+#endif
+#include <stdio.h>
+
+#define DQN_PLATFORM_HEADER
+#include "External/Dqn.h"
+
+#if defined(DQN_IS_WIN32)
+    #define BENCH_PATH_SEP "\\"
+#else
+    #define BENCH_PATH_SEP "/"
+#endif
+
+struct BenchConfig
+{
+    char const *root          = "WPDBench";
+    char const *exe           = nullptr;
+    i32         num_tracks    = 2000;
+    i32         num_playlists = 20;
+    i32         playlist_size = 500;
+    f32         overlap       = 0.5f;
+    u32         seed          = 1;
+    i32         runs          = 1;
+    bool        strace        = false;
+    bool        generate      = true;
+    bool        run           = true;
+    bool        check_catalog = false;
+};
+
+enum struct BenchFormat
+{
+    MP3,
+    FLAC,
+    M4A,
+    OGG,
+    Count,
+};
+
+FILE_SCOPE char const *const BENCH_FORMAT_EXTENSION[] = {"mp3", "flac", "m4a", "ogg"};
+DQN_COMPILE_ASSERT(DQN_ARRAY_COUNT(BENCH_FORMAT_EXTENSION) == (int)BenchFormat::Count);
+
+// NOTE: Tags are stored as null-terminated UTF-8, an empty string means the tag is omitted from the file.
+struct BenchTags
+{
+    DqnFixedString256 title;
+    DqnFixedString256 artist;
+    DqnFixedString256 album;
+    DqnFixedString256 album_artist;
+    DqnFixedString32  date;
+    DqnFixedString64  genre;
+    i32               track;
+    i32               tracktotal;
+    i32               disc;
+};
+
+// Synthetic Tag Distributions
+// =================================================================================================
+// NOTE: UTF-8 is hex escaped so MSVC does not depend on the source code page. Names with characters
+// that are invalid on disk (/ : ?) are intentional, they exercise SanitiseStringForDiskFile.
+FILE_SCOPE char const *const BENCH_WORDS_A[] =
+{
+    "Midnight", "Silver", "Electric", "Velvet", "Golden", "Broken", "Crystal", "Neon", "Quiet", "Wild",
+    "Northern", "Hollow", "Paper", "Burning", "Lonely", "Analog", "Static", "Summer", "Winter", "Distant",
+};
+
+FILE_SCOPE char const *const BENCH_WORDS_B[] =
+{
+    "Echoes", "Harbor", "Garden", "Machine", "Horizon", "Riders", "Atlas", "Parade", "Signal", "Orchard",
+    "Lights", "Rivers", "Engines", "Ghosts", "Satellites", "Tides", "Mirrors", "Cities", "Wolves", "Lanterns",
+};
+
+FILE_SCOPE char const *const BENCH_WORDS_UNICODE[] =
+{
+    "Bj\xC3\xB6rk",                                     // Björk
+    "Sigur R\xC3\xB3s",                                 // Sigur Rós
+    "Mot\xC3\xB6rhead",                                 // Motörhead
+    "Caf\xC3\xA9",                                      // Café
+    "\xE5\x9D\x82\xE6\x9C\xAC \xE9\xBE\x8D\xE4\xB8\x80", // 坂本 龍一
+    "\xE3\x81\x82\xE3\x81\x84\xE3\x81\x86",             // あいう
+    "\xD0\x9C\xD1\x83\xD0\xBC\xD0\xB8\xD0\xB9",         // Мумий
+    "\xCE\x91\xCE\xB8\xCE\xAE\xCE\xBD\xCE\xB1",         // Αθήνα
+    "\xEC\x84\x9C\xEC\x9A\xB8",                         // 서울
+    "\xF0\x9F\x8E\xB5 Notes",                           // 🎵 Notes
+    "AC/DC",
+    "Live: Tokyo?",
+};
+
+// NOTE: Ordered by popularity, sampling is skewed towards the front of the list.
+FILE_SCOPE char const *const BENCH_GENRES[] =
+{
+    "Rock", "Pop", "Electronic", "Hip-Hop", "Jazz", "Metal", "Classical", "Folk", "Ambient", "Soundtrack",
+    "R&B", "Country", "Blues", "Reggae", "K-Pop", "J-Pop",
+};
+
+FILE_SCOPE char const *PickWord(DqnRndPCG *rng, char const *const *words, i32 num_words)
+{
+    char const *result = words[rng->Range(0, num_words - 1)];
+    return result;
+}
+
+// Make a 1-3 word name, with a chance of drawing a word from the unicode pool.
+template <int MAX>
+FILE_SCOPE void MakeName(DqnRndPCG *rng, DqnFixedString<MAX> *name, f32 unicode_chance)
+{
+    name->Clear();
+    i32 num_words = rng->Range(1, 3);
+    DQN_FOR_EACH(i, num_words)
+    {
+        char const *word = nullptr;
+        if      (rng->Nextf() < unicode_chance) word = PickWord(rng, BENCH_WORDS_UNICODE, DQN_ARRAY_COUNT(BENCH_WORDS_UNICODE));
+        else if (i % 2 == 0)                    word = PickWord(rng, BENCH_WORDS_A,       DQN_ARRAY_COUNT(BENCH_WORDS_A));
+        else                                    word = PickWord(rng, BENCH_WORDS_B,       DQN_ARRAY_COUNT(BENCH_WORDS_B));
+
+        if (i > 0) name->SprintfAppend(" ");
+        name->SprintfAppend("%s", word);
+    }
+}
+
+FILE_SCOPE BenchFormat PickFormat(DqnRndPCG *rng)
+{
+    f32 roll = rng->Nextf();
+    if (roll < 0.45f) return BenchFormat::MP3;
+    if (roll < 0.80f) return BenchFormat::FLAC;
+    if (roll < 0.92f) return BenchFormat::M4A;
+    return BenchFormat::OGG;
+}
+
+// Disk Helpers
+// =================================================================================================
+FILE_SCOPE void MakeDir(char const *path)
+{
+#if defined(DQN_IS_WIN32)
+    wchar_t wide_path[1024];
+    DqnWin32_UTF8ToWChar(path, wide_path, DQN_ARRAY_COUNT(wide_path));
+    CreateDirectoryW(wide_path, nullptr);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+// NOTE: Destructive while running, path is restored on return.
+FILE_SCOPE void MakeDirRecursive(char *path)
+{
+    for (char *ptr = path + 1; *ptr; ++ptr)
+    {
+        if (*ptr != '/' && *ptr != '\\')
+            continue;
+
+        char tmp = *ptr;
+        *ptr     = 0;
+        MakeDir(path);
+        *ptr     = tmp;
+    }
+    MakeDir(path);
+}
+
+// Same rules as SanitiseStringForDiskFile in the pipeline.
+template <int MAX>
+FILE_SCOPE void SanitiseForDisk(DqnFixedString<MAX> *string)
+{
+    DQN_FOR_EACH(i, string->len)
+    {
+        switch (string->str[i])
+        {
+            case '?':
+            case ':':
+            case '\\':
+            case '/':
+            case '<':
+            case '>':
+            case '*':
+            case '|':
+            case '"':
+                string->str[i] = ' ';
+                break;
+        }
+    }
+}
+
+// Byte Writers
+// =================================================================================================
+FILE_SCOPE void PushU8   (DqnArray<u8> *buf, u8 val)                 { buf->Push(val); }
+FILE_SCOPE void PushBytes(DqnArray<u8> *buf, void const *src, isize len) { buf->Push(static_cast<u8 const *>(src), len); }
+FILE_SCOPE void PushStr  (DqnArray<u8> *buf, char const *str)        { PushBytes(buf, str, DqnStr_Len(str)); }
+FILE_SCOPE void PushZero (DqnArray<u8> *buf, isize len)              { u8 *dest = buf->Make(len); DqnMem_Set(dest, 0, len); }
+FILE_SCOPE void PushU16BE(DqnArray<u8> *buf, u16 val)                { PushU8(buf, (u8)(val >> 8)); PushU8(buf, (u8)val); }
+FILE_SCOPE void PushU32BE(DqnArray<u8> *buf, u32 val)                { PushU16BE(buf, (u16)(val >> 16)); PushU16BE(buf, (u16)val); }
+FILE_SCOPE void PushU64BE(DqnArray<u8> *buf, u64 val)                { PushU32BE(buf, (u32)(val >> 32)); PushU32BE(buf, (u32)val); }
+FILE_SCOPE void PushU16LE(DqnArray<u8> *buf, u16 val)                { PushU8(buf, (u8)val); PushU8(buf, (u8)(val >> 8)); }
+FILE_SCOPE void PushU32LE(DqnArray<u8> *buf, u32 val)                { PushU16LE(buf, (u16)val); PushU16LE(buf, (u16)(val >> 16)); }
+FILE_SCOPE void PushU64LE(DqnArray<u8> *buf, u64 val)                { PushU32LE(buf, (u32)val); PushU32LE(buf, (u32)(val >> 32)); }
+
+FILE_SCOPE void PatchU32BE(DqnArray<u8> *buf, isize offset, u32 val)
+{
+    buf->data[offset + 0] = (u8)(val >> 24);
+    buf->data[offset + 1] = (u8)(val >> 16);
+    buf->data[offset + 2] = (u8)(val >> 8);
+    buf->data[offset + 3] = (u8)(val);
+}
+
+// MP3: ID3v2.4 tag followed by silent MPEG-1 Layer III frames
+// =================================================================================================
+FILE_SCOPE void PushU32Syncsafe(DqnArray<u8> *buf, u32 val)
+{
+    PushU8(buf, (u8)((val >> 21) & 0x7F));
+    PushU8(buf, (u8)((val >> 14) & 0x7F));
+    PushU8(buf, (u8)((val >> 7)  & 0x7F));
+    PushU8(buf, (u8)((val >> 0)  & 0x7F));
+}
+
+FILE_SCOPE void PushID3TextFrame(DqnArray<u8> *buf, char const *id, char const *text)
+{
+    i32 text_len = DqnStr_Len(text);
+    if (text_len == 0) return;
+
+    u8 const ID3_ENCODING_UTF8 = 3;
+    PushBytes(buf, id, 4);
+    PushU32Syncsafe(buf, 1 + text_len);
+    PushU16BE(buf, 0 /*flags*/);
+    PushU8(buf, ID3_ENCODING_UTF8);
+    PushBytes(buf, text, text_len);
+}
+
+FILE_SCOPE void WriteMP3(DqnArray<u8> *buf, BenchTags const *tags)
+{
+    DqnFixedString32 track = {};
+    DqnFixedString32 disc  = {};
+    if (tags->track) track.Sprintf("%d/%d", tags->track, tags->tracktotal);
+    if (tags->disc)  disc.Sprintf("%d", tags->disc);
+
+    PushStr(buf, "ID3");
+    PushU8(buf, 4); // Version 2.4
+    PushU8(buf, 0); // Revision
+    PushU8(buf, 0); // Flags
+    isize size_offset = buf->len;
+    PushU32BE(buf, 0); // Patched below with the syncsafe tag size
+
+    isize frames_start = buf->len;
+    PushID3TextFrame(buf, "TIT2", tags->title.str);
+    PushID3TextFrame(buf, "TPE1", tags->artist.str);
+    PushID3TextFrame(buf, "TALB", tags->album.str);
+    PushID3TextFrame(buf, "TPE2", tags->album_artist.str);
+    PushID3TextFrame(buf, "TDRC", tags->date.str);
+    PushID3TextFrame(buf, "TCON", tags->genre.str);
+    PushID3TextFrame(buf, "TRCK", track.str);
+    PushID3TextFrame(buf, "TPOS", disc.str);
+
+    u32 tag_size = (u32)(buf->len - frames_start);
+    buf->data[size_offset + 0] = (u8)((tag_size >> 21) & 0x7F);
+    buf->data[size_offset + 1] = (u8)((tag_size >> 14) & 0x7F);
+    buf->data[size_offset + 2] = (u8)((tag_size >> 7)  & 0x7F);
+    buf->data[size_offset + 3] = (u8)((tag_size >> 0)  & 0x7F);
+
+    // NOTE: MPEG-1 Layer III, 128kbps, 44.1kHz, joint stereo, no CRC. A zeroed side info and main
+    // data decodes to silence. Frame length = 144 * 128000 / 44100 = 417 bytes.
+    u32 const FRAME_HEADER = 0xFFFB9064;
+    i32 const FRAME_LEN    = 417;
+    i32 const NUM_FRAMES   = 4;
+    DQN_FOR_EACH(i, NUM_FRAMES)
+    {
+        PushU32BE(buf, FRAME_HEADER);
+        PushZero(buf, FRAME_LEN - 4);
+    }
+}
+
+// FLAC: STREAMINFO and VORBIS_COMMENT metadata blocks
+// =================================================================================================
+FILE_SCOPE void PushVorbisComment(DqnArray<u8> *buf, char const *key, char const *value, u32 *count)
+{
+    i32 value_len = DqnStr_Len(value);
+    if (value_len == 0) return;
+
+    i32 key_len = DqnStr_Len(key);
+    PushU32LE(buf, key_len + 1 + value_len);
+    PushBytes(buf, key, key_len);
+    PushU8(buf, '=');
+    PushBytes(buf, value, value_len);
+    (*count)++;
+}
+
+// Vorbis comment payload shared by FLAC and Ogg, the "OpusTags" magic is prepended by the caller.
+FILE_SCOPE void PushVorbisComments(DqnArray<u8> *buf, BenchTags const *tags)
+{
+    char const VENDOR[] = "WPDBench";
+    PushU32LE(buf, DQN_CHAR_COUNT(VENDOR));
+    PushBytes(buf, VENDOR, DQN_CHAR_COUNT(VENDOR));
+
+    isize count_offset = buf->len;
+    PushU32LE(buf, 0);
+
+    DqnFixedString16 track      = {};
+    DqnFixedString16 tracktotal = {};
+    DqnFixedString16 disc       = {};
+    if (tags->track)      track.Sprintf("%d", tags->track);
+    if (tags->tracktotal) tracktotal.Sprintf("%d", tags->tracktotal);
+    if (tags->disc)       disc.Sprintf("%d", tags->disc);
+
+    u32 count = 0;
+    PushVorbisComment(buf, "TITLE",       tags->title.str,        &count);
+    PushVorbisComment(buf, "ARTIST",      tags->artist.str,       &count);
+    PushVorbisComment(buf, "ALBUM",       tags->album.str,        &count);
+    PushVorbisComment(buf, "ALBUMARTIST", tags->album_artist.str, &count);
+    PushVorbisComment(buf, "DATE",        tags->date.str,         &count);
+    PushVorbisComment(buf, "GENRE",       tags->genre.str,        &count);
+    PushVorbisComment(buf, "TRACKNUMBER", track.str,              &count);
+    PushVorbisComment(buf, "TRACKTOTAL",  tracktotal.str,         &count);
+    PushVorbisComment(buf, "DISCNUMBER",  disc.str,               &count);
+
+    buf->data[count_offset + 0] = (u8)(count);
+    buf->data[count_offset + 1] = (u8)(count >> 8);
+    buf->data[count_offset + 2] = (u8)(count >> 16);
+    buf->data[count_offset + 3] = (u8)(count >> 24);
+}
+
+FILE_SCOPE void WriteFLAC(DqnArray<u8> *buf, BenchTags const *tags)
+{
+    u8 const FLAC_BLOCK_STREAMINFO     = 0;
+    u8 const FLAC_BLOCK_VORBIS_COMMENT = 4;
+    u8 const FLAC_BLOCK_LAST           = 0x80;
+
+    PushStr(buf, "fLaC");
+
+    // STREAMINFO: 4096 sample blocks, 44.1kHz, stereo, 16 bit, unknown number of samples
+    PushU8(buf, FLAC_BLOCK_STREAMINFO);
+    PushU8(buf, 0); PushU16BE(buf, 34); // 24 bit block length
+    PushU16BE(buf, 4096); // Min block size
+    PushU16BE(buf, 4096); // Max block size
+    PushZero(buf, 3);     // Min frame size
+    PushZero(buf, 3);     // Max frame size
+    u64 const sample_rate = 44100, channels = 2, bits_per_sample = 16, total_samples = 0;
+    PushU64BE(buf, (sample_rate << 44) | ((channels - 1) << 41) | ((bits_per_sample - 1) << 36) | total_samples);
+    PushZero(buf, 16); // MD5
+
+    PushU8(buf, FLAC_BLOCK_VORBIS_COMMENT | FLAC_BLOCK_LAST);
+    isize len_offset = buf->len;
+    PushZero(buf, 3);
+    isize block_start = buf->len;
+    PushVorbisComments(buf, tags);
+    u32 block_len = (u32)(buf->len - block_start);
+    buf->data[len_offset + 0] = (u8)(block_len >> 16);
+    buf->data[len_offset + 1] = (u8)(block_len >> 8);
+    buf->data[len_offset + 2] = (u8)(block_len);
+}
+
+// OGG: Ogg Opus, OpusHead and OpusTags header pages and a single silent packet
+// =================================================================================================
+FILE_SCOPE u32 OggCRC(u8 const *data, isize len)
+{
+    LOCAL_PERSIST u32 table[256];
+    LOCAL_PERSIST bool table_init;
+    if (!table_init)
+    {
+        DQN_FOR_EACH(i, 256)
+        {
+            u32 r = (u32)i << 24;
+            DQN_FOR_EACH(bit, 8) r = (r & 0x80000000) ? ((r << 1) ^ 0x04C11DB7) : (r << 1);
+            table[i] = r;
+        }
+        table_init = true;
+    }
+
+    u32 result = 0;
+    DQN_FOR_EACH(i, len) result = (result << 8) ^ table[((result >> 24) & 0xFF) ^ data[i]];
+    return result;
+}
+
+FILE_SCOPE void PushOggPage(DqnArray<u8> *buf, u8 header_type, u64 granule, u32 seq_no, u8 const *packet, isize packet_len)
+{
+    u32 const SERIAL = 0x57504442; // "WPDB"
+    isize page_start = buf->len;
+    PushStr(buf, "OggS");
+    PushU8(buf, 0); // Version
+    PushU8(buf, header_type);
+    PushU64LE(buf, granule);
+    PushU32LE(buf, SERIAL);
+    PushU32LE(buf, seq_no);
+    isize crc_offset = buf->len;
+    PushU32LE(buf, 0);
+
+    isize num_segments = (packet_len / 255) + 1;
+    DQN_ASSERTM(num_segments <= 255, "Packet too large for a single page: %zu", packet_len);
+    PushU8(buf, (u8)num_segments);
+    DQN_FOR_EACH(i, num_segments - 1) PushU8(buf, 255);
+    PushU8(buf, (u8)(packet_len % 255));
+    PushBytes(buf, packet, packet_len);
+
+    u32 crc = OggCRC(buf->data + page_start, buf->len - page_start);
+    buf->data[crc_offset + 0] = (u8)(crc);
+    buf->data[crc_offset + 1] = (u8)(crc >> 8);
+    buf->data[crc_offset + 2] = (u8)(crc >> 16);
+    buf->data[crc_offset + 3] = (u8)(crc >> 24);
+}
+
+FILE_SCOPE void WriteOGG(DqnArray<u8> *buf, BenchTags const *tags)
+{
+    u8 const OGG_BOS = 0x02;
+    u8 const OGG_EOS = 0x04;
+    u16 const PRE_SKIP = 312;
+
+    DqnArray<u8> packet = {};
+    DQN_DEFER { packet.Free(); };
+
+    PushStr(&packet, "OpusHead");
+    PushU8(&packet, 1); // Version
+    PushU8(&packet, 2); // Channels
+    PushU16LE(&packet, PRE_SKIP);
+    PushU32LE(&packet, 48000);
+    PushU16LE(&packet, 0); // Output gain
+    PushU8(&packet, 0);    // Channel mapping family
+    PushOggPage(buf, OGG_BOS, 0, 0, packet.data, packet.len);
+
+    packet.Clear();
+    PushStr(&packet, "OpusTags");
+    PushVorbisComments(&packet, tags);
+    PushOggPage(buf, 0, 0, 1, packet.data, packet.len);
+
+    // NOTE: TOC byte for a 20ms CELT fullband stereo frame with an empty payload, i.e. DTX/silence.
+    u8 const silent_packet[] = {0xFC};
+    PushOggPage(buf, OGG_EOS, PRE_SKIP + 960, 2, silent_packet, DQN_ARRAY_COUNT(silent_packet));
+}
+
+// M4A: ftyp and moov with iTunes style udta/meta/ilst tags
+// =================================================================================================
+FILE_SCOPE isize BeginAtom(DqnArray<u8> *buf, char const *type)
+{
+    isize result = buf->len;
+    PushU32BE(buf, 0); // Size, patched in EndAtom
+    PushBytes(buf, type, 4);
+    return result;
+}
+
+FILE_SCOPE void EndAtom(DqnArray<u8> *buf, isize atom_start)
+{
+    PatchU32BE(buf, atom_start, (u32)(buf->len - atom_start));
+}
+
+FILE_SCOPE void PushILSTData(DqnArray<u8> *buf, char const *type, u32 data_type, void const *data, isize data_len)
+{
+    isize atom = BeginAtom(buf, type);
+    {
+        isize data_atom = BeginAtom(buf, "data");
+        PushU32BE(buf, data_type);
+        PushU32BE(buf, 0); // Locale
+        PushBytes(buf, data, data_len);
+        EndAtom(buf, data_atom);
+    }
+    EndAtom(buf, atom);
+}
+
+FILE_SCOPE void PushILSTText(DqnArray<u8> *buf, char const *type, char const *text)
+{
+    u32 const ILST_DATA_UTF8 = 1;
+    i32 text_len = DqnStr_Len(text);
+    if (text_len) PushILSTData(buf, type, ILST_DATA_UTF8, text, text_len);
+}
+
+FILE_SCOPE void WriteM4A(DqnArray<u8> *buf, BenchTags const *tags)
+{
+    isize ftyp = BeginAtom(buf, "ftyp");
+    PushStr(buf, "M4A ");
+    PushU32BE(buf, 0);
+    PushStr(buf, "M4A mp42isom");
+    EndAtom(buf, ftyp);
+
+    isize moov = BeginAtom(buf, "moov");
+    {
+        isize mvhd = BeginAtom(buf, "mvhd");
+        PushU32BE(buf, 0);          // Version and flags
+        PushU32BE(buf, 0);          // Creation time
+        PushU32BE(buf, 0);          // Modification time
+        PushU32BE(buf, 1000);       // Timescale
+        PushU32BE(buf, 0);          // Duration
+        PushU32BE(buf, 0x00010000); // Rate
+        PushU16BE(buf, 0x0100);     // Volume
+        PushZero(buf, 10);          // Reserved
+        u32 const matrix[] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+        for (u32 val : matrix) PushU32BE(buf, val);
+        PushZero(buf, 24);          // Pre-defined
+        PushU32BE(buf, 1);          // Next track id
+        EndAtom(buf, mvhd);
+
+        isize udta = BeginAtom(buf, "udta");
+        isize meta = BeginAtom(buf, "meta");
+        PushU32BE(buf, 0); // Version and flags
+        {
+            isize hdlr = BeginAtom(buf, "hdlr");
+            PushU32BE(buf, 0); // Version and flags
+            PushU32BE(buf, 0); // Pre-defined
+            PushStr(buf, "mdir");
+            PushStr(buf, "appl");
+            PushZero(buf, 8);  // Reserved
+            PushU8(buf, 0);    // Empty name
+            EndAtom(buf, hdlr);
+
+            isize ilst = BeginAtom(buf, "ilst");
+            PushILSTText(buf, "\xA9nam", tags->title.str);
+            PushILSTText(buf, "\xA9" "ART", tags->artist.str);
+            PushILSTText(buf, "\xA9" "alb", tags->album.str);
+            PushILSTText(buf, "aART",  tags->album_artist.str);
+            PushILSTText(buf, "\xA9" "day", tags->date.str);
+            PushILSTText(buf, "\xA9" "gen", tags->genre.str);
+
+            u32 const ILST_DATA_IMPLICIT = 0;
+            if (tags->track)
+            {
+                u8 trkn[8] = {0, 0, (u8)(tags->track >> 8), (u8)tags->track, (u8)(tags->tracktotal >> 8), (u8)tags->tracktotal, 0, 0};
+                PushILSTData(buf, "trkn", ILST_DATA_IMPLICIT, trkn, sizeof(trkn));
+            }
+
+            if (tags->disc)
+            {
+                u8 disk[6] = {0, 0, (u8)(tags->disc >> 8), (u8)tags->disc, 0, 0};
+                PushILSTData(buf, "disk", ILST_DATA_IMPLICIT, disk, sizeof(disk));
+            }
+            EndAtom(buf, ilst);
+        }
+        EndAtom(buf, meta);
+        EndAtom(buf, udta);
+    }
+    EndAtom(buf, moov);
+}
+
+// Library Generation
+// =================================================================================================
+struct BenchLibrary
+{
+    DqnMemStack             allocator;
+    DqnArray<DqnBuffer<char>> track_paths; // Absolute UTF-8 paths in generation order
+    usize                   total_bytes;
+};
+
+FILE_SCOPE DqnBuffer<char> PushPath(DqnMemStack *allocator, char const *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    DqnBuffer<char> result = {};
+    result.len             = Dqn_vsnprintf(nullptr, 0, fmt, va);
+    va_end(va);
+
+    va_start(va, fmt);
+    result.str = DQN_MEMSTACK_PUSH_ARRAY(allocator, char, result.len + 1);
+    Dqn_vsnprintf(result.str, result.len + 1, fmt, va);
+    va_end(va);
+    return result;
+}
+
+FILE_SCOPE void GenerateLibrary(BenchConfig const *config, char const *root, BenchLibrary *library)
+{
+    DqnRndPCG rng(config->seed);
+    DqnArray<u8> file_buf = {};
+    DQN_DEFER { file_buf.Free(); };
+    file_buf.Reserve(DQN_KILOBYTE(8));
+
+    library->track_paths.Reserve(config->num_tracks);
+    while (library->track_paths.len < config->num_tracks)
+    {
+        BenchTags artist_tags = {};
+        MakeName(&rng, &artist_tags.artist, 0.15f);
+        f32 genre_roll    = rng.Nextf();
+        char const *genre = BENCH_GENRES[(i32)(DQN_SQUARED(genre_roll) * DQN_ARRAY_COUNT(BENCH_GENRES))];
+
+        i32 num_albums = rng.Range(1, 4);
+        for (i32 album_index = 0; album_index < num_albums && library->track_paths.len < config->num_tracks; album_index++)
+        {
+            BenchTags album_tags = artist_tags;
+            MakeName(&rng, &album_tags.album, 0.10f);
+            if (rng.Nextf() < 0.90f) album_tags.album_artist = album_tags.artist;
+            if (rng.Nextf() < 0.95f) album_tags.date.Sprintf("%d", rng.Range(1960, 2019));
+            album_tags.genre      = genre;
+            album_tags.tracktotal = rng.Range(6, 16);
+            album_tags.disc       = (rng.Nextf() < 0.5f) ? 1 : 0;
+
+            BenchFormat format = PickFormat(&rng);
+
+            DqnFixedString256 artist_dir = album_tags.artist;
+            DqnFixedString256 album_dir  = album_tags.album;
+            SanitiseForDisk(&artist_dir);
+            SanitiseForDisk(&album_dir);
+
+            DqnFixedString1024 dir = {};
+            dir.Sprintf("%s" BENCH_PATH_SEP "Library" BENCH_PATH_SEP "%s" BENCH_PATH_SEP "%s", root, artist_dir.str, album_dir.str);
+            MakeDirRecursive(dir.str);
+
+            for (i32 track = 1; track <= album_tags.tracktotal && library->track_paths.len < config->num_tracks; track++)
+            {
+                BenchTags tags = album_tags;
+                tags.track     = track;
+                MakeName(&rng, &tags.title, 0.05f);
+
+                // NOTE: A small number of untagged files exercise the "no metadata" path
+                if (rng.Nextf() < 0.01f) tags = {};
+
+                DqnFixedString256 title_file = tags.title;
+                SanitiseForDisk(&title_file);
+
+                DqnBuffer<char> path = PushPath(&library->allocator,
+                                                "%s" BENCH_PATH_SEP "%02d %s.%s",
+                                                dir.str,
+                                                track,
+                                                title_file.str,
+                                                BENCH_FORMAT_EXTENSION[(int)format]);
+
+                file_buf.Clear();
+                switch (format)
+                {
+                    case BenchFormat::MP3:  WriteMP3 (&file_buf, &tags); break;
+                    case BenchFormat::FLAC: WriteFLAC(&file_buf, &tags); break;
+                    case BenchFormat::M4A:  WriteM4A (&file_buf, &tags); break;
+                    case BenchFormat::OGG:  WriteOGG (&file_buf, &tags); break;
+                    default: DQN_ASSERT(DQN_INVALID_CODE_PATH); break;
+                }
+
+                if (!DqnFile_WriteAll(path.str, file_buf.data, file_buf.len))
+                {
+                    fprintf(stderr, "WPDBench: Failed to write file: %s\n", path.str);
+                    continue;
+                }
+
+                library->total_bytes += file_buf.len;
+                library->track_paths.Push(path);
+            }
+        }
+    }
+}
+
+// Playlists draw "overlap" of their entries from a hot set shared by every playlist, i.e. the same
+// popular albums referenced across many playlists. The rest are drawn uniformly from the library.
+FILE_SCOPE i32 GeneratePlaylists(BenchConfig const *config, char const *root, BenchLibrary const *library)
+{
+    if (library->track_paths.len == 0) return 0;
+
+    DqnRndPCG rng(config->seed ^ 0x9E3779B9);
+    isize hot_set_len = DQN_MAX(DQN_MIN(library->track_paths.len, (isize)config->playlist_size), 1);
+
+    DqnFixedString1024 input_dir = {};
+    input_dir.Sprintf("%s" BENCH_PATH_SEP "Input", root);
+    MakeDirRecursive(input_dir.str);
+
+    DqnArray<u8> playlist_buf = {};
+    DQN_DEFER { playlist_buf.Free(); };
+
+    i32 result = 0;
+    DQN_FOR_EACH(playlist_index, config->num_playlists)
+    {
+        playlist_buf.Clear();
+        PushStr(&playlist_buf, "#EXTM3U\n");
+        DQN_FOR_EACH(entry_index, config->playlist_size)
+        {
+            f32 roll = rng.Nextf();
+            if (roll < 0.01f)
+            {
+                // NOTE: Dead entries exercise the existence check
+                DqnFixedString1024 missing = {};
+                missing.Sprintf("%s" BENCH_PATH_SEP "Library" BENCH_PATH_SEP "missing_%d.mp3\n", root, (i32)entry_index);
+                PushBytes(&playlist_buf, missing.str, missing.len);
+                continue;
+            }
+
+            isize track_index = 0;
+            if (rng.Nextf() < config->overlap) track_index = (isize)(rng.Nextf() * hot_set_len);
+            else                               track_index = (isize)(rng.Nextf() * library->track_paths.len);
+            track_index = DQN_MIN(track_index, library->track_paths.len - 1);
+
+            DqnBuffer<char> const *path = &library->track_paths.data[track_index];
+            PushBytes(&playlist_buf, path->str, path->len);
+            PushU8(&playlist_buf, '\n');
+        }
+
+        DqnFixedString1024 playlist_path = {};
+        playlist_path.Sprintf("%s" BENCH_PATH_SEP "Bench_%03d.m3u", input_dir.str, (i32)playlist_index);
+        if (DqnFile_WriteAll(playlist_path.str, playlist_buf.data, playlist_buf.len))
+            result++;
+        else
+            fprintf(stderr, "WPDBench: Failed to write playlist: %s\n", playlist_path.str);
+    }
+
+    return result;
+}
+
+// Pipeline Execution
+// =================================================================================================
+struct BenchRunResult
+{
+    bool launched;
+    i32  exit_code;
+    f64  wall_time_ms;
+    u64  peak_memory_bytes;
+    u64  read_ops;
+    u64  write_ops;
+    u64  other_ops;  // Win32: non read/write I/O operations
+    i64  syscalls;   // Unix: from strace, -1 if unavailable
+};
+
+FILE_SCOPE BenchRunResult RunPipeline(char const *root, char const *exe, bool strace)
+{
+    BenchRunResult result = {};
+    result.syscalls       = -1;
+
+#if defined(DQN_IS_WIN32)
+    (void)strace;
+    wchar_t cmd_line[2048];
+    wchar_t working_dir[1024];
+    DqnWin32_UTF8ToWChar(exe,  cmd_line,    DQN_ARRAY_COUNT(cmd_line));
+    DqnWin32_UTF8ToWChar(root, working_dir, DQN_ARRAY_COUNT(working_dir));
+
+    STARTUPINFOW startup_info       = {};
+    startup_info.cb                 = sizeof(startup_info);
+    PROCESS_INFORMATION proc_info   = {};
+    f64 start_ms                    = DqnTimer_NowInMs();
+    if (!CreateProcessW(nullptr, cmd_line, nullptr, nullptr, FALSE, 0, nullptr, working_dir, &startup_info, &proc_info))
+    {
+        fprintf(stderr, "WPDBench: CreateProcessW failed: %s\n", DqnWin32_GetLastError());
+        return result;
+    }
+    DQN_DEFER { CloseHandle(proc_info.hThread); CloseHandle(proc_info.hProcess); };
+
+    WaitForSingleObject(proc_info.hProcess, INFINITE);
+    result.wall_time_ms = DqnTimer_NowInMs() - start_ms;
+    result.launched     = true;
+
+    DWORD exit_code = 0;
+    GetExitCodeProcess(proc_info.hProcess, &exit_code);
+    result.exit_code = (i32)exit_code;
+
+    PROCESS_MEMORY_COUNTERS mem_counters = {};
+    if (K32GetProcessMemoryInfo(proc_info.hProcess, &mem_counters, sizeof(mem_counters)))
+        result.peak_memory_bytes = mem_counters.PeakWorkingSetSize;
+
+    IO_COUNTERS io_counters = {};
+    if (GetProcessIoCounters(proc_info.hProcess, &io_counters))
+    {
+        result.read_ops  = io_counters.ReadOperationCount;
+        result.write_ops = io_counters.WriteOperationCount;
+        result.other_ops = io_counters.OtherOperationCount;
+    }
+
+#else
+    DqnFixedString2048 cmd         = {};
+    DqnFixedString1024 strace_file = {};
+    if (strace)
+    {
+        strace_file.Sprintf("%s/strace.txt", root);
+        cmd.Sprintf("strace -f -c -o '%s' %s", strace_file.str, exe);
+    }
+    else
+    {
+        cmd.Sprintf("%s", exe);
+    }
+
+    f64 start_ms = DqnTimer_NowInMs();
+    pid_t pid    = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "WPDBench: fork failed\n");
+        return result;
+    }
+
+    if (pid == 0)
+    {
+        if (chdir(root) != 0) _exit(127);
+        execl("/bin/sh", "sh", "-c", cmd.str, (char *)nullptr);
+        _exit(127);
+    }
+
+    int status           = 0;
+    struct rusage usage  = {};
+    wait4(pid, &status, 0, &usage);
+    result.wall_time_ms      = DqnTimer_NowInMs() - start_ms;
+    result.launched          = true;
+    result.exit_code         = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    result.peak_memory_bytes = (u64)usage.ru_maxrss * 1024; // NOTE: Linux reports kilobytes
+    result.read_ops          = (u64)usage.ru_inblock;
+    result.write_ops         = (u64)usage.ru_oublock;
+
+    // NOTE: strace -c ends with a summary line, "100.00 <seconds> <usecs/call> <calls> [errors] total"
+    if (strace)
+    {
+        usize buf_size = 0;
+        if (u8 *buf = DqnFile_ReadAll(strace_file.str, &buf_size))
+        {
+            DQN_DEFER { dqn_lib_context_.allocator->Free(buf, buf_size); };
+            char *ptr = reinterpret_cast<char *>(buf);
+            ptr[buf_size - 1] = 0;
+            while (char *line = Dqn_EatLine(&ptr, nullptr))
+            {
+                int line_len = DqnStr_Len(line);
+                if (!DqnStr_EndsWith(line, line_len, "total", 5))
+                    continue;
+
+                // NOTE: Columns are padded with a variable number of spaces, calls is the 4th column
+                char *column = line;
+                DQN_FOR_EACH(column_index, 3)
+                {
+                    while (*column && *column != ' ') column++;
+                    while (*column == ' ')            column++;
+                }
+                result.syscalls = Dqn_StrToI64(column, DqnStr_LenDelimitWith(column, ' '));
+            }
+        }
+    }
+#endif
+
+    return result;
+}
+
+struct BenchCatalogAsset
+{
+    char text[64];
+};
+
+DQN_CATALOG_LOAD_PROC(BenchCatalogLoad, BenchCatalogAsset)
+{
+    usize text_len = 0;
+    if (!DqnFile_Size(file.str, &text_len) || text_len >= sizeof(data->text))
+        return false;
+    return DqnFile_ReadAll(file.str, reinterpret_cast<u8 *>(data->text), text_len);
+}
+
+// Add a file to an event driven DqnCatalog by its bare name, change it and check the change is picked up.
+// The watch on "." reports the file as "./<name>", which has to resolve to the asset keyed as "<name>".
+FILE_SCOPE bool CheckCatalogReload(char const *root)
+{
+#if defined(DQN_IS_WIN32)
+    wchar_t wide_root[1024];
+    DqnWin32_UTF8ToWChar(root, wide_root, DQN_ARRAY_COUNT(wide_root));
+    if (!SetCurrentDirectoryW(wide_root)) return false;
+#else
+    if (chdir(root) != 0) return false;
+#endif
+
+    char const file[]   = "WPDBenchCatalog.txt";
+    char const before[] = "before";
+    char const after[]  = "after";
+    if (!DqnFile_WriteAll(file, reinterpret_cast<u8 const *>(before), sizeof(before)))
+        return false;
+    DQN_DEFER { DqnFile_Delete(file); };
+
+    DqnCatalog<BenchCatalogAsset, BenchCatalogLoad> catalog = {};
+    DQN_DEFER { catalog.Free(); };
+    if (!catalog.Init())
+    {
+        fprintf(stderr, "WPDBench: File watches are unavailable, the catalog polls instead\n");
+        return false;
+    }
+
+    BenchCatalogAsset *asset = catalog.GetIfUpdated(file);
+    if (!asset || DqnStr_Cmp(asset->text, before) != 0)
+        return false;
+
+    if (!DqnFile_WriteAll(file, reinterpret_cast<u8 const *>(after), sizeof(after)))
+        return false;
+
+    f64 deadline_ms = DqnTimer_NowInMs() + 2000;
+    while (DqnTimer_NowInMs() < deadline_ms)
+    {
+        catalog.PollAssets();
+        if ((asset = catalog.GetIfUpdated(file)))
+            return DqnStr_Cmp(asset->text, after) == 0;
+#if defined(DQN_IS_WIN32)
+        Sleep(10);
+#else
+        usleep(10 * 1000);
+#endif
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config = {};
+    for (int arg_index = 1; arg_index < argc; arg_index++)
+    {
+        char const *arg   = argv[arg_index];
+        char const *value = (arg_index + 1 < argc) ? argv[arg_index + 1] : "";
+        i32 value_len     = DqnStr_Len(value);
+
+        if      (DqnStr_Cmp(arg, "--root")          == 0) { config.root          = value; arg_index++; }
+        else if (DqnStr_Cmp(arg, "--exe")           == 0) { config.exe           = value; arg_index++; }
+        else if (DqnStr_Cmp(arg, "--tracks")        == 0) { config.num_tracks    = (i32)Dqn_StrToI64(value, value_len); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--playlists")     == 0) { config.num_playlists = (i32)Dqn_StrToI64(value, value_len); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--playlist-size") == 0) { config.playlist_size = (i32)Dqn_StrToI64(value, value_len); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--overlap")       == 0) { config.overlap       = DQN_CLAMP(Dqn_StrToF32(value, value_len), 0.f, 1.f); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--seed")          == 0) { config.seed          = (u32)Dqn_StrToI64(value, value_len); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--runs")          == 0) { config.runs          = (i32)Dqn_StrToI64(value, value_len); arg_index++; }
+        else if (DqnStr_Cmp(arg, "--strace")        == 0) { config.strace        = true;  }
+        else if (DqnStr_Cmp(arg, "--no-generate")   == 0) { config.generate      = false; }
+        else if (DqnStr_Cmp(arg, "--no-run")        == 0) { config.run           = false; }
+        else if (DqnStr_Cmp(arg, "--check-catalog") == 0) { config.check_catalog = true;  }
+        else
+        {
+            fprintf(stderr, "WPDBench: Unknown argument: %s, see the top of WPDBench.cpp for usage\n", arg);
+            return 1;
+        }
+    }
+
+    MakeDirRecursive(const_cast<char *>(config.root));
+
+    // NOTE: Playlists reference tracks by absolute path, the pipeline runs from inside the root
+    char root[1024] = {};
+#if defined(DQN_IS_WIN32)
+    {
+        wchar_t wide_root[1024];
+        wchar_t full_root[1024];
+        DqnWin32_UTF8ToWChar(config.root, wide_root, DQN_ARRAY_COUNT(wide_root));
+        GetFullPathNameW(wide_root, DQN_ARRAY_COUNT(full_root), full_root, nullptr);
+        DqnWin32_WCharToUTF8(full_root, root, DQN_ARRAY_COUNT(root));
+    }
+#else
+    if (!realpath(config.root, root))
+    {
+        fprintf(stderr, "WPDBench: Could not resolve root directory: %s\n", config.root);
+        return 1;
+    }
+#endif
+
+    if (config.check_catalog)
+    {
+        bool reloaded = CheckCatalogReload(root);
+        fprintf(stdout, "WPDBench: Catalog reload of a bare file name %s\n", reloaded ? "passed" : "FAILED");
+        return reloaded ? 0 : 1;
+    }
+
+    fprintf(stdout,
+            "WPDBench: root=%s tracks=%d playlists=%d playlist_size=%d overlap=%.2f seed=%u\n",
+            root, config.num_tracks, config.num_playlists, config.playlist_size, config.overlap, config.seed);
+
+    if (config.generate)
+    {
+        BenchLibrary library = {};
+        library.allocator    = DqnMemStack(DQN_MEGABYTE(4), Dqn::ZeroMem::No, 0, DqnMemTracker::None);
+        DQN_DEFER { library.track_paths.Free(); library.allocator.Free(); };
+
+        f64 start_ms      = DqnTimer_NowInMs();
+        GenerateLibrary(&config, root, &library);
+        i32 num_playlists = GeneratePlaylists(&config, root, &library);
+        f64 end_ms        = DqnTimer_NowInMs();
+
+        fprintf(stdout,
+                "Generate:  %zd files (%.2f MB), %d playlists in %.2f ms\n",
+                library.track_paths.len, library.total_bytes / (f64)DQN_MEGABYTE(1), num_playlists, end_ms - start_ms);
+    }
+
+    if (!config.run)
+        return 0;
+
+    DqnFixedString1024 exe = {};
+    if (config.exe)
+    {
+        exe = config.exe;
+    }
+    else
+    {
+#if defined(DQN_IS_WIN32)
+        wchar_t exe_path[1024];
+        DWORD exe_path_len = GetModuleFileNameW(nullptr, exe_path, DQN_ARRAY_COUNT(exe_path));
+        while (exe_path_len > 0 && exe_path[exe_path_len - 1] != '\\') exe_path_len--;
+        exe_path[exe_path_len] = 0;
+
+        char exe_dir[1024];
+        DqnWin32_WCharToUTF8(exe_path, exe_dir, DQN_ARRAY_COUNT(exe_dir));
+        exe.Sprintf("\"%sWPDPlayground.exe\"", exe_dir);
+#else
+        fprintf(stderr, "WPDBench: --exe is required on this platform, i.e. --exe \"wine /path/to/WPDPlayground.exe\"\n");
+        return 1;
+#endif
+    }
+
+    DQN_FOR_EACH(run_index, config.runs)
+    {
+        // NOTE: The pipeline prints its per-stage table to the inherited stdout and also dumps it to
+        // <root>/WPDBenchStats_run<N>.json for diffing between runs.
+        DqnFixedString1024 run_cmd = {};
+        run_cmd.Sprintf("%s --stats-json WPDBenchStats_run%d.json", exe.str, (i32)run_index + 1);
+
+        BenchRunResult run = RunPipeline(root, run_cmd.str, config.strace);
+        if (!run.launched)
+            return 1;
+
+        fprintf(stdout,
+                "Run %-3d    exit=%d wall=%.2f ms peak_mem=%.2f MB read_ops=%llu write_ops=%llu other_ops=%llu",
+                (i32)run_index + 1,
+                run.exit_code,
+                run.wall_time_ms,
+                run.peak_memory_bytes / (f64)DQN_MEGABYTE(1),
+                (unsigned long long)run.read_ops,
+                (unsigned long long)run.write_ops,
+                (unsigned long long)run.other_ops);
+        if (run.syscalls >= 0) fprintf(stdout, " syscalls=%lld", (long long)run.syscalls);
+        fprintf(stdout, "\n");
+    }
+
+    return 0;
+}
@@ -1,30 +1,539 @@
 #define WIN32_MEAN_AND_LEAN
 #include <Windows.h>
 #include <comdef.h>
+#include <emmintrin.h>
+#include <math.h>
 #include <stdio.h>
+#include <time.h>
 
 #pragma warning(push)
 #pragma warning(disable: 4244) // 'return': conversion from 'int' to 'uint8_t', possible loss of data
 extern "C"
 {
+#include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/audio_fifo.h>
 #include <libavutil/dict.h>
+#include <libavutil/mem.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
 }
 #pragma warning(pop)
 
 #define DQN_PLATFORM_HEADER
 #include "External/Dqn.h"
 
+#define STAGES \
+    X(IndexLoad,       "index_load") \
+    X(LibraryScan,     "library_scan") \
+    X(PlaylistParse,   "playlist_parse") \
+    X(Search,          "search") \
+    X(QueryEval,       "query_eval") \
+    X(ExistenceCheck,  "existence_check") \
+    X(MetadataExtract, "metadata_extract") \
+    X(BuildPath,       "build_path") \
+    X(MakeDir,         "make_dir") \
+    X(Link,            "link") \
+    X(Copy,            "copy") \
+    X(Analyse,         "analyse") \
+    X(Art,             "art") \
+    X(Transcode,       "transcode") \
+    X(WriteM3U,        "write_m3u") \
+    X(IndexWrite,      "index_write")
+
+#define X(stage, name) stage,
+enum struct Stage { STAGES Count };
+#undef X
+
+#define X(stage, name) name,
+FILE_SCOPE char const *const STAGE_NAMES[] = {STAGES};
+#undef X
+#undef STAGES
+
+struct StageStats
+{
+    u64 elapsed_ns;
+    i64 items;
+    i64 bytes;    // Bytes read by the stage, or written for Stage::WriteM3U
+    i64 failures;
+};
+
+struct PipelineStats
+{
+    StageStats stages[(int)Stage::Count];
+    u64        start_ns;
+    i64        output_tiers[(int)DqnFileCopyTier::Count]; // Sounds put into Output by each tier
+
+    StageStats *operator[](Stage stage) { return stages + (int)stage; }
+};
+
+// Accumulates wall time into a stage for the lifetime of the scope. Scopes nest exclusively, opening
+// a scope pauses the enclosing one so time is only ever attributed to the innermost stage.
+struct StageScope
+{
+     StageScope(PipelineStats *stats_, Stage stage_);
+    ~StageScope();
+
+    PipelineStats *stats;
+    Stage          stage;
+    u64            start_ns;
+    StageScope    *parent;
+    bool           traced;
+};
+
+#define STAGE_SCOPE(stats, stage) StageScope DQN_UNIQUE_NAME(stage_scope_)(stats, stage)
+
+struct LibraryIndex;
+struct LibraryIndexBuilder;
+struct TrigramIndex;
+struct StatCache;
+struct TranscodeTarget;
+struct TranscodeCache;
+struct WaveformStore;
+struct FingerprintIndex;
+struct ArtStore;
+
 struct Context
 {
     DqnLogger          logger;
     DqnMemStack        allocator;
     DqnBuffer<wchar_t> exe_name;
     DqnBuffer<wchar_t> exe_directory;
+    PipelineStats      stats;
+    DqnFileBatch       file_batch;
+    DqnJobQueue       *job_queue;
+    u32                num_workers; // Threads servicing job_queue, excluding the main thread
+    i64                copy_budget_bytes; // Upper bound of file data being copied into Output at once
+    isize              stream_chunk_size; // Playlist entries synced at a time, 0 syncs a playlist whole
+    TranscodeTarget   *transcode;         // (Optional) Sounds in other formats are transcoded to it rather than linked
+    TranscodeCache    *transcode_cache;   // Set if transcode is, where the transcodes are written and linked from
+    bool               analyse_loudness;  // Measure the loudness of sounds the index has none for
+    bool               detect_silence;    // Find the leading and trailing silence of sounds the index has none for
+    WaveformStore     *waveforms;         // (Optional) Waveforms are made for the sounds it has none for
+    FingerprintIndex  *fingerprints;      // (Optional) Near duplicates of a sound already synced are listed as its output
+    ArtStore          *art;               // (Optional) Front covers are stored in it and linked as each album's folder art
+
+    LibraryIndex        *index;          // Index written by the previous run, empty if there was none
+    LibraryIndexBuilder *index_builder;  // Index of this run, every sound made is added to it
+    i64                  num_index_hits; // Sounds whose metadata came from the index
+    u64                  start_time_in_s; // Wall clock at startup, in seconds since the Unix epoch
+    TrigramIndex        *search_index;    // Over the searchable tags of index_builder, for search: playlist entries
+    StatCache           *stat_cache;      // Every stat of the run goes through this
 };
 
 FILE_SCOPE DqnVArray<char> global_logger_buf;
 FILE_SCOPE DqnMemStack global_func_local_allocator_;
+FILE_SCOPE StageScope *global_stage_scope_;
+FILE_SCOPE DqnJob global_jobs_[256];
+FILE_SCOPE DqnJobQueue global_job_queue_; // NOTE(doyle): Global, worker threads outlive main()
+
+// Live Metrics
+// =================================================================================================
+// Progress of the run whilst it's running, long runs over a network share are otherwise silent until
+// the stats at exit. Counters bumped off the main thread (lanes, workers, the file batch) are relaxed
+// atomics, they're independent totals so nothing is ordered by them. The rest is read from the
+// pipeline stats, which only the main thread writes. A publisher thread takes a snapshot every interval
+// and rewrites the live stats file (written beside it and renamed over it, so a reader never sees half
+// a file) and/or prints a progress line to stderr. Both are one snapshot per line of key=value pairs or
+// one JSON object, meant to be scraped.
+#define LIVE_COUNTERS \
+    X(EntriesParsed, "entries_parsed") /* Playlist entries and files found by library scans */ \
+    X(BytesRead,     "bytes_read")     /* Of sounds, by metadata extraction, analysis and transcodes */ \
+    X(IoInFlight,    "io_in_flight")   /* File batch ops submitted and not completed, and copies running */
+
+#define X(counter, name) counter,
+enum struct LiveCounter { LIVE_COUNTERS Count };
+#undef X
+
+#define X(counter, name) name,
+FILE_SCOPE char const *const LIVE_COUNTER_NAMES[] = {LIVE_COUNTERS};
+#undef X
+
+struct LiveMetrics
+{
+    i64 volatile counters[(int)LiveCounter::Count];
+    i32 volatile stage; // Innermost open Stage, -1 between stages
+};
+
+FILE_SCOPE LiveMetrics global_live_metrics_ = {{}, -1};
+
+FILE_SCOPE void LiveMetrics_Add(LiveCounter counter, i64 value)
+{
+    InterlockedExchangeAddNoFence64(&global_live_metrics_.counters[(int)counter], value);
+}
+
+struct LiveMetricsSnapshot
+{
+    f64         elapsed_s;
+    i64         counters[(int)LiveCounter::Count];
+    char const *stage;
+    i64         probed;      // Sounds opened for metadata, i.e. not from the index
+    i64         linked;      // Outputs linked or copied into Output
+    i64         failed;      // Of every stage
+    i32         jobs_queued; // Waiting on the job queue
+};
+
+// NOTE(doyle): The pipeline stats are written by the main thread whilst this runs, the reads are
+// volatile so each is a single load of the current value.
+FILE_SCOPE void LiveMetrics_Snapshot(Context const *context, LiveMetricsSnapshot *snapshot)
+{
+    auto const volatile *stats = &context->stats;
+    *snapshot                  = {};
+    snapshot->elapsed_s        = (DqnTimer_NowInNs() - stats->start_ns) / 1000000000.0;
+    DQN_FOR_EACH(counter, LiveCounter::Count)
+        snapshot->counters[counter] = global_live_metrics_.counters[counter];
+
+    i32 stage         = global_live_metrics_.stage;
+    snapshot->stage   = (stage >= 0 && stage < (i32)Stage::Count) ? STAGE_NAMES[stage] : "none";
+    snapshot->probed  = stats->stages[(int)Stage::MetadataExtract].items - *static_cast<i64 const volatile *>(&context->num_index_hits);
+    DQN_FOR_EACH(stage_index, Stage::Count)
+        snapshot->failed += stats->stages[stage_index].failures;
+    for (int tier = (int)DqnFileCopyTier::HardLink; tier < (int)DqnFileCopyTier::Count; tier++)
+        snapshot->linked += stats->output_tiers[tier];
+    snapshot->jobs_queued = (context->job_queue) ? context->job_queue->num_jobs_queued : 0;
+}
+
+struct LiveMetricsPublisher
+{
+    Context const *context;
+    char const    *json_path;    // (Optional) Rewritten every interval
+    char          *partial_path; // json_path is written here then renamed over it
+    bool           progress;     // Print a progress line to stderr every interval
+    u32            interval_ms;
+    HANDLE         stop_event;
+    HANDLE         thread;
+};
+
+FILE_SCOPE void LiveMetricsPublisher_Publish(LiveMetricsPublisher *publisher)
+{
+    LiveMetricsSnapshot snapshot = {};
+    LiveMetrics_Snapshot(publisher->context, &snapshot);
+
+    char line[1024];
+    if (publisher->json_path)
+    {
+        int line_len = Dqn_sprintf(line, "{\"elapsed_s\": %.3f, \"stage\": \"%s\", \"probed\": %lld, \"linked\": %lld, \"failed\": %lld, \"jobs_queued\": %d",
+                                   snapshot.elapsed_s, snapshot.stage, (long long)snapshot.probed, (long long)snapshot.linked, (long long)snapshot.failed, snapshot.jobs_queued);
+        DQN_FOR_EACH(counter, LiveCounter::Count)
+            line_len += Dqn_sprintf(line + line_len, ", \"%s\": %lld", LIVE_COUNTER_NAMES[counter], (long long)snapshot.counters[counter]);
+        line_len += Dqn_sprintf(line + line_len, "}\n");
+
+        // NOTE(doyle): Not DqnFile_WriteAll, it logs on failure and the logger is the main thread's
+        DqnFile file = {};
+        bool written = false;
+        if (file.Open(publisher->partial_path, DqnFile::Flag::FileWrite, DqnFile::Action::ForceCreate))
+        {
+            written = file.Write(reinterpret_cast<u8 *>(line), (usize)line_len) == (usize)line_len;
+            file.Close();
+        }
+        if (written) MoveFileExA(publisher->partial_path, publisher->json_path, MOVEFILE_REPLACE_EXISTING);
+    }
+
+    if (publisher->progress)
+    {
+        fprintf(stderr, "progress elapsed_s=%.1f stage=%s probed=%lld linked=%lld failed=%lld jobs_queued=%d", snapshot.elapsed_s, snapshot.stage,
+                (long long)snapshot.probed, (long long)snapshot.linked, (long long)snapshot.failed, snapshot.jobs_queued);
+        DQN_FOR_EACH(counter, LiveCounter::Count)
+            fprintf(stderr, " %s=%lld", LIVE_COUNTER_NAMES[counter], (long long)snapshot.counters[counter]);
+        fprintf(stderr, "\n");
+    }
+}
+
+FILE_SCOPE DWORD WINAPI LiveMetricsPublisher_Thread(void *user_data)
+{
+    auto *publisher = static_cast<LiveMetricsPublisher *>(user_data);
+    while (WaitForSingleObject(publisher->stop_event, publisher->interval_ms) == WAIT_TIMEOUT)
+        LiveMetricsPublisher_Publish(publisher);
+
+    // NOTE(doyle): The last snapshot is of the finished run
+    LiveMetricsPublisher_Publish(publisher);
+    return 0;
+}
+
+// return: False if the publisher's thread could not be started
+FILE_SCOPE bool LiveMetricsPublisher_Start(LiveMetricsPublisher *publisher, Context *context, char const *json_path, bool progress, u32 interval_ms)
+{
+    *publisher             = {};
+    publisher->context     = context;
+    publisher->json_path   = json_path;
+    publisher->progress    = progress;
+    publisher->interval_ms = DQN_MAX(interval_ms, 50u);
+    if (json_path)
+    {
+        publisher->partial_path = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, char, DqnStr_Len(json_path) + 6);
+        Dqn_sprintf(publisher->partial_path, "%s.part", json_path);
+    }
+
+    publisher->stop_event = CreateEventW(nullptr, true /*bManualReset*/, false /*bInitialState*/, nullptr);
+    if (!publisher->stop_event)
+        return false;
+
+    publisher->thread = CreateThread(nullptr, 0, LiveMetricsPublisher_Thread, publisher, 0, nullptr);
+    if (!publisher->thread)
+    {
+        CloseHandle(publisher->stop_event);
+        *publisher = {};
+        return false;
+    }
+
+    return true;
+}
+
+FILE_SCOPE void LiveMetricsPublisher_Stop(LiveMetricsPublisher *publisher)
+{
+    if (!publisher->thread)
+        return;
+
+    SetEvent(publisher->stop_event);
+    WaitForSingleObject(publisher->thread, INFINITE);
+    CloseHandle(publisher->thread);
+    CloseHandle(publisher->stop_event);
+    *publisher = {};
+}
+
+// Execute the ops on the file batch, counted as I/O in flight until they complete
+FILE_SCOPE void ExecuteFileOps(Context *context, DqnFileOp *ops, isize num_ops)
+{
+    LiveMetrics_Add(LiveCounter::IoInFlight, num_ops);
+    context->file_batch.Execute(ops, num_ops);
+    LiveMetrics_Add(LiveCounter::IoInFlight, -num_ops);
+}
+
+// Trace
+// =================================================================================================
+// With --trace <path> the begin and end of every stage scope, job callback and lane item is recorded
+// and written as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev) when the run finishes, to
+// see what each worker was doing. Each thread appends to its own buffer so recording takes no locks,
+// an event is a counter read and a store. Disabled, a trace point is a branch on a global that's never
+// taken. A full buffer drops its thread's events from then on.
+#define TRACE_MAX_THREADS      128
+#define TRACE_BUFFER_EVENTS    (256 * 1024) // Per thread
+#define TRACE_END_HEADROOM     64           // Events kept for the ends of open scopes once a buffer is nearly full
+
+struct TraceEvent
+{
+    i64         ticks; // QueryPerformanceCounter
+    char const *name;  // Static string
+    char        phase; // 'B'egin or 'E'nd
+};
+
+struct TraceBuffer
+{
+    TraceEvent  *events;
+    i32 volatile num_events;
+    i32          num_dropped;
+    char         thread_name[32];
+};
+
+struct TraceState
+{
+    bool         enabled;
+    i64          start_ticks;
+    TraceBuffer  buffers[TRACE_MAX_THREADS];
+    i32 volatile num_buffers;
+};
+
+FILE_SCOPE TraceState global_trace_;
+FILE_SCOPE thread_local TraceBuffer *global_trace_buffer_;
+
+// return: The thread's buffer, made on the thread's first event, nullptr if there's no room for it
+FILE_SCOPE TraceBuffer *Trace_ThreadBuffer()
+{
+    if (global_trace_buffer_)
+        return global_trace_buffer_;
+
+    i32 index = DqnAtomic_Add32(&global_trace_.num_buffers, 1) - 1;
+    if (index >= TRACE_MAX_THREADS)
+        return nullptr;
+
+    TraceBuffer *buffer = global_trace_.buffers + index;
+    buffer->events      = static_cast<TraceEvent *>(dqn_lib_context_.allocator->Malloc(sizeof(TraceEvent) * TRACE_BUFFER_EVENTS));
+    Dqn_sprintf(buffer->thread_name, "worker %d", index);
+    global_trace_buffer_ = buffer;
+    return buffer;
+}
+
+FILE_SCOPE void Trace_Record(char const *name, char phase)
+{
+    TraceBuffer *buffer = Trace_ThreadBuffer();
+    if (!buffer || !buffer->events)
+        return;
+
+    i32 limit = (phase == 'B') ? TRACE_BUFFER_EVENTS - TRACE_END_HEADROOM : TRACE_BUFFER_EVENTS;
+    if (buffer->num_events >= limit)
+    {
+        buffer->num_dropped++;
+        return;
+    }
+
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    TraceEvent *event = buffer->events + buffer->num_events;
+    event->ticks      = ticks.QuadPart;
+    event->name       = name;
+    event->phase      = phase;
+    buffer->num_events++;
+}
+
+// Name the calling thread in the trace, i.e. "main"
+FILE_SCOPE void Trace_NameThread(char const *name)
+{
+    if (!global_trace_.enabled)
+        return;
+
+    if (TraceBuffer *buffer = Trace_ThreadBuffer())
+        Dqn_sprintf(buffer->thread_name, "%.*s", (int)sizeof(buffer->thread_name) - 1, name);
+}
+
+struct TraceScope
+{
+    char const *name; // nullptr if tracing was disabled when the scope opened
+     TraceScope(char const *name_) { name = (global_trace_.enabled) ? name_ : nullptr; if (name) Trace_Record(name, 'B'); }
+    ~TraceScope()                  { if (name) Trace_Record(name, 'E'); }
+};
+
+#define TRACE_SCOPE(name) TraceScope DQN_UNIQUE_NAME(trace_scope_)(name)
+
+FILE_SCOPE void Trace_Begin()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    global_trace_.start_ticks = ticks.QuadPart;
+    global_trace_.enabled     = true;
+}
+
+// Stop recording and write every thread's events as trace event JSON. Threads must be done recording,
+// i.e. the job queue has been drained.
+FILE_SCOPE bool Trace_End(char const *path)
+{
+    global_trace_.enabled = false;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    f64 us_per_tick = 1000000.0 / (f64)frequency.QuadPart;
+
+    DqnArray<char> json = {};
+    DQN_DEFER { json.Free(); };
+
+    char line[512];
+    int line_len = Dqn_sprintf(line, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    json.Push(line, line_len);
+
+    i32 num_buffers = DQN_MIN(global_trace_.num_buffers, TRACE_MAX_THREADS);
+    i64 num_dropped = 0;
+    char const *separator = "";
+    DQN_FOR_EACH(buffer_index, num_buffers)
+    {
+        TraceBuffer *buffer = global_trace_.buffers + buffer_index;
+        i32 tid             = (i32)buffer_index + 1;
+        line_len = Dqn_sprintf(line, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", separator, tid, buffer->thread_name);
+        json.Push(line, line_len);
+        separator = ",\n";
+
+        DQN_FOR_EACH(event_index, buffer->num_events)
+        {
+            TraceEvent const *event = buffer->events + event_index;
+            line_len = Dqn_sprintf(line, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f}",
+                                   event->name, event->phase, tid, (event->ticks - global_trace_.start_ticks) * us_per_tick);
+            json.Push(line, line_len);
+        }
+
+        num_dropped += buffer->num_dropped;
+        if (buffer->events) dqn_lib_context_.allocator->Free(buffer->events, sizeof(TraceEvent) * TRACE_BUFFER_EVENTS);
+        *buffer = {};
+    }
+
+    line_len = Dqn_sprintf(line, "\n], \"otherData\": {\"dropped_events\": %lld}}\n", (long long)num_dropped);
+    json.Push(line, line_len);
+    return DqnFile_WriteAll(path, reinterpret_cast<u8 *>(json.data), json.len);
+}
+
+StageScope::StageScope(PipelineStats *stats_, Stage stage_)
+{
+    stats    = stats_;
+    stage    = stage_;
+    start_ns = DqnTimer_NowInNs();
+    parent   = global_stage_scope_;
+    if (parent)
+        (*parent->stats)[parent->stage]->elapsed_ns += start_ns - parent->start_ns;
+    global_stage_scope_         = this;
+    global_live_metrics_.stage = (i32)stage;
+    traced                     = global_trace_.enabled;
+    if (traced) Trace_Record(STAGE_NAMES[(int)stage], 'B');
+}
+
+StageScope::~StageScope()
+{
+    if (traced) Trace_Record(STAGE_NAMES[(int)stage], 'E');
+    u64 end_ns = DqnTimer_NowInNs();
+    (*stats)[stage]->elapsed_ns += end_ns - start_ns;
+    global_stage_scope_         = parent;
+    global_live_metrics_.stage = (parent) ? (i32)parent->stage : -1;
+    if (parent)
+        parent->start_ns = end_ns;
+}
+
+void PrintPipelineStats(PipelineStats *stats, FILE *file)
+{
+    f64 total_ms = (DqnTimer_NowInNs() - stats->start_ns) / 1000000.0;
+    fprintf(file, "%-18s %12s %10s %14s %14s %10s\n", "Stage", "Time (ms)", "Items", "Items/s", "Bytes", "Failures");
+    DQN_FOR_EACH(stage_index, Stage::Count)
+    {
+        StageStats const *stage = stats->stages + stage_index;
+        f64 elapsed_ms          = stage->elapsed_ns / 1000000.0;
+        f64 items_per_s         = (stage->elapsed_ns) ? stage->items / (stage->elapsed_ns / 1000000000.0) : 0;
+        fprintf(file,
+                "%-18s %12.3f %10lld %14.1f %14lld %10lld\n",
+                STAGE_NAMES[stage_index],
+                elapsed_ms,
+                (long long)stage->items,
+                items_per_s,
+                (long long)stage->bytes,
+                (long long)stage->failures);
+    }
+    fprintf(file, "%-18s %12.3f\n", "total", total_ms);
+
+    fprintf(file, "Output:");
+    for (int tier = (int)DqnFileCopyTier::HardLink; tier < (int)DqnFileCopyTier::Count; tier++)
+        fprintf(file, " %lld %s%s", (long long)stats->output_tiers[tier], DqnFileCopyTier_Name((DqnFileCopyTier)tier), (tier + 1 < (int)DqnFileCopyTier::Count) ? "," : "\n");
+}
+
+bool WritePipelineStatsJson(PipelineStats *stats, char const *path)
+{
+    DqnArray<char> json = {};
+    DQN_DEFER { json.Free(); };
+
+    char line[512];
+    int line_len = Dqn_sprintf(line, "{\n  \"total_ms\": %.3f,\n  \"stages\": [\n", (DqnTimer_NowInNs() - stats->start_ns) / 1000000.0);
+    json.Push(line, line_len);
+    DQN_FOR_EACH(stage_index, Stage::Count)
+    {
+        StageStats const *stage = stats->stages + stage_index;
+        f64 items_per_s         = (stage->elapsed_ns) ? stage->items / (stage->elapsed_ns / 1000000000.0) : 0;
+        line_len = Dqn_sprintf(line,
+                               "    {\"name\": \"%s\", \"ms\": %.3f, \"items\": %lld, \"items_per_s\": %.1f, \"bytes\": %lld, \"failures\": %lld}%s\n",
+                               STAGE_NAMES[stage_index],
+                               stage->elapsed_ns / 1000000.0,
+                               (long long)stage->items,
+                               items_per_s,
+                               (long long)stage->bytes,
+                               (long long)stage->failures,
+                               (stage_index + 1 < (isize)Stage::Count) ? "," : "");
+        json.Push(line, line_len);
+    }
+
+    line_len = Dqn_sprintf(line, "  ],\n  \"output_tiers\": {");
+    json.Push(line, line_len);
+    for (int tier = (int)DqnFileCopyTier::HardLink; tier < (int)DqnFileCopyTier::Count; tier++)
+    {
+        line_len = Dqn_sprintf(line, "\"%s\": %lld%s", DqnFileCopyTier_Name((DqnFileCopyTier)tier), (long long)stats->output_tiers[tier], (tier + 1 < (int)DqnFileCopyTier::Count) ? ", " : "");
+        json.Push(line, line_len);
+    }
+
+    line_len = Dqn_sprintf(line, "}\n}\n");
+    json.Push(line, line_len);
+    return DqnFile_WriteAll(path, reinterpret_cast<u8 *>(json.data), json.len);
+}
 
 DqnBuffer<wchar_t> CopyWStringToBuffer(DqnMemStack *allocator, wchar_t const *str_to_copy, int len = -1)
 {
@@ -85,336 +594,7309 @@ struct SoundMetadata
     DqnBuffer<wchar_t> tracktotal;
 };
 
+#define LOUDNESS_HISTOGRAM_BINS   150   // From the absolute gate up to +5 LUFS
+#define LOUDNESS_HISTOGRAM_MIN    -70.0
+#define LOUDNESS_HISTOGRAM_BIN_LU 0.5
+
+// EBU R128 loudness of a track. The histogram counts the track's gating blocks by loudness so tracks
+// can be gated together, i.e. for an album's loudness.
+struct TrackLoudness
+{
+    f32 integrated_lufs;
+    f32 true_peak;       // Linear, 1.0 is full scale
+    u32 analysed;        // 0 if the track hasn't been analysed yet
+    u16 histogram[LOUDNESS_HISTOGRAM_BINS];
+};
+
+// Technical properties of a sound's audio stream, from its container header
+struct SoundStreamInfo
+{
+    u32 codec_id;        // AVCodecID, AV_CODEC_ID_NONE if the header has no audio stream
+    u32 sample_rate;
+    u32 bit_rate;        // Bits per second, averaged over the file if the header doesn't say
+    u8  channels;
+    u8  bits_per_sample; // 0 for lossy codecs
+};
+
+// Acoustic fingerprint of the start of a track, see FingerprintBuilder
+struct TrackFingerprint
+{
+    u64 bits[3];    // A bit per pitch class of each of the 16 segments
+    u32 num_frames; // Too short to compare if fewer than the segments
+    u32 analysed;   // 0 if the track hasn't been fingerprinted yet
+};
+
+// Silence at either end of a track, see SilenceScanner
+struct TrackSilence
+{
+    u32 leading_ms;
+    u32 trailing_ms;
+    u32 analysed;    // 0 if the track hasn't been scanned yet
+};
+
+// Front cover of a track in the art store, see ArtStore
+struct TrackArt
+{
+    u64 hash;      // 0 if there's none
+    u32 extracted; // 0 if the track hasn't been read with --art yet, or its cover could not be stored
+};
+
 struct SoundFile
 {
     DqnBuffer<wchar_t> path;
     DqnSlice <wchar_t> name;
     DqnSlice <wchar_t> extension; // Slice into file_path
     SoundMetadata      metadata;
+    DqnFileInfo        info;      // Of the source file, from the existence check or library scan
+    u32                duration_ms;
+    SoundStreamInfo    stream;
+    TrackLoudness      loudness;
+    TrackFingerprint   fingerprint;
+    TrackSilence       silence;
+    TrackArt           art;
+};
+
+// Library Index
+// =================================================================================================
+// A memory mapped, position independent snapshot of every track the pipeline has extracted, rewritten
+// at the end of each run. Tracks whose size and last write time still match their entry skip metadata
+// extraction, so the index is both the metadata cache and the manifest of what has been synced.
+// Nothing is parsed on load, sections are found through offsets in the header and each per-track
+// field is its own contiguous column so it can be scanned without touching the others.
+//
+// Layout: LibraryIndexHeader | string offsets | string data | path hash slots | columns | tag columns
+// Sections are 8 byte aligned. Strings are interned, null-terminated UTF-8, string id 0 is "".
+#define LIBRARY_INDEX_MAGIC   0x49445057 // "WPDI"
+#define LIBRARY_INDEX_VERSION 8
+
+// X(Enum, member, Type)
+#define LIBRARY_INDEX_COLUMNS \
+    X(Path,             path,                 u32) /* String id of the UTF-8 source path */ \
+    X(PathHash,         path_hash,            u64) \
+    X(OutputPath,       output_path,          u32) /* String id of the library relative link, 0 if never linked */ \
+    X(Size,             size,                 u64) \
+    X(LastWriteTimeInS, last_write_time_in_s, u64) \
+    X(DurationMs,       duration_ms,          u32) \
+    X(CodecId,          codec_id,             u32) /* AVCodecID of the audio stream */ \
+    X(SampleRate,       sample_rate,          u32) \
+    X(BitRate,          bit_rate,             u32) /* Bits per second */ \
+    X(Channels,         channels,             u8)  \
+    X(BitsPerSample,    bits_per_sample,      u8)  /* 0 for lossy codecs */ \
+    X(AddedTimeInS,     added_time_in_s,      u64) /* When the track first entered the index */ \
+    X(Loudness,         loudness,             TrackLoudness) \
+    X(AlbumLoudness,    album_loudness_lufs,  f32) /* Of the tracks sharing the album and album artist, set on write */ \
+    X(Fingerprint,      fingerprint,          TrackFingerprint) \
+    X(Silence,          silence,              TrackSilence) \
+    X(Art,              art,                  TrackArt)
+
+// X(Enum, SoundMetadata member), tag columns hold string ids
+#define LIBRARY_INDEX_TAGS \
+    X(Album,       album) \
+    X(AlbumArtist, album_artist) \
+    X(Artist,      artist) \
+    X(Date,        date) \
+    X(Disc,        disc) \
+    X(Genre,       genre) \
+    X(Title,       title) \
+    X(Track,       track) \
+    X(TrackTotal,  tracktotal)
+
+#define X(Enum, member, Type) Enum,
+enum struct LibraryColumn { LIBRARY_INDEX_COLUMNS Count };
+#undef X
+
+#define X(Enum, member) Enum,
+enum struct LibraryTag { LIBRARY_INDEX_TAGS Count };
+#undef X
+
+struct LibraryIndexHeader
+{
+    u32 magic;
+    u32 version;
+    u64 file_size;
+    u32 num_tracks;
+    u32 num_strings;
+    u32 num_hash_slots;          // Power of 2
+    u32 padding;
+    u64 string_offsets_offset;   // u32[num_strings], offset of each string in the string data
+    u64 string_data_offset;
+    u64 string_data_size;
+    u64 hash_slots_offset;       // u32[num_hash_slots], track index + 1 by path hash, 0 is empty
+    u64 column_offsets[(int)LibraryColumn::Count];
+    u64 tag_offsets   [(int)LibraryTag::Count];
 };
 
-FILE_SCOPE DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> ReadPlaylistFile(Context *context, wchar_t const *file)
+FILE_SCOPE u64 LibraryIndex_HashPath(char const *path, i32 len)
 {
-    DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> result(DQN_MEGABYTE(8));
+    u64 result = DqnHash_Murmur64(path, len);
+    return result;
+}
 
-    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
-    usize buf_size = 0;
-    u8 *buf        = DqnFile_ReadAll(file, &buf_size, &global_func_local_allocator_);
-    if (!buf)
-    {
-        char const *msg = DQN_LOGGER_W(&context->logger, "DqnFile_ReadAll: Failed, could not read file: %s", WCharToUTF8(&global_func_local_allocator_, file));
-        global_logger_buf.Push(msg, DqnStr_Len(msg));
-        return result;
-    }
+// Read only view of an index file mapped into memory
+struct LibraryIndex
+{
+    DqnFileMap                map;
+    LibraryIndexHeader const *header;
+    u32 const                *string_offsets;
+    char const               *string_data;
+    u32 const                *hash_slots;
+    isize                     num_tracks;
 
-    auto *buf_ptr = reinterpret_cast<char *>(buf);
+#define X(Enum, member, Type) Type const *member;
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    u32 const                *tags[(int)LibraryTag::Count];
 
-    // Skip UTF8-BOM bytes if present
-    if (buf_size > 3 && (u8)buf_ptr[0] == 0xEF && (u8)buf_ptr[1] == 0xBB && (u8)buf_ptr[2] == 0xBF)
-        buf_ptr += 3;
+    bool        Load  (wchar_t const *file_path); // return: False if missing, corrupt or not an index of this version
+    void        Free  ();
+    char const *String(u32 id) const { return string_data + string_offsets[id]; }
+    isize       Find  (char const *path_utf8, i32 len) const; // return: The track index, -1 if not found
+};
+
+bool LibraryIndex::Load(wchar_t const *file_path)
+{
+    *this = {};
+    if (!map.Map(file_path))
+        return false;
 
-    while (char *line = Dqn_EatLine(&buf_ptr, nullptr/*line_len*/))
+    auto *hdr     = reinterpret_cast<LibraryIndexHeader const *>(map.data);
+    bool valid    = map.size >= sizeof(*hdr) && hdr->magic == LIBRARY_INDEX_MAGIC && hdr->version == LIBRARY_INDEX_VERSION && hdr->file_size == map.size;
+    auto InBounds = [&](u64 offset, u64 size) -> bool { return (offset % 8) == 0 && offset <= map.size && size <= map.size - offset; };
+    if (valid)
     {
-        if (line[0] == '#')
-            continue;
+        valid &= hdr->num_strings > 0 && (hdr->num_hash_slots & (hdr->num_hash_slots - 1)) == 0 && hdr->num_hash_slots > hdr->num_tracks;
+        valid &= InBounds(hdr->string_offsets_offset, sizeof(u32) * (u64)hdr->num_strings);
+        valid &= InBounds(hdr->string_data_offset,    hdr->string_data_size);
+        valid &= InBounds(hdr->hash_slots_offset,     sizeof(u32) * (u64)hdr->num_hash_slots);
+#define X(Enum, member, Type) valid &= InBounds(hdr->column_offsets[(int)LibraryColumn::Enum], sizeof(Type) * (u64)hdr->num_tracks);
+        LIBRARY_INDEX_COLUMNS
+#undef X
+        DQN_FOR_EACH(tag, LibraryTag::Count)
+            valid &= InBounds(hdr->tag_offsets[tag], sizeof(u32) * (u64)hdr->num_tracks);
+    }
+
+    // NOTE(doyle): Readers index with the ids and slots as read, so a torn or stale file is rejected here
+    // rather than read out of bounds later. One linear pass over the ids, no strings are touched.
+    if (valid)
+    {
+        u8 const   *base       = map.data;
+        u32 const  *offsets    = reinterpret_cast<u32 const *>(base + hdr->string_offsets_offset);
+        u32 const  *slots      = reinterpret_cast<u32 const *>(base + hdr->hash_slots_offset);
+        u32 const  *path_ids   = reinterpret_cast<u32 const *>(base + hdr->column_offsets[(int)LibraryColumn::Path]);
+        u32 const  *output_ids = reinterpret_cast<u32 const *>(base + hdr->column_offsets[(int)LibraryColumn::OutputPath]);
+        char const *strings    = reinterpret_cast<char const *>(base + hdr->string_data_offset);
 
-        if (DqnFile_Size(line, nullptr))
+        // NOTE(doyle): Every string is terminated before the end of the data if the data ends in one
+        valid &= hdr->string_data_size > 0 && strings[hdr->string_data_size - 1] == 0;
+        for (u32 id = 0; valid && id < hdr->num_strings; id++)
+            valid &= offsets[id] < hdr->string_data_size;
+
+        u32 num_empty_slots = 0;
+        for (u32 slot = 0; valid && slot < hdr->num_hash_slots; slot++)
         {
-            DqnBuffer<wchar_t> file_path = {};
-            file_path.str                = UTF8ToWChar(&context->allocator, line, &file_path.len);
-            result.GetOrMake(file_path);
+            valid &= slots[slot] <= hdr->num_tracks;
+            num_empty_slots += (slots[slot] == 0);
         }
-        else
+        valid &= num_empty_slots > 0; // NOTE(doyle): Find() probes until it hits an empty slot
+
+        for (u32 track = 0; valid && track < hdr->num_tracks; track++)
         {
-            fprintf(stdout, "Could not access file in file system: %s\n", line);
+            valid &= path_ids[track] < hdr->num_strings && output_ids[track] < hdr->num_strings;
+            DQN_FOR_EACH(tag, LibraryTag::Count)
+            {
+                auto const *tag_ids = reinterpret_cast<u32 const *>(base + hdr->tag_offsets[tag]);
+                valid &= tag_ids[track] < hdr->num_strings;
+            }
         }
     }
 
-#if 0
-    for (DqnVHashTable<DqnBuffer<wchar_t>, SoundFile>::Entry const &entry : result)
-        fwprintf(stdout, L"parsed line: %s\n", entry.key.str);
-#endif
+    if (!valid)
+    {
+        map.Unmap();
+        *this = {};
+        return false;
+    }
 
-    return result;
+    header         = hdr;
+    num_tracks     = hdr->num_tracks;
+    string_offsets = reinterpret_cast<u32 const *>(map.data + hdr->string_offsets_offset);
+    string_data    = reinterpret_cast<char const *>(map.data + hdr->string_data_offset);
+    hash_slots     = reinterpret_cast<u32 const *>(map.data + hdr->hash_slots_offset);
+#define X(Enum, member, Type) member = reinterpret_cast<Type const *>(map.data + hdr->column_offsets[(int)LibraryColumn::Enum]);
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    DQN_FOR_EACH(tag, LibraryTag::Count)
+        tags[tag] = reinterpret_cast<u32 const *>(map.data + hdr->tag_offsets[tag]);
+
+    return true;
 }
 
-FILE_SCOPE bool ExtractSoundMetadata(DqnMemStack *allocator, AVDictionary const *dictionary, SoundMetadata *metadata)
+void LibraryIndex::Free()
 {
-    bool atleast_one_entry_filled = false;
-    if (!dictionary) return atleast_one_entry_filled;
+    map.Unmap();
+    *this = {};
+}
 
-    AVDictionaryEntry const *entry = av_dict_get(dictionary, "", nullptr, AV_DICT_IGNORE_SUFFIX);
-    if (!entry) return atleast_one_entry_filled;
+isize LibraryIndex::Find(char const *path_utf8, i32 len) const
+{
+    if (num_tracks == 0) return -1;
 
-    while (entry)
+    u64 hash = LibraryIndex_HashPath(path_utf8, len);
+    u32 mask = header->num_hash_slots - 1;
+    for (u32 slot = (u32)hash & mask;; slot = (slot + 1) & mask)
     {
-        DqnBuffer<wchar_t> *dest_buffer = nullptr;
-        const auto key                  = DqnSlice<char>(entry->key, DqnStr_Len(entry->key));
+        u32 track = hash_slots[slot];
+        if (track == 0)
+            return -1;
 
-        if      (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("album"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->album;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("album_artist"), Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->album_artist;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("artist"),       Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->artist;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("date"),         Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->date;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("disc"),         Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->disc;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("genre"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->genre;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("title"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->title;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("track"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->track;
-        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("tracktotal"),   Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->tracktotal;
+        track--;
+        if (path_hash[track] == hash && DqnStr_Cmp(String(path[track]), path_utf8, len) == 0 && String(path[track])[len] == 0)
+            return track;
+    }
+}
 
-        if (dest_buffer && dest_buffer->len == 0)
-        {
-            atleast_one_entry_filled = true;
-            const auto value         = DqnSlice<char>(entry->value, DqnStr_Len(entry->value));
-            dest_buffer->str = UTF8ToWChar(allocator, value.str, &dest_buffer->len);
-        }
+// Accumulates the tracks of a run in column form, written out as the next run's LibraryIndex
+struct LibraryIndexBuilder
+{
+    DqnArray<char>  string_data;
+    DqnArray<u32>   string_offsets;
+    DqnArray<u32>   string_slots;   // string id + 1 by string hash, 0 is empty
+    DqnArray<u32>   track_slots;    // track index + 1 by path hash, 0 is empty
+    DqnArray<u32>   output_refs;    // By string id, the number of tracks output to it
+    isize           num_tracks;
 
-        AVDictionaryEntry const *prev_entry = entry;
-        entry = av_dict_get(dictionary, "", prev_entry, AV_DICT_IGNORE_SUFFIX);
+#define X(Enum, member, Type) DqnArray<Type> member;
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    DqnArray<u32>   tags[(int)LibraryTag::Count];
+
+    void  Init       ();
+    void  Free       ();
+    u32   Intern     (char const *str, i32 len);
+    char const *String(u32 id) const { return string_data.data + string_offsets.data[id]; }
+    isize MakeTrack  (char const *path_utf8, i32 len, bool *existed = nullptr); // return: The track index, columns are zero for new tracks
+    isize Find       (char const *path_utf8, i32 len) const;                    // return: The track index, -1 if the path has no track
+    void  SetOutput  (isize track, u32 output_path);                            // Set the track's output path, keeping output_refs in step
+    u32   OutputRefs (u32 output_path) const { return (output_path < output_refs.len) ? output_refs.data[output_path] : 0; }
+    void  MergeUnseen(LibraryIndex const *index); // Carry over tracks of a previous index not seen this run
+    bool  Write      (wchar_t const *file_path);
+};
+
+// Rebuild an open addressed table of (index + 1) with double the slots
+FILE_SCOPE void LibraryIndex_GrowSlots(DqnArray<u32> *slots, isize num_items, u64 (*HashItem)(LibraryIndexBuilder const *, u32), LibraryIndexBuilder const *builder)
+{
+    isize num_slots = DQN_MAX(slots->len * 2, (isize)1024);
+    slots->Resize(num_slots);
+    DqnMem_Set(slots->data, 0, sizeof(*slots->data) * num_slots);
+
+    u32 mask = (u32)num_slots - 1;
+    DQN_FOR_EACH(item, num_items)
+    {
+        u32 slot = (u32)HashItem(builder, (u32)item) & mask;
+        while (slots->data[slot]) slot = (slot + 1) & mask;
+        slots->data[slot] = (u32)item + 1;
     }
+}
 
-    return atleast_one_entry_filled;
+FILE_SCOPE u64 LibraryIndexBuilder_HashString(LibraryIndexBuilder const *builder, u32 id)
+{
+    char const *str = builder->string_data.data + builder->string_offsets.data[id];
+    u64 result      = LibraryIndex_HashPath(str, DqnStr_Len(str));
+    return result;
 }
 
-DqnBuffer<wchar_t> AllocateSwprintf(DqnMemStack *allocator, wchar_t const *fmt, ...)
+FILE_SCOPE u64 LibraryIndexBuilder_HashTrack(LibraryIndexBuilder const *builder, u32 track)
 {
-    va_list va;
-    va_start(va, fmt);
-    DqnBuffer<wchar_t> result = {};
-    result.len                = vswprintf(nullptr, 0, fmt, va) + 1;
-    result.str                = DQN_MEMSTACK_PUSH_ARRAY(allocator, wchar_t, result.len);
-    vswprintf(result.str, result.len, fmt, va);
-    va_end(va);
+    u64 result = builder->path_hash.data[track];
     return result;
 }
 
-void CheckAllocatorHasZeroAllocations(DqnMemStack const *allocator)
+void LibraryIndexBuilder::Init()
 {
-    DQN_ASSERTM(!allocator->block->prev_block, "Allocator should not have multiple blocks at zero allocations, just the initial block.");
-    DQN_ASSERTM(allocator->block->Usage() == 0, "Allocator has non-zero memory usage: %zu\n", allocator->block->Usage());
+    *this = {};
+    string_offsets.Push(0);
+    string_data.Push('\0');
 }
 
-DqnArray<SoundFile> MakeSoundFiles(Context *context, DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> *playlist)
+void LibraryIndexBuilder::Free()
 {
-    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
-    auto *buf   = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, SoundFile, playlist->num_used_entries);
-    auto result = DqnArray<SoundFile>(buf, playlist->num_used_entries);
+    string_data.Free();
+    string_offsets.Free();
+    string_slots.Free();
+    track_slots.Free();
+    output_refs.Free();
+#define X(Enum, member, Type) member.Free();
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    for (DqnArray<u32> &tag : tags)
+        tag.Free();
+}
 
-    for (DqnVHashTable<DqnBuffer<wchar_t>, SoundFile>::Entry const &entry : *playlist)
-    {
-        auto mem_region = context->allocator.MemRegionScope();
+u32 LibraryIndexBuilder::Intern(char const *str, i32 len)
+{
+    if (!str || len <= 0) return 0;
+
+    if ((string_offsets.len + 1) * 2 > string_slots.len)
+        LibraryIndex_GrowSlots(&string_slots, string_offsets.len, LibraryIndexBuilder_HashString, this);
+
+    u32 mask = (u32)string_slots.len - 1;
+    u32 slot = (u32)LibraryIndex_HashPath(str, len) & mask;
+    for (; string_slots.data[slot]; slot = (slot + 1) & mask)
+    {
+        u32 id               = string_slots.data[slot] - 1;
+        char const *interned = string_data.data + string_offsets.data[id];
+        if (DqnStr_Cmp(interned, str, len) == 0 && interned[len] == 0)
+            return id;
+    }
+
+    u32 result = (u32)string_offsets.len;
+    string_offsets.Push((u32)string_data.len);
+    string_data.Push(str, len);
+    string_data.Push('\0');
+    string_slots.data[slot] = result + 1;
+    return result;
+}
+
+void LibraryIndexBuilder::SetOutput(isize track, u32 output)
+{
+    u32 old_output = output_path.data[track];
+    if (old_output) output_refs.data[old_output]--;
+    if (output)
+    {
+        u32 const no_refs = 0;
+        if (output >= output_refs.len) output_refs.Resize(string_offsets.len, &no_refs);
+        output_refs.data[output]++;
+    }
+    output_path.data[track] = output;
+}
+
+isize LibraryIndexBuilder::MakeTrack(char const *path_utf8, i32 len, bool *existed)
+{
+    if ((num_tracks + 1) * 2 > track_slots.len)
+        LibraryIndex_GrowSlots(&track_slots, num_tracks, LibraryIndexBuilder_HashTrack, this);
+
+    u64 hash = LibraryIndex_HashPath(path_utf8, len);
+    u32 mask = (u32)track_slots.len - 1;
+    u32 slot = (u32)hash & mask;
+    for (; track_slots.data[slot]; slot = (slot + 1) & mask)
+    {
+        u32 track       = track_slots.data[slot] - 1;
+        char const *str = string_data.data + string_offsets.data[path.data[track]];
+        if (path_hash.data[track] == hash && DqnStr_Cmp(str, path_utf8, len) == 0 && str[len] == 0)
+        {
+            if (existed) *existed = true;
+            return track;
+        }
+    }
+
+    if (existed) *existed = false;
+    isize result           = num_tracks++;
+    track_slots.data[slot] = (u32)result + 1;
+
+#define X(Enum, member, Type) member.Push({});
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    for (DqnArray<u32> &tag : tags)
+        tag.Push(0);
+
+    path.data[result]      = Intern(path_utf8, len);
+    path_hash.data[result] = hash;
+    return result;
+}
+
+isize LibraryIndexBuilder::Find(char const *path_utf8, i32 len) const
+{
+    if (num_tracks == 0) return -1;
+
+    u64 hash = LibraryIndex_HashPath(path_utf8, len);
+    u32 mask = (u32)track_slots.len - 1;
+    for (u32 slot = (u32)hash & mask; track_slots.data[slot]; slot = (slot + 1) & mask)
+    {
+        u32 track       = track_slots.data[slot] - 1;
+        char const *str = String(path.data[track]);
+        if (path_hash.data[track] == hash && DqnStr_Cmp(str, path_utf8, len) == 0 && str[len] == 0)
+            return track;
+    }
+    return -1;
+}
+
+void LibraryIndexBuilder::MergeUnseen(LibraryIndex const *index)
+{
+    DQN_FOR_EACH(src_track, index->num_tracks)
+    {
+        char const *src_path = index->String(index->path[src_track]);
+        bool existed         = false;
+        isize track          = MakeTrack(src_path, DqnStr_Len(src_path), &existed);
+        if (existed)
+            continue;
+
+        char const *output = index->String(index->output_path[src_track]);
+        SetOutput(track, Intern(output, DqnStr_Len(output)));
+        size.data[track]                 = index->size[src_track];
+        last_write_time_in_s.data[track] = index->last_write_time_in_s[src_track];
+        duration_ms.data[track]          = index->duration_ms[src_track];
+        codec_id.data[track]             = index->codec_id[src_track];
+        sample_rate.data[track]          = index->sample_rate[src_track];
+        bit_rate.data[track]             = index->bit_rate[src_track];
+        channels.data[track]             = index->channels[src_track];
+        bits_per_sample.data[track]      = index->bits_per_sample[src_track];
+        added_time_in_s.data[track]      = index->added_time_in_s[src_track];
+        loudness.data[track]             = index->loudness[src_track];
+        fingerprint.data[track]          = index->fingerprint[src_track];
+        silence.data[track]              = index->silence[src_track];
+        art.data[track]                  = index->art[src_track];
+        DQN_FOR_EACH(tag, LibraryTag::Count)
+        {
+            char const *value     = index->String(index->tags[tag][src_track]);
+            tags[tag].data[track] = Intern(value, DqnStr_Len(value));
+        }
+    }
+}
+
+bool LibraryIndexBuilder::Write(wchar_t const *file_path)
+{
+    // NOTE(doyle): The written hash table must be a power of 2 larger than the track count
+    if ((num_tracks + 1) * 2 > track_slots.len)
+        LibraryIndex_GrowSlots(&track_slots, num_tracks, LibraryIndexBuilder_HashTrack, this);
+
+    auto Align8 = [](u64 offset) -> u64 { return (offset + 7) & ~(u64)7; };
+    LibraryIndexHeader header    = {};
+    header.magic                 = LIBRARY_INDEX_MAGIC;
+    header.version               = LIBRARY_INDEX_VERSION;
+    header.num_tracks            = (u32)num_tracks;
+    header.num_strings           = (u32)string_offsets.len;
+    header.num_hash_slots        = (u32)track_slots.len;
+    header.string_offsets_offset = Align8(sizeof(header));
+    header.string_data_offset    = Align8(header.string_offsets_offset + sizeof(u32) * string_offsets.len);
+    header.string_data_size      = string_data.len;
+    header.hash_slots_offset     = Align8(header.string_data_offset + string_data.len);
+
+    u64 offset = Align8(header.hash_slots_offset + sizeof(u32) * track_slots.len);
+#define X(Enum, member, Type) header.column_offsets[(int)LibraryColumn::Enum] = offset; offset = Align8(offset + sizeof(Type) * num_tracks);
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    DQN_FOR_EACH(tag, LibraryTag::Count)
+    {
+        header.tag_offsets[tag] = offset;
+        offset                  = Align8(offset + sizeof(u32) * num_tracks);
+    }
+    header.file_size = offset;
+
+    auto *buf = static_cast<u8 *>(DqnMem_Alloc(header.file_size));
+    if (!buf) return false;
+    DQN_DEFER { DqnMem_Free(buf); };
+    DqnMem_Clear(buf, 0, header.file_size);
+
+    DqnMem_Copy(buf, &header, sizeof(header));
+    DqnMem_Copy(buf + header.string_offsets_offset, string_offsets.data, sizeof(u32) * string_offsets.len);
+    DqnMem_Copy(buf + header.string_data_offset,    string_data.data,    string_data.len);
+    DqnMem_Copy(buf + header.hash_slots_offset,     track_slots.data,    sizeof(u32) * track_slots.len);
+#define X(Enum, member, Type) if (num_tracks) DqnMem_Copy(buf + header.column_offsets[(int)LibraryColumn::Enum], member.data, sizeof(Type) * num_tracks);
+    LIBRARY_INDEX_COLUMNS
+#undef X
+    DQN_FOR_EACH(tag, LibraryTag::Count)
+    {
+        if (num_tracks) DqnMem_Copy(buf + header.tag_offsets[tag], tags[tag].data, sizeof(u32) * num_tracks);
+    }
+
+    // NOTE(doyle): Written under a temporary name first, a crash mid-write leaves the previous index intact
+    i32 file_path_len  = DqnWStr_Len(file_path);
+    auto *partial_path = static_cast<wchar_t *>(DqnMem_Alloc(sizeof(wchar_t) * (file_path_len + 6)));
+    if (!partial_path) return false;
+    DQN_DEFER { DqnMem_Free(partial_path); };
+    DqnMem_Copy(partial_path, file_path, sizeof(wchar_t) * file_path_len);
+    DqnMem_Copy(partial_path + file_path_len, L".part", sizeof(wchar_t) * 6);
+
+    bool result = DqnFile_WriteAll(partial_path, buf, header.file_size) &&
+                  MoveFileExW(partial_path, file_path, MOVEFILE_REPLACE_EXISTING);
+    if (!result) DqnFile_Delete(partial_path);
+    return result;
+}
+
+// Search Index
+// =================================================================================================
+// Trigram index over the tag strings people search by. Every string is broken into its overlapping
+// 3 byte sequences (ASCII lower cased), each trigram has a posting list of the string ids containing
+// it. A word is looked up by intersecting the posting lists of its trigrams, the survivors are then
+// checked for the word as a substring since trigrams can match out of order.
+//
+// Strings are added in increasing id order as the builder interns them so posting lists are sorted and
+// stored as varint deltas, usually 1 byte an entry. A string interned for another purpose before it
+// turned up in a searchable tag can arrive out of order, those are kept aside and always checked.
+FILE_SCOPE LibraryTag const SEARCH_TAGS[] = {LibraryTag::Artist, LibraryTag::AlbumArtist, LibraryTag::Album, LibraryTag::Title};
+
+struct TrigramPosting
+{
+    u32          trigram;
+    u32          count;
+    u32          last_id;
+    DqnArray<u8> deltas; // Varint encoded, 7 bits a byte, high bit set if more bytes follow
+};
+
+struct TrigramIndex
+{
+    LibraryIndexBuilder const *builder;    // Owner of the string ids
+    DqnArray<TrigramPosting>   postings;
+    DqnArray<u32>              slots;      // posting index + 1 by trigram hash, 0 is empty
+    DqnArray<u8>               indexed;    // By string id, 1 if the string has been added
+    DqnArray<u32>              string_ids; // Every string added, to check words too short for trigrams
+    DqnArray<u32>              late_ids;   // Strings added after a larger id, not in the posting lists
+    u32                        next_id;    // Strings below this id arrive late
+
+    void Init  (LibraryIndexBuilder const *builder_); // Add the searchable tags of every track in the builder
+    void Free  ();
+    void Add   (u32 id);                              // Add the string if not already, id 0 is the empty string and ignored
+    void Search(char const *word, i32 len, DqnArray<u32> *ids) const; // Append the ids of strings containing the word, ignoring case
+};
+
+FILE_SCOPE u32 TrigramIndex_Hash(u32 trigram) { return trigram * 0x9E3779B1u; }
+
+FILE_SCOPE u32 TrigramIndex_Trigram(char const *str)
+{
+    u32 result = (u32)(u8)DqnChar_ToLower(str[0]) | ((u32)(u8)DqnChar_ToLower(str[1]) << 8) | ((u32)(u8)DqnChar_ToLower(str[2]) << 16);
+    return result;
+}
+
+FILE_SCOPE TrigramPosting *TrigramIndex_Find(TrigramIndex const *index, u32 trigram, u32 *slot_)
+{
+    u32 mask = (u32)index->slots.len - 1;
+    u32 slot = TrigramIndex_Hash(trigram) & mask;
+    for (; index->slots.data[slot]; slot = (slot + 1) & mask)
+    {
+        TrigramPosting *posting = index->postings.data + (index->slots.data[slot] - 1);
+        if (posting->trigram == trigram)
+            return posting;
+    }
+
+    if (slot_) *slot_ = slot;
+    return nullptr;
+}
+
+void TrigramIndex::Init(LibraryIndexBuilder const *builder_)
+{
+    *this   = {};
+    builder = builder_;
+    u32 const empty_slot = 0;
+    slots.Resize(1024, &empty_slot);
+
+    // NOTE(doyle): Add in id order so the posting lists start out sorted
+    u8 const not_indexed = 0;
+    DqnArray<u8> searchable = {};
+    DQN_DEFER { searchable.Free(); };
+    searchable.Resize(builder->string_offsets.len, &not_indexed);
+    for (LibraryTag tag : SEARCH_TAGS)
+    {
+        for (u32 id : builder->tags[(int)tag])
+            searchable.data[id] = 1;
+    }
+
+    DQN_FOR_EACH(id, searchable.len)
+    {
+        if (searchable.data[id])
+            Add((u32)id);
+    }
+}
+
+void TrigramIndex::Free()
+{
+    for (TrigramPosting &posting : postings)
+        posting.deltas.Free();
+    postings.Free();
+    slots.Free();
+    indexed.Free();
+    string_ids.Free();
+    late_ids.Free();
+}
+
+void TrigramIndex::Add(u32 id)
+{
+    if (id == 0 || (id < (u32)indexed.len && indexed.data[id]))
+        return;
+
+    u8 const not_indexed = 0;
+    if (id >= (u32)indexed.len)
+        indexed.Resize(DQN_MAX((isize)id + 1, builder->string_offsets.len), &not_indexed);
+    indexed.data[id] = 1;
+    string_ids.Push(id);
+
+    if (id < next_id)
+    {
+        late_ids.Push(id);
+        return;
+    }
+    next_id = id + 1;
+
+    char const *str = builder->string_data.data + builder->string_offsets.data[id];
+    i32 len         = DqnStr_Len(str);
+    for (i32 offset = 0; offset + 3 <= len; offset++)
+    {
+        if ((postings.len + 1) * 2 > slots.len)
+        {
+            u32 const empty_slot = 0;
+            isize new_len        = slots.len * 2;
+            slots.Clear();
+            slots.Resize(new_len, &empty_slot);
+            DQN_FOR_EACH(posting_index, postings.len)
+            {
+                u32 slot = 0;
+                TrigramIndex_Find(this, postings.data[posting_index].trigram, &slot);
+                slots.data[slot] = (u32)posting_index + 1;
+            }
+        }
+
+        u32 trigram             = TrigramIndex_Trigram(str + offset);
+        u32 slot                = 0;
+        TrigramPosting *posting = TrigramIndex_Find(this, trigram, &slot);
+        if (!posting)
+        {
+            TrigramPosting new_posting = {};
+            new_posting.trigram        = trigram;
+            postings.Push(new_posting);
+            slots.data[slot] = (u32)postings.len;
+            posting          = postings.data + (postings.len - 1);
+        }
+
+        // NOTE(doyle): A trigram repeated in the string was already posted
+        if (posting->count > 0 && posting->last_id == id)
+            continue;
+
+        for (u32 delta = id - posting->last_id;; delta >>= 7)
+        {
+            u8 byte = (u8)(delta & 0x7F);
+            if (delta > 0x7F)
+            {
+                posting->deltas.Push(byte | 0x80);
+                continue;
+            }
+            posting->deltas.Push(byte);
+            break;
+        }
+        posting->last_id = id;
+        posting->count++;
+    }
+}
+
+FILE_SCOPE void TrigramPosting_Decode(TrigramPosting const *posting, u32 *ids)
+{
+    u8 const *ptr = posting->deltas.data;
+    u32 id        = 0;
+    DQN_FOR_EACH(index, posting->count)
+    {
+        u32 delta = 0;
+        for (u32 shift = 0;; shift += 7)
+        {
+            u8 byte = *ptr++;
+            delta |= (u32)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        id        += delta;
+        ids[index] = id;
+    }
+}
+
+// Intersect 2 sorted id lists, 4 ids of each compared against each other at once. The result is written
+// to 'a' in sorted order.
+// return: The number of ids in the intersection
+FILE_SCOPE isize IntersectSortedIds(u32 *a, isize a_len, u32 const *b, isize b_len)
+{
+    isize a_index = 0, b_index = 0, result = 0;
+    while (a_index + 4 <= a_len && b_index + 4 <= b_len)
+    {
+        u32 a_max      = a[a_index + 3];
+        u32 b_max      = b[b_index + 3];
+        __m128i a_vals = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + a_index));
+        __m128i b_vals = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + b_index));
+
+        // NOTE(doyle): Compare against every rotation of b so each a lane sees all 4 b lanes
+        __m128i match = _mm_cmpeq_epi32(a_vals, b_vals);
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(a_vals, _mm_shuffle_epi32(b_vals, _MM_SHUFFLE(0, 3, 2, 1))));
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(a_vals, _mm_shuffle_epi32(b_vals, _MM_SHUFFLE(1, 0, 3, 2))));
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(a_vals, _mm_shuffle_epi32(b_vals, _MM_SHUFFLE(2, 1, 0, 3))));
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (mask & (1 << lane))
+                a[result++] = a[a_index + lane];
+        }
+
+        if (a_max <= b_max) a_index += 4;
+        if (b_max <= a_max) b_index += 4;
+    }
+
+    while (a_index < a_len && b_index < b_len)
+    {
+        if      (a[a_index] < b[b_index]) a_index++;
+        else if (a[a_index] > b[b_index]) b_index++;
+        else
+        {
+            a[result++] = a[a_index++];
+            b_index++;
+        }
+    }
+
+    return result;
+}
+
+FILE_SCOPE bool TrigramPosting_CountLessThan(TrigramPosting const *const &a, TrigramPosting const *const &b, void *)
+{
+    return a->count < b->count;
+}
+
+void TrigramIndex::Search(char const *word, i32 len, DqnArray<u32> *ids) const
+{
+    auto StringContainsWord = [this, word, len](u32 id) -> bool {
+        char const *str = builder->string_data.data + builder->string_offsets.data[id];
+        return DqnStr_FindFirstOccurence(str, DqnStr_Len(str), word, len, Dqn::IgnoreCase::Yes) != -1;
+    };
+
+    if (len < 3)
+    {
+        for (u32 id : string_ids)
+        {
+            if (StringContainsWord(id))
+                ids->Push(id);
+        }
+        return;
+    }
+
+    // NOTE(doyle): Intersect from the rarest trigram up, the candidates only ever shrink
+    DqnArray<TrigramPosting const *> word_postings = {};
+    DqnArray<u32> candidates = {}, other = {};
+    DQN_DEFER
+    {
+        word_postings.Free();
+        candidates.Free();
+        other.Free();
+    };
+
+    bool missing_trigram = false;
+    for (i32 offset = 0; offset + 3 <= len; offset++)
+    {
+        TrigramPosting const *posting = TrigramIndex_Find(this, TrigramIndex_Trigram(word + offset), nullptr);
+        if (!posting)
+        {
+            missing_trigram = true;
+            break;
+        }
+        word_postings.Push(posting);
+    }
+
+    if (!missing_trigram)
+    {
+        DqnQuickSort<TrigramPosting const *, TrigramPosting_CountLessThan>(word_postings.data, word_postings.len, nullptr);
+        candidates.Resize(word_postings.data[0]->count);
+        TrigramPosting_Decode(word_postings.data[0], candidates.data);
+        for (isize posting_index = 1; posting_index < word_postings.len && candidates.len > 0; posting_index++)
+        {
+            // NOTE(doyle): Decoding a list costs more than checking the few candidates left directly
+            TrigramPosting const *posting = word_postings.data[posting_index];
+            if (candidates.len * 32 < (isize)posting->count)
+                break;
+
+            other.Resize(posting->count);
+            TrigramPosting_Decode(posting, other.data);
+            candidates.len = IntersectSortedIds(candidates.data, candidates.len, other.data, other.len);
+        }
+
+        // NOTE(doyle): A 3 byte word is its own trigram, every string in the posting list contains it
+        if (len == 3)
+        {
+            ids->Push(candidates.data, candidates.len);
+        }
+        else
+        {
+            for (u32 id : candidates)
+            {
+                if (StringContainsWord(id))
+                    ids->Push(id);
+            }
+        }
+    }
+
+    for (u32 id : late_ids)
+    {
+        if (StringContainsWord(id))
+            ids->Push(id);
+    }
+}
+
+// Resolve a search entry to the library tracks where every word appears in one of the searched tags
+// terms: Whitespace separated words, i.e. "portishead dummy"
+FILE_SCOPE void SearchLibrary(Context *context, DqnSlice<char const> terms, DqnArray<DqnFileOp> *stat_ops)
+{
+    STAGE_SCOPE(&context->stats, Stage::Search);
+    context->stats[Stage::Search]->items++;
+
+    LibraryIndexBuilder const *builder = context->index_builder;
+    TrigramIndex const *search_index   = context->search_index;
+    isize num_words                    = (builder->num_tracks + 63) / 64;
+    if (num_words == 0)
+        return;
+
+    DqnArray<u64> bits     = {};
+    DqnArray<u8> id_lookup = {};
+    DqnArray<u32> ids      = {};
+    DQN_DEFER
+    {
+        bits.Free();
+        id_lookup.Free();
+        ids.Free();
+    };
+
+    u64 const all_tracks = ~(u64)0;
+    u8 const not_matched = 0;
+    bits.Resize(num_words, &all_tracks);
+    id_lookup.Resize(builder->string_offsets.len, &not_matched);
+
+    bool has_word = false;
+    char const *terms_end = terms.data + terms.len;
+    for (char const *ptr = terms.data; ptr < terms_end;)
+    {
+        while (ptr < terms_end && DqnChar_IsWhitespace(*ptr)) ptr++;
+        char const *word = ptr;
+        while (ptr < terms_end && !DqnChar_IsWhitespace(*ptr)) ptr++;
+        i32 word_len = (i32)(ptr - word);
+        if (word_len == 0)
+            break;
+        has_word = true;
+
+        ids.Clear();
+        search_index->Search(word, word_len, &ids);
+        for (u32 id : ids) id_lookup.data[id] = 1;
+
+        for (isize word_start = 0; word_start < builder->num_tracks; word_start += 64)
+        {
+            u64 *track_bits = bits.data + (word_start / 64);
+            if (*track_bits == 0)
+                continue;
+
+            isize word_end = DQN_MIN(word_start + 64, builder->num_tracks);
+            u64 matched    = 0;
+            for (isize track = word_start; track < word_end; track++)
+            {
+                u8 track_matched = 0;
+                for (LibraryTag tag : SEARCH_TAGS)
+                    track_matched |= id_lookup.data[builder->tags[(int)tag].data[track]];
+                matched |= (u64)track_matched << (track - word_start);
+            }
+            *track_bits &= matched;
+        }
+
+        for (u32 id : ids) id_lookup.data[id] = 0;
+    }
+
+    if (!has_word)
+    {
+        context->stats[Stage::Search]->failures++;
+        char const *msg = DQN_LOGGER_W(&context->logger, "Search playlist entry has no terms, skipped");
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+        return;
+    }
+
+    DQN_FOR_EACH(word_index, num_words)
+    {
+        for (u64 word = bits.data[word_index]; word; word &= word - 1)
+        {
+            unsigned long bit = 0;
+            _BitScanForward64(&bit, word);
+            isize track = word_index * 64 + bit;
+            if (track >= builder->num_tracks)
+                break;
+
+            DqnFileOp op = {};
+            op.type      = DqnFileOp::Type::Stat;
+            op.path      = builder->String(builder->path.data[track]);
+            stat_ops->Push(op);
+        }
+    }
+}
+
+// return: The index track for the path if its size and last write time match, -1 otherwise
+FILE_SCOPE isize FindUnchangedIndexTrack(LibraryIndex const *index, char const *path_utf8, i32 len, DqnFileInfo const *info)
+{
+    if (!index || index->num_tracks == 0) return -1;
+
+    isize result = index->Find(path_utf8, len);
+    if (result != -1 && (index->size[result] != info->size || index->last_write_time_in_s[result] != info->last_write_time_in_s))
+        result = -1;
+
+    return result;
+}
+
+FILE_SCOPE void LoadSoundMetadataFromIndex(DqnMemStack *allocator, LibraryIndex const *index, isize track, SoundFile *sound_file)
+{
+    sound_file->duration_ms            = index->duration_ms[track];
+    sound_file->stream.codec_id        = index->codec_id[track];
+    sound_file->stream.sample_rate     = index->sample_rate[track];
+    sound_file->stream.bit_rate        = index->bit_rate[track];
+    sound_file->stream.channels        = index->channels[track];
+    sound_file->stream.bits_per_sample = index->bits_per_sample[track];
+    sound_file->loudness               = index->loudness[track];
+    sound_file->fingerprint            = index->fingerprint[track];
+    sound_file->silence                = index->silence[track];
+    sound_file->art                    = index->art[track];
+#define X(Enum, member)                                                                                               \
+    if (u32 id = index->tags[(int)LibraryTag::Enum][track])                                                           \
+        sound_file->metadata.member.str = UTF8ToWChar(allocator, index->String(id), &sound_file->metadata.member.len);
+    LIBRARY_INDEX_TAGS
+#undef X
+}
+
+// prev_index: Optional, the track keeps its added time from the previous index
+// return:     The sound's track in the builder
+FILE_SCOPE isize AddSoundToIndex(DqnMemStack *allocator, LibraryIndexBuilder *builder, LibraryIndex const *prev_index, TrigramIndex *search_index,
+                                 SoundFile const *sound_file, u64 now_in_s)
+{
+    auto DQN_UNIQUE_NAME(mem_region) = allocator->MemRegionScope();
+    int path_len    = 0;
+    char *path_utf8 = WCharToUTF8(allocator, sound_file->path.str, &path_len);
+    bool existed    = false;
+    isize result    = builder->MakeTrack(path_utf8, path_len - 1, &existed);
+
+    if (!existed)
+    {
+        isize prev_track                      = (prev_index) ? prev_index->Find(path_utf8, path_len - 1) : -1;
+        builder->added_time_in_s.data[result] = (prev_track == -1) ? now_in_s : prev_index->added_time_in_s[prev_track];
+    }
+
+    builder->size.data[result]                 = sound_file->info.size;
+    builder->last_write_time_in_s.data[result] = sound_file->info.last_write_time_in_s;
+    builder->duration_ms.data[result]          = sound_file->duration_ms;
+    builder->codec_id.data[result]             = sound_file->stream.codec_id;
+    builder->sample_rate.data[result]          = sound_file->stream.sample_rate;
+    builder->bit_rate.data[result]             = sound_file->stream.bit_rate;
+    builder->channels.data[result]             = sound_file->stream.channels;
+    builder->bits_per_sample.data[result]      = sound_file->stream.bits_per_sample;
+    builder->loudness.data[result]             = sound_file->loudness;
+    builder->fingerprint.data[result]          = sound_file->fingerprint;
+    builder->silence.data[result]              = sound_file->silence;
+    builder->art.data[result]                  = sound_file->art;
+#define X(Enum, member)                                                                                               \
+    if (sound_file->metadata.member)                                                                                  \
+    {                                                                                                                 \
+        int value_len = 0;                                                                                            \
+        char *value   = WCharToUTF8(allocator, sound_file->metadata.member.str, &value_len);                          \
+        builder->tags[(int)LibraryTag::Enum].data[result] = builder->Intern(value, value_len - 1);                     \
+    }                                                                                                                 \
+    else                                                                                                              \
+    {                                                                                                                 \
+        builder->tags[(int)LibraryTag::Enum].data[result] = 0;                                                        \
+    }
+    LIBRARY_INDEX_TAGS
+#undef X
+
+    if (search_index)
+    {
+        for (LibraryTag tag : SEARCH_TAGS)
+            search_index->Add(builder->tags[(int)tag].data[result]);
+    }
+
+    return result;
+}
+
+// Playlist Formats
+// =================================================================================================
+// Streaming parsers over the mapped playlist file. Nothing is copied or built while parsing, each entry
+// is a slice of the file with flags for what decoding it still needs. The one copy of a path is made by
+// ResolvePlaylistEntry, once it is known to be wanted, straight into the null-terminated form the file
+// system takes.
+//
+// M3U  : A path per line, '#' lines are comments or extended info. "search:" lines are searches.
+// PLS  : INI style, FileN=<path> under [playlist]
+// XSPF : XML, <track><location>URI</location></track>
+// WPL  : XML (SMIL), <media src="path"/>
+// CUE  : FILE "path" WAVE, the file the following tracks index into
+enum struct PlaylistFormat
+{
+    M3U,
+    PLS,
+    XSPF,
+    WPL,
+    CUE,
+};
+
+struct PlaylistEntry
+{
+    enum Flag
+    {
+        XmlEscaped = 1 << 0, // Contains XML entities, i.e. &amp;
+        Uri        = 1 << 1, // A URI reference, percent encoded and '/' separated
+    };
+
+    enum struct Type
+    {
+        Path,
+        Search, // value holds the search terms
+    };
+
+    Type                 type;
+    DqnSlice<char const> value;
+    u32                  flags;
+};
+
+FILE_SCOPE bool SliceStartsWith(DqnSlice<char const> slice, char const *prefix, Dqn::IgnoreCase ignore = Dqn::IgnoreCase::Yes)
+{
+    i32 prefix_len = DqnStr_Len(prefix);
+    bool result    = slice.len >= prefix_len && DqnStr_Cmp(prefix, slice.data, prefix_len, ignore) == 0;
+    return result;
+}
+
+// Minimal XML tokenizer, enough for playlists. No validation, no allocation, names and text are slices of
+// the document. Comments, processing instructions and DOCTYPEs are skipped.
+struct XmlToken
+{
+    enum struct Type
+    {
+        StartTag, // attribs holds everything between the name and the closing '>'
+        EndTag,
+        Text,     // Entities are left encoded, CDATA sections are returned raw
+    };
+
+    Type                 type;
+    DqnSlice<char const> name;
+    DqnSlice<char const> attribs;
+    DqnSlice<char const> text;
+    bool                 self_closing;
+    bool                 cdata;
+};
+
+struct XmlTokenizer
+{
+    char const *ptr;
+    char const *end;
+
+    bool Next(XmlToken *token); // return: False at the end of the document
+};
+
+FILE_SCOPE char const *Xml_Find(char const *ptr, char const *end, char const *find)
+{
+    i32 find_len = DqnStr_Len(find);
+    for (; ptr + find_len <= end; ptr++)
+    {
+        if (ptr[0] == find[0] && DqnStr_Cmp(find, ptr, find_len) == 0)
+            return ptr;
+    }
+    return end;
+}
+
+FILE_SCOPE bool Xml_IsNameChar(char c) { return !DqnChar_IsWhitespace(c) && c != '>' && c != '/' && c != '=' && c != 0; }
+
+bool XmlTokenizer::Next(XmlToken *token)
+{
+    *token = {};
+    while (ptr < end)
+    {
+        if (ptr[0] != '<')
+        {
+            char const *text_start = ptr;
+            ptr = static_cast<char const *>(memchr(ptr, '<', end - ptr));
+            if (!ptr) ptr = end;
+            token->type = XmlToken::Type::Text;
+            token->text = DqnSlice<char const>(text_start, (int)(ptr - text_start));
+            return true;
+        }
+
+        DqnSlice<char const> rest(ptr, (int)(end - ptr));
+        bool bang = (ptr + 1 < end && ptr[1] == '!');
+        if (bang && SliceStartsWith(rest, "<!--", Dqn::IgnoreCase::No))
+        {
+            ptr = DQN_MIN(Xml_Find(ptr + 4, end, "-->") + 3, end);
+            continue;
+        }
+
+        if (bang && SliceStartsWith(rest, "<![CDATA[", Dqn::IgnoreCase::No))
+        {
+            char const *text_start = ptr + 9;
+            char const *text_end   = Xml_Find(text_start, end, "]]>");
+            ptr                    = DQN_MIN(text_end + 3, end);
+            token->type            = XmlToken::Type::Text;
+            token->text            = DqnSlice<char const>(text_start, (int)(text_end - text_start));
+            token->cdata           = true;
+            return true;
+        }
+
+        if (ptr + 1 < end && (ptr[1] == '?' || ptr[1] == '!'))
+        {
+            ptr = DQN_MIN(Xml_Find(ptr, end, ">") + 1, end);
+            continue;
+        }
+
+        ptr++;
+        token->type = XmlToken::Type::StartTag;
+        if (ptr < end && ptr[0] == '/')
+        {
+            token->type = XmlToken::Type::EndTag;
+            ptr++;
+        }
+
+        char const *name_start = ptr;
+        while (ptr < end && Xml_IsNameChar(ptr[0])) ptr++;
+        token->name = DqnSlice<char const>(name_start, (int)(ptr - name_start));
+
+        // NOTE(doyle): Attribute values may contain '>', skip over quoted values to find the real end
+        char const *attribs_start = ptr;
+        char quote                = 0;
+        for (; ptr < end; ptr++)
+        {
+            if (quote)                          { if (ptr[0] == quote) quote = 0; }
+            else if (ptr[0] == '"' || ptr[0] == '\'') quote = ptr[0];
+            else if (ptr[0] == '>')             break;
+        }
+
+        char const *attribs_end = ptr;
+        if (attribs_end > attribs_start && attribs_end[-1] == '/')
+        {
+            token->self_closing = true;
+            attribs_end--;
+        }
+        token->attribs = DqnSlice<char const>(attribs_start, (int)(attribs_end - attribs_start));
+        ptr            = DQN_MIN(ptr + 1, end);
+        return true;
+    }
+
+    return false;
+}
+
+// return: The value of the attribute in the start tag's attribs, entities still encoded. Empty if absent.
+FILE_SCOPE DqnSlice<char const> Xml_Attribute(DqnSlice<char const> attribs, char const *name)
+{
+    DqnSlice<char const> result = {};
+    char const *ptr             = attribs.data;
+    char const *end             = attribs.data + attribs.len;
+    i32 name_len                = DqnStr_Len(name);
+    while (ptr < end)
+    {
+        while (ptr < end && !Xml_IsNameChar(ptr[0])) ptr++;
+        char const *attrib_name = ptr;
+        while (ptr < end && Xml_IsNameChar(ptr[0])) ptr++;
+        i32 attrib_name_len = (i32)(ptr - attrib_name);
+
+        while (ptr < end && DqnChar_IsWhitespace(ptr[0])) ptr++;
+        if (ptr >= end || ptr[0] != '=')
+            continue;
+        ptr++;
+        while (ptr < end && DqnChar_IsWhitespace(ptr[0])) ptr++;
+        if (ptr >= end || (ptr[0] != '"' && ptr[0] != '\''))
+            continue;
+
+        char quote              = *ptr++;
+        char const *value_start = ptr;
+        while (ptr < end && ptr[0] != quote) ptr++;
+        if (attrib_name_len == name_len && DqnStr_Cmp(name, attrib_name, name_len, Dqn::IgnoreCase::Yes) == 0)
+        {
+            result = DqnSlice<char const>(value_start, (int)(ptr - value_start));
+            break;
+        }
+        ptr++;
+    }
+    return result;
+}
+
+// Iterates the entries of a playlist of any format
+struct PlaylistParser
+{
+    PlaylistFormat format;
+    char const    *ptr;
+    char const    *end;
+    XmlTokenizer   xml;
+    bool           in_track;          // XSPF: Inside <track>
+    bool           has_location;      // XSPF: The track's first <location> was taken
+    bool           in_location;       // XSPF: Inside the <location> to take
+
+    void Init(PlaylistFormat format_, char const *buf, usize buf_size);
+    bool Next(PlaylistEntry *entry); // return: False once there are no more entries
+
+    DqnSlice<char const> NextLine();
+};
+
+// The format by file extension, or by sniffing the content if the extension says nothing
+FILE_SCOPE PlaylistFormat DetectPlaylistFormat(char const *file_name, char const *buf, usize buf_size)
+{
+    char const *ext = nullptr;
+    for (char const *ptr = file_name; *ptr; ptr++)
+    {
+        if (*ptr == '.') ext = ptr + 1;
+    }
+
+    if (ext)
+    {
+        if (DqnStr_Cmp(ext, "pls",  -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::PLS;
+        if (DqnStr_Cmp(ext, "xspf", -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::XSPF;
+        if (DqnStr_Cmp(ext, "wpl",  -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::WPL;
+        if (DqnStr_Cmp(ext, "cue",  -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::CUE;
+        if (DqnStr_Cmp(ext, "m3u",  -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::M3U;
+        if (DqnStr_Cmp(ext, "m3u8", -1, Dqn::IgnoreCase::Yes) == 0) return PlaylistFormat::M3U;
+    }
+
+    DqnSlice<char const> head(buf, (int)DQN_MIN(buf_size, (usize)512));
+    while (head.len > 0 && (DqnChar_IsWhitespace(head.data[0]) || (u8)head.data[0] >= 0x80)) // Whitespace, UTF-8 BOM
+    {
+        head.data++;
+        head.len--;
+    }
+
+    if (SliceStartsWith(head, "[playlist]")) return PlaylistFormat::PLS;
+    if (SliceStartsWith(head, "<?wpl") || SliceStartsWith(head, "<smil")) return PlaylistFormat::WPL;
+    if (SliceStartsWith(head, "<?xml") || SliceStartsWith(head, "<playlist")) return PlaylistFormat::XSPF;
+    return PlaylistFormat::M3U;
+}
+
+void PlaylistParser::Init(PlaylistFormat format_, char const *buf, usize buf_size)
+{
+    *this  = {};
+    format = format_;
+    ptr    = buf;
+    end    = buf + buf_size;
+
+    // Skip UTF8-BOM bytes if present
+    if (buf_size >= 3 && (u8)ptr[0] == 0xEF && (u8)ptr[1] == 0xBB && (u8)ptr[2] == 0xBF)
+        ptr += 3;
+
+    xml.ptr = ptr;
+    xml.end = end;
+}
+
+// return: The next line trimmed of surrounding whitespace, empty lines included. Null data at the end.
+DqnSlice<char const> PlaylistParser::NextLine()
+{
+    DqnSlice<char const> result = {};
+    if (ptr >= end)
+        return result;
+
+    char const *line_start = ptr;
+    while (ptr < end && ptr[0] != '\n' && ptr[0] != '\r') ptr++;
+    char const *line_end = ptr;
+    if (ptr < end && ptr[0] == '\r') ptr++;
+    if (ptr < end && ptr[0] == '\n') ptr++;
+
+    while (line_start < line_end && DqnChar_IsWhitespace(line_start[0]))  line_start++;
+    while (line_end > line_start && DqnChar_IsWhitespace(line_end[-1]))  line_end--;
+    result = DqnSlice<char const>(line_start, (int)(line_end - line_start));
+    return result;
+}
+
+bool PlaylistParser::Next(PlaylistEntry *entry)
+{
+    *entry = {};
+    switch (format)
+    {
+        case PlaylistFormat::M3U:
+        {
+            for (DqnSlice<char const> line = NextLine(); line.data; line = NextLine())
+            {
+                if (line.len == 0 || line.data[0] == '#')
+                    continue;
+
+                // NOTE(doyle): "search: <words>" adds every library track matching the words
+                if (SliceStartsWith(line, "search:"))
+                {
+                    entry->type  = PlaylistEntry::Type::Search;
+                    entry->value = DqnSlice<char const>(line.data + DQN_CHAR_COUNT("search:"), line.len - (int)(DQN_CHAR_COUNT("search:")));
+                    return true;
+                }
+
+                entry->value = line;
+                entry->flags = SliceStartsWith(line, "file:") ? PlaylistEntry::Uri : 0;
+                return true;
+            }
+        }
+        break;
+
+        case PlaylistFormat::PLS:
+        {
+            for (DqnSlice<char const> line = NextLine(); line.data; line = NextLine())
+            {
+                if (!SliceStartsWith(line, "file"))
+                    continue;
+
+                i32 index = 4;
+                while (index < line.len && DqnChar_IsDigit(line.data[index])) index++;
+                if (index == 4 || index >= line.len || line.data[index] != '=')
+                    continue;
+
+                entry->value = DqnSlice<char const>(line.data + index + 1, line.len - index - 1);
+                entry->flags = SliceStartsWith(entry->value, "file:") ? PlaylistEntry::Uri : 0;
+                if (entry->value.len > 0)
+                    return true;
+            }
+        }
+        break;
+
+        case PlaylistFormat::CUE:
+        {
+            for (DqnSlice<char const> line = NextLine(); line.data; line = NextLine())
+            {
+                if (!SliceStartsWith(line, "FILE ") && !SliceStartsWith(line, "FILE\t"))
+                    continue;
+
+                // NOTE(doyle): FILE "name with spaces.wav" WAVE, or unquoted up to the file type
+                char const *value_start = line.data + 5;
+                char const *line_end    = line.data + line.len;
+                while (value_start < line_end && DqnChar_IsWhitespace(value_start[0])) value_start++;
+
+                char const *value_end = nullptr;
+                if (value_start < line_end && value_start[0] == '"')
+                {
+                    value_start++;
+                    value_end = value_start;
+                    while (value_end < line_end && value_end[0] != '"') value_end++;
+                }
+                else
+                {
+                    value_end = line_end;
+                    while (value_end > value_start && !DqnChar_IsWhitespace(value_end[-1])) value_end--;
+                    while (value_end > value_start && DqnChar_IsWhitespace(value_end[-1]))  value_end--;
+                    if (value_end == value_start) value_end = line_end; // No file type given
+                }
+
+                entry->value = DqnSlice<char const>(value_start, (int)(value_end - value_start));
+                if (entry->value.len > 0)
+                    return true;
+            }
+        }
+        break;
+
+        case PlaylistFormat::WPL:
+        {
+            for (XmlToken token = {}; xml.Next(&token);)
+            {
+                if (token.type != XmlToken::Type::StartTag || !DQN_SLICE_STRCMP(token.name, DQN_BUFFER_STR_LIT("media"), Dqn::IgnoreCase::Yes))
+                    continue;
+
+                entry->value = Xml_Attribute(token.attribs, "src");
+                entry->flags = PlaylistEntry::XmlEscaped | (SliceStartsWith(entry->value, "file:") ? PlaylistEntry::Uri : 0);
+                if (entry->value.len > 0)
+                    return true;
+            }
+        }
+        break;
+
+        case PlaylistFormat::XSPF:
+        {
+            DqnSlice<char const> location_name = DQN_BUFFER_STR_LIT("location");
+            DqnSlice<char const> track_name    = DQN_BUFFER_STR_LIT("track");
+            for (XmlToken token = {}; xml.Next(&token);)
+            {
+                if (token.type == XmlToken::Type::StartTag)
+                {
+                    if (DQN_SLICE_STRCMP(token.name, track_name, Dqn::IgnoreCase::Yes) && !token.self_closing)
+                    {
+                        in_track     = true;
+                        has_location = false;
+                    }
+                    else if (in_track && !has_location && DQN_SLICE_STRCMP(token.name, location_name, Dqn::IgnoreCase::Yes) && !token.self_closing)
+                    {
+                        in_location = true;
+                    }
+                }
+                else if (token.type == XmlToken::Type::EndTag)
+                {
+                    if (DQN_SLICE_STRCMP(token.name, track_name, Dqn::IgnoreCase::Yes))         in_track    = false;
+                    else if (DQN_SLICE_STRCMP(token.name, location_name, Dqn::IgnoreCase::Yes)) in_location = false;
+                }
+                else if (in_location)
+                {
+                    // NOTE(doyle): Alternative locations may follow, the first is the one we take
+                    DqnSlice<char const> text = token.text;
+                    while (text.len > 0 && DqnChar_IsWhitespace(text.data[0]))          { text.data++; text.len--; }
+                    while (text.len > 0 && DqnChar_IsWhitespace(text.data[text.len - 1])) text.len--;
+
+                    in_location  = false;
+                    has_location = true;
+                    entry->value = text;
+                    entry->flags = PlaylistEntry::Uri | (token.cdata ? 0 : PlaylistEntry::XmlEscaped);
+                    if (entry->value.len > 0)
+                        return true;
+                }
+            }
+        }
+        break;
+    }
+
+    return false;
+}
+
+FILE_SCOPE i32 HexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// return: The number of bytes written, up to 4
+FILE_SCOPE i32 EncodeUTF8(u32 codepoint, char *dest)
+{
+    if (codepoint < 0x80)    { dest[0] = (char)codepoint; return 1; }
+    if (codepoint < 0x800)   { dest[0] = (char)(0xC0 | (codepoint >> 6));  dest[1] = (char)(0x80 | (codepoint & 0x3F)); return 2; }
+    if (codepoint < 0x10000) { dest[0] = (char)(0xE0 | (codepoint >> 12)); dest[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F)); dest[2] = (char)(0x80 | (codepoint & 0x3F)); return 3; }
+    dest[0] = (char)(0xF0 | (codepoint >> 18));
+    dest[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    dest[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    dest[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Decode XML entities in place
+// return: The decoded length, never longer than len
+FILE_SCOPE i32 DecodeXmlEntities(char *str, i32 len)
+{
+    LOCAL_PERSIST struct { char const *name; char value; } const ENTITIES[] =
+    {
+        {"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''},
+    };
+
+    i32 result = 0;
+    for (i32 index = 0; index < len;)
+    {
+        if (str[index] != '&')
+        {
+            str[result++] = str[index++];
+            continue;
+        }
+
+        char const *entity = str + index + 1;
+        i32 entity_len     = len - index - 1;
+        bool decoded       = false;
+        for (auto const &named : ENTITIES)
+        {
+            i32 name_len = DqnStr_Len(named.name);
+            if (entity_len >= name_len && DqnStr_Cmp(named.name, entity, name_len) == 0)
+            {
+                str[result++] = named.value;
+                index        += 1 + name_len;
+                decoded       = true;
+                break;
+            }
+        }
+
+        if (!decoded && entity_len >= 3 && entity[0] == '#')
+        {
+            bool hex       = (entity[1] == 'x' || entity[1] == 'X');
+            i32 digit      = hex ? 2 : 1;
+            u32 codepoint  = 0;
+            for (; digit < entity_len && entity[digit] != ';' && digit < 10; digit++)
+            {
+                i32 value = hex ? HexDigitValue(entity[digit]) : (DqnChar_IsDigit(entity[digit]) ? entity[digit] - '0' : -1);
+                if (value < 0) break;
+                codepoint = codepoint * (hex ? 16 : 10) + value;
+            }
+
+            // NOTE(doyle): Decoding happens in place, the reference (& to ;) must be no shorter than its UTF-8
+            if (digit < entity_len && entity[digit] == ';' && codepoint > 0 && codepoint <= 0x10FFFF)
+            {
+                char utf8[4];
+                i32 utf8_len = EncodeUTF8(codepoint, utf8);
+                if (utf8_len <= digit + 2)
+                {
+                    DqnMem_Copy(str + result, utf8, utf8_len);
+                    result  += utf8_len;
+                    index   += digit + 2;
+                    decoded  = true;
+                }
+            }
+        }
+
+        if (!decoded)
+            str[result++] = str[index++];
+    }
+
+    return result;
+}
+
+// Decode %XX escapes in place
+// return: The decoded length
+FILE_SCOPE i32 DecodePercentEscapes(char *str, i32 len)
+{
+    i32 result = 0;
+    for (i32 index = 0; index < len; index++)
+    {
+        i32 high = (str[index] == '%' && index + 2 < len) ? HexDigitValue(str[index + 1]) : -1;
+        i32 low  = (high >= 0) ? HexDigitValue(str[index + 2]) : -1;
+        if (high >= 0 && low >= 0)
+        {
+            str[result++] = (char)((high << 4) | low);
+            index        += 2;
+        }
+        else
+        {
+            str[result++] = str[index];
+        }
+    }
+    return result;
+}
+
+// Turn an entry into the path the file system should see, a copy of the entry appended to paths that is
+// decoded, joined to the playlist's directory if relative and stripped of '.' and '..' components.
+// NOTE(doyle): Paths are appended to one buffer, a playlist's worth of entries is a handful of reallocs
+// instead of an allocation each.
+// dir: The playlist's directory, UTF-8
+// return: Offset of the null-terminated path in paths, -1 if the entry is not a local file (i.e. an http URI)
+FILE_SCOPE isize ResolvePlaylistEntry(DqnArray<char> *paths, DqnSlice<char const> dir, PlaylistEntry const *entry)
+{
+    DqnSlice<char const> value = entry->value;
+    bool uri                   = (entry->flags & PlaylistEntry::Uri);
+    bool unc                   = false;
+    if (uri)
+    {
+        if (SliceStartsWith(value, "file:"))
+        {
+            value.data += 5;
+            value.len  -= 5;
+
+            // NOTE(doyle): file:///C:/a.mp3 is a local path, file://server/share/a.mp3 a network one
+            if (SliceStartsWith(value, "//"))
+            {
+                value.data += 2;
+                value.len  -= 2;
+                if (SliceStartsWith(value, "/"))
+                {
+                    value.data++;
+                    value.len--;
+                }
+                else if (!SliceStartsWith(value, "localhost/"))
+                {
+                    unc = true;
+                }
+                else
+                {
+                    value.data += DQN_CHAR_COUNT("localhost/");
+                    value.len  -= (int)(DQN_CHAR_COUNT("localhost/"));
+                }
+            }
+        }
+    }
+
+    // NOTE(doyle): Any other scheme, "<scheme>:" before the first separator, is not a file we can sync.
+    // Drive letters are a single character.
+    if (!SliceStartsWith(entry->value, "file:"))
+    {
+        for (i32 index = 0; index < value.len && value.data[index] != '/' && value.data[index] != '\\'; index++)
+        {
+            if (value.data[index] == ':' && index > 1)
+                return -1;
+        }
+    }
+
+    // NOTE(doyle): Decode in place after room for what may go in front, either the UNC prefix or the
+    // directory and a separator. Decoding only ever shrinks the value.
+    isize prefix_len = DQN_MAX((isize)2, (isize)dir.len + 1);
+    isize buf_offset = paths->len;
+    paths->Resize(paths->len + prefix_len + value.len + 1);
+    char *path       = paths->data + buf_offset + prefix_len;
+    DqnMem_Copy(path, value.data, value.len);
+
+    i32 path_len = value.len;
+    if (entry->flags & PlaylistEntry::XmlEscaped) path_len = DecodeXmlEntities(path, path_len);
+    if (uri)                                      path_len = DecodePercentEscapes(path, path_len);
+
+    DQN_FOR_EACH(index, path_len)
+    {
+        if (path[index] == '/') path[index] = '\\';
+    }
+
+    // NOTE(doyle): Absolute are \\server, \root or X:\, everything else is relative to the playlist
+    bool absolute = unc || (path_len >= 1 && path[0] == '\\') || (path_len >= 2 && path[1] == ':');
+    char *start   = path;
+    if (unc)
+    {
+        start    -= 2;
+        start[0]  = '\\';
+        start[1]  = '\\';
+        path_len += 2;
+    }
+    else if (!absolute && dir.len > 0)
+    {
+        start    -= dir.len + 1;
+        DqnMem_Copy(start, dir.data, dir.len);
+        start[dir.len] = '\\';
+        path_len += dir.len + 1;
+    }
+    start[path_len] = 0;
+
+    // NOTE(doyle): Collapse "." and ".." so the same file is one path whichever playlist named it. The
+    // leading ".." of a relative path are kept, ".." at a root stays at the root.
+    char *prefix_end = start;
+    if      (start[0] == '\\' && start[1] == '\\') { prefix_end += 2; while (*prefix_end && *prefix_end != '\\') prefix_end++; }
+    else if (start[0] && start[1] == ':')          { prefix_end += 2; }
+    if (*prefix_end == '\\') prefix_end++;
+
+    bool rooted     = (prefix_end > start);
+    char *write     = prefix_end;
+    char *keep_base = prefix_end; // ".." can't pop below this
+    for (char *read = prefix_end; *read;)
+    {
+        char *component = read;
+        while (*read && *read != '\\') read++;
+        i32 component_len = (i32)(read - component);
+        if (*read) read++;
+
+        bool dot_dot = (component_len == 2 && component[0] == '.' && component[1] == '.');
+        if (component_len == 0 || (component_len == 1 && component[0] == '.'))
+            continue;
+
+        if (dot_dot && (write > keep_base || rooted))
+        {
+            while (write > keep_base && write[-1] != '\\') write--;
+            if (write > keep_base) write--; // Separator before the popped component
+            continue;
+        }
+
+        // NOTE(doyle): The output is never ahead of the input, a forward copy is safe
+        if (write > prefix_end) *write++ = '\\';
+        DQN_FOR_EACH(index, component_len)
+            write[index] = component[index];
+        write += component_len;
+
+        if (dot_dot)
+            keep_base = write;
+    }
+
+    *write      = 0;
+    isize result = start - paths->data;
+    paths->len   = (write + 1) - paths->data;
+    return result;
+}
+
+// Stat Cache
+// =================================================================================================
+// Every stage asks the file system about the same paths: the sources when playlists are parsed, their
+// destinations before linking and the destinations' directories before they're made. Across hundreds of
+// playlists sharing albums the cache answers each path once per run. A directory that several paths
+// ask about at once is listed instead, one listing answering for every entry in it.
+//
+// Paths compare ignoring ASCII case as the file system does. A listing only ever answers positively,
+// names missing from it are still stat'd before being reported missing since they may be spelt
+// differently (i.e. another Unicode normalisation) to the name on disk.
+//
+// Readers share the lock so any thread may look paths up, stages that create files or directories add
+// them once made so the cache never goes stale from our own writes.
+#define STAT_CACHE_LIST_THRESHOLD 4 // Uncached paths in one directory before it's listed instead of stat'd
+
+struct StatCacheEntry
+{
+    u64         hash;
+    u32         path_offset;
+    u32         path_len;
+    bool        exists;
+    bool        listed; // A directory whose entries have all been added
+    bool        stale;  // Invalidated, the path has to go to the file system again
+    DqnFileInfo info;
+};
+
+struct StatCache
+{
+    DqnRWLock                lock;
+    DqnArray<char>           strings;
+    DqnArray<StatCacheEntry> entries;
+    DqnArray<u32>            slots;        // entry index + 1 by path hash, 0 is empty
+
+    i64                      num_hits;     // Paths answered without going to the file system
+    i64                      num_stats;    // Paths stat'd
+    i64                      num_listings; // Directories listed
+
+    void Init  ();
+    void Free  ();
+    bool Lookup(char const *path, i32 len, StatCacheEntry *entry); // return: False if the path isn't cached, entry is a copy
+    void Set   (char const *path, i32 len, bool exists, DqnFileInfo const *info);
+    void Set_  (char const *path, i32 len, bool exists, DqnFileInfo const *info, bool listed); // Lock must be held exclusively
+    void Invalidate(char const *path, i32 len); // Forget the path and every path below it, i.e. after it changed on disk
+};
+
+FILE_SCOPE u64 StatCache_Hash(char const *path, i32 len)
+{
+    u64 result = 14695981039346656037ULL;
+    DQN_FOR_EACH(index, len)
+    {
+        result ^= (u8)DqnChar_ToLower(path[index]);
+        result *= 1099511628211ULL;
+    }
+    return result;
+}
+
+// return: The slot holding the path, or the empty slot it would go in
+FILE_SCOPE u32 StatCache_FindSlot(StatCache const *cache, char const *path, i32 len, u64 hash)
+{
+    u32 mask = (u32)cache->slots.len - 1;
+    u32 slot = (u32)hash & mask;
+    for (; cache->slots.data[slot]; slot = (slot + 1) & mask)
+    {
+        StatCacheEntry const *entry = cache->entries.data + (cache->slots.data[slot] - 1);
+        if (entry->hash == hash && (i32)entry->path_len == len &&
+            DqnStr_Cmp(cache->strings.data + entry->path_offset, path, len, Dqn::IgnoreCase::Yes) == 0)
+        {
+            break;
+        }
+    }
+    return slot;
+}
+
+void StatCache::Init()
+{
+    *this = {};
+    lock.Init();
+    u32 const empty_slot = 0;
+    slots.Resize(4096, &empty_slot);
+}
+
+void StatCache::Free()
+{
+    strings.Free();
+    entries.Free();
+    slots.Free();
+    lock.Delete();
+}
+
+bool StatCache::Lookup(char const *path, i32 len, StatCacheEntry *entry)
+{
+    u64 hash = StatCache_Hash(path, len);
+    lock.AcquireShared();
+    u32 slot    = StatCache_FindSlot(this, path, len, hash);
+    bool result = (slots.data[slot] != 0 && !entries.data[slots.data[slot] - 1].stale);
+    if (result) *entry = entries.data[slots.data[slot] - 1];
+    lock.ReleaseShared();
+    return result;
+}
+
+void StatCache::Set(char const *path, i32 len, bool exists, DqnFileInfo const *info)
+{
+    lock.AcquireExclusive();
+    Set_(path, len, exists, info, false /*listed*/);
+    lock.ReleaseExclusive();
+}
+
+void StatCache::Set_(char const *path, i32 len, bool exists, DqnFileInfo const *info, bool listed)
+{
+    if ((entries.len + 1) * 2 > slots.len)
+    {
+        u32 const empty_slot = 0;
+        isize new_len        = slots.len * 2;
+        slots.Clear();
+        slots.Resize(new_len, &empty_slot);
+        DQN_FOR_EACH(entry_index, entries.len)
+        {
+            StatCacheEntry const *entry = entries.data + entry_index;
+            u32 slot                    = StatCache_FindSlot(this, strings.data + entry->path_offset, entry->path_len, entry->hash);
+            slots.data[slot]            = (u32)entry_index + 1;
+        }
+    }
+
+    u64 hash = StatCache_Hash(path, len);
+    u32 slot = StatCache_FindSlot(this, path, len, hash);
+    if (!slots.data[slot])
+    {
+        StatCacheEntry new_entry = {};
+        new_entry.hash           = hash;
+        new_entry.path_offset    = (u32)strings.len;
+        new_entry.path_len       = (u32)len;
+        strings.Push(path, len);
+        strings.Push(0);
+        entries.Push(new_entry);
+        slots.data[slot] = (u32)entries.len;
+    }
+
+    StatCacheEntry *entry = entries.data + (slots.data[slot] - 1);
+    if (entry->stale)
+    {
+        entry->stale  = false;
+        entry->listed = false;
+    }
+
+    entry->exists  = exists;
+    entry->info    = (info) ? *info : DqnFileInfo{};
+    entry->listed |= listed;
+}
+
+// NOTE(doyle): Entries can't be removed from the open addressed table, they're marked stale instead and
+// revived by the next Set. A change is rare enough that checking every entry for the prefix is fine.
+void StatCache::Invalidate(char const *path, i32 len)
+{
+    lock.AcquireExclusive();
+    for (StatCacheEntry &entry : entries)
+    {
+        if ((i32)entry.path_len < len)
+            continue;
+
+        char const *entry_path = strings.data + entry.path_offset;
+        char next              = entry_path[len];
+        if ((next == 0 || next == '\\' || next == '/') && DqnStr_Cmp(entry_path, path, len, Dqn::IgnoreCase::Yes) == 0)
+            entry.stale = true;
+    }
+    lock.ReleaseExclusive();
+}
+
+// return: Length of the directory part of the path, excluding the separator. -1 if there is none.
+FILE_SCOPE i32 StatCache_DirLen(char const *path)
+{
+    i32 result = -1;
+    for (char const *ptr = path; *ptr; ptr++)
+    {
+        if (*ptr == '\\' || *ptr == '/') result = (i32)(ptr - path);
+    }
+    return result;
+}
+
+FILE_SCOPE bool StatCache_DirLessThan(isize const &a, isize const &b, void *user_context)
+{
+    auto const *ops = static_cast<DqnFileOp const *>(user_context);
+    char const *a_path = ops[a].path;
+    char const *b_path = ops[b].path;
+    i32 a_len          = StatCache_DirLen(a_path);
+    i32 b_len          = StatCache_DirLen(b_path);
+    if (a_len != b_len) return a_len < b_len;
+    return DqnStr_Cmp(a_path, b_path, DQN_MAX(a_len, 0), Dqn::IgnoreCase::Yes) < 0;
+}
+
+// Fill the stat ops from the cache, listing directories that are asked about often enough and stat'ing
+// the rest in one batch. Results are the same as executing the ops on the file batch.
+FILE_SCOPE void StatCache_Stat(Context *context, DqnFileOp *ops, isize num_ops)
+{
+    StatCache *cache = context->stat_cache;
+    i64 num_hits     = 0;
+    i64 num_stats    = 0;
+    i64 num_listings = 0;
+
+    DqnArray<isize> pending       = {};
+    DqnArray<isize> batch_indexes = {};
+    DqnArray<DqnFileOp> batch_ops = {};
+    DQN_DEFER
+    {
+        pending.Free();
+        batch_indexes.Free();
+        batch_ops.Free();
+    };
+
+    auto AnswerFromCache = [cache](DqnFileOp *op) -> bool {
+        StatCacheEntry entry = {};
+        if (!cache->Lookup(op->path, DqnStr_Len(op->path), &entry))
+            return false;
+
+        op->success = entry.exists;
+        op->error   = (entry.exists) ? 0 : 2; // ERROR_FILE_NOT_FOUND and ENOENT
+        op->info    = entry.info;
+        return true;
+    };
+
+    DQN_FOR_EACH(op_index, num_ops)
+    {
+        DQN_ASSERT(ops[op_index].type == DqnFileOp::Type::Stat);
+        if (AnswerFromCache(ops + op_index)) num_hits++;
+        else                                  pending.Push(op_index);
+    }
+
+    // NOTE(doyle): List the directories that enough of the remaining paths are in
+    DqnQuickSort<isize, StatCache_DirLessThan>(pending.data, pending.len, ops);
+    for (isize run_start = 0; run_start < pending.len;)
+    {
+        char const *dir = ops[pending.data[run_start]].path;
+        i32 dir_len     = StatCache_DirLen(dir);
+        isize run_end   = run_start + 1;
+        while (run_end < pending.len && !StatCache_DirLessThan(pending.data[run_start], pending.data[run_end], ops))
+            run_end++;
+
+        StatCacheEntry dir_entry = {};
+        bool listed = cache->Lookup(dir, dir_len, &dir_entry) && dir_entry.listed;
+        if (dir_len > 0 && !listed && run_end - run_start >= STAT_CACHE_LIST_THRESHOLD)
+        {
+            auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+            char *dir_path = CopyStringToBuffer(&global_func_local_allocator_, dir, dir_len).str;
+
+            DqnFileDirList list = {};
+            if (DqnFile_ListDir(dir_path, &global_func_local_allocator_, &list, DqnFileDirList::Info))
+            {
+                num_listings++;
+                DqnArray<char> entry_path = {};
+                DQN_DEFER { entry_path.Free(); };
+
+                cache->lock.AcquireExclusive();
+                for (DqnFileDirList::Entry const &list_entry : list)
+                {
+                    entry_path.Clear();
+                    entry_path.Push(dir, dir_len);
+                    entry_path.Push('\\');
+                    entry_path.Push(list_entry.name.data, list_entry.name.len);
+
+                    DqnFileInfo info          = {};
+                    info.size                 = list_entry.size;
+                    info.last_write_time_in_s = list_entry.last_write_time_in_s;
+                    cache->Set_(entry_path.data, (i32)entry_path.len, true /*exists*/, &info, false /*listed*/);
+                }
+                cache->Set_(dir, dir_len, true /*exists*/, nullptr, true /*listed*/);
+                cache->lock.ReleaseExclusive();
+            }
+        }
+
+        run_start = run_end;
+    }
+
+    // NOTE(doyle): Whatever the listings didn't find is stat'd, see the note at the top
+    for (isize op_index : pending)
+    {
+        if (AnswerFromCache(ops + op_index) && ops[op_index].success)
+        {
+            num_hits++;
+            continue;
+        }
+
+        batch_indexes.Push(op_index);
+        batch_ops.Push(ops[op_index]);
+    }
+
+    num_stats += batch_ops.len;
+    ExecuteFileOps(context, batch_ops.data, batch_ops.len);
+
+    cache->lock.AcquireExclusive();
+    DQN_FOR_EACH(batch_index, batch_ops.len)
+    {
+        DqnFileOp *op = ops + batch_indexes.data[batch_index];
+        *op           = batch_ops.data[batch_index];
+        cache->Set_(op->path, DqnStr_Len(op->path), op->success, op->success ? &op->info : nullptr, false /*listed*/);
+    }
+
+    cache->num_hits     += num_hits;
+    cache->num_stats    += num_stats;
+    cache->num_listings += num_listings;
+    cache->lock.ReleaseExclusive();
+}
+
+// Check the stat ops' paths exist, all in one batch, and make a sound table of the ones that do
+FILE_SCOPE DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> StatSoundPaths(Context *context, DqnArray<DqnFileOp> *stat_ops)
+{
+    DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> result(DQN_MEGABYTE(8));
+
+    // NOTE(doyle): Existence checks are independent, let the batch have them all in flight at once
+    {
+        STAGE_SCOPE(&context->stats, Stage::ExistenceCheck);
+        StatCache_Stat(context, stat_ops->data, stat_ops->len);
+        context->stats[Stage::ExistenceCheck]->items += stat_ops->len;
+    }
+
+    for (DqnFileOp const &op : *stat_ops)
+    {
+        if (op.success)
+        {
+            DqnBuffer<wchar_t> file_path = {};
+            file_path.str                = UTF8ToWChar(&context->allocator, op.path, &file_path.len);
+            SoundFile *sound_file        = result.GetOrMake(file_path);
+            *sound_file                  = {};
+            sound_file->info             = op.info;
+        }
+        else
+        {
+            context->stats[Stage::ExistenceCheck]->failures++;
+            fprintf(stdout, "Could not access file in file system: %s\n", op.path);
+        }
+    }
+
+    return result;
+}
+
+// What a playlist was made from, so it's only synced again when one of its sounds changes
+struct PlaylistSources
+{
+    DqnArray<u64> path_hashes; // StatCache_Hash of every sound path the playlist lists, sorted
+    bool          has_search;  // Has search: entries, which may match any sound
+};
+
+// The path hashes of the sounds a playlist has passed on so far, so a sound listed twice is synced and
+// listed once. Open addressed, 8 bytes a sound, it's the only part of a streamed playlist that grows
+// with its length.
+struct PathHashSet
+{
+    u64  *slots;     // 0 is an empty slot
+    isize num_slots; // Power of 2
+    isize num_used;
+
+    bool Add (u64 hash); // return: False if the hash was already in the set
+    void Free()          { if (slots) dqn_lib_context_.allocator->Free(slots, sizeof(*slots) * num_slots); *this = {}; }
+};
+
+bool PathHashSet::Add(u64 hash)
+{
+    if (hash == 0) hash = 1;
+    if ((num_used + 1) * 2 > num_slots)
+    {
+        isize new_num_slots = DQN_MAX(num_slots * 2, (isize)1024);
+        auto *new_slots     = static_cast<u64 *>(dqn_lib_context_.allocator->Malloc(sizeof(u64) * new_num_slots, Dqn::ZeroMem::Yes));
+        if (!new_slots)
+            return true; // NOTE(doyle): A duplicate is synced twice rather than a sound not at all
+
+        DQN_FOR_EACH(slot_index, num_slots)
+        {
+            if (u64 slot = slots[slot_index])
+            {
+                isize index = (isize)(slot & (new_num_slots - 1));
+                while (new_slots[index]) index = (index + 1) & (new_num_slots - 1);
+                new_slots[index] = slot;
+            }
+        }
+
+        if (slots) dqn_lib_context_.allocator->Free(slots, sizeof(*slots) * num_slots);
+        slots     = new_slots;
+        num_slots = new_num_slots;
+    }
+
+    isize index = (isize)(hash & (num_slots - 1));
+    for (; slots[index]; index = (index + 1) & (num_slots - 1))
+    {
+        if (slots[index] == hash)
+            return false;
+    }
+
+    slots[index] = hash;
+    num_used++;
+    return true;
+}
+
+// A chunk of a playlist's sounds, stat'd and ready to sync. The table and the memory it was made in are
+// released once the proc returns.
+typedef void PlaylistChunkProc(Context *context, DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> *sounds, void *user_data);
+
+// Parse the playlist and pass its sounds to chunk_proc, context->stream_chunk_size entries at a time if
+// it's set, otherwise all at once. A chunk is synced before the next is parsed, so memory stays the same
+// however long the playlist is. A sound listed more than once is only passed the first time.
+// sources: (Optional) Filled with the paths the playlist lists, whether they exist or not
+FILE_SCOPE void ReadPlaylistFile(Context *context, wchar_t const *file, PlaylistSources *sources, PlaylistChunkProc *chunk_proc, void *user_data)
+{
+    // NOTE(doyle): Nothing is kept on the func local allocator, chunks are synced whilst the file is read
+    char const *file_utf8 = WCharToUTF8(&context->allocator, file);
+
+    // NOTE(doyle): Mapping fails on empty files, which are fine, they just have no entries
+    DqnFileMap map = {};
+    DqnFileInfo info = {};
+    {
+        STAGE_SCOPE(&context->stats, Stage::PlaylistParse);
+        if (!map.Map(file))
+        {
+            if (DqnFile_GetInfo(file, &info) && info.size == 0)
+                return;
+
+            context->stats[Stage::PlaylistParse]->failures++;
+            char const *msg = DQN_LOGGER_W(&context->logger, "DqnFileMap: Failed, could not map file: %s", file_utf8);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            return;
+        }
+        context->stats[Stage::PlaylistParse]->items++;
+        context->stats[Stage::PlaylistParse]->bytes += map.size;
+    }
+    DQN_DEFER { map.Unmap(); };
+
+    DqnSlice<char const> dir = DqnSlice<char const>(file_utf8, 0);
+    for (char const *ptr = file_utf8; *ptr; ptr++)
+    {
+        if (*ptr == '\\' || *ptr == '/') dir.len = (int)(ptr - file_utf8);
+    }
+
+    char const *file_name = (dir.len > 0) ? file_utf8 + dir.len + 1 : file_utf8;
+    auto const *buf       = reinterpret_cast<char const *>(map.data);
+    PlaylistParser parser = {};
+    parser.Init(DetectPlaylistFormat(file_name, buf, map.size), buf, map.size);
+
+    DqnArray<DqnFileOp> stat_ops = {};
+    DqnArray<char> paths         = {};
+    PathHashSet seen             = {};
+    DQN_DEFER
+    {
+        stat_ops.Free();
+        paths.Free();
+        seen.Free();
+    };
+
+    isize chunk_size    = (context->stream_chunk_size > 0) ? context->stream_chunk_size : DQN_I64_MAX;
+    PlaylistEntry entry = {};
+    for (bool parsing = true; parsing;)
+    {
+        {
+            STAGE_SCOPE(&context->stats, Stage::PlaylistParse);
+            while (stat_ops.len < chunk_size && (parsing = parser.Next(&entry)))
+            {
+                if (entry.type == PlaylistEntry::Type::Search)
+                {
+                    if (sources) sources->has_search = true;
+                    isize num_ops = stat_ops.len;
+                    SearchLibrary(context, entry.value, &stat_ops);
+                    LiveMetrics_Add(LiveCounter::EntriesParsed, stat_ops.len - num_ops);
+                    continue;
+                }
+
+                isize path_offset = ResolvePlaylistEntry(&paths, dir, &entry);
+                if (path_offset == -1)
+                {
+                    char const *msg = DQN_LOGGER_W(&context->logger, "Playlist entry is not a local file, skipped: %.*s", entry.value.len, entry.value.data);
+                    global_logger_buf.Push(msg, DqnStr_Len(msg));
+                    continue;
+                }
+
+                // NOTE(doyle): paths may move as it grows, the op is pointed into it once the chunk is parsed
+                DqnFileOp op = {};
+                op.type      = DqnFileOp::Type::Stat;
+                op.user_data = reinterpret_cast<void *>(path_offset);
+                stat_ops.Push(op);
+                LiveMetrics_Add(LiveCounter::EntriesParsed, 1);
+            }
+
+            isize num_ops = 0;
+            for (DqnFileOp &op : stat_ops)
+            {
+                if (!op.path)
+                    op.path = paths.data + reinterpret_cast<isize>(op.user_data);
+
+                u64 path_hash = StatCache_Hash(op.path, DqnStr_Len(op.path));
+                if (!seen.Add(path_hash))
+                    continue;
+
+                if (sources) sources->path_hashes.Push(path_hash);
+                stat_ops.data[num_ops++] = op;
+            }
+            stat_ops.len = num_ops;
+        }
+
+        if (stat_ops.len > 0)
+        {
+            auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+            DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> sounds = StatSoundPaths(context, &stat_ops);
+            DQN_DEFER { sounds.Free(); };
+
+#if 0
+            for (DqnVHashTable<DqnBuffer<wchar_t>, SoundFile>::Entry const &sound : sounds)
+                fwprintf(stdout, L"parsed line: %s\n", sound.key.str);
+#endif
+
+            if (sounds.num_used_entries > 0)
+                chunk_proc(context, &sounds, user_data);
+        }
+
+        stat_ops.Clear();
+        paths.Clear();
+    }
+
+    if (sources)
+        DqnQuickSort(sources->path_hashes.data, sources->path_hashes.len);
+}
+
+FILE_SCOPE bool ExtractSoundMetadata(DqnMemStack *allocator, AVDictionary const *dictionary, SoundMetadata *metadata)
+{
+    bool atleast_one_entry_filled = false;
+    if (!dictionary) return atleast_one_entry_filled;
+
+    AVDictionaryEntry const *entry = av_dict_get(dictionary, "", nullptr, AV_DICT_IGNORE_SUFFIX);
+    if (!entry) return atleast_one_entry_filled;
+
+    while (entry)
+    {
+        DqnBuffer<wchar_t> *dest_buffer = nullptr;
+        const auto key                  = DqnSlice<char>(entry->key, DqnStr_Len(entry->key));
+
+        if      (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("album"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->album;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("album_artist"), Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->album_artist;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("artist"),       Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->artist;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("date"),         Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->date;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("disc"),         Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->disc;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("genre"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->genre;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("title"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->title;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("track"),        Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->track;
+        else if (DQN_BUFFER_STRCMP(key, DQN_BUFFER_STR_LIT("tracktotal"),   Dqn::IgnoreCase::Yes)) dest_buffer = &metadata->tracktotal;
+
+        if (dest_buffer && dest_buffer->len == 0)
+        {
+            atleast_one_entry_filled = true;
+            const auto value         = DqnSlice<char>(entry->value, DqnStr_Len(entry->value));
+            dest_buffer->str = UTF8ToWChar(allocator, value.str, &dest_buffer->len);
+        }
+
+        AVDictionaryEntry const *prev_entry = entry;
+        entry = av_dict_get(dictionary, "", prev_entry, AV_DICT_IGNORE_SUFFIX);
+    }
+
+    return atleast_one_entry_filled;
+}
+
+DqnBuffer<wchar_t> AllocateSwprintf(DqnMemStack *allocator, wchar_t const *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    DqnBuffer<wchar_t> result = {};
+    result.len                = vswprintf(nullptr, 0, fmt, va) + 1;
+    result.str                = DQN_MEMSTACK_PUSH_ARRAY(allocator, wchar_t, result.len);
+    vswprintf(result.str, result.len, fmt, va);
+    va_end(va);
+    return result;
+}
+
+void CheckAllocatorHasZeroAllocations(DqnMemStack const *allocator)
+{
+    DQN_ASSERTM(!allocator->block->prev_block, "Allocator should not have multiple blocks at zero allocations, just the initial block.");
+    DQN_ASSERTM(allocator->block->Usage() == 0, "Allocator has non-zero memory usage: %zu\n", allocator->block->Usage());
+}
+
+// NOTE(doyle): libavformat opening files by path does its own small reads and probes the whole
+// probe window per file. Instead we hand it an AVIOContext over our reader, which serves reads from a
+// mapping of the file (no syscalls per read) or failing that, large block reads.
+#define SOUND_READER_BLOCK_SIZE DQN_KILOBYTE(256)
+#define SOUND_READER_AVIO_SIZE  DQN_KILOBYTE(64)
+
+// Per-thread scratch reused across files so probing a library doesn't malloc and free I/O buffers per
+// track. libavformat may swap the AVIO buffer out from under us (i.e. ffio_set_buf_size, rewinding
+// with probe data), so whatever buffer it holds on release is what we keep.
+struct SoundReaderScratch
+{
+    u8 *avio_buf;
+    int avio_buf_size;
+    u8 *block;
+};
+
+FILE_SCOPE thread_local SoundReaderScratch global_sound_reader_scratch_;
+
+struct SoundReader
+{
+    DqnFileMap  map;          // If mapped, reads are served from the mapping
+    DqnFile     file;         // Otherwise reads are served in blocks from the file
+    u8         *block;
+    i64         block_offset; // File offset of block[0]
+    i64         block_len;
+
+    i64         pos;
+    i64         size;
+    i64         bytes_read;   // Bytes handed to libavformat
+
+    AVIOContext *avio;
+
+    bool Open (wchar_t const *path);
+    void Close();
+};
+
+FILE_SCOPE int SoundReader_AVIORead(void *user_data, u8 *buf, int buf_size)
+{
+    auto *reader = static_cast<SoundReader *>(user_data);
+    if (reader->pos >= reader->size)
+        return AVERROR_EOF;
+
+    i64 bytes_to_copy = DQN_MIN((i64)buf_size, reader->size - reader->pos);
+    if (reader->map.data)
+    {
+        DqnMem_Copy(buf, reader->map.data + reader->pos, bytes_to_copy);
+    }
+    else
+    {
+        for (i64 copied = 0; copied < bytes_to_copy;)
+        {
+            i64 pos = reader->pos + copied;
+            if (pos < reader->block_offset || pos >= reader->block_offset + reader->block_len)
+            {
+                reader->block_offset = pos;
+                reader->block_len    = (i64)reader->file.ReadAt(reader->block, SOUND_READER_BLOCK_SIZE, (usize)pos);
+                if (reader->block_len <= 0)
+                {
+                    bytes_to_copy = copied;
+                    break;
+                }
+            }
+
+            i64 block_pos = pos - reader->block_offset;
+            i64 len       = DQN_MIN(bytes_to_copy - copied, reader->block_len - block_pos);
+            DqnMem_Copy(buf + copied, reader->block + block_pos, len);
+            copied += len;
+        }
+    }
+
+    if (bytes_to_copy == 0)
+        return AVERROR_EOF;
+
+    reader->pos        += bytes_to_copy;
+    reader->bytes_read += bytes_to_copy;
+    LiveMetrics_Add(LiveCounter::BytesRead, bytes_to_copy);
+    return (int)bytes_to_copy;
+}
+
+FILE_SCOPE i64 SoundReader_AVIOSeek(void *user_data, i64 offset, int whence)
+{
+    auto *reader = static_cast<SoundReader *>(user_data);
+    i64 result   = -1;
+    switch (whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE: return reader->size;
+        case SEEK_SET:    result = offset; break;
+        case SEEK_CUR:    result = reader->pos + offset; break;
+        case SEEK_END:    result = reader->size + offset; break;
+    }
+
+    if (result < 0)
+        return -1;
+
+    reader->pos = DQN_MIN(result, reader->size);
+    return reader->pos;
+}
+
+bool SoundReader::Open(wchar_t const *path)
+{
+    *this                        = {};
+    SoundReaderScratch *scratch  = &global_sound_reader_scratch_;
+    if (this->map.Map(path))
+    {
+        this->size = (i64)this->map.size;
+    }
+    else
+    {
+        if (!this->file.Open(path, DqnFile::Flag::FileRead, DqnFile::Action::OpenOnly))
+            return false;
+
+        if (!scratch->block)
+            scratch->block = static_cast<u8 *>(av_malloc(SOUND_READER_BLOCK_SIZE));
+
+        this->block = scratch->block;
+        this->size  = (i64)this->file.size;
+    }
+
+    if (!scratch->avio_buf || scratch->avio_buf_size < SOUND_READER_AVIO_SIZE)
+    {
+        av_free(scratch->avio_buf);
+        scratch->avio_buf      = static_cast<u8 *>(av_malloc(SOUND_READER_AVIO_SIZE));
+        scratch->avio_buf_size = SOUND_READER_AVIO_SIZE;
+    }
+
+    this->avio = avio_alloc_context(scratch->avio_buf, scratch->avio_buf_size, 0 /*write_flag*/, this, SoundReader_AVIORead, nullptr, SoundReader_AVIOSeek);
+    if (!this->avio || (!this->block && !this->map.data))
+    {
+        this->Close();
+        return false;
+    }
+
+    // NOTE(doyle): The context owns the buffer now, it's given back to the scratch on Close()
+    scratch->avio_buf      = nullptr;
+    scratch->avio_buf_size = 0;
+    return true;
+}
+
+void SoundReader::Close()
+{
+    if (this->avio)
+    {
+        SoundReaderScratch *scratch = &global_sound_reader_scratch_;
+        av_free(scratch->avio_buf);
+        scratch->avio_buf      = this->avio->buffer;
+        scratch->avio_buf_size = this->avio->buffer_size;
+        avio_context_free(&this->avio);
+    }
+
+    this->map.Unmap();
+    if (this->file.handle) this->file.Close();
+}
+
+// Open the sound file for tag access only. Probing is bounded, we only need the container header and
+// tags, not stream parameters, so nothing past the header is read for analysis.
+FILE_SCOPE AVFormatContext *OpenSoundForTags(SoundReader *reader, char const *path_utf8)
+{
+    AVFormatContext *result = avformat_alloc_context();
+    if (!result)
+        return nullptr;
+
+    result->pb     = reader->avio;
+    result->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    AVDictionary *options = nullptr;
+    av_dict_set(&options, "formatprobesize", "32768", 0);
+    av_dict_set(&options, "probesize",       "32768", 0);
+    av_dict_set(&options, "analyzeduration", "0",     0);
+    DQN_DEFER { av_dict_free(&options); };
+
+    // NOTE: The path is only passed so the extension can be used as a hint when the probe is ambiguous,
+    // i.e. an ID3v2 tag larger than the probe window. On failure avformat_open_input frees result.
+    if (avformat_open_input(&result, path_utf8, nullptr, &options) != 0)
+        return nullptr;
+
+    return result;
+}
+
+// Cover Art
+// =================================================================================================
+// Front covers embedded in sounds are stored once per unique image in Art\, named by the hash of their
+// bytes so the 15 tracks of an album sharing a cover store it once. The cover is the attached picture
+// packet libavformat reads along with the header, no audio is read or decoded for it. Every album
+// directory in Output gets its cover as a folder.jpg (or .png) linked from the store.
+//
+// The names are the store's index, <hash as hex>.jpg|.png, and <hash as hex>_thumb.jpg for the
+// thumbnail of an image with --art-thumbnail-px.
+#define ART_THUMBNAIL_SUFFIX "_thumb.jpg"
+
+struct ArtEntry
+{
+    DqnFileInfo info;         // Of the stored image
+    char        extension[8]; // ".jpg" or ".png"
+};
+
+struct ArtStore
+{
+    DqnBuffer<wchar_t>           dir;
+    char                        *dir_utf8;
+    int                          thumbnail_px; // Longest side of thumbnails, 0 for no thumbnails
+    i64                          num_stored;   // Images new this run
+    i64                          num_reused;   // Covers of sounds that were already stored
+    i64                          num_thumbnails;
+    DqnVHashTable<u64, ArtEntry> entries;
+    DqnArray<u64>                pending_thumbnails; // Images without a thumbnail yet
+
+    bool Load(Context *context, int thumbnail_px_);
+    void Free() { entries.Free(); pending_thumbnails.Free(); }
+    u64  Put (Context *context, u8 const *data, int size); // return: The image's hash, 0 if it's not a JPEG or PNG or could not be stored
+};
+
+// extension: Including the '.', or ART_THUMBNAIL_SUFFIX
+FILE_SCOPE char *ArtStore_Path(DqnMemStack *allocator, ArtStore const *store, u64 hash, char const *extension)
+{
+    char *result = DQN_MEMSTACK_PUSH_ARRAY(allocator, char, DqnStr_Len(store->dir_utf8) + 1 + 16 + DqnStr_Len(extension) + 1);
+    Dqn_sprintf(result, "%s\\%016llx%s", store->dir_utf8, (unsigned long long)hash, extension);
+    return result;
+}
+
+// return: False if the name isn't 16 lower case hex digits followed by suffix
+FILE_SCOPE bool ArtStore_ParseName(DqnSlice<char> name, char const *suffix, u64 *hash)
+{
+    i32 suffix_len = DqnStr_Len(suffix);
+    if (name.len != 16 + suffix_len || DqnStr_Cmp(name.data + 16, suffix, suffix_len) != 0)
+        return false;
+
+    *hash = 0;
+    DQN_FOR_EACH(i, 16)
+    {
+        char ch = name.data[i];
+        int digit;
+        if      (ch >= '0' && ch <= '9') digit = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') digit = ch - 'a' + 10;
+        else return false;
+        *hash = (*hash << 4) | (u64)digit;
+    }
+    return true;
+}
+
+bool ArtStore::Load(Context *context, int thumbnail_px_)
+{
+    *this              = {};
+    this->thumbnail_px = thumbnail_px_;
+    this->dir          = AllocateSwprintf(&context->allocator, L"%s\\Art", context->exe_directory.str);
+    this->dir_utf8     = WCharToUTF8(&context->allocator, this->dir.str);
+    this->entries.LazyInit(DQN_MEGABYTE(1));
+    if (!DqnFile_MakeDir(this->dir_utf8))
+        return false;
+
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+    DqnFileDirList files             = {};
+    DqnArray<u64> thumbnails         = {};
+    DQN_DEFER { thumbnails.Free(); };
+    DqnFile_ListDir(this->dir_utf8, &context->allocator, &files, DqnFileDirList::Info);
+    for (DqnFileDirList::Entry const &file : files)
+    {
+        u64 hash = 0;
+        if (file.type != DqnFileDirEntry::Type::File)
+            continue;
+
+        if (ArtStore_ParseName(file.name, ART_THUMBNAIL_SUFFIX, &hash))
+        {
+            thumbnails.Push(hash);
+            continue;
+        }
+
+        char const *extension = (ArtStore_ParseName(file.name, ".jpg", &hash)) ? ".jpg" : (ArtStore_ParseName(file.name, ".png", &hash)) ? ".png" : nullptr;
+        if (!extension)
+            continue;
+
+        ArtEntry *entry                  = this->entries.GetOrMake(hash);
+        *entry                           = {};
+        entry->info.size                 = file.size;
+        entry->info.last_write_time_in_s = file.last_write_time_in_s;
+        DqnMem_Copy(entry->extension, extension, DqnStr_Len(extension));
+    }
+
+    // NOTE(doyle): Images stored before thumbnails were asked for get theirs now
+    if (this->thumbnail_px > 0)
+    {
+        DqnQuickSort(thumbnails.data, thumbnails.len);
+        for (DqnVHashTable<u64, ArtEntry>::Entry const &entry : this->entries)
+        {
+            if (DqnBSearch(thumbnails.data, thumbnails.len, entry.key) == -1)
+                this->pending_thumbnails.Push(entry.key);
+        }
+    }
+
+    return true;
+}
+
+u64 ArtStore::Put(Context *context, u8 const *data, int size)
+{
+    char const *extension = nullptr;
+    if      (size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)  extension = ".jpg";
+    else if (size > 8 && DqnMem_Cmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)          extension = ".png";
+    if (!extension)
+        return 0;
+
+    u64 result = DqnHash_Murmur64(data, (usize)size);
+    if (result == 0) result = 1; // NOTE(doyle): 0 is no cover
+    if (entries.Get(result))
+    {
+        num_reused++;
+        return result;
+    }
+
+    // NOTE(doyle): Written under a temporary name first, a name in the store is always a whole image
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+    char *path         = ArtStore_Path(&context->allocator, this, result, extension);
+    char *partial_path = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, char, DqnStr_Len(path) + 6);
+    Dqn_sprintf(partial_path, "%s.part", path);
+
+    ArtEntry entry = {};
+    bool stored    = DqnFile_WriteAll(partial_path, data, (usize)size) &&
+                     MoveFileExW(UTF8ToWChar(&context->allocator, partial_path), UTF8ToWChar(&context->allocator, path), MOVEFILE_REPLACE_EXISTING) &&
+                     DqnFile_GetInfo(path, &entry.info);
+    if (!stored)
+    {
+        DqnFile_Delete(partial_path);
+        char const *msg = DQN_LOGGER_E(&context->logger, "Could not store cover art at: %s", path);
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+        return 0;
+    }
+
+    DqnMem_Copy(entry.extension, extension, DqnStr_Len(extension));
+    entries.Set(result, entry);
+    num_stored++;
+    if (thumbnail_px > 0)
+        pending_thumbnails.Push(result);
+    return result;
+}
+
+// return: The front cover's picture packet if the sound has any attached pictures, the first of them
+//         if none is marked as the front cover
+FILE_SCOPE AVPacket const *FindFrontCover(AVFormatContext const *fmt_context)
+{
+    AVPacket const *result = nullptr;
+    DQN_FOR_EACH(i, fmt_context->nb_streams)
+    {
+        AVStream const *stream = fmt_context->streams[i];
+        if (!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC) || stream->attached_pic.size <= 0)
+            continue;
+
+        AVDictionaryEntry const *comment = av_dict_get(stream->metadata, "comment", nullptr, 0);
+        if (comment && DqnStr_Cmp(comment->value, "Cover (front)") == 0)
+            return &stream->attached_pic;
+
+        if (!result)
+            result = &stream->attached_pic;
+    }
+    return result;
+}
+
+// Store the sound's front cover in the art store. A cover that could not be stored, or is not an image
+// format the store takes, is left unextracted so the next run tries again.
+FILE_SCOPE void ExtractSoundArt(Context *context, AVFormatContext const *fmt_context, TrackArt *art)
+{
+    *art           = {};
+    art->extracted = 1;
+    if (AVPacket const *cover = FindFrontCover(fmt_context))
+    {
+        art->hash      = context->art->Put(context, cover->data, cover->size);
+        art->extracted = (art->hash != 0);
+    }
+}
+
+// Fill in the duration and stream properties from what the demuxer read of the header. No packets are
+// read or decoded for them.
+// NOTE(doyle): Without avformat_find_stream_info the context's duration is rarely estimated, the
+// stream's is what the header says (i.e. Xing/VBRI frames, FLAC STREAMINFO, MP4 mvhd).
+FILE_SCOPE void ExtractSoundStreamInfo(AVFormatContext *fmt_context, SoundFile *sound_file)
+{
+    int stream_index = av_find_best_stream(fmt_context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (stream_index < 0)
+        return;
+
+    AVStream const *stream            = fmt_context->streams[stream_index];
+    AVCodecParameters const *codecpar = stream->codecpar;
+    SoundStreamInfo *info             = &sound_file->stream;
+    info->codec_id                    = static_cast<u32>(codecpar->codec_id);
+    info->sample_rate                 = static_cast<u32>(DQN_MAX(codecpar->sample_rate, 0));
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100) // NOTE(doyle): channels is removed in FFmpeg 7
+    info->channels                    = static_cast<u8>(DQN_CLAMP(codecpar->ch_layout.nb_channels, 0, 255));
+#else
+    info->channels                    = static_cast<u8>(DQN_CLAMP(codecpar->channels, 0, 255));
+#endif
+    info->bits_per_sample             = static_cast<u8>(DQN_CLAMP(codecpar->bits_per_raw_sample, 0, 255));
+
+    if (fmt_context->duration != AV_NOPTS_VALUE && fmt_context->duration > 0)
+        sound_file->duration_ms = static_cast<u32>(fmt_context->duration / (AV_TIME_BASE / 1000));
+    else if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0 && stream->time_base.den > 0)
+        sound_file->duration_ms = static_cast<u32>(av_rescale_q(stream->duration, stream->time_base, AVRational{1, 1000}));
+
+    i64 bit_rate = codecpar->bit_rate;
+    if (bit_rate <= 0) bit_rate = fmt_context->bit_rate;
+    if (bit_rate <= 0 && sound_file->duration_ms > 0)
+        bit_rate = static_cast<i64>(sound_file->info.size * 8000 / sound_file->duration_ms);
+    info->bit_rate = static_cast<u32>(DQN_CLAMP(bit_rate, (i64)0, (i64)0xFFFFFFFF));
+}
+
+DqnArray<SoundFile> MakeSoundFiles(Context *context, DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> *playlist)
+{
+    STAGE_SCOPE(&context->stats, Stage::MetadataExtract);
+    StageStats *stage_stats = context->stats[Stage::MetadataExtract];
+
+    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+    auto *buf   = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, SoundFile, playlist->num_used_entries);
+    auto result = DqnArray<SoundFile>(buf, playlist->num_used_entries);
+
+    for (DqnVHashTable<DqnBuffer<wchar_t>, SoundFile>::Entry const &entry : *playlist)
+    {
+        auto mem_region = context->allocator.MemRegionScope();
 
         DqnBuffer<wchar_t> const sound_path = entry.key;
         DqnBuffer<char> sound_path_utf8     = {};
-        sound_path_utf8.str                 = WCharToUTF8(&global_func_local_allocator_, sound_path.str);
+        sound_path_utf8.str                 = WCharToUTF8(&global_func_local_allocator_, sound_path.str, &sound_path_utf8.len);
+
+        stage_stats->items++;
+        SoundFile sound_file = {};
+        sound_file.path = CopyWStringToBuffer(&context->allocator, entry.key.str, entry.key.len);
+        for (isize i = sound_file.path.len; i >= 0; --i)
+        {
+            if (sound_file.path.str[i] == '.')
+            {
+                sound_file.extension.str = sound_file.path.str + (i + 1);
+                sound_file.extension.len = static_cast<int>(sound_file.path.len - i);
+                break;
+            }
+        }
+
+        if (!sound_file.path)
+        {
+            stage_stats->failures++;
+            char const *msg = DQN_LOGGER_E(&context->logger, "Could not figure out the file extension for file path: %s", sound_path_utf8.str);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            continue;
+        }
+
+        for (isize i = sound_file.extension.len; i >= 0; --i)
+        {
+            if (sound_file.path.str[i] == '\\')
+            {
+                sound_file.name.str = sound_file.path.str + (i + 1);
+                sound_file.name.len = static_cast<int>(sound_file.path.len - i);
+                break;
+            }
+        }
+
+        if (!sound_file.name)
+        {
+            stage_stats->failures++;
+            char const *msg = DQN_LOGGER_E(&context->logger, "Could not figure out the file name for file path: %s", sound_path_utf8.str);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            continue;
+        }
+
+        sound_file.info = entry.item.info;
+
+        // NOTE(doyle): Unchanged since the index was written, its metadata is still valid
+        isize index_track = FindUnchangedIndexTrack(context->index, sound_path_utf8.str, sound_path_utf8.len - 1, &sound_file.info);
+        if (index_track != -1)
+        {
+            context->num_index_hits++;
+            LoadSoundMetadataFromIndex(&context->allocator, context->index, index_track, &sound_file);
+
+            // NOTE(doyle): The index may have been written without --art, or the store lost the cover since.
+            // Only the header is read again, a sound that can't be opened keeps what the index has.
+            TrackArt const &art = sound_file.art;
+            if (context->art && (!art.extracted || (art.hash && !context->art->entries.Get(art.hash))))
+            {
+                SoundReader reader = {};
+                if (reader.Open(sound_path.str))
+                {
+                    if (AVFormatContext *fmt_context = OpenSoundForTags(&reader, sound_path_utf8.str))
+                    {
+                        ExtractSoundArt(context, fmt_context, &sound_file.art);
+                        avformat_close_input(&fmt_context);
+                    }
+                    stage_stats->bytes += reader.bytes_read;
+                    reader.Close();
+                }
+            }
+
+            context->allocator.MemRegionSave(&mem_region);
+            result.Push(sound_file);
+            continue;
+        }
+
+        SoundReader reader = {};
+        if (!reader.Open(sound_path.str))
+        {
+            stage_stats->failures++;
+            char const *msg = DQN_LOGGER_E(&context->logger, "SoundReader: failed to open file: %s", sound_path_utf8.str);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            continue;
+        }
+        DQN_DEFER
+        {
+            stage_stats->bytes += reader.bytes_read;
+            reader.Close();
+        };
+
+        AVFormatContext *fmt_context = OpenSoundForTags(&reader, sound_path_utf8.str);
+        if (!fmt_context)
+        {
+            stage_stats->failures++;
+            char const *msg = DQN_LOGGER_E(&context->logger, "avformat_open_input: failed to open file: %s", sound_path_utf8.str);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            continue;
+        }
+        DQN_DEFER { avformat_close_input(&fmt_context); };
+
+#if 1
+        bool atleast_one_entry_filled = ExtractSoundMetadata(&context->allocator, fmt_context->metadata, &sound_file.metadata);
+        DQN_FOR_EACH(i, fmt_context->nb_streams)
+        {
+            AVStream const *stream = fmt_context->streams[i];
+            atleast_one_entry_filled |= ExtractSoundMetadata(&context->allocator, stream->metadata, &sound_file.metadata);
+        }
+
+        if (!atleast_one_entry_filled)
+        {
+            stage_stats->failures++;
+            char const *msg = DQN_LOGGER_W(&context->logger, "No metadata could be parsed for file: %s", entry.key.str);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            continue;
+        }
+
+        ExtractSoundStreamInfo(fmt_context, &sound_file);
+        if (context->art)
+            ExtractSoundArt(context, fmt_context, &sound_file.art);
+
+        context->allocator.MemRegionSave(&mem_region);
+        result.Push(sound_file);
+#else
+        av_dump_format(fmt_context, 0, sound_file_path.str, 0);
+#endif
+    }
+
+    return result;
+}
+
+void SanitiseStringForDiskFile(wchar_t *string)
+{
+    while(*string++)
+    {
+        switch (string[0])
+        {
+            case '?':
+            case ':':
+            case '\\':
+            case '/':
+            case '<':
+            case '>':
+            case '*':
+            case '|':
+            case '"':
+                string[0] = ' ';
+                break;
+        }
+    }
+}
+
+struct DirPrefix
+{
+    DqnSlice<char const> path; // Includes the trailing separator
+    i32                  depth;
+};
+
+FILE_SCOPE bool DirPrefixLessThan(DirPrefix const &a, DirPrefix const &b, void *)
+{
+    if (a.depth != b.depth) return a.depth < b.depth;
+
+    i32 result = DqnStr_Cmp(a.path.data, b.path.data, DQN_MIN(a.path.len, b.path.len), Dqn::IgnoreCase::No);
+    if (result != 0) return result < 0;
+    return a.path.len < b.path.len;
+}
+
+// Create every parent directory of the link ops' destinations. Directories are deduplicated and made
+// one depth at a time so each depth is a single batch whose parents are guaranteed to exist.
+FILE_SCOPE void MakeParentDirectories(Context *context, DqnFileOp const *link_ops, isize num_link_ops)
+{
+    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+    DqnArray<DirPrefix> prefixes     = {};
+    DQN_DEFER { prefixes.Free(); };
+
+    DQN_FOR_EACH(link_index, num_link_ops)
+    {
+        char const *path = link_ops[link_index].path;
+        i32 depth        = 0;
+        for (char const *ptr = path; *ptr; ptr++)
+        {
+            if (*ptr != '\\')
+                continue;
+
+            DirPrefix prefix = {};
+            prefix.path      = DqnSlice<char const>(path, (int)(ptr - path) + 1);
+            prefix.depth     = depth++;
+            prefixes.Push(prefix);
+        }
+    }
+
+    DqnQuickSort<DirPrefix, DirPrefixLessThan>(prefixes.data, prefixes.len, nullptr);
+
+    auto *dir_ops = DQN_MEMSTACK_PUSH_ARRAY(&global_func_local_allocator_, DqnFileOp, prefixes.len);
+    isize num_ops = 0;
+    for (isize prefix_index = 0; prefix_index < prefixes.len;)
+    {
+        i32 depth         = prefixes.data[prefix_index].depth;
+        isize depth_start = num_ops;
+        for (; prefix_index < prefixes.len && prefixes.data[prefix_index].depth == depth; prefix_index++)
+        {
+            DirPrefix const *prefix = prefixes.data + prefix_index;
+            if (prefix_index > 0 && DQN_SLICE_STRCMP(prefix->path, prefixes.data[prefix_index - 1].path, Dqn::IgnoreCase::No))
+                continue;
+
+            StatCacheEntry entry = {};
+            if (context->stat_cache->Lookup(prefix->path.data, prefix->path.len - 1, &entry) && entry.exists)
+                continue;
+
+            DqnFileOp *op = dir_ops + num_ops++;
+            *op           = {};
+            op->type      = DqnFileOp::Type::MakeDir;
+            op->path      = CopyStringToBuffer(&global_func_local_allocator_, prefix->path.data, prefix->path.len).str;
+        }
+
+        ExecuteFileOps(context, dir_ops + depth_start, num_ops - depth_start);
+    }
+
+    context->stats[Stage::MakeDir]->items += num_ops;
+    DQN_FOR_EACH(op_index, num_ops)
+    {
+        DqnFileOp const *op = dir_ops + op_index;
+        if (op->success) context->stat_cache->Set(op->path, DqnStr_Len(op->path) - 1, true /*exists*/, nullptr);
+        else             context->stats[Stage::MakeDir]->failures++;
+    }
+}
+
+// Copy Job
+// =================================================================================================
+// Output is often on a different volume than the sounds (removable storage), where hard links fail.
+// Those sounds are copied instead by the cheapest tier the volumes support, many files at once.
+FILE_SCOPE usize const COPY_BUF_SIZE = DQN_MEGABYTE(4);
+
+struct CopyJob
+{
+    DqnFileOp       *op;    // The failed link op, copied from src_path to path
+    usize            size;
+    DqnFileCopyTier  tier;
+    i32              error;
+    i32 volatile     done;
+    bool             retired; // Main thread has taken it out of the bytes in flight
+};
+
+FILE_SCOPE void CopyJobCallback(DqnJobQueue *, void *user_data)
+{
+    auto *job = static_cast<CopyJob *>(user_data);
+    {
+        TRACE_SCOPE("copy");
+        usize buf_size = DQN_MIN(DQN_MAX(job->size, (usize)DQN_KILOBYTE(64)), COPY_BUF_SIZE);
+        auto *buf      = static_cast<u8 *>(dqn_lib_context_.allocator->Malloc(buf_size));
+        if (!buf) buf_size = 0; // NOTE(doyle): Only the streamed copy needs it, the kernel may not
+
+        // NOTE(doyle): The hard link was already tried by the file batch
+        LiveMetrics_Add(LiveCounter::IoInFlight, 1);
+        job->tier = DqnFile_Materialize(job->op->src_path, job->op->path, buf, buf_size, DqnFileCopyTier::Reflink, &job->error);
+        LiveMetrics_Add(LiveCounter::IoInFlight, -1);
+        if (buf) dqn_lib_context_.allocator->Free(buf, buf_size);
+    }
+    DqnAtomic_CompareSwap32(&job->done, 1, 0);
+}
+
+// Run the copies on the job queue, only starting a copy once the bytes of the copies in flight leave
+// room for it in the budget. A file bigger than the budget is copied on its own.
+FILE_SCOPE void RunCopyJobs(Context *context, CopyJob *jobs, isize num_jobs)
+{
+    i64 bytes_in_flight = 0;
+    isize next_job      = 0;
+    isize oldest_job    = 0; // Every job before it is retired
+    while (oldest_job < num_jobs)
+    {
+        if (next_job < num_jobs)
+        {
+            CopyJob *job = jobs + next_job;
+            if (bytes_in_flight == 0 || bytes_in_flight + (i64)job->size <= context->copy_budget_bytes)
+            {
+                DqnJob dqn_job = {CopyJobCallback, job};
+                if (context->job_queue->AddJob(dqn_job))
+                {
+                    bytes_in_flight += job->size;
+                    next_job++;
+                    continue;
+                }
+            }
+        }
+
+        // NOTE(doyle): Over budget or the queue is full, help out until a copy finishes
+        if (!context->job_queue->TryExecuteNextJob())
+            Sleep(0);
+
+        for (isize job_index = oldest_job; job_index < next_job; job_index++)
+        {
+            CopyJob *job = jobs + job_index;
+            if (job->done && !job->retired)
+            {
+                job->retired     = true;
+                bytes_in_flight -= job->size;
+            }
+        }
+
+        while (oldest_job < next_job && jobs[oldest_job].retired)
+            oldest_job++;
+    }
+}
+
+// Lanes
+// =================================================================================================
+// CPU bound work over many files (decoding, encoding) is run on lanes, long running jobs that each pull
+// the next item of a batch until none are left. The queue oversubscribes the cores for I/O, one lane
+// per logical core saturates the CPU whilst leaving workers for the file work queued after them.
+struct LaneBatch
+{
+    void       (*Run)(void *user_data, isize item);
+    void        *user_data;
+    char const  *name;      // Of the items in traces, i.e. "transcode"
+    i32          num_items;
+    i32 volatile next_item;
+    i32 volatile num_lanes_running;
+};
+
+FILE_SCOPE void LaneBatch_RunLane(LaneBatch *batch)
+{
+    for (;;)
+    {
+        i32 item = DqnAtomic_Add32(&batch->next_item, 1) - 1;
+        if (item >= batch->num_items)
+            break;
+
+        TRACE_SCOPE(batch->name);
+        batch->Run(batch->user_data, item);
+    }
+}
+
+FILE_SCOPE void LaneBatch_LaneJobCallback(DqnJobQueue *, void *user_data)
+{
+    auto *batch = static_cast<LaneBatch *>(user_data);
+    {
+        // NOTE(doyle): Ended before the lane is, the main thread may finish the trace once it's done
+        TRACE_SCOPE("lane");
+        LaneBatch_RunLane(batch);
+    }
+    DqnAtomic_Add32(&batch->num_lanes_running, -1);
+}
+
+// Start the lanes on the job queue, they run alongside whatever is queued after them
+FILE_SCOPE void LaneBatch_Start(Context *context, LaneBatch *batch)
+{
+    u32 num_lanes = DQN_MAX(1u, context->num_workers / 2);
+    num_lanes     = DQN_MIN(num_lanes, (u32)batch->num_items);
+    DQN_FOR_EACH(lane_index, num_lanes)
+    {
+        DqnAtomic_Add32(&batch->num_lanes_running, 1);
+        if (!context->job_queue->AddJob({LaneBatch_LaneJobCallback, batch}))
+        {
+            DqnAtomic_Add32(&batch->num_lanes_running, -1);
+            break;
+        }
+    }
+}
+
+// The main thread runs a lane too until there's nothing left, then helps out until the lanes finish
+FILE_SCOPE void LaneBatch_Finish(Context *context, LaneBatch *batch)
+{
+    LaneBatch_RunLane(batch);
+    while (batch->num_lanes_running > 0)
+    {
+        if (!context->job_queue->TryExecuteNextJob())
+            Sleep(1);
+    }
+}
+
+// Transcode
+// =================================================================================================
+// Portable devices often want a fixed bitrate lossy format rather than the masters. With --transcode
+// sounds in any other format are decoded, resampled and encoded into Output rather than linked.
+// Transcodes run on lanes, a lane reuses its thread's encoder, resampler and frame buffers for every
+// sound it does.
+#define TRANSCODE_DEFAULT_FRAME_SIZE 4096 // Samples per frame for encoders that take any frame size
+
+struct TranscodeTarget
+{
+    AVCodec const *codec;
+    wchar_t const *extension;     // Of the output files, without the '.'
+    char const    *extension_utf8;
+    char const    *format_name;   // Muxer
+    bool           global_header; // Codec headers go in the container rather than the stream
+    i64            bit_rate;
+    int            sample_rate;
+};
+
+// return: False if the format is unknown or FFmpeg was built without an encoder for it
+FILE_SCOPE bool TranscodeTarget_Init(TranscodeTarget *target, char const *format, i64 kbps)
+{
+    *target = {};
+    AVCodecID codec_id = AV_CODEC_ID_NONE;
+    if (DqnStr_Cmp(format, "mp3") == 0)
+    {
+        codec_id               = AV_CODEC_ID_MP3;
+        target->extension      = L"mp3";
+        target->extension_utf8 = "mp3";
+        target->format_name    = "mp3";
+    }
+    else if (DqnStr_Cmp(format, "aac") == 0)
+    {
+        codec_id               = AV_CODEC_ID_AAC;
+        target->extension      = L"m4a";
+        target->extension_utf8 = "m4a";
+        target->format_name    = "ipod";
+    }
+
+    target->codec = (codec_id != AV_CODEC_ID_NONE) ? avcodec_find_encoder(codec_id) : nullptr;
+    if (!target->codec)
+        return false;
+
+    AVOutputFormat const *output_format = av_guess_format(target->format_name, nullptr, nullptr);
+    if (!output_format)
+        return false;
+
+    target->global_header = (output_format->flags & AVFMT_GLOBALHEADER) != 0;
+    target->bit_rate      = kbps * 1000;
+    target->sample_rate   = 44100;
+    if (int const *rates = target->codec->supported_samplerates)
+    {
+        // NOTE(doyle): Prefer 44.1kHz, what the masters almost always are, otherwise the highest rate
+        target->sample_rate = rates[0];
+        for (; *rates; rates++)
+        {
+            if (*rates == 44100) { target->sample_rate = 44100; break; }
+            target->sample_rate = DQN_MAX(target->sample_rate, *rates);
+        }
+    }
+
+    return true;
+}
+
+FILE_SCOPE bool TranscodeTarget_Wants(TranscodeTarget const *target, SoundFile const *sound_file)
+{
+    bool result = (target && _wcsicmp(sound_file->extension.str, target->extension) != 0);
+    return result;
+}
+
+// Per-thread state reused across sounds, like SoundReaderScratch. Only the decoder is made per sound,
+// its setup depends on the source's codec and stream headers.
+struct TranscodeScratch
+{
+    AVCodecContext *encoder;
+    SwrContext     *resampler;
+    AVAudioFifo    *fifo;           // Resampled samples waiting for a full encoder frame
+    AVFrame        *decoded;
+    AVFrame        *encode;         // Sized to the encoder's frame size
+    AVPacket       *packet;         // Read from the source
+    AVPacket       *encoded;        // Received from the encoder
+    u8            **resampled;      // Planes of resampled_max samples
+    int             resampled_max;
+};
+
+FILE_SCOPE thread_local TranscodeScratch global_transcode_scratch_;
+
+// return: The thread's encoder, ready for a new stream, nullptr if it could not be opened
+FILE_SCOPE AVCodecContext *TranscodeScratch_GetEncoder(TranscodeScratch *scratch, TranscodeTarget const *target)
+{
+    if (scratch->encoder)
+    {
+        // NOTE(doyle): A drained encoder only takes frames again after a flush, if it can't be flushed
+        // (i.e. libmp3lame) it has to be opened again for every sound. Only the frame, FIFO and packets
+        // are reused for those.
+#if defined(AV_CODEC_CAP_ENCODER_FLUSH)
+        if (scratch->encoder->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)
+        {
+            avcodec_flush_buffers(scratch->encoder);
+            return scratch->encoder;
+        }
+#endif
+        avcodec_free_context(&scratch->encoder);
+    }
+
+    AVCodecContext *encoder = avcodec_alloc_context3(target->codec);
+    if (!encoder)
+        return nullptr;
+
+    encoder->bit_rate       = target->bit_rate;
+    encoder->sample_rate    = target->sample_rate;
+    encoder->channel_layout = AV_CH_LAYOUT_STEREO;
+    encoder->channels       = 2;
+    encoder->sample_fmt     = (target->codec->sample_fmts) ? target->codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    encoder->time_base      = {1, target->sample_rate};
+    encoder->thread_count   = 1; // NOTE(doyle): Lanes already use every core
+    if (target->global_header)
+        encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if (avcodec_open2(encoder, target->codec, nullptr) < 0)
+    {
+        avcodec_free_context(&encoder);
+        return nullptr;
+    }
+
+    // NOTE(doyle): The frame and FIFO formats follow the encoder, which is the same for every sound
+    int frame_size = (encoder->frame_size > 0) ? encoder->frame_size : TRANSCODE_DEFAULT_FRAME_SIZE;
+    if (!scratch->encode || scratch->encode->nb_samples != frame_size || scratch->encode->format != encoder->sample_fmt)
+    {
+        av_frame_free(&scratch->encode);
+        scratch->encode                 = av_frame_alloc();
+        scratch->encode->nb_samples     = frame_size;
+        scratch->encode->format         = encoder->sample_fmt;
+        scratch->encode->channel_layout = encoder->channel_layout;
+        scratch->encode->channels       = encoder->channels;
+        scratch->encode->sample_rate    = encoder->sample_rate;
+        if (av_frame_get_buffer(scratch->encode, 0) < 0)
+            av_frame_free(&scratch->encode);
+
+        if (scratch->fifo) av_audio_fifo_free(scratch->fifo);
+        scratch->fifo = av_audio_fifo_alloc(encoder->sample_fmt, encoder->channels, frame_size * 4);
+    }
+
+    if (!scratch->decoded) scratch->decoded = av_frame_alloc();
+    if (!scratch->packet)  scratch->packet  = av_packet_alloc();
+    if (!scratch->encoded) scratch->encoded = av_packet_alloc();
+    if (!scratch->encode || !scratch->fifo || !scratch->decoded || !scratch->packet || !scratch->encoded)
+    {
+        avcodec_free_context(&encoder);
+        return nullptr;
+    }
+
+    scratch->encoder = encoder;
+    return encoder;
+}
+
+struct TranscodeJob
+{
+    DqnFileOp      op;             // Transcoded from src_path to path, user_data is the SoundFile
+    char          *partial_path;   // Written to, then renamed to path when complete
+    wchar_t       *partial_path_w;
+    wchar_t       *path_w;
+    u64            cache_key;
+    DqnFileOp     *output_op;      // Links path into Output once transcoded
+    DqnFileInfo    info;           // Of path, once transcoded
+    i64            bytes_written;
+    bool           success;
+    char const    *failed_step;    // What failed if not successful
+    int            av_error;       // AVERROR of the failed step
+};
+
+// Streams one sound through decoder -> resampler -> FIFO -> encoder -> muxer
+struct Transcoder
+{
+    TranscodeScratch *scratch;
+    AVCodecContext   *decoder;
+    AVCodecContext   *encoder;
+    AVFormatContext  *output;
+    i64               next_pts;     // In samples, the encoder's time base
+    bool              resampler_ready;
+};
+
+FILE_SCOPE int Transcoder_DrainEncoder(Transcoder *transcoder)
+{
+    TranscodeScratch *scratch = transcoder->scratch;
+    AVStream *stream          = transcoder->output->streams[0];
+    int result                = 0;
+    while ((result = avcodec_receive_packet(transcoder->encoder, scratch->encoded)) == 0)
+    {
+        av_packet_rescale_ts(scratch->encoded, transcoder->encoder->time_base, stream->time_base);
+        scratch->encoded->stream_index = 0;
+        result = av_interleaved_write_frame(transcoder->output, scratch->encoded);
+        if (result < 0)
+            return result;
+    }
+
+    return (result == AVERROR(EAGAIN) || result == AVERROR_EOF) ? 0 : result;
+}
+
+// Encode whole frames out of the FIFO, or everything left in it when flushing
+FILE_SCOPE int Transcoder_EncodeFifo(Transcoder *transcoder, bool flush)
+{
+    TranscodeScratch *scratch = transcoder->scratch;
+    AVFrame *frame            = scratch->encode;
+    int frame_size            = (transcoder->encoder->frame_size > 0) ? transcoder->encoder->frame_size : TRANSCODE_DEFAULT_FRAME_SIZE;
+    for (;;)
+    {
+        int available = av_audio_fifo_size(scratch->fifo);
+        if (available == 0 || (available < frame_size && !flush))
+            return 0;
+
+        // NOTE(doyle): The encoder may still reference the last frame's buffers. The frame is shared by
+        // every sound on the thread and the last one may have shrunk it for its tail, so it's made
+        // writable at full size and reallocated if its buffers are smaller than that.
+        frame->nb_samples = frame_size;
+        int result        = av_frame_make_writable(frame);
+        if (result < 0)
+            return result;
+
+        int linesize = 0;
+        if (av_samples_get_buffer_size(&linesize, frame->channels, frame_size, (AVSampleFormat)frame->format, 1 /*align*/) < 0 || frame->linesize[0] < linesize)
+        {
+            int format         = frame->format;
+            u64 channel_layout = frame->channel_layout;
+            int channels       = frame->channels;
+            int sample_rate    = frame->sample_rate;
+            av_frame_unref(frame);
+
+            frame->nb_samples     = frame_size;
+            frame->format         = format;
+            frame->channel_layout = channel_layout;
+            frame->channels       = channels;
+            frame->sample_rate    = sample_rate;
+            result                = av_frame_get_buffer(frame, 0);
+            if (result < 0)
+                return result;
+        }
+
+        frame->nb_samples = DQN_MIN(available, frame_size);
+        av_audio_fifo_read(scratch->fifo, reinterpret_cast<void **>(frame->data), frame->nb_samples);
+        frame->pts             = transcoder->next_pts;
+        transcoder->next_pts += frame->nb_samples;
+
+        result = avcodec_send_frame(transcoder->encoder, frame);
+        if (result >= 0) result = Transcoder_DrainEncoder(transcoder);
+        if (result < 0)
+            return result;
+    }
+}
+
+// in: Decoded frame, nullptr to flush the samples buffered in the resampler
+FILE_SCOPE int Transcoder_Resample(Transcoder *transcoder, AVFrame const *in)
+{
+    TranscodeScratch *scratch = transcoder->scratch;
+    AVCodecContext *encoder   = transcoder->encoder;
+    if (in && !transcoder->resampler_ready)
+    {
+        // NOTE(doyle): Configured from the first decoded frame, the container's stream parameters
+        // aren't probed for and can be missing.
+        i64 in_layout = (in->channel_layout) ? (i64)in->channel_layout : av_get_default_channel_layout(in->channels);
+        scratch->resampler = swr_alloc_set_opts(scratch->resampler,
+                                                (i64)encoder->channel_layout, encoder->sample_fmt, encoder->sample_rate,
+                                                in_layout, (AVSampleFormat)in->format, in->sample_rate,
+                                                0, nullptr);
+        if (!scratch->resampler)
+            return AVERROR(ENOMEM);
+
+        int result = swr_init(scratch->resampler);
+        if (result < 0)
+            return result;
+        transcoder->resampler_ready = true;
+    }
+
+    if (!transcoder->resampler_ready)
+        return 0;
+
+    int in_samples  = (in) ? in->nb_samples : 0;
+    int out_samples = swr_get_out_samples(scratch->resampler, in_samples);
+    if (out_samples > scratch->resampled_max)
+    {
+        if (scratch->resampled)
+        {
+            av_freep(&scratch->resampled[0]);
+            av_freep(&scratch->resampled);
+        }
+
+        scratch->resampled_max = 0;
+        int result             = av_samples_alloc_array_and_samples(&scratch->resampled, nullptr, encoder->channels, out_samples, encoder->sample_fmt, 0);
+        if (result < 0)
+            return result;
+        scratch->resampled_max = out_samples;
+    }
+
+    u8 const **in_data = (in) ? const_cast<u8 const **>(in->extended_data) : nullptr;
+    int converted      = swr_convert(scratch->resampler, scratch->resampled, scratch->resampled_max, in_data, in_samples);
+    if (converted < 0)
+        return converted;
+
+    if (converted > 0 && av_audio_fifo_write(scratch->fifo, reinterpret_cast<void **>(scratch->resampled), converted) < converted)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+// packet: Packet of the decoded stream, nullptr to flush the decoder
+FILE_SCOPE int Transcoder_Decode(Transcoder *transcoder, AVPacket const *packet)
+{
+    AVFrame *decoded = transcoder->scratch->decoded;
+    int result       = avcodec_send_packet(transcoder->decoder, packet);
+    if (result < 0 && result != AVERROR_INVALIDDATA)
+        return result;
+
+    while ((result = avcodec_receive_frame(transcoder->decoder, decoded)) == 0)
+    {
+        result = Transcoder_Resample(transcoder, decoded);
+        av_frame_unref(decoded);
+        if (result >= 0) result = Transcoder_EncodeFifo(transcoder, false /*flush*/);
+        if (result < 0)
+            return result;
+    }
+
+    return (result == AVERROR(EAGAIN) || result == AVERROR_EOF) ? 0 : result;
+}
+
+FILE_SCOPE void TranscodeSound(TranscodeTarget const *target, TranscodeJob *job)
+{
+    TranscodeScratch *scratch = &global_transcode_scratch_;
+    Transcoder transcoder     = {};
+    transcoder.scratch        = scratch;
+
+#define TRANSCODE_CHECK(expr, step) if ((job->av_error = (expr)) < 0) { job->failed_step = step; return; }
+    job->success = false;
+    auto const *sound_file = static_cast<SoundFile const *>(job->op.user_data);
+    SoundReader reader     = {};
+    if (!reader.Open(sound_file->path.str))
+    {
+        job->failed_step = "open";
+        return;
+    }
+    DQN_DEFER { reader.Close(); };
+
+    AVFormatContext *input = OpenSoundForTags(&reader, job->op.src_path);
+    if (!input)
+    {
+        job->failed_step = "open";
+        return;
+    }
+    DQN_DEFER { avformat_close_input(&input); };
+
+    AVCodec *decoder_codec = nullptr;
+    int stream_index       = av_find_best_stream(input, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder_codec, 0);
+    TRANSCODE_CHECK(stream_index, "find audio stream");
+
+    transcoder.decoder = avcodec_alloc_context3(decoder_codec);
+    DQN_DEFER { avcodec_free_context(&transcoder.decoder); };
+    TRANSCODE_CHECK(transcoder.decoder ? 0 : AVERROR(ENOMEM), "decoder");
+    TRANSCODE_CHECK(avcodec_parameters_to_context(transcoder.decoder, input->streams[stream_index]->codecpar), "decoder");
+    transcoder.decoder->thread_count = 1;
+    TRANSCODE_CHECK(avcodec_open2(transcoder.decoder, decoder_codec, nullptr), "decoder");
+
+    transcoder.encoder = TranscodeScratch_GetEncoder(scratch, target);
+    TRANSCODE_CHECK(transcoder.encoder ? 0 : AVERROR(ENOMEM), "encoder");
+    av_audio_fifo_reset(scratch->fifo);
+
+    TRANSCODE_CHECK(avformat_alloc_output_context2(&transcoder.output, nullptr, target->format_name, job->partial_path), "output");
+    bool output_opened = false;
+    DQN_DEFER
+    {
+        if (output_opened) avio_closep(&transcoder.output->pb);
+        avformat_free_context(transcoder.output);
+        if (!job->success) DeleteFileW(job->partial_path_w);
+    };
+
+    AVStream *stream = avformat_new_stream(transcoder.output, nullptr);
+    TRANSCODE_CHECK(stream ? 0 : AVERROR(ENOMEM), "output");
+    TRANSCODE_CHECK(avcodec_parameters_from_context(stream->codecpar, transcoder.encoder), "output");
+    stream->time_base = transcoder.encoder->time_base;
+    av_dict_copy(&transcoder.output->metadata, input->metadata, 0);
+    av_dict_copy(&transcoder.output->metadata, input->streams[stream_index]->metadata, 0);
+
+    TRANSCODE_CHECK(avio_open(&transcoder.output->pb, job->partial_path, AVIO_FLAG_WRITE), "output");
+    output_opened = true;
+    TRANSCODE_CHECK(avformat_write_header(transcoder.output, nullptr), "write");
+
+    AVPacket *packet = scratch->packet;
+    for (;;)
+    {
+        int result = av_read_frame(input, packet);
+        if (result == AVERROR_EOF)
+            break;
+        TRANSCODE_CHECK(result, "read");
+
+        if (packet->stream_index == stream_index)
+            result = Transcoder_Decode(&transcoder, packet);
+
+        av_packet_unref(packet);
+        TRANSCODE_CHECK(result, "transcode");
+    }
+
+    TRANSCODE_CHECK(Transcoder_Decode(&transcoder, nullptr), "transcode");
+    TRANSCODE_CHECK(Transcoder_Resample(&transcoder, nullptr), "transcode");
+    TRANSCODE_CHECK(Transcoder_EncodeFifo(&transcoder, true /*flush*/), "transcode");
+    TRANSCODE_CHECK(avcodec_send_frame(transcoder.encoder, nullptr), "transcode");
+    TRANSCODE_CHECK(Transcoder_DrainEncoder(&transcoder), "transcode");
+    TRANSCODE_CHECK(av_write_trailer(transcoder.output), "write");
+
+    job->bytes_written = avio_tell(transcoder.output->pb);
+    avio_closep(&transcoder.output->pb);
+    output_opened = false;
+
+    if (!MoveFileExW(job->partial_path_w, job->path_w, MOVEFILE_REPLACE_EXISTING) || !DqnFile_GetInfo(job->path_w, &job->info))
+    {
+        job->failed_step = "rename";
+        job->av_error    = 0;
+        return;
+    }
+
+    job->success = true;
+#undef TRANSCODE_CHECK
+}
+
+struct TranscodeBatch
+{
+    LaneBatch              lanes;
+    TranscodeTarget const *target;
+    TranscodeJob          *jobs;
+};
+
+FILE_SCOPE void TranscodeBatch_Run(void *user_data, isize job_index)
+{
+    auto *batch = static_cast<TranscodeBatch *>(user_data);
+    TranscodeSound(batch->target, batch->jobs + job_index);
+}
+
+// Transcode Cache
+// =================================================================================================
+// Transcodes are written to TranscodeCache\ and linked into Output from there, so a sound is encoded
+// once per transcode target rather than every time it's synced. Entries are keyed by the source's
+// identity and the encoder settings, the least recently used are evicted to keep the cache under its
+// size cap when it's written.
+#define TRANSCODE_CACHE_MAGIC   0x43445057 // "WPDC"
+#define TRANSCODE_CACHE_VERSION 1
+
+struct TranscodeCacheEntry
+{
+    u64         key;
+    u64         last_used_in_s;
+    DqnFileInfo info;         // Of the cached file
+    char        extension[8]; // The file is <key as hex>.<extension>, each target has its own
+};
+
+struct TranscodeCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 num_entries;
+    u64 file_size;
+};
+
+struct TranscodeCache
+{
+    DqnBuffer<wchar_t> dir;
+    char              *dir_utf8;
+    DqnBuffer<wchar_t> manifest_path;
+    i64                max_bytes;
+    i64                num_bytes;   // Of every entry
+    i64                num_hits;
+    i64                num_misses;
+    i64                num_evicted;
+    DqnVHashTable<u64, TranscodeCacheEntry> entries;
+
+    bool                 Load (Context *context, i64 max_bytes_);
+    void                 Free ()                 { entries.Free(); }
+    TranscodeCacheEntry *Get  (u64 key)          { return entries.Get(key); }
+    void                 Put  (u64 key, TranscodeTarget const *target, DqnFileInfo const *info, u64 now_in_s);
+};
+
+// The identity of the source (path, size and last write time) and everything that changes the encoder's
+// output. The path stands in for a file ID, which DqnFileInfo doesn't have.
+// return: <dir>\<key as hex>.<extension>
+FILE_SCOPE char *TranscodeCache_Path(DqnMemStack *allocator, TranscodeCache const *cache, u64 key, char const *extension, int *result_len = nullptr)
+{
+    int len      = DqnStr_Len(cache->dir_utf8) + 1 + 16 + 1 + DqnStr_Len(extension);
+    char *result = DQN_MEMSTACK_PUSH_ARRAY(allocator, char, len + 1);
+    Dqn_sprintf(result, "%s\\%016llx.%s", cache->dir_utf8, (unsigned long long)key, extension);
+    if (result_len) *result_len = len;
+    return result;
+}
+
+FILE_SCOPE u64 TranscodeCache_Key(TranscodeTarget const *target, char const *src_path, DqnFileInfo const *src_info)
+{
+    struct
+    {
+        u64 size;
+        u64 last_write_time_in_s;
+        i64 bit_rate;
+        i32 codec_id;
+        i32 sample_rate;
+        u32 avcodec_version;
+        u32 cache_version;
+    } identity = {};
+
+    identity.size                 = src_info->size;
+    identity.last_write_time_in_s = src_info->last_write_time_in_s;
+    identity.bit_rate             = target->bit_rate;
+    identity.codec_id             = (i32)target->codec->id;
+    identity.sample_rate          = target->sample_rate;
+    identity.avcodec_version      = avcodec_version();
+    identity.cache_version        = TRANSCODE_CACHE_VERSION;
+
+    u64 path_hash = DqnHash_Murmur64(src_path, DqnStr_Len(src_path));
+    u64 result    = DqnHash_Murmur64Seed(&identity, sizeof(identity), path_hash);
+    return result;
+}
+
+bool TranscodeCache::Load(Context *context, i64 max_bytes_)
+{
+    *this               = {};
+    this->max_bytes     = max_bytes_;
+    this->dir           = AllocateSwprintf(&context->allocator, L"%s\\TranscodeCache", context->exe_directory.str);
+    this->dir_utf8      = WCharToUTF8(&context->allocator, this->dir.str);
+    this->manifest_path = AllocateSwprintf(&context->allocator, L"%s\\Cache.index", this->dir.str);
+    this->entries.LazyInit(DQN_MEGABYTE(1));
+    if (!DqnFile_MakeDir(this->dir_utf8))
+        return false;
+
+    // NOTE(doyle): A missing or invalid manifest starts an empty cache, the orphaned files are overwritten
+    // as sounds are transcoded again.
+    usize buf_size = 0;
+    u8 *buf        = DqnFile_ReadAll(this->manifest_path.str, &buf_size);
+    if (!buf)
+        return true;
+    DQN_DEFER { dqn_lib_context_.allocator->Free(buf, buf_size); };
+
+    auto const *header = reinterpret_cast<TranscodeCacheHeader const *>(buf);
+    bool valid = buf_size >= sizeof(*header) && header->magic == TRANSCODE_CACHE_MAGIC && header->version == TRANSCODE_CACHE_VERSION &&
+                 header->file_size == buf_size && header->num_entries == (buf_size - sizeof(*header)) / sizeof(TranscodeCacheEntry);
+    if (!valid)
+        return true;
+
+    auto const *entry = reinterpret_cast<TranscodeCacheEntry const *>(buf + sizeof(*header));
+    for (u64 entry_index = 0; entry_index < header->num_entries; entry_index++, entry++)
+    {
+        this->entries.Set(entry->key, *entry);
+        this->num_bytes += entry->info.size;
+    }
+
+    return true;
+}
+
+void TranscodeCache::Put(u64 key, TranscodeTarget const *target, DqnFileInfo const *info, u64 now_in_s)
+{
+    bool existed               = false;
+    TranscodeCacheEntry *entry = entries.GetOrMake(key, &existed);
+    if (existed) num_bytes -= entry->info.size;
+
+    *entry                = {};
+    entry->key            = key;
+    entry->last_used_in_s = now_in_s;
+    entry->info           = *info;
+    DqnMem_Copy(entry->extension, target->extension_utf8, DQN_MIN(DqnStr_Len(target->extension_utf8), (i32)DQN_ARRAY_COUNT(entry->extension) - 1));
+    num_bytes += info->size;
+}
+
+FILE_SCOPE bool TranscodeCacheEntry_LastUsedLessThan(TranscodeCacheEntry const &a, TranscodeCacheEntry const &b, void *)
+{
+    return a.last_used_in_s < b.last_used_in_s;
+}
+
+// Evict the least recently used entries until the cache fits its cap, then write the manifest. Output
+// keeps its links to evicted files, only the cache's copy is deleted.
+FILE_SCOPE void WriteTranscodeCache(Context *context, TranscodeCache *cache)
+{
+    isize num_entries = cache->entries.num_used_entries;
+    usize buf_size    = sizeof(TranscodeCacheHeader) + sizeof(TranscodeCacheEntry) * num_entries;
+    auto *buf         = static_cast<u8 *>(dqn_lib_context_.allocator->Malloc(buf_size));
+    if (!buf) return;
+    DQN_DEFER { dqn_lib_context_.allocator->Free(buf, buf_size); };
+
+    auto *sorted = reinterpret_cast<TranscodeCacheEntry *>(buf + sizeof(TranscodeCacheHeader));
+    isize entry_index = 0;
+    for (DqnVHashTable<u64, TranscodeCacheEntry>::Entry const &entry : cache->entries)
+        sorted[entry_index++] = entry.item;
+
+    isize num_evicted = 0;
+    if (cache->num_bytes > cache->max_bytes)
+    {
+        DqnQuickSort<TranscodeCacheEntry, TranscodeCacheEntry_LastUsedLessThan>(sorted, num_entries, nullptr);
+        auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+        for (; num_evicted < num_entries && cache->num_bytes > cache->max_bytes; num_evicted++)
+        {
+            // NOTE(doyle): A file that's already gone is as good as evicted
+            TranscodeCacheEntry const *entry = sorted + num_evicted;
+            int path_len                     = 0;
+            char *path                       = TranscodeCache_Path(&context->allocator, cache, entry->key, entry->extension, &path_len);
+            DqnFile_Delete(path);
+            context->stat_cache->Set(path, path_len, false /*exists*/, nullptr);
+            cache->entries.Erase(entry->key);
+            cache->num_bytes -= entry->info.size;
+            cache->num_evicted++;
+        }
+
+        memmove(sorted, sorted + num_evicted, sizeof(*sorted) * (num_entries - num_evicted));
+    }
+
+    auto *header        = reinterpret_cast<TranscodeCacheHeader *>(buf);
+    header->magic       = TRANSCODE_CACHE_MAGIC;
+    header->version     = TRANSCODE_CACHE_VERSION;
+    header->num_entries = (u64)(num_entries - num_evicted);
+    header->file_size   = sizeof(*header) + sizeof(TranscodeCacheEntry) * header->num_entries;
+    if (!DqnFile_WriteAll(cache->manifest_path.str, buf, (usize)header->file_size))
+    {
+        char const *msg = DQN_LOGGER_E(&context->logger, "Could not write the transcode cache manifest to: %s", WCharToUTF8(&context->allocator, cache->manifest_path.str));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Cover Art Thumbnails
+// =================================================================================================
+// With --art-thumbnail-px every cover in the art store also gets a JPEG fit within that many pixels,
+// for devices that struggle with full size art. Covers are only ever scaled down. Thumbnails are made
+// on lanes, a lane reuses its thread's scaler and frames for every cover it does.
+struct ArtThumbnailJob
+{
+    char        *path;           // The thumbnail, for the log
+    wchar_t     *src_path_w;     // The stored cover
+    wchar_t     *partial_path_w; // Written to, then renamed to path_w when complete
+    wchar_t     *path_w;
+    bool         is_png;
+    int          max_px;
+    bool         success;
+    char const  *failed_step;    // What failed if not successful
+    int          av_error;       // AVERROR of the failed step
+};
+
+struct ArtThumbnailScratch
+{
+    SwsContext *scaler;
+    AVPacket   *packet;
+    AVFrame    *decoded;
+    AVFrame    *scaled;
+};
+
+FILE_SCOPE thread_local ArtThumbnailScratch global_art_thumbnail_scratch_;
+
+FILE_SCOPE void MakeArtThumbnail(ArtThumbnailJob *job)
+{
+    ArtThumbnailScratch *scratch = &global_art_thumbnail_scratch_;
+    if (!scratch->packet)  scratch->packet  = av_packet_alloc();
+    if (!scratch->decoded) scratch->decoded = av_frame_alloc();
+    if (!scratch->scaled)  scratch->scaled  = av_frame_alloc();
+
+#define THUMBNAIL_CHECK(expr, step) if ((job->av_error = (expr)) < 0) { job->failed_step = step; return; }
+    job->success = false;
+    THUMBNAIL_CHECK((scratch->packet && scratch->decoded && scratch->scaled) ? 0 : AVERROR(ENOMEM), "alloc");
+
+    usize image_size = 0;
+    u8 *image        = DqnFile_ReadAll(job->src_path_w, &image_size);
+    if (!image)
+    {
+        job->failed_step = "read";
+        return;
+    }
+    DQN_DEFER { dqn_lib_context_.allocator->Free(image, image_size); };
+
+    AVCodec *decoder_codec  = avcodec_find_decoder(job->is_png ? AV_CODEC_ID_PNG : AV_CODEC_ID_MJPEG);
+    AVCodecContext *decoder = (decoder_codec) ? avcodec_alloc_context3(decoder_codec) : nullptr;
+    DQN_DEFER { avcodec_free_context(&decoder); };
+    THUMBNAIL_CHECK(decoder ? 0 : AVERROR(ENOMEM), "decoder");
+    decoder->thread_count = 1;
+    THUMBNAIL_CHECK(avcodec_open2(decoder, decoder_codec, nullptr), "decoder");
+
+    AVPacket *packet = scratch->packet;
+    packet->data     = image;
+    packet->size     = static_cast<int>(image_size);
+    AVFrame *decoded = scratch->decoded;
+    av_frame_unref(decoded);
+    THUMBNAIL_CHECK(avcodec_send_packet(decoder, packet), "decode");
+    packet->data = nullptr;
+    packet->size = 0;
+    THUMBNAIL_CHECK(avcodec_receive_frame(decoder, decoded), "decode");
+
+    int width  = decoded->width;
+    int height = decoded->height;
+    if (width > job->max_px || height > job->max_px)
+    {
+        if (width >= height) { height = DQN_MAX(1, static_cast<int>((i64)height * job->max_px / width));  width  = job->max_px; }
+        else                 { width  = DQN_MAX(1, static_cast<int>((i64)width  * job->max_px / height)); height = job->max_px; }
+    }
+
+    scratch->scaler = sws_getCachedContext(scratch->scaler, decoded->width, decoded->height, static_cast<AVPixelFormat>(decoded->format),
+                                           width, height, AV_PIX_FMT_YUVJ420P, SWS_AREA, nullptr, nullptr, nullptr);
+    THUMBNAIL_CHECK(scratch->scaler ? 0 : AVERROR(EINVAL), "scale");
+
+    AVFrame *scaled = scratch->scaled;
+    av_frame_unref(scaled);
+    scaled->width  = width;
+    scaled->height = height;
+    scaled->format = AV_PIX_FMT_YUVJ420P;
+    THUMBNAIL_CHECK(av_frame_get_buffer(scaled, 0), "scale");
+    THUMBNAIL_CHECK(sws_scale(scratch->scaler, decoded->data, decoded->linesize, 0, decoded->height, scaled->data, scaled->linesize), "scale");
+
+    AVCodec *encoder_codec  = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    AVCodecContext *encoder = (encoder_codec) ? avcodec_alloc_context3(encoder_codec) : nullptr;
+    DQN_DEFER { avcodec_free_context(&encoder); };
+    THUMBNAIL_CHECK(encoder ? 0 : AVERROR(ENOMEM), "encoder");
+    encoder->width          = width;
+    encoder->height         = height;
+    encoder->pix_fmt        = AV_PIX_FMT_YUVJ420P;
+    encoder->color_range    = AVCOL_RANGE_JPEG;
+    encoder->time_base      = AVRational{1, 25};
+    encoder->flags         |= AV_CODEC_FLAG_QSCALE;
+    encoder->global_quality = FF_QP2LAMBDA * 3;
+    encoder->thread_count   = 1;
+    THUMBNAIL_CHECK(avcodec_open2(encoder, encoder_codec, nullptr), "encoder");
+
+    scaled->quality = encoder->global_quality;
+    scaled->pts     = 0;
+    THUMBNAIL_CHECK(avcodec_send_frame(encoder, scaled), "encode");
+    THUMBNAIL_CHECK(avcodec_receive_packet(encoder, packet), "encode");
+    DQN_DEFER { av_packet_unref(packet); };
+
+    DqnFile file = {};
+    if (!file.Open(job->partial_path_w, DqnFile::Flag::FileWrite, DqnFile::Action::ForceCreate))
+    {
+        job->failed_step = "write";
+        return;
+    }
+    usize bytes_written = file.Write(packet->data, static_cast<usize>(packet->size));
+    file.Close();
+
+    if (bytes_written != static_cast<usize>(packet->size) || !MoveFileExW(job->partial_path_w, job->path_w, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(job->partial_path_w);
+        job->failed_step = "write";
+        return;
+    }
+
+    job->success = true;
+#undef THUMBNAIL_CHECK
+}
+
+struct ArtThumbnailBatch
+{
+    LaneBatch        lanes;
+    ArtThumbnailJob *jobs;
+};
+
+FILE_SCOPE void ArtThumbnailBatch_Run(void *user_data, isize job_index)
+{
+    auto *batch = static_cast<ArtThumbnailBatch *>(user_data);
+    MakeArtThumbnail(batch->jobs + job_index);
+}
+
+// Make the thumbnails of the covers stored since the last call, and of those stored before thumbnails
+// were asked for
+FILE_SCOPE void MakeArtThumbnails(Context *context)
+{
+    ArtStore *store = context->art;
+    if (!store || store->pending_thumbnails.len == 0)
+        return;
+
+    STAGE_SCOPE(&context->stats, Stage::Art);
+    StageStats *stage_stats          = context->stats[Stage::Art];
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+
+    ArtThumbnailBatch batch = {};
+    batch.lanes.Run         = ArtThumbnailBatch_Run;
+    batch.lanes.user_data   = &batch;
+    batch.lanes.name        = "art_thumbnail";
+    batch.jobs              = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, ArtThumbnailJob, store->pending_thumbnails.len);
+    for (u64 hash : store->pending_thumbnails)
+    {
+        ArtEntry const *entry = store->entries.Get(hash);
+        if (!entry)
+            continue;
+
+        ArtThumbnailJob *job = batch.jobs + batch.lanes.num_items++;
+        *job                 = {};
+        job->path            = ArtStore_Path(&context->allocator, store, hash, ART_THUMBNAIL_SUFFIX);
+        job->src_path_w      = UTF8ToWChar(&context->allocator, ArtStore_Path(&context->allocator, store, hash, entry->extension));
+        job->path_w          = UTF8ToWChar(&context->allocator, job->path);
+        job->is_png          = DqnStr_Cmp(entry->extension, ".png") == 0;
+        job->max_px          = store->thumbnail_px;
+
+        char *partial_path   = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, char, DqnStr_Len(job->path) + 6);
+        Dqn_sprintf(partial_path, "%s.part", job->path);
+        job->partial_path_w  = UTF8ToWChar(&context->allocator, partial_path);
+    }
+    store->pending_thumbnails.Clear();
+
+    if (batch.lanes.num_items == 0)
+        return;
+
+    stage_stats->items += batch.lanes.num_items;
+    LaneBatch_Start(context, &batch.lanes);
+    LaneBatch_Finish(context, &batch.lanes);
+
+    DQN_FOR_EACH(job_index, batch.lanes.num_items)
+    {
+        ArtThumbnailJob const *job = batch.jobs + job_index;
+        if (job->success)
+        {
+            store->num_thumbnails++;
+            continue;
+        }
+
+        stage_stats->failures++;
+        char av_error[AV_ERROR_MAX_STRING_SIZE] = "no error code";
+        if (job->av_error < 0) av_strerror(job->av_error, av_error, sizeof(av_error));
+        char const *msg = DQN_LOGGER_E(&context->logger, "Cover art thumbnail failed at %s (%s). Could not make: %s", job->failed_step, av_error, job->path);
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Sound Decoder
+// =================================================================================================
+// Decodes a sound to interleaved f32 at its own sample rate for analysis, downmixed to stereo if it
+// has more channels. Pulled a chunk at a time, the chunk is valid until the next Read. The resampler,
+// frame, packet and sample buffer are per-thread and reused across sounds like SoundReaderScratch.
+struct SoundDecoderScratch
+{
+    SwrContext *resampler;
+    AVFrame    *frame;
+    AVPacket   *packet;
+    f32        *samples;
+    int         max_frames;
+};
+
+FILE_SCOPE thread_local SoundDecoderScratch global_sound_decoder_scratch_;
+
+struct SoundDecoder
+{
+    SoundReader      reader;
+    AVFormatContext *input;
+    AVCodecContext  *decoder;
+    int              stream_index;
+    int              sample_rate;   // Valid once the first chunk is read
+    int              num_channels;  // 1 or 2, valid once the first chunk is read
+    bool             resampler_ready;
+    bool             decoder_drained;
+    bool             flushed;
+
+    int  Open (SoundFile const *sound_file, char const *path_utf8); // return: 0 or the AVERROR
+    int  Read (f32 const **samples, int *num_frames);              // return: 0 or the AVERROR, AVERROR_EOF after the last chunk
+    int  Seek (i64 time_ms);                                        // return: 0 or the AVERROR, the next chunk is at or before the time
+    void Close();
+};
+
+int SoundDecoder::Open(SoundFile const *sound_file, char const *path_utf8)
+{
+    *this = {};
+    SoundDecoderScratch *scratch = &global_sound_decoder_scratch_;
+    if (!scratch->frame)  scratch->frame  = av_frame_alloc();
+    if (!scratch->packet) scratch->packet = av_packet_alloc();
+    if (!scratch->frame || !scratch->packet)
+        return AVERROR(ENOMEM);
+
+    if (!this->reader.Open(sound_file->path.str))
+        return AVERROR(ENOENT);
+
+    this->input = OpenSoundForTags(&this->reader, path_utf8);
+    if (!this->input)
+    {
+        this->Close();
+        return AVERROR_INVALIDDATA;
+    }
+
+    AVCodec *codec     = nullptr;
+    this->stream_index = av_find_best_stream(this->input, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    int result         = this->stream_index;
+    if (result >= 0) result = (this->decoder = avcodec_alloc_context3(codec)) ? 0 : AVERROR(ENOMEM);
+    if (result >= 0) result = avcodec_parameters_to_context(this->decoder, this->input->streams[this->stream_index]->codecpar);
+    if (result >= 0)
+    {
+        this->decoder->thread_count = 1; // NOTE(doyle): Sounds are decoded on lanes, one per core
+        result = avcodec_open2(this->decoder, codec, nullptr);
+    }
+
+    if (result < 0)
+        this->Close();
+    return (result < 0) ? result : 0;
+}
+
+// Convert a decoded frame, nullptr to flush the resampler
+FILE_SCOPE int SoundDecoder_Convert(SoundDecoder *decoder, AVFrame const *frame, f32 const **samples, int *num_frames)
+{
+    SoundDecoderScratch *scratch = &global_sound_decoder_scratch_;
+    if (frame && !decoder->resampler_ready)
+    {
+        int channels         = (frame->channels > 0) ? frame->channels : 1;
+        i64 in_layout        = (frame->channel_layout) ? (i64)frame->channel_layout : av_get_default_channel_layout(channels);
+        decoder->num_channels = (channels == 1) ? 1 : 2;
+        decoder->sample_rate  = frame->sample_rate;
+        i64 out_layout       = (decoder->num_channels == 1) ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
+        scratch->resampler   = swr_alloc_set_opts(scratch->resampler,
+                                                  out_layout, AV_SAMPLE_FMT_FLT, frame->sample_rate,
+                                                  in_layout, (AVSampleFormat)frame->format, frame->sample_rate,
+                                                  0, nullptr);
+        if (!scratch->resampler)
+            return AVERROR(ENOMEM);
+
+        int result = swr_init(scratch->resampler);
+        if (result < 0)
+            return result;
+        decoder->resampler_ready = true;
+    }
+
+    *num_frames = 0;
+    if (!decoder->resampler_ready)
+        return 0;
+
+    int in_frames  = (frame) ? frame->nb_samples : 0;
+    int out_frames = swr_get_out_samples(scratch->resampler, in_frames);
+    if (out_frames > scratch->max_frames)
+    {
+        av_freep(&scratch->samples);
+        scratch->max_frames = 0;
+        scratch->samples    = static_cast<f32 *>(av_malloc(sizeof(f32) * 2 * out_frames));
+        if (!scratch->samples)
+            return AVERROR(ENOMEM);
+        scratch->max_frames = out_frames;
+    }
+
+    u8 *out_data[]     = {reinterpret_cast<u8 *>(scratch->samples)};
+    u8 const **in_data = (frame) ? const_cast<u8 const **>(frame->extended_data) : nullptr;
+    int converted      = swr_convert(scratch->resampler, out_data, scratch->max_frames, in_data, in_frames);
+    if (converted < 0)
+        return converted;
+
+    *samples    = scratch->samples;
+    *num_frames = converted;
+    return 0;
+}
+
+int SoundDecoder::Read(f32 const **samples, int *num_frames)
+{
+    SoundDecoderScratch *scratch = &global_sound_decoder_scratch_;
+    for (;;)
+    {
+        int result = avcodec_receive_frame(this->decoder, scratch->frame);
+        if (result == 0)
+        {
+            result = SoundDecoder_Convert(this, scratch->frame, samples, num_frames);
+            av_frame_unref(scratch->frame);
+            if (result < 0 || *num_frames > 0)
+                return result;
+            continue;
+        }
+
+        if (result == AVERROR_EOF)
+        {
+            if (this->flushed)
+                return AVERROR_EOF;
+
+            this->flushed = true;
+            result        = SoundDecoder_Convert(this, nullptr, samples, num_frames);
+            if (result < 0 || *num_frames > 0)
+                return result;
+            return AVERROR_EOF;
+        }
+
+        if (result != AVERROR(EAGAIN))
+            return result;
+
+        AVPacket *packet = scratch->packet;
+        result           = av_read_frame(this->input, packet);
+        if (result == AVERROR_EOF)
+        {
+            if (this->decoder_drained)
+                return AVERROR_EOF;
+            this->decoder_drained = true;
+            avcodec_send_packet(this->decoder, nullptr);
+            continue;
+        }
+
+        if (result < 0)
+            return result;
+
+        if (packet->stream_index == this->stream_index)
+            result = avcodec_send_packet(this->decoder, packet);
+        av_packet_unref(packet);
+
+        // NOTE(doyle): A corrupt packet loses its samples, the rest of the sound is still usable
+        if (result < 0 && result != AVERROR_INVALIDDATA)
+            return result;
+    }
+}
+
+int SoundDecoder::Seek(i64 time_ms)
+{
+    int result = av_seek_frame(this->input, -1, time_ms * (AV_TIME_BASE / 1000), AVSEEK_FLAG_BACKWARD);
+    if (result < 0)
+        return result;
+
+    avcodec_flush_buffers(this->decoder);
+    this->decoder_drained = false;
+    this->flushed         = false;
+    return 0;
+}
+
+void SoundDecoder::Close()
+{
+    avcodec_free_context(&this->decoder);
+    if (this->input) avformat_close_input(&this->input);
+    this->reader.Close();
+}
+
+// Loudness
+// =================================================================================================
+// EBU R128 (ITU-R BS.1770-4) integrated loudness and true peak, from which ReplayGain 2.0 style gains
+// follow (-18 LUFS reference). Sounds are K-weighted by two biquads with the channels in the lanes of
+// an __m128d, the mean square of every 100ms is summed over the channels and 400ms gating blocks
+// overlap by 75%. True peak is the peak of a 4x oversampled signal, the 4 phases of the interpolating
+// FIR are the lanes of an __m128 so every oversampled value of an input sample comes out at once.
+#define LOUDNESS_TRUE_PEAK_TAPS   12   // Per phase, 4 phases for 4x oversampling
+#define LOUDNESS_ABSOLUTE_GATE    -70.0
+#define LOUDNESS_RELATIVE_GATE    -10.0
+
+FILE_SCOPE f64 Loudness_FromEnergy(f64 energy) { return -0.691 + 10.0 * log10(energy); }
+FILE_SCOPE f64 Loudness_ToEnergy  (f64 lufs)   { return pow(10.0, (lufs + 0.691) / 10.0); }
+
+// Gate the blocks of a loudness histogram, bin centres stand in for the blocks' loudness
+// return: Integrated loudness in LUFS, LOUDNESS_ABSOLUTE_GATE if every block is gated out
+FILE_SCOPE f64 Loudness_IntegrateHistogram(u32 const *histogram)
+{
+    f64 energy_sum = 0;
+    u64 num_blocks = 0;
+    DQN_FOR_EACH(bin, LOUDNESS_HISTOGRAM_BINS)
+    {
+        f64 centre  = LOUDNESS_HISTOGRAM_MIN + LOUDNESS_HISTOGRAM_BIN_LU * (bin + 0.5);
+        energy_sum += histogram[bin] * Loudness_ToEnergy(centre);
+        num_blocks += histogram[bin];
+    }
+
+    if (num_blocks == 0)
+        return LOUDNESS_ABSOLUTE_GATE;
+
+    f64 relative_gate = Loudness_FromEnergy(energy_sum / num_blocks) + LOUDNESS_RELATIVE_GATE;
+    energy_sum        = 0;
+    num_blocks        = 0;
+    DQN_FOR_EACH(bin, LOUDNESS_HISTOGRAM_BINS)
+    {
+        f64 centre = LOUDNESS_HISTOGRAM_MIN + LOUDNESS_HISTOGRAM_BIN_LU * (bin + 0.5);
+        if (centre < relative_gate)
+            continue;
+        energy_sum += histogram[bin] * Loudness_ToEnergy(centre);
+        num_blocks += histogram[bin];
+    }
+
+    f64 result = (num_blocks) ? Loudness_FromEnergy(energy_sum / num_blocks) : LOUDNESS_ABSOLUTE_GATE;
+    return result;
+}
+
+struct LoudnessBiquad
+{
+    __m128d b0, b1, b2, a1, a2; // Same coefficient in both lanes
+    __m128d z1, z2;             // Transposed direct form II state, a channel a lane
+};
+
+// Per-thread, the block energies and true peak history are reused across sounds
+struct LoudnessMeter
+{
+    int            num_channels;
+    LoudnessBiquad shelf;            // Stage 1 of the K-weighting, +4dB above ~1.5kHz
+    LoudnessBiquad high_pass;        // Stage 2, RLB weighting
+    __m128d        sub_block_sum;    // Sum of squares of the K-weighted samples, a channel a lane
+    int            sub_block_frames; // Frames in a 100ms sub block
+    int            sub_block_pos;
+    f64            sub_blocks[4];    // Mean squares of the last 4 sub blocks, summed over the channels
+    isize          num_sub_blocks;
+    DqnArray<f64>  block_energies;   // Of every 400ms gating block above the absolute gate
+
+    __m128         true_peak_coeffs[LOUDNESS_TRUE_PEAK_TAPS]; // A phase a lane, oldest sample's tap first
+    f32            history[2][2 * LOUDNESS_TRUE_PEAK_TAPS];   // Each sample is stored twice for contiguous windows
+    int            history_pos;
+    __m128         peak;             // Absolute maxima, lanes are reduced at the end
+};
+
+FILE_SCOPE thread_local LoudnessMeter global_loudness_meter_;
+
+FILE_SCOPE void LoudnessBiquad_Init(LoudnessBiquad *biquad, f64 b0, f64 b1, f64 b2, f64 a1, f64 a2)
+{
+    biquad->b0 = _mm_set1_pd(b0);
+    biquad->b1 = _mm_set1_pd(b1);
+    biquad->b2 = _mm_set1_pd(b2);
+    biquad->a1 = _mm_set1_pd(a1);
+    biquad->a2 = _mm_set1_pd(a2);
+    biquad->z1 = _mm_setzero_pd();
+    biquad->z2 = _mm_setzero_pd();
+}
+
+FILE_SCOPE inline __m128d LoudnessBiquad_Process(LoudnessBiquad *biquad, __m128d x)
+{
+    __m128d y  = _mm_add_pd(_mm_mul_pd(biquad->b0, x), biquad->z1);
+    biquad->z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(biquad->b1, x), _mm_mul_pd(biquad->a1, y)), biquad->z2);
+    biquad->z2 = _mm_sub_pd(_mm_mul_pd(biquad->b2, x), _mm_mul_pd(biquad->a2, y));
+    return y;
+}
+
+// NOTE(doyle): The filters decay towards denormals over silence, which are very slow on x86
+FILE_SCOPE inline void LoudnessBiquad_FlushDenormals(LoudnessBiquad *biquad)
+{
+    __m128d const tiny = _mm_set1_pd(1e-30);
+    __m128d const sign = _mm_set1_pd(-0.0);
+    biquad->z1         = _mm_and_pd(biquad->z1, _mm_cmpge_pd(_mm_andnot_pd(sign, biquad->z1), tiny));
+    biquad->z2         = _mm_and_pd(biquad->z2, _mm_cmpge_pd(_mm_andnot_pd(sign, biquad->z2), tiny));
+}
+
+FILE_SCOPE void LoudnessMeter_Begin(LoudnessMeter *meter, int sample_rate, int num_channels)
+{
+    // NOTE(doyle): Cleared by hand, MSVC and GCC disagree on brace initialising SSE members
+    DqnArray<f64> block_energies = meter->block_energies;
+    block_energies.Clear();
+    DqnMem_Clear(meter, 0, sizeof(*meter));
+    meter->block_energies = block_energies;
+    meter->num_channels   = num_channels;
+
+    // NOTE(doyle): The K-weighting filters of BS.1770 are specified at 48kHz, these are the analog
+    // prototypes they were taken from mapped to the sound's rate by the bilinear transform.
+    {
+        f64 const f0 = 1681.974450955533, gain_db = 3.999843853973347, q = 0.7071752369554196;
+        f64 k        = tan(DQN_PI * f0 / sample_rate);
+        f64 vh       = pow(10.0, gain_db / 20.0);
+        f64 vb       = pow(vh, 0.4996667741545416);
+        f64 a0       = 1.0 + k / q + k * k;
+        LoudnessBiquad_Init(&meter->shelf,
+                            (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                            2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0);
+    }
+    {
+        f64 const f0 = 38.13547087602444, q = 0.5003270373238773;
+        f64 k        = tan(DQN_PI * f0 / sample_rate);
+        f64 a0       = 1.0 + k / q + k * k;
+        LoudnessBiquad_Init(&meter->high_pass, 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0);
+    }
+
+    meter->sub_block_sum    = _mm_setzero_pd();
+    meter->sub_block_frames = DQN_MAX(sample_rate / 10, 1);
+
+    // NOTE(doyle): Hann windowed sinc cut off at the sound's Nyquist, phase p of the polyphase FIR is
+    // every 4th tap from p
+    int const num_taps = 4 * LOUDNESS_TRUE_PEAK_TAPS;
+    DQN_FOR_EACH(tap, LOUDNESS_TRUE_PEAK_TAPS)
+    {
+        f32 phases[4];
+        DQN_FOR_EACH(phase, 4)
+        {
+            int n         = (int)phase + 4 * (LOUDNESS_TRUE_PEAK_TAPS - 1 - (int)tap);
+            f64 t         = (n - (num_taps - 1) * 0.5) / 4.0;
+            f64 sinc      = (t == 0) ? 1.0 : sin(DQN_PI * t) / (DQN_PI * t);
+            f64 window    = 0.5 - 0.5 * cos(2.0 * DQN_PI * (n + 0.5) / num_taps);
+            phases[phase] = (f32)(sinc * window);
+        }
+        meter->true_peak_coeffs[tap] = _mm_loadu_ps(phases);
+    }
+    meter->peak = _mm_setzero_ps();
+}
+
+FILE_SCOPE void LoudnessMeter_EndSubBlock(LoudnessMeter *meter)
+{
+    f64 sums[2];
+    _mm_storeu_pd(sums, meter->sub_block_sum);
+    // NOTE(doyle): Mono is measured as dual mono, it's played on both speakers
+    f64 weight                                     = (meter->num_channels == 1) ? 2.0 : 1.0;
+    meter->sub_blocks[meter->num_sub_blocks++ % 4] = weight * (sums[0] + sums[1]) / meter->sub_block_frames;
+    meter->sub_block_sum                           = _mm_setzero_pd();
+    meter->sub_block_pos                           = 0;
+    LoudnessBiquad_FlushDenormals(&meter->shelf);
+    LoudnessBiquad_FlushDenormals(&meter->high_pass);
+
+    if (meter->num_sub_blocks >= 4)
+    {
+        f64 energy = (meter->sub_blocks[0] + meter->sub_blocks[1] + meter->sub_blocks[2] + meter->sub_blocks[3]) * 0.25;
+        if (energy > 0 && Loudness_FromEnergy(energy) >= LOUDNESS_ABSOLUTE_GATE)
+            meter->block_energies.Push(energy);
+    }
+}
+
+FILE_SCOPE void LoudnessMeter_Process(LoudnessMeter *meter, f32 const *samples, int num_frames)
+{
+    __m128 const sign = _mm_set1_ps(-0.0f);
+    __m128 peak       = meter->peak;
+    DQN_FOR_EACH(frame_index, num_frames)
+    {
+        f32 const *frame = samples + frame_index * meter->num_channels;
+        __m128d x        = (meter->num_channels == 1) ? _mm_set_pd(0.0, frame[0]) : _mm_set_pd(frame[1], frame[0]);
+        __m128d y        = LoudnessBiquad_Process(&meter->shelf, x);
+        y                = LoudnessBiquad_Process(&meter->high_pass, y);
+        meter->sub_block_sum = _mm_add_pd(meter->sub_block_sum, _mm_mul_pd(y, y));
+        if (++meter->sub_block_pos == meter->sub_block_frames)
+            LoudnessMeter_EndSubBlock(meter);
+
+        int pos = meter->history_pos;
+        DQN_FOR_EACH(channel, meter->num_channels)
+        {
+            f32 *history                           = meter->history[channel];
+            history[pos]                           = frame[channel];
+            history[pos + LOUDNESS_TRUE_PEAK_TAPS] = frame[channel];
+
+            f32 const *window = history + pos + 1;
+            __m128 phases     = _mm_andnot_ps(sign, _mm_set1_ps(frame[channel]));
+            peak              = _mm_max_ps(peak, phases);
+            phases            = _mm_setzero_ps();
+            DQN_FOR_EACH(tap, LOUDNESS_TRUE_PEAK_TAPS)
+                phases = _mm_add_ps(phases, _mm_mul_ps(_mm_set1_ps(window[tap]), meter->true_peak_coeffs[tap]));
+            peak = _mm_max_ps(peak, _mm_andnot_ps(sign, phases));
+        }
+        meter->history_pos = (pos + 1) % LOUDNESS_TRUE_PEAK_TAPS;
+    }
+    meter->peak = peak;
+}
+
+FILE_SCOPE void LoudnessMeter_End(LoudnessMeter *meter, TrackLoudness *loudness)
+{
+    *loudness          = {};
+    loudness->analysed = 1;
+
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, meter->peak);
+    loudness->true_peak = 0;
+    for (f32 lane : lanes)
+        loudness->true_peak = DQN_MAX(loudness->true_peak, lane);
+
+    f64 energy_sum = 0;
+    for (f64 energy : meter->block_energies)
+        energy_sum += energy;
+
+    isize num_blocks          = meter->block_energies.len;
+    loudness->integrated_lufs = (f32)LOUDNESS_ABSOLUTE_GATE;
+    if (num_blocks == 0)
+        return;
+
+    f64 relative_gate = Loudness_FromEnergy(energy_sum / num_blocks) + LOUDNESS_RELATIVE_GATE;
+    f64 gated_sum     = 0;
+    isize num_gated   = 0;
+    for (f64 energy : meter->block_energies)
+    {
+        f64 lufs = Loudness_FromEnergy(energy);
+        int bin  = DQN_MIN((int)((lufs - LOUDNESS_HISTOGRAM_MIN) / LOUDNESS_HISTOGRAM_BIN_LU), LOUDNESS_HISTOGRAM_BINS - 1);
+        if (loudness->histogram[bin] < 0xFFFF) loudness->histogram[bin]++;
+        if (lufs < relative_gate) continue;
+        gated_sum += energy;
+        num_gated++;
+    }
+
+    if (num_gated)
+        loudness->integrated_lufs = (f32)Loudness_FromEnergy(gated_sum / num_gated);
+}
+
+struct AlbumTrack
+{
+    u32 album;        // String ids of the album's tags, equal strings are the same id
+    u32 album_artist;
+    u32 track;
+};
+
+FILE_SCOPE bool AlbumTrack_LessThan(AlbumTrack const &a, AlbumTrack const &b, void *)
+{
+    if (a.album != b.album) return a.album < b.album;
+    return a.album_artist < b.album_artist;
+}
+
+// Gate the blocks of every analysed track sharing an album and album artist together, from the tracks'
+// histograms so no sound is decoded again. Tracks without an album are their own album.
+FILE_SCOPE void SetAlbumLoudness(LibraryIndexBuilder *builder)
+{
+    DqnArray<AlbumTrack> album_tracks = {};
+    DQN_DEFER { album_tracks.Free(); };
+    DQN_FOR_EACH(track, builder->num_tracks)
+    {
+        TrackLoudness const *loudness            = builder->loudness.data + track;
+        builder->album_loudness_lufs.data[track] = loudness->integrated_lufs;
+        u32 album                                = builder->tags[(int)LibraryTag::Album].data[track];
+        if (loudness->analysed && album)
+            album_tracks.Push({album, builder->tags[(int)LibraryTag::AlbumArtist].data[track], (u32)track});
+    }
+
+    DqnQuickSort<AlbumTrack, AlbumTrack_LessThan>(album_tracks.data, album_tracks.len, nullptr);
+    for (isize start = 0; start < album_tracks.len;)
+    {
+        isize end = start + 1;
+        while (end < album_tracks.len && !AlbumTrack_LessThan(album_tracks.data[start], album_tracks.data[end], nullptr))
+            end++;
+
+        u32 histogram[LOUDNESS_HISTOGRAM_BINS] = {};
+        for (isize i = start; i < end; i++)
+        {
+            TrackLoudness const *loudness = builder->loudness.data + album_tracks.data[i].track;
+            DQN_FOR_EACH(bin, LOUDNESS_HISTOGRAM_BINS)
+                histogram[bin] += loudness->histogram[bin];
+        }
+
+        f32 album_lufs = (f32)Loudness_IntegrateHistogram(histogram);
+        for (isize i = start; i < end; i++)
+            builder->album_loudness_lufs.data[album_tracks.data[i].track] = album_lufs;
+        start = end;
+    }
+}
+
+// Waveform
+// =================================================================================================
+// A peak summary of a sound for drawing, WAVEFORM_NUM_PEAKS (min, max) pairs over all its channels,
+// evenly spaced through the sound. Decoded samples are reduced to the min and max of every
+// WAVEFORM_WINDOW_FRAMES frames as they come, 4 samples at a time. A sound's length isn't known until
+// it's decoded, so the windows are merged down to the summary at the end. Peaks are i8, 127 is full
+// scale.
+#define WAVEFORM_NUM_PEAKS     1024
+#define WAVEFORM_WINDOW_FRAMES 256
+
+struct WaveformPeaks
+{
+    i8 peaks[WAVEFORM_NUM_PEAKS][2]; // (min, max)
+};
+
+// Per-thread, the windows are reused across sounds
+struct WaveformBuilder
+{
+    int           window_samples; // Interleaved samples in a window
+    int           window_pos;
+    __m128        min;
+    __m128        max;
+    DqnArray<f32> windows;        // (min, max) of every window so far
+};
+
+FILE_SCOPE thread_local WaveformBuilder global_waveform_builder_;
+
+FILE_SCOPE void WaveformBuilder_Begin(WaveformBuilder *builder, int num_channels)
+{
+    builder->windows.Clear();
+    builder->window_samples = WAVEFORM_WINDOW_FRAMES * num_channels;
+    builder->window_pos     = 0;
+    builder->min            = _mm_set1_ps(INFINITY);
+    builder->max            = _mm_set1_ps(-INFINITY);
+}
+
+FILE_SCOPE void WaveformBuilder_EndWindow(WaveformBuilder *builder)
+{
+    __m128 min = builder->min;
+    __m128 max = builder->max;
+    min        = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(1, 0, 3, 2)));
+    min        = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(2, 3, 0, 1)));
+    max        = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+    max        = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+    builder->windows.Push(_mm_cvtss_f32(min));
+    builder->windows.Push(_mm_cvtss_f32(max));
+
+    builder->window_pos = 0;
+    builder->min        = _mm_set1_ps(INFINITY);
+    builder->max        = _mm_set1_ps(-INFINITY);
+}
+
+// samples: Interleaved, num_samples is the frames times the channels
+FILE_SCOPE void WaveformBuilder_Process(WaveformBuilder *builder, f32 const *samples, int num_samples)
+{
+    for (int sample_index = 0; sample_index < num_samples;)
+    {
+        int len        = DQN_MIN(num_samples - sample_index, builder->window_samples - builder->window_pos);
+        f32 const *src = samples + sample_index;
+        __m128 min     = builder->min;
+        __m128 max     = builder->max;
+        int i          = 0;
+        for (; i + 4 <= len; i += 4)
+        {
+            __m128 values = _mm_loadu_ps(src + i);
+            min           = _mm_min_ps(min, values);
+            max           = _mm_max_ps(max, values);
+        }
+
+        for (; i < len; i++)
+        {
+            __m128 value = _mm_set_ss(src[i]);
+            min          = _mm_min_ss(min, value);
+            max          = _mm_max_ss(max, value);
+        }
+
+        builder->min         = min;
+        builder->max         = max;
+        builder->window_pos += len;
+        sample_index        += len;
+        if (builder->window_pos == builder->window_samples)
+            WaveformBuilder_EndWindow(builder);
+    }
+}
+
+FILE_SCOPE i8 Waveform_Quantise(f32 value)
+{
+    int result = (int)floorf(value * 127.0f + 0.5f);
+    return (i8)DQN_CLAMP(result, -127, 127);
+}
+
+FILE_SCOPE void WaveformBuilder_End(WaveformBuilder *builder, WaveformPeaks *peaks)
+{
+    if (builder->window_pos > 0)
+        WaveformBuilder_EndWindow(builder);
+
+    *peaks             = {};
+    isize num_windows  = builder->windows.len / 2;
+    f32 const *windows = builder->windows.data;
+    if (num_windows == 0)
+        return;
+
+    // NOTE(doyle): A sound with fewer windows than peaks repeats its windows over several peaks
+    DQN_FOR_EACH(peak_index, WAVEFORM_NUM_PEAKS)
+    {
+        isize first = (isize)peak_index * num_windows / WAVEFORM_NUM_PEAKS;
+        isize last  = DQN_MAX(first + 1, ((isize)peak_index + 1) * num_windows / WAVEFORM_NUM_PEAKS);
+        f32 min     = windows[first * 2 + 0];
+        f32 max     = windows[first * 2 + 1];
+        for (isize window = first + 1; window < last; window++)
+        {
+            min = DQN_MIN(min, windows[window * 2 + 0]);
+            max = DQN_MAX(max, windows[window * 2 + 1]);
+        }
+
+        peaks->peaks[peak_index][0] = Waveform_Quantise(min);
+        peaks->peaks[peak_index][1] = Waveform_Quantise(max);
+    }
+}
+
+// Waveform Store
+// =================================================================================================
+// Waveforms are kept in WPDLibrary.waveforms beside the library index and keyed the same way, by the
+// hash of the source's path and valid whilst its size and last write time are unchanged. Sounds with a
+// valid waveform aren't decoded again. The file is rewritten whole when waveforms were made.
+//
+// Layout: WaveformStoreHeader | WaveformStoreEntry[num_entries] | WaveformPeaks[num_entries]
+#define WAVEFORM_STORE_MAGIC   0x57445057 // "WPDW"
+#define WAVEFORM_STORE_VERSION 1
+
+struct WaveformStoreHeader
+{
+    u32 magic;
+    u32 version;
+    u64 num_entries;
+    u64 num_peaks;   // Per entry, WAVEFORM_NUM_PEAKS
+    u64 file_size;
+};
+
+struct WaveformStoreEntry
+{
+    u64 path_hash;            // LibraryIndex_HashPath of the UTF-8 source path
+    u64 size;
+    u64 last_write_time_in_s;
+    u64 peaks_index;          // Of the entry's peaks
+};
+
+struct WaveformStore
+{
+    DqnBuffer<wchar_t>                     path;
+    bool                                   dirty; // Waveforms were made since the store was written
+    i64                                    num_made;
+    DqnVHashTable<u64, WaveformStoreEntry> entries;
+    DqnArray<WaveformPeaks>                peaks;
+
+    void                 Load(Context *context);
+    void                 Free() { entries.Free(); peaks.Free(); }
+    WaveformPeaks const *Get (u64 path_hash, DqnFileInfo const *info); // return: Null if there's none or the sound changed since
+    void                 Put (u64 path_hash, DqnFileInfo const *info, WaveformPeaks const *waveform);
+};
+
+void WaveformStore::Load(Context *context)
+{
+    *this      = {};
+    this->path = AllocateSwprintf(&context->allocator, L"%s\\WPDLibrary.waveforms", context->exe_directory.str);
+    this->entries.LazyInit(DQN_MEGABYTE(1));
+
+    // NOTE(doyle): A missing or invalid store starts empty, every sound's waveform is made again
+    usize buf_size = 0;
+    u8 *buf        = DqnFile_ReadAll(this->path.str, &buf_size);
+    if (!buf)
+        return;
+    DQN_DEFER { dqn_lib_context_.allocator->Free(buf, buf_size); };
+
+    auto const *header = reinterpret_cast<WaveformStoreHeader const *>(buf);
+    bool valid = buf_size >= sizeof(*header) && header->magic == WAVEFORM_STORE_MAGIC && header->version == WAVEFORM_STORE_VERSION &&
+                 header->num_peaks == WAVEFORM_NUM_PEAKS && header->file_size == buf_size &&
+                 header->num_entries == (buf_size - sizeof(*header)) / (sizeof(WaveformStoreEntry) + sizeof(WaveformPeaks));
+    if (!valid)
+        return;
+
+    auto const *entry     = reinterpret_cast<WaveformStoreEntry const *>(buf + sizeof(*header));
+    auto const *waveforms = reinterpret_cast<WaveformPeaks const *>(entry + header->num_entries);
+    this->peaks.Resize((isize)header->num_entries);
+    DqnMem_Copy(this->peaks.data, waveforms, sizeof(*waveforms) * header->num_entries);
+    for (u64 entry_index = 0; entry_index < header->num_entries; entry_index++, entry++)
+    {
+        if (entry->peaks_index < header->num_entries)
+            this->entries.Set(entry->path_hash, *entry);
+    }
+}
+
+WaveformPeaks const *WaveformStore::Get(u64 path_hash, DqnFileInfo const *info)
+{
+    WaveformStoreEntry const *entry = entries.Get(path_hash);
+    if (!entry || entry->size != info->size || entry->last_write_time_in_s != info->last_write_time_in_s)
+        return nullptr;
+    return peaks.data + entry->peaks_index;
+}
+
+void WaveformStore::Put(u64 path_hash, DqnFileInfo const *info, WaveformPeaks const *waveform)
+{
+    // NOTE(doyle): A changed sound's waveform is overwritten in place, every entry's peaks are the same size
+    bool existed              = false;
+    WaveformStoreEntry *entry = entries.GetOrMake(path_hash, &existed);
+    if (!existed)
+    {
+        entry->peaks_index = (u64)peaks.len;
+        peaks.Push(*waveform);
+    }
+    else
+    {
+        peaks.data[entry->peaks_index] = *waveform;
+    }
+
+    entry->path_hash            = path_hash;
+    entry->size                 = info->size;
+    entry->last_write_time_in_s = info->last_write_time_in_s;
+    dirty                       = true;
+    num_made++;
+}
+
+FILE_SCOPE void WriteWaveformStore(Context *context, WaveformStore *store)
+{
+    if (!store->dirty)
+        return;
+
+    isize num_entries = store->entries.num_used_entries;
+    usize buf_size    = sizeof(WaveformStoreHeader) + (sizeof(WaveformStoreEntry) + sizeof(WaveformPeaks)) * num_entries;
+    auto *buf         = static_cast<u8 *>(dqn_lib_context_.allocator->Malloc(buf_size));
+    if (!buf) return;
+    DQN_DEFER { dqn_lib_context_.allocator->Free(buf, buf_size); };
+
+    auto *header        = reinterpret_cast<WaveformStoreHeader *>(buf);
+    header->magic       = WAVEFORM_STORE_MAGIC;
+    header->version     = WAVEFORM_STORE_VERSION;
+    header->num_entries = (u64)num_entries;
+    header->num_peaks   = WAVEFORM_NUM_PEAKS;
+    header->file_size   = buf_size;
+
+    auto *entries     = reinterpret_cast<WaveformStoreEntry *>(buf + sizeof(*header));
+    auto *waveforms   = reinterpret_cast<WaveformPeaks *>(entries + num_entries);
+    isize entry_index = 0;
+    for (DqnVHashTable<u64, WaveformStoreEntry>::Entry const &entry : store->entries)
+    {
+        entries[entry_index]             = entry.item;
+        entries[entry_index].peaks_index = (u64)entry_index;
+        waveforms[entry_index]           = store->peaks.data[entry.item.peaks_index];
+        entry_index++;
+    }
+
+    if (DqnFile_WriteAll(store->path.str, buf, buf_size))
+    {
+        store->dirty = false;
+    }
+    else
+    {
+        char const *msg = DQN_LOGGER_E(&context->logger, "Could not write the waveforms to: %s", WCharToUTF8(&context->allocator, store->path.str));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Fingerprint
+// =================================================================================================
+// The same song ripped or encoded more than once (FLAC, MP3, M4A) is found by how it sounds rather than
+// its bytes. Up to the first FINGERPRINT_SECONDS past any leading silence are downmixed to mono and cut
+// into frames FINGERPRINT_FRAMES_PER_SECOND times a second. The power spectrum of each frame (radix-2
+// FFT, Hann window) is folded into a chroma vector, the energy of each of the 12 pitch classes.
+// Frames are summed into FINGERPRINT_NUM_SEGMENTS segments spread over the fingerprinted span, and
+// each segment contributes a bit per pitch class, set if it's louder than the pitch class a semitone
+// above. Lossy encoding barely moves these comparisons, so fingerprints of the same song are a few bits
+// apart and unrelated songs about half their bits apart.
+//
+// Frame hops and FFT sizes are derived from the sound's rate, so sounds at different rates are
+// comparable without resampling.
+#define FINGERPRINT_SECONDS           30
+#define FINGERPRINT_FRAMES_PER_SECOND 8
+#define FINGERPRINT_MAX_FRAMES        (FINGERPRINT_SECONDS * FINGERPRINT_FRAMES_PER_SECOND)
+#define FINGERPRINT_NUM_SEGMENTS      16
+#define FINGERPRINT_SILENCE           0.001f // ~-60dBFS, leading samples quieter than this are skipped
+#define FINGERPRINT_MIN_HZ            110.0  // A2
+#define FINGERPRINT_MAX_HZ            5000.0
+
+// Per-thread, the tables are rebuilt when the sample rate changes
+struct FingerprintBuilder
+{
+    int           sample_rate;
+    int           num_channels;
+    int           fft_size;      // Power of 2, at least a hop
+    int           hop;           // Samples between frames
+    DqnArray<f32> window;        // Hann, fft_size
+    DqnArray<f32> twiddles;      // (cos, sin) of 2 pi k / fft_size for k < fft_size / 2
+    DqnArray<i8>  pitch_classes; // Of every bin up to fft_size / 2, -1 if outside the chroma range
+    DqnArray<f32> re;
+    DqnArray<f32> im;
+    DqnArray<f32> history;       // Ring of the last fft_size mono samples
+    int           history_pos;
+    int           num_history;
+    int           since_frame;
+    bool          started;       // Past the leading silence
+    int           num_frames;
+    f32           frames[FINGERPRINT_MAX_FRAMES][12];
+};
+
+FILE_SCOPE thread_local FingerprintBuilder global_fingerprint_builder_;
+
+FILE_SCOPE void FingerprintBuilder_Begin(FingerprintBuilder *builder, int sample_rate, int num_channels)
+{
+    builder->num_channels = num_channels;
+    builder->history_pos  = 0;
+    builder->num_history  = 0;
+    builder->since_frame  = 0;
+    builder->started      = false;
+    builder->num_frames   = 0;
+    if (builder->sample_rate == sample_rate)
+        return;
+
+    builder->sample_rate = sample_rate;
+    builder->hop         = DQN_MAX(sample_rate / FINGERPRINT_FRAMES_PER_SECOND, 1);
+    builder->fft_size    = 2;
+    while (builder->fft_size < builder->hop)
+        builder->fft_size *= 2;
+
+    int n = builder->fft_size;
+    builder->window.Resize(n);
+    builder->re.Resize(n);
+    builder->im.Resize(n);
+    builder->history.Resize(n);
+    builder->twiddles.Resize(n);
+    builder->pitch_classes.Resize(n / 2);
+    DQN_FOR_EACH(i, n)
+        builder->window.data[i] = (f32)(0.5 - 0.5 * cos(2.0 * DQN_PI * i / n));
+
+    DQN_FOR_EACH(k, n / 2)
+    {
+        builder->twiddles.data[k * 2 + 0] = (f32)cos(2.0 * DQN_PI * k / n);
+        builder->twiddles.data[k * 2 + 1] = (f32)sin(2.0 * DQN_PI * k / n);
+
+        f64 hz                           = (f64)k * sample_rate / n;
+        builder->pitch_classes.data[k]   = -1;
+        if (hz >= FINGERPRINT_MIN_HZ && hz <= FINGERPRINT_MAX_HZ)
+        {
+            int midi_note                  = (int)floor(12.0 * log2(hz / 440.0) + 69.0 + 0.5);
+            builder->pitch_classes.data[k] = (i8)(midi_note % 12);
+        }
+    }
+}
+
+// In place, iterative radix-2 decimation in time
+FILE_SCOPE void Fingerprint_FFT(f32 *re, f32 *im, int n, f32 const *twiddles)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            DQN_SWAP(f32, re[i], re[j]);
+            DQN_SWAP(f32, im[i], im[j]);
+        }
+    }
+
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        int half = len >> 1;
+        int step = n / len;
+        for (int start = 0; start < n; start += len)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                f32 wr = twiddles[k * step * 2 + 0];
+                f32 wi = -twiddles[k * step * 2 + 1];
+                int a  = start + k;
+                int b  = a + half;
+                f32 tr = re[b] * wr - im[b] * wi;
+                f32 ti = re[b] * wi + im[b] * wr;
+                re[b]  = re[a] - tr;
+                im[b]  = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+FILE_SCOPE void FingerprintBuilder_Frame(FingerprintBuilder *builder)
+{
+    int n   = builder->fft_size;
+    f32 *re = builder->re.data;
+    f32 *im = builder->im.data;
+    DQN_FOR_EACH(i, n)
+    {
+        re[i] = builder->history.data[(builder->history_pos + i) % n] * builder->window.data[i];
+        im[i] = 0;
+    }
+    Fingerprint_FFT(re, im, n, builder->twiddles.data);
+
+    f32 *chroma = builder->frames[builder->num_frames++];
+    DqnMem_Clear(chroma, 0, sizeof(builder->frames[0]));
+    DQN_FOR_EACH(k, n / 2)
+    {
+        int pitch_class = builder->pitch_classes.data[k];
+        if (pitch_class >= 0)
+            chroma[pitch_class] += re[k] * re[k] + im[k] * im[k];
+    }
+}
+
+FILE_SCOPE bool FingerprintBuilder_Done(FingerprintBuilder const *builder)
+{
+    return builder->num_frames == FINGERPRINT_MAX_FRAMES;
+}
+
+FILE_SCOPE void FingerprintBuilder_Process(FingerprintBuilder *builder, f32 const *samples, int num_frames)
+{
+    int n = builder->fft_size;
+    for (int frame_index = 0; frame_index < num_frames && !FingerprintBuilder_Done(builder); frame_index++)
+    {
+        f32 const *frame = samples + frame_index * builder->num_channels;
+        f32 mono         = (builder->num_channels == 1) ? frame[0] : (frame[0] + frame[1]) * 0.5f;
+        if (!builder->started)
+        {
+            if (mono > -FINGERPRINT_SILENCE && mono < FINGERPRINT_SILENCE)
+                continue;
+            builder->started = true;
+        }
+
+        builder->history.data[builder->history_pos] = mono;
+        builder->history_pos                         = (builder->history_pos + 1) % n;
+        builder->num_history                         = DQN_MIN(builder->num_history + 1, n);
+        if (++builder->since_frame >= builder->hop && builder->num_history == n)
+        {
+            FingerprintBuilder_Frame(builder);
+            builder->since_frame = 0;
+        }
+    }
+}
+
+FILE_SCOPE void FingerprintBuilder_End(FingerprintBuilder *builder, TrackFingerprint *fingerprint)
+{
+    *fingerprint            = {};
+    fingerprint->analysed   = 1;
+    fingerprint->num_frames = (u32)builder->num_frames;
+    if (builder->num_frames < FINGERPRINT_NUM_SEGMENTS)
+        return;
+
+    DQN_FOR_EACH(segment, FINGERPRINT_NUM_SEGMENTS)
+    {
+        f32 chroma[12] = {};
+        isize first    = (isize)segment * builder->num_frames / FINGERPRINT_NUM_SEGMENTS;
+        isize last     = ((isize)segment + 1) * builder->num_frames / FINGERPRINT_NUM_SEGMENTS;
+        for (isize frame = first; frame < last; frame++)
+        {
+            DQN_FOR_EACH(pitch_class, 12)
+                chroma[pitch_class] += builder->frames[frame][pitch_class];
+        }
+
+        DQN_FOR_EACH(pitch_class, 12)
+        {
+            if (chroma[pitch_class] > chroma[(pitch_class + 1) % 12])
+            {
+                isize bit                    = segment * 12 + pitch_class;
+                fingerprint->bits[bit / 64] |= (u64)1 << (bit % 64);
+            }
+        }
+    }
+}
+
+// Fingerprint Index
+// =================================================================================================
+// Near duplicate lookup over the fingerprints of the sounds synced this run, by locality sensitive
+// hashing on the bits. The 192 bits are split into FINGERPRINT_NUM_BANDS bands of 16, each band the
+// bits of one pitch class across every segment. A fingerprint is bucketed by each band's value in
+// that band's table, a lookup only compares against fingerprints sharing a bucket in some band. Any
+// two fingerprints at most 11 bits apart share at least one band exactly, and further ones usually
+// still do, whilst unrelated fingerprints rarely share any. A lookup touches a handful of entries
+// however many sounds are indexed.
+//
+// Buckets are chains through the entries, one link per band, so adding a sound is constant time and
+// never moves an entry.
+#define FINGERPRINT_NUM_BANDS          12
+#define FINGERPRINT_BAND_BITS          16
+#define FINGERPRINT_MAX_DISTANCE       24   // Bits of 192 that may differ for sounds to be duplicates
+#define FINGERPRINT_MAX_DURATION_DELTA 3000 // Milliseconds, when both durations are known
+#define FINGERPRINT_MAX_CHAIN          1024 // Entries checked per bucket, quiet passages fill a few buckets
+
+struct FingerprintEntry
+{
+    u64 bits[3];
+    u32 duration_ms;
+    u32 track;                        // In the index builder
+    u32 next[FINGERPRINT_NUM_BANDS];  // Entry index + 1 of the next entry in the band's bucket, 0 ends it
+};
+
+struct FingerprintIndex
+{
+    DqnArray<u32>              heads; // Entry index + 1 of each bucket's first entry, band major
+    DqnArray<FingerprintEntry> entries;
+    i64                        num_duplicates;
+
+    void  Init();
+    void  Free() { heads.Free(); entries.Free(); }
+    isize Find(TrackFingerprint const *fingerprint, u32 duration_ms, LibraryIndexBuilder const *builder); // return: Builder track of a near duplicate, -1 if none
+    void  Add (TrackFingerprint const *fingerprint, u32 duration_ms, isize track);
+};
+
+FILE_SCOPE int Fingerprint_PopCount(u64 value)
+{
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((value * 0x0101010101010101ULL) >> 56);
+}
+
+FILE_SCOPE int Fingerprint_Distance(u64 const *a, u64 const *b)
+{
+    return Fingerprint_PopCount(a[0] ^ b[0]) + Fingerprint_PopCount(a[1] ^ b[1]) + Fingerprint_PopCount(a[2] ^ b[2]);
+}
+
+FILE_SCOPE u32 Fingerprint_Band(u64 const *bits, int band)
+{
+    u32 result = 0;
+    DQN_FOR_EACH(segment, FINGERPRINT_BAND_BITS)
+    {
+        isize bit = segment * 12 + band;
+        result   |= (u32)((bits[bit / 64] >> (bit % 64)) & 1) << segment;
+    }
+    return result;
+}
+
+FILE_SCOPE bool Fingerprint_Usable(TrackFingerprint const *fingerprint)
+{
+    return fingerprint->analysed && fingerprint->num_frames >= FINGERPRINT_NUM_SEGMENTS;
+}
+
+void FingerprintIndex::Init()
+{
+    *this = {};
+    heads.Resize(FINGERPRINT_NUM_BANDS << FINGERPRINT_BAND_BITS);
+    DqnMem_Set(heads.data, 0, sizeof(*heads.data) * heads.len);
+}
+
+isize FingerprintIndex::Find(TrackFingerprint const *fingerprint, u32 duration_ms, LibraryIndexBuilder const *builder)
+{
+    DQN_FOR_EACH(band, FINGERPRINT_NUM_BANDS)
+    {
+        u32 entry_index = heads.data[(band << FINGERPRINT_BAND_BITS) + Fingerprint_Band(fingerprint->bits, (int)band)];
+        for (int chain = 0; entry_index && chain < FINGERPRINT_MAX_CHAIN; chain++)
+        {
+            FingerprintEntry const *entry = entries.data + (entry_index - 1);
+            entry_index                   = entry->next[band];
+            if (Fingerprint_Distance(entry->bits, fingerprint->bits) > FINGERPRINT_MAX_DISTANCE)
+                continue;
+
+            if (duration_ms && entry->duration_ms)
+            {
+                i64 delta = (i64)duration_ms - (i64)entry->duration_ms;
+                if (delta < -FINGERPRINT_MAX_DURATION_DELTA || delta > FINGERPRINT_MAX_DURATION_DELTA)
+                    continue;
+            }
+
+            // NOTE(doyle): The entry is stale if its sound changed and was fingerprinted again (watch mode)
+            if (DqnMem_Cmp(builder->fingerprint.data[entry->track].bits, entry->bits, sizeof(entry->bits)) != 0)
+                continue;
+
+            return entry->track;
+        }
+    }
+
+    return -1;
+}
+
+void FingerprintIndex::Add(TrackFingerprint const *fingerprint, u32 duration_ms, isize track)
+{
+    FingerprintEntry entry = {};
+    DqnMem_Copy(entry.bits, fingerprint->bits, sizeof(entry.bits));
+    entry.duration_ms = duration_ms;
+    entry.track       = (u32)track;
+
+    u32 entry_index = (u32)entries.len + 1;
+    DQN_FOR_EACH(band, FINGERPRINT_NUM_BANDS)
+    {
+        u32 *head        = heads.data + (band << FINGERPRINT_BAND_BITS) + Fingerprint_Band(fingerprint->bits, (int)band);
+        entry.next[band] = *head;
+        *head            = entry_index;
+    }
+    entries.Push(entry);
+}
+
+// Silence
+// =================================================================================================
+// Leading and trailing silence of a sound, for gapless playback and trimming. Samples are scanned in
+// SILENCE_BLOCK_MS blocks, a block is loud if its mean square over the channels reaches
+// SILENCE_THRESHOLD, 4 samples a step. Only the head and tail are decoded when the container can
+// seek: the head up to the first loud block, then the last SILENCE_TAIL_MS. Trailing silence is
+// counted back from the end of the sound, so an imprecise seek doesn't matter.
+#define SILENCE_BLOCK_MS  10
+#define SILENCE_THRESHOLD 1e-6f  // Mean square, -60dBFS
+#define SILENCE_TAIL_MS   30000  // Trailing silence longer than this is reported as this when seeking
+
+struct SilenceScanner
+{
+    int    sample_rate;
+    int    num_channels;
+    int    block_samples;    // Interleaved samples in a block
+    int    block_pos;
+    __m128 block_sum;
+    i64    num_frames;       // Frames scanned since the start, or since the seek to the tail
+    i64    first_loud_frame; // -1 until a loud block is found
+    i64    last_loud_end;    // The frame after the last loud block, counted like num_frames
+};
+
+FILE_SCOPE void SilenceScanner_Begin(SilenceScanner *scanner, int sample_rate, int num_channels)
+{
+    DqnMem_Clear(scanner, 0, sizeof(*scanner));
+    scanner->sample_rate      = sample_rate;
+    scanner->num_channels     = num_channels;
+    scanner->block_samples    = DQN_MAX(sample_rate * SILENCE_BLOCK_MS / 1000, 1) * num_channels;
+    scanner->block_sum        = _mm_setzero_ps();
+    scanner->first_loud_frame = -1;
+}
+
+// The next samples are the tail of the sound after a seek
+FILE_SCOPE void SilenceScanner_Restart(SilenceScanner *scanner)
+{
+    scanner->block_pos     = 0;
+    scanner->block_sum     = _mm_setzero_ps();
+    scanner->num_frames    = 0;
+    scanner->last_loud_end = 0;
+}
+
+FILE_SCOPE void SilenceScanner_EndBlock(SilenceScanner *scanner)
+{
+    __m128 sum = scanner->block_sum;
+    sum        = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum        = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    i64 block_frames = scanner->block_pos / scanner->num_channels;
+    if (_mm_cvtss_f32(sum) >= SILENCE_THRESHOLD * scanner->block_pos)
+    {
+        if (scanner->first_loud_frame == -1)
+            scanner->first_loud_frame = scanner->num_frames;
+        scanner->last_loud_end = scanner->num_frames + block_frames;
+    }
+
+    scanner->num_frames += block_frames;
+    scanner->block_pos   = 0;
+    scanner->block_sum   = _mm_setzero_ps();
+}
+
+FILE_SCOPE void SilenceScanner_Process(SilenceScanner *scanner, f32 const *samples, int num_frames)
+{
+    int num_samples = num_frames * scanner->num_channels;
+    for (int sample_index = 0; sample_index < num_samples;)
+    {
+        int len        = DQN_MIN(num_samples - sample_index, scanner->block_samples - scanner->block_pos);
+        f32 const *src = samples + sample_index;
+        __m128 sum     = scanner->block_sum;
+        int i          = 0;
+        for (; i + 4 <= len; i += 4)
+        {
+            __m128 values = _mm_loadu_ps(src + i);
+            sum           = _mm_add_ps(sum, _mm_mul_ps(values, values));
+        }
+
+        for (; i < len; i++)
+            sum = _mm_add_ss(sum, _mm_set_ss(src[i] * src[i]));
+
+        scanner->block_sum    = sum;
+        scanner->block_pos   += len;
+        sample_index         += len;
+        if (scanner->block_pos == scanner->block_samples)
+            SilenceScanner_EndBlock(scanner);
+    }
+}
+
+FILE_SCOPE void SilenceScanner_End(SilenceScanner *scanner, TrackSilence *silence)
+{
+    if (scanner->block_pos > 0)
+        SilenceScanner_EndBlock(scanner);
+
+    *silence          = {};
+    silence->analysed = 1;
+    if (scanner->first_loud_frame == -1)
+    {
+        // NOTE(doyle): All silence, it's all leading
+        silence->leading_ms = (u32)(scanner->num_frames * 1000 / scanner->sample_rate);
+        return;
+    }
+
+    silence->leading_ms  = (u32)(scanner->first_loud_frame * 1000 / scanner->sample_rate);
+    silence->trailing_ms = (u32)((scanner->num_frames - scanner->last_loud_end) * 1000 / scanner->sample_rate);
+}
+
+// Sound Analysis
+// =================================================================================================
+// Loudness, waveforms, fingerprints and silence all need the decoded samples, a sound is decoded once
+// for every analysis it needs and each chunk is fed to the thread's meter, builders and scanner in
+// turn. Sounds are analysed on lanes, results are left in the job for the main thread.
+struct SoundAnalysisJob
+{
+    enum Analysis
+    {
+        Loudness    = 1 << 0, // Into sound_file->loudness
+        Waveform    = 1 << 1, // Into waveform
+        Fingerprint = 1 << 2, // Into sound_file->fingerprint
+        Silence     = 1 << 3, // Into sound_file->silence
+    };
+
+    SoundFile     *sound_file;
+    char const    *path_utf8;
+    u64            path_hash;
+    u32            analyses;
+    WaveformPeaks *waveform;
+    int            av_error;
+    bool           success;
+};
+
+struct SoundAnalysisBatch
+{
+    LaneBatch         lanes;
+    SoundAnalysisJob *jobs;
+};
+
+FILE_SCOPE void SoundAnalysisBatch_Run(void *user_data, isize job_index)
+{
+    auto *batch           = static_cast<SoundAnalysisBatch *>(user_data);
+    SoundAnalysisJob *job = batch->jobs + job_index;
+
+    SoundDecoder decoder = {};
+    job->av_error        = decoder.Open(job->sound_file, job->path_utf8);
+    if (job->av_error < 0)
+        return;
+    DQN_DEFER { decoder.Close(); };
+
+    // NOTE(doyle): The analyses are set up on the first chunk, the rate and channels aren't known until then
+    LoudnessMeter *meter            = &global_loudness_meter_;
+    WaveformBuilder *builder        = &global_waveform_builder_;
+    FingerprintBuilder *fingerprint = &global_fingerprint_builder_;
+    SilenceScanner silence          = {};
+    bool began                      = false;
+    bool whole_sound                = (job->analyses & (SoundAnalysisJob::Loudness | SoundAnalysisJob::Waveform)) != 0;
+    bool seeked                     = false;
+    for (;;)
+    {
+        // NOTE(doyle): Fingerprints and leading silence only need the start of the sound. Once that's all
+        // that's left the sound is done, or skips to its tail for the trailing silence. A sound that can't
+        // seek, or whose tail is already close, is decoded through instead.
+        if (began && !whole_sound)
+        {
+            bool head_done = (!(job->analyses & SoundAnalysisJob::Fingerprint) || FingerprintBuilder_Done(fingerprint)) &&
+                             (!(job->analyses & SoundAnalysisJob::Silence)     || silence.first_loud_frame != -1);
+            if (head_done && !(job->analyses & SoundAnalysisJob::Silence))
+                break;
+
+            if (head_done && !seeked)
+            {
+                seeked          = true;
+                i64 duration_ms = job->sound_file->duration_ms;
+                i64 position_ms = silence.num_frames * 1000 / silence.sample_rate;
+                if (duration_ms > position_ms + 2 * SILENCE_TAIL_MS && decoder.Seek(duration_ms - SILENCE_TAIL_MS) == 0)
+                    SilenceScanner_Restart(&silence);
+            }
+        }
+
+        f32 const *samples = nullptr;
+        int num_frames     = 0;
+        int result         = decoder.Read(&samples, &num_frames);
+        if (result == AVERROR_EOF)
+            break;
+
+        if (result < 0)
+        {
+            job->av_error = result;
+            return;
+        }
+
+        if (!began)
+        {
+            if (job->analyses & SoundAnalysisJob::Loudness)    LoudnessMeter_Begin(meter, decoder.sample_rate, decoder.num_channels);
+            if (job->analyses & SoundAnalysisJob::Waveform)    WaveformBuilder_Begin(builder, decoder.num_channels);
+            if (job->analyses & SoundAnalysisJob::Fingerprint) FingerprintBuilder_Begin(fingerprint, decoder.sample_rate, decoder.num_channels);
+            if (job->analyses & SoundAnalysisJob::Silence)     SilenceScanner_Begin(&silence, decoder.sample_rate, decoder.num_channels);
+            began = true;
+        }
+
+        if (job->analyses & SoundAnalysisJob::Loudness)    LoudnessMeter_Process(meter, samples, num_frames);
+        if (job->analyses & SoundAnalysisJob::Waveform)    WaveformBuilder_Process(builder, samples, num_frames * decoder.num_channels);
+        if (job->analyses & SoundAnalysisJob::Fingerprint) FingerprintBuilder_Process(fingerprint, samples, num_frames);
+        if (job->analyses & SoundAnalysisJob::Silence)     SilenceScanner_Process(&silence, samples, num_frames);
+    }
+
+    if (!began)
+    {
+        job->av_error = AVERROR_INVALIDDATA;
+        return;
+    }
+
+    if (job->analyses & SoundAnalysisJob::Loudness)    LoudnessMeter_End(meter, &job->sound_file->loudness);
+    if (job->analyses & SoundAnalysisJob::Waveform)    WaveformBuilder_End(builder, job->waveform);
+    if (job->analyses & SoundAnalysisJob::Fingerprint) FingerprintBuilder_End(fingerprint, &job->sound_file->fingerprint);
+    if (job->analyses & SoundAnalysisJob::Silence)     SilenceScanner_End(&silence, &job->sound_file->silence);
+    job->success = true;
+}
+
+// Run every analysis that's enabled on the sounds that don't have its result yet. Sounds from the index
+// keep their loudness, fingerprint and silence, sounds in the waveform store keep their waveform.
+FILE_SCOPE void AnalyseSounds(Context *context, DqnArray<SoundFile> *sounds)
+{
+    if (!context->analyse_loudness && !context->waveforms && !context->fingerprints && !context->detect_silence)
+        return;
+
+    STAGE_SCOPE(&context->stats, Stage::Analyse);
+    StageStats *stage_stats = context->stats[Stage::Analyse];
+
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+    auto *jobs                 = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, SoundAnalysisJob, sounds->len);
+    SoundAnalysisBatch batch   = {};
+    batch.lanes.Run            = SoundAnalysisBatch_Run;
+    batch.lanes.user_data      = &batch;
+    batch.lanes.name           = "analyse_sound";
+    batch.jobs                 = jobs;
+    for (SoundFile &sound_file : *sounds)
+    {
+        auto mem_region = context->allocator.MemRegionScope();
+        int path_len    = 0;
+        char *path_utf8 = WCharToUTF8(&context->allocator, sound_file.path.str, &path_len);
+        u64 path_hash   = LibraryIndex_HashPath(path_utf8, path_len - 1);
+
+        u32 analyses = 0;
+        if (context->analyse_loudness && !sound_file.loudness.analysed)                  analyses |= SoundAnalysisJob::Loudness;
+        if (context->waveforms && !context->waveforms->Get(path_hash, &sound_file.info)) analyses |= SoundAnalysisJob::Waveform;
+        if (context->fingerprints && !sound_file.fingerprint.analysed)                   analyses |= SoundAnalysisJob::Fingerprint;
+        if (context->detect_silence && !sound_file.silence.analysed)                     analyses |= SoundAnalysisJob::Silence;
+        if (!analyses)
+            continue;
+
+        SoundAnalysisJob *job = jobs + batch.lanes.num_items++;
+        *job                  = {};
+        job->sound_file       = &sound_file;
+        job->path_utf8        = path_utf8;
+        job->path_hash        = path_hash;
+        job->analyses         = analyses;
+        if (analyses & SoundAnalysisJob::Waveform)
+        {
+            job->waveform = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, WaveformPeaks, 1);
+        }
+        context->allocator.MemRegionSave(&mem_region);
+    }
+
+    if (batch.lanes.num_items == 0)
+        return;
+
+    stage_stats->items += batch.lanes.num_items;
+    LaneBatch_Start(context, &batch.lanes);
+    LaneBatch_Finish(context, &batch.lanes);
+
+    DQN_FOR_EACH(job_index, batch.lanes.num_items)
+    {
+        SoundAnalysisJob const *job = jobs + job_index;
+        if (job->success)
+        {
+            stage_stats->bytes += job->sound_file->info.size;
+            if (job->analyses & SoundAnalysisJob::Waveform)
+                context->waveforms->Put(job->path_hash, &job->sound_file->info, job->waveform);
+            continue;
+        }
+
+        stage_stats->failures++;
+        char av_error[AV_ERROR_MAX_STRING_SIZE] = "no error code";
+        if (job->av_error < 0) av_strerror(job->av_error, av_error, sizeof(av_error));
+        char const *msg = DQN_LOGGER_E(&context->logger, "Analysing the sound failed (%s): %s", av_error, job->path_utf8);
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Hard link every op's src_path to its path, copying the ones that could not be linked.
+// link_ops: user_data is the DqnFileInfo of src_path. A link is the same file and a copy keeps its
+//           last write time, so the output is put in the stat cache with it.
+FILE_SCOPE void LinkIntoOutput(Context *context, DqnFileOp *link_ops, isize num_ops)
+{
+    if (num_ops == 0)
+        return;
+
+    {
+        STAGE_SCOPE(&context->stats, Stage::Link);
+        ExecuteFileOps(context, link_ops, num_ops);
+        context->stats[Stage::Link]->items += num_ops;
+    }
+
+    // NOTE(doyle): Files that could not be linked, usually as Output is on another volume, are copied
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+    auto *copy_jobs                  = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, CopyJob, num_ops);
+    isize num_copies                 = 0;
+    DQN_FOR_EACH(link_index, num_ops)
+    {
+        DqnFileOp *op = link_ops + link_index;
+        auto *info    = static_cast<DqnFileInfo const *>(op->user_data);
+        if (op->success)
+        {
+            context->stat_cache->Set(op->path, DqnStr_Len(op->path), true /*exists*/, info);
+            context->stats.output_tiers[(int)DqnFileCopyTier::HardLink]++;
+            continue;
+        }
+
+        context->stats[Stage::Link]->failures++;
+        CopyJob *job = copy_jobs + num_copies++;
+        *job         = {};
+        job->op      = op;
+        job->size    = info->size;
+    }
+
+    if (num_copies > 0)
+    {
+        STAGE_SCOPE(&context->stats, Stage::Copy);
+        context->stats[Stage::Copy]->items += num_copies;
+        RunCopyJobs(context, copy_jobs, num_copies);
+    }
+
+    DQN_FOR_EACH(copy_index, num_copies)
+    {
+        CopyJob const *job  = copy_jobs + copy_index;
+        DqnFileOp const *op = job->op;
+        if (job->tier != DqnFileCopyTier::None)
+        {
+            context->stat_cache->Set(op->path, DqnStr_Len(op->path), true /*exists*/, static_cast<DqnFileInfo const *>(op->user_data));
+            context->stats.output_tiers[(int)job->tier]++;
+            context->stats[Stage::Copy]->bytes += job->size;
+            continue;
+        }
+
+        context->stats[Stage::Copy]->failures++;
+        char const *msg = DQN_LOGGER_E(&context->logger, "Hard link failed (error %d) and so did copying (error %d). Could not output: %s -> %s", op->error, job->error, op->src_path, op->path);
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Look the sound's fingerprint up amongst the sounds synced so far this run
+// return: The builder track of a near duplicate of the sound, -1 if there's none and the sound was
+//         added to the fingerprints instead
+FILE_SCOPE isize FindDuplicateSound(Context *context, SoundFile const *sound_file, isize index_track)
+{
+    FingerprintIndex *fingerprints = context->fingerprints;
+    if (!fingerprints || !Fingerprint_Usable(&sound_file->fingerprint))
+        return -1;
+
+    isize result = fingerprints->Find(&sound_file->fingerprint, sound_file->duration_ms, context->index_builder);
+    if (result == index_track)
+        return -1;
+
+    if (result == -1)
+        fingerprints->Add(&sound_file->fingerprint, sound_file->duration_ms, index_track);
+    else
+        fingerprints->num_duplicates++;
+    return result;
+}
+
+// return: True if a track other than this one is output to the same file, i.e. a near duplicate
+FILE_SCOPE bool IsOutputShared(LibraryIndexBuilder const *builder, isize track, u32 output_path)
+{
+    u32 refs   = builder->OutputRefs(output_path);
+    bool owned = (track != -1 && builder->output_path.data[track] == output_path);
+    return refs > (owned ? 1u : 0u);
+}
+
+// The cover art of an album directory in Output, Files\<artist>\<album>\folder.jpg|.png
+struct FolderArt
+{
+    u64   path_hash;
+    char *path;
+    u64   art_hash;
+};
+
+FILE_SCOPE bool FolderArt_LessThan(FolderArt const &a, FolderArt const &b, void *)
+{
+    return a.path_hash < b.path_hash;
+}
+
+// Link every sound of the table into the output library and append the sounds' library relative
+// paths to the M3U buffer.
+FILE_SCOPE void SyncSoundsToLibrary(Context *context, DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> *sounds_table, DqnArray<char> *m3u_buf)
+{
+    DqnArray<SoundFile> sounds = MakeSoundFiles(context, sounds_table);
+    AnalyseSounds(context, &sounds);
+    MakeArtThumbnails(context);
+
+    isize sounds_to_rel_path_num = sounds.len;
+    auto *sounds_to_rel_path_mem = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnBuffer<wchar_t>, sounds_to_rel_path_num);
+    DqnArray<DqnBuffer<wchar_t>> sounds_to_rel_path(sounds_to_rel_path_mem, sounds_to_rel_path_num);
+
+    // NOTE(doyle): Linking is done in phases so each phase can be batched, stat every destination,
+    // make the missing parent directories (shallowest first) then link the missing files.
+    auto *dest_stat_ops   = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, sounds.len);
+    auto *link_ops        = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, sounds.len);
+    auto *folder_arts     = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, FolderArt, sounds.len);
+    isize num_folder_arts = 0;
+
+    isize estimated_buf_chars = sounds.len; // for each sound file path, we also need a new line \n
+    isize num_ops             = 0;
+    for (SoundFile &sound_file : sounds)
+    {
+        CheckAllocatorHasZeroAllocations(&global_func_local_allocator_);
+        STAGE_SCOPE(&context->stats, Stage::BuildPath);
+        context->stats[Stage::BuildPath]->items++;
+
+        // NOTE(doyle): Index the metadata before it's sanitised for use in the path
+        isize index_track = AddSoundToIndex(&context->allocator, context->index_builder, context->index, context->search_index, &sound_file, context->start_time_in_s);
+
+        // NOTE(doyle): Another rip or encoding of a sound already synced isn't linked, it's listed as that
+        // sound's output
+        isize duplicate_track = FindDuplicateSound(context, &sound_file, index_track);
+        if (duplicate_track != -1)
+        {
+            LibraryIndexBuilder *builder = context->index_builder;
+            u32 output_path              = builder->output_path.data[duplicate_track];
+            builder->SetOutput(index_track, output_path);
+
+            DqnBuffer<wchar_t> rel_path = {};
+            rel_path.str                = UTF8ToWChar(&context->allocator, builder->String(output_path), &rel_path.len);
+            sounds_to_rel_path.Push(rel_path);
+            estimated_buf_chars += rel_path.len;
+            continue;
+        }
+
+        wchar_t *artist = (sound_file.metadata.artist) ? sound_file.metadata.artist.str : L"_";
+        wchar_t *album  = (sound_file.metadata.album)  ? sound_file.metadata.album.str : L"_";
+        wchar_t *title  = (sound_file.metadata.title)  ? sound_file.metadata.title.str : sound_file.name.str;
+
+        // NOTE(doyle): Destructive
+        SanitiseStringForDiskFile(artist);
+        SanitiseStringForDiskFile(album);
+        SanitiseStringForDiskFile(title);
+
+        if (context->art && sound_file.art.hash)
+        {
+            if (ArtEntry const *art = context->art->entries.Get(sound_file.art.hash))
+            {
+                DqnBuffer<wchar_t> folder_art_path = AllocateSwprintf(&context->allocator, L"%s\\Output\\Files\\%s\\%s\\folder%s", context->exe_directory.str, artist, album, UTF8ToWChar(&context->allocator, art->extension));
+                int folder_art_path_len = 0;
+                FolderArt *folder_art   = folder_arts + num_folder_arts++;
+                folder_art->path        = WCharToUTF8(&context->allocator, folder_art_path.str, &folder_art_path_len);
+                folder_art->path_hash   = DqnHash_Murmur64(folder_art->path, folder_art_path_len - 1);
+                folder_art->art_hash    = sound_file.art.hash;
+            }
+        }
+
+        wchar_t const *extension    = (TranscodeTarget_Wants(context->transcode, &sound_file)) ? context->transcode->extension : sound_file.extension.str;
+        DqnBuffer<wchar_t> rel_path = AllocateSwprintf(&context->allocator, L"Files\\%s\\%s\\%s.%s", artist, album, title, extension);
+        sounds_to_rel_path.Push(rel_path);
+        estimated_buf_chars += rel_path.len;
+
+        {
+            auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+            int rel_path_utf8_len            = 0;
+            char *rel_path_utf8              = WCharToUTF8(&context->allocator, rel_path.str, &rel_path_utf8_len);
+            context->index_builder->SetOutput(index_track, context->index_builder->Intern(rel_path_utf8, rel_path_utf8_len - 1));
+        }
+
+        context->allocator.SetAllocMode(DqnMemStack::AllocMode::Tail);
+        DqnBuffer<wchar_t> dest_path = AllocateSwprintf(&context->allocator, L"%s\\Output\\%s", context->exe_directory.str, rel_path.str);
+        context->allocator.SetAllocMode(DqnMemStack::AllocMode::Head);
+        DQN_DEFER { context->allocator.Pop(dest_path.str); };
+
+        isize op_index                  = num_ops++;
+        DqnFileOp *dest_stat_op         = dest_stat_ops + op_index;
+        *dest_stat_op                   = {};
+        dest_stat_op->type              = DqnFileOp::Type::Stat;
+        dest_stat_op->path              = WCharToUTF8(&context->allocator, dest_path.str);
+
+        DqnFileOp *link_op              = link_ops + op_index;
+        *link_op                        = {};
+        link_op->type                   = DqnFileOp::Type::Link;
+        link_op->path                   = dest_stat_op->path;
+        link_op->src_path               = WCharToUTF8(&context->allocator, sound_file.path.str);
+        link_op->user_data              = &sound_file;
+    }
+
+    // NOTE(doyle): The destination check is charged to the link stage, it's the link's precondition
+    {
+        STAGE_SCOPE(&context->stats, Stage::Link);
+        StatCache_Stat(context, dest_stat_ops, num_ops);
+    }
+
+    isize num_missing = 0;
+    DQN_FOR_EACH(op_index, num_ops)
+    {
+        if (!dest_stat_ops[op_index].success)
+            link_ops[num_missing++] = link_ops[op_index];
+    }
+
+    {
+        STAGE_SCOPE(&context->stats, Stage::MakeDir);
+        MakeParentDirectories(context, link_ops, num_missing);
+    }
+
+    // NOTE(doyle): Sounds in another format than the transcode target are taken out of the link ops and
+    // output from the transcode cache instead, the ones not in it are transcoded into it first.
+    TranscodeCache *cache           = context->transcode_cache;
+    auto *transcode_jobs            = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, TranscodeJob, num_missing);
+    auto *cache_stat_ops            = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, num_missing);
+    auto *cache_link_ops            = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, num_missing);
+    isize num_cache_links           = 0;
+    TranscodeBatch transcode_batch  = {};
+    transcode_batch.lanes.Run       = TranscodeBatch_Run;
+    transcode_batch.lanes.user_data = &transcode_batch;
+    transcode_batch.lanes.name      = "transcode_sound";
+    transcode_batch.target          = context->transcode;
+    transcode_batch.jobs            = transcode_jobs;
+    {
+        isize num_links = 0;
+        DQN_FOR_EACH(link_index, num_missing)
+        {
+            DqnFileOp *op          = link_ops + link_index;
+            auto const *sound_file = static_cast<SoundFile const *>(op->user_data);
+            if (!TranscodeTarget_Wants(context->transcode, sound_file))
+            {
+                link_ops[num_links]           = *op;
+                link_ops[num_links].user_data = const_cast<DqnFileInfo *>(&sound_file->info);
+                num_links++;
+                continue;
+            }
+
+            isize cache_index       = num_cache_links++;
+            TranscodeJob *job       = transcode_jobs + cache_index;
+            *job                    = {};
+            job->cache_key          = TranscodeCache_Key(context->transcode, op->src_path, &sound_file->info);
+            job->op                 = *op;
+            job->op.path            = TranscodeCache_Path(&context->allocator, cache, job->cache_key, context->transcode->extension_utf8);
+            job->output_op          = cache_link_ops + cache_index;
+
+            DqnFileOp *cache_stat_op = cache_stat_ops + cache_index;
+            *cache_stat_op           = {};
+            cache_stat_op->type      = DqnFileOp::Type::Stat;
+            cache_stat_op->path      = job->op.path;
+
+            DqnFileOp *cache_link_op = job->output_op;
+            *cache_link_op           = {};
+            cache_link_op->type      = DqnFileOp::Type::Link;
+            cache_link_op->path      = op->path;
+            cache_link_op->src_path  = job->op.path;
+        }
+
+        num_missing = num_links;
+    }
+
+    if (num_cache_links > 0)
+    {
+        STAGE_SCOPE(&context->stats, Stage::Transcode);
+        StatCache_Stat(context, cache_stat_ops, num_cache_links);
+
+        // NOTE(doyle): Misses are moved to the front of the jobs, they're the ones the lanes transcode
+        u64 now_in_s = static_cast<u64>(time(nullptr));
+        DQN_FOR_EACH(cache_index, num_cache_links)
+        {
+            TranscodeJob *job          = transcode_jobs + cache_index;
+            TranscodeCacheEntry *entry = cache->Get(job->cache_key);
+            if (entry && cache_stat_ops[cache_index].success)
+            {
+                entry->last_used_in_s      = now_in_s;
+                job->output_op->user_data  = &entry->info;
+                cache->num_hits++;
+                continue;
+            }
+
+            cache->num_misses++;
+            DQN_SWAP(TranscodeJob, transcode_jobs[transcode_batch.lanes.num_items], *job);
+            job = transcode_jobs + transcode_batch.lanes.num_items++;
+
+            int path_len        = DqnStr_Len(job->op.path);
+            job->partial_path   = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, char, path_len + 6);
+            Dqn_sprintf(job->partial_path, "%s.part", job->op.path);
+            job->partial_path_w = UTF8ToWChar(&context->allocator, job->partial_path);
+            job->path_w         = UTF8ToWChar(&context->allocator, job->op.path);
+        }
+    }
+
+    // NOTE(doyle): The lanes are started first so they run whilst the links and copies are done
+    if (transcode_batch.lanes.num_items > 0)
+    {
+        context->stats[Stage::Transcode]->items += transcode_batch.lanes.num_items;
+        LaneBatch_Start(context, &transcode_batch.lanes);
+    }
+
+    LinkIntoOutput(context, link_ops, num_missing);
+
+    if (transcode_batch.lanes.num_items > 0)
+    {
+        STAGE_SCOPE(&context->stats, Stage::Transcode);
+        LaneBatch_Finish(context, &transcode_batch.lanes);
+    }
+
+    u64 now_in_s = static_cast<u64>(time(nullptr));
+    DQN_FOR_EACH(job_index, transcode_batch.lanes.num_items)
+    {
+        TranscodeJob *job = transcode_jobs + job_index;
+        if (job->success)
+        {
+            cache->Put(job->cache_key, context->transcode, &job->info, now_in_s);
+            context->stat_cache->Set(job->op.path, DqnStr_Len(job->op.path), true /*exists*/, &job->info);
+            context->stats[Stage::Transcode]->bytes += job->bytes_written;
+            job->output_op->user_data                = &job->info;
+            continue;
+        }
+
+        context->stats[Stage::Transcode]->failures++;
+        char av_error[AV_ERROR_MAX_STRING_SIZE] = "no error code";
+        if (job->av_error < 0) av_strerror(job->av_error, av_error, sizeof(av_error));
+        char const *msg = DQN_LOGGER_E(&context->logger, "Transcoding failed at %s (%s). Could not output: %s -> %s", job->failed_step, av_error, job->op.src_path, job->output_op->path);
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+
+    // NOTE(doyle): Failed transcodes have nothing to link
+    {
+        isize num_outputs = 0;
+        DQN_FOR_EACH(cache_index, num_cache_links)
+        {
+            if (cache_link_ops[cache_index].user_data)
+                cache_link_ops[num_outputs++] = cache_link_ops[cache_index];
+        }
+        LinkIntoOutput(context, cache_link_ops, num_outputs);
+    }
+
+    // NOTE(doyle): An album directory gets the cover of one of its sounds as its folder art, linked from
+    // the art store once the sounds have made the directory
+    if (num_folder_arts > 0)
+    {
+        DqnQuickSort<FolderArt, FolderArt_LessThan>(folder_arts, num_folder_arts, nullptr);
+        auto *folder_stat_ops = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, num_folder_arts);
+        auto *folder_link_ops = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, DqnFileOp, num_folder_arts);
+        isize num_folders     = 0;
+        DQN_FOR_EACH(folder_index, num_folder_arts)
+        {
+            FolderArt const *folder_art = folder_arts + folder_index;
+            if (folder_index > 0 && folder_art->path_hash == folder_arts[folder_index - 1].path_hash)
+                continue;
+
+            ArtEntry *art            = context->art->entries.Get(folder_art->art_hash);
+            DqnFileOp *stat_op       = folder_stat_ops + num_folders;
+            *stat_op                 = {};
+            stat_op->type            = DqnFileOp::Type::Stat;
+            stat_op->path            = folder_art->path;
+
+            DqnFileOp *link_op       = folder_link_ops + num_folders;
+            *link_op                 = {};
+            link_op->type            = DqnFileOp::Type::Link;
+            link_op->path            = folder_art->path;
+            link_op->src_path        = ArtStore_Path(&context->allocator, context->art, folder_art->art_hash, art->extension);
+            link_op->user_data       = &art->info;
+            num_folders++;
+        }
+
+        {
+            STAGE_SCOPE(&context->stats, Stage::Link);
+            StatCache_Stat(context, folder_stat_ops, num_folders);
+        }
+
+        isize num_missing_folders = 0;
+        DQN_FOR_EACH(folder_index, num_folders)
+        {
+            if (!folder_stat_ops[folder_index].success)
+                folder_link_ops[num_missing_folders++] = folder_link_ops[folder_index];
+        }
+        LinkIntoOutput(context, folder_link_ops, num_missing_folders);
+    }
+
+    DQN_ASSERT(sounds.len == sounds_to_rel_path.len);
+    {
+        STAGE_SCOPE(&context->stats, Stage::WriteM3U);
+        m3u_buf->Reserve(m3u_buf->len + estimated_buf_chars + /*safety_margin*/ 1024);
+        for (DqnBuffer<wchar_t> const &output_path : sounds_to_rel_path)
+        {
+            auto DQN_UNIQUE_NAME(mem_scope) = context->allocator.MemRegionScope();
+            DqnBuffer<char> utf8 = {};
+            utf8.str = WCharToUTF8(&context->allocator, output_path.str, &utf8.len);
+
+            m3u_buf->Push(utf8.str, utf8.len - 1);
+            m3u_buf->Push('\n');
+        }
+    }
+}
+
+// Write the M3U buffer to Output\<file_name>
+FILE_SCOPE void WriteM3UFile(Context *context, wchar_t const *file_name, DqnArray<char> *m3u_buf)
+{
+    STAGE_SCOPE(&context->stats, Stage::WriteM3U);
+    context->stats[Stage::WriteM3U]->items++;
+
+    auto DQN_UNIQUE_NAME(mem_scope) = context->allocator.MemRegionScope();
+    DqnBuffer<wchar_t> dest_file    = AllocateSwprintf(&context->allocator, L"%s\\Output\\%s", context->exe_directory.str, file_name);
+    usize m3u_bytes                 = m3u_buf->len * sizeof(m3u_buf->data[0]);
+    if (DqnFile_WriteAll(dest_file.str, reinterpret_cast<u8 *>(m3u_buf->data), m3u_bytes))
+    {
+        context->stats[Stage::WriteM3U]->bytes += m3u_bytes;
+    }
+    else
+    {
+        context->stats[Stage::WriteM3U]->failures++;
+        char const *msg = DQN_LOGGER_E(&context->logger, "DqnFile_WriteAll failed: Could not write m3u file to destination: %s", WCharToUTF8(&context->allocator, dest_file.str));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+struct PlaylistSync
+{
+    DqnArray<char>     m3u_buf;
+    wchar_t const     *m3u_file;  // Name of the M3U in Output
+    DqnBuffer<wchar_t> m3u_path;         // Set when streaming, replaced by the partial M3U once all chunks are in. Cleared if writing fails
+    DqnBuffer<wchar_t> m3u_partial_path; // <m3u_path>.part, each chunk's lines are appended to it
+    DqnFile            m3u;
+    isize              num_sounds;
+};
+
+FILE_SCOPE void PlaylistSync_Chunk(Context *context, DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> *sounds, void *user_data)
+{
+    auto *sync = static_cast<PlaylistSync *>(user_data);
+    sync->num_sounds += sounds->num_used_entries;
+    SyncSoundsToLibrary(context, sounds, &sync->m3u_buf);
+    if (context->stream_chunk_size <= 0)
+        return; // NOTE(doyle): Not streaming, the lines are kept for the whole M3U to be written at the end
+
+    // NOTE(doyle): m3u_path is cleared once writing fails, the rest of the playlist's lines are dropped
+    DQN_DEFER { sync->m3u_buf.Clear(); };
+    if (!sync->m3u_path)
+        return;
+
+    STAGE_SCOPE(&context->stats, Stage::WriteM3U);
+    if (!sync->m3u.handle)
+    {
+        context->stats[Stage::WriteM3U]->items++;
+        if (!sync->m3u.Open(sync->m3u_partial_path.str, DqnFile::Flag::FileWrite, DqnFile::Action::ForceCreate))
+        {
+            context->stats[Stage::WriteM3U]->failures++;
+            char const *msg = DQN_LOGGER_E(&context->logger, "DqnFile: Failed, could not open m3u file for streaming to destination: %s", WCharToUTF8(&context->allocator, sync->m3u_partial_path.str));
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            sync->m3u_path = {};
+            return;
+        }
+    }
+
+    usize m3u_bytes = sync->m3u_buf.len * sizeof(sync->m3u_buf.data[0]);
+    if (sync->m3u.Write(reinterpret_cast<u8 *>(sync->m3u_buf.data), m3u_bytes) == m3u_bytes)
+    {
+        context->stats[Stage::WriteM3U]->bytes += m3u_bytes;
+    }
+    else
+    {
+        // NOTE(doyle): The previous M3U is left as it was rather than replaced by one missing entries
+        context->stats[Stage::WriteM3U]->failures++;
+        char const *msg = DQN_LOGGER_E(&context->logger, "DqnFile: Failed, could not append to streamed m3u file: %s", WCharToUTF8(&context->allocator, sync->m3u_partial_path.str));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+        sync->m3u.Close();
+        DqnFile_Delete(sync->m3u_partial_path.str);
+        sync->m3u_path = {};
+    }
+}
+
+// Sync the playlist Input\<file_name> to the library and write it to Output as M3U. With
+// context->stream_chunk_size the playlist is synced a chunk at a time and the M3U written as it goes.
+FILE_SCOPE void SyncPlaylistFile(Context *context, char const *file_name, PlaylistSources *sources)
+{
+    auto DQN_UNIQUE_NAME(mem_scope) = context->allocator.MemRegionScope();
+    auto DQN_UNIQUE_NAME(mem_scope) = global_func_local_allocator_.MemRegionScope();
+
+    if (sources)
+    {
+        sources->path_hashes.Clear();
+        sources->has_search = false;
+    }
+
+    DqnBuffer<wchar_t> playlist_file_path = AllocateSwprintf(&context->allocator, L".\\Input\\%s", UTF8ToWChar(&context->allocator, file_name));
+
+    // NOTE(doyle): Other formats are written out as M3U, <name>.pls becomes <name>.m3u
+    PlaylistSync sync = {};
+    sync.m3u_file     = UTF8ToWChar(&context->allocator, file_name);
+    DQN_DEFER
+    {
+        sync.m3u_buf.Free();
+        if (sync.m3u.handle)
+        {
+            sync.m3u.Close();
+            DqnFile_Delete(sync.m3u_partial_path.str);
+        }
+    };
+
+    if (DetectPlaylistFormat(file_name, nullptr, 0) != PlaylistFormat::M3U)
+    {
+        i32 stem_len = 0;
+        for (i32 index = 0; sync.m3u_file[index]; index++)
+        {
+            if (sync.m3u_file[index] == L'.') stem_len = index;
+        }
+        sync.m3u_file = AllocateSwprintf(&context->allocator, L"%.*s.m3u", stem_len, sync.m3u_file).str;
+    }
+
+    if (context->stream_chunk_size > 0)
+    {
+        sync.m3u_path         = AllocateSwprintf(&context->allocator, L"%s\\Output\\%s", context->exe_directory.str, sync.m3u_file);
+        sync.m3u_partial_path = AllocateSwprintf(&context->allocator, L"%s.part", sync.m3u_path.str);
+    }
+
+    ReadPlaylistFile(context, playlist_file_path.str, sources, PlaylistSync_Chunk, &sync);
+    if (context->stream_chunk_size > 0)
+    {
+        // NOTE(doyle): Streamed under a temporary name, an interrupted run never leaves a truncated M3U
+        if (sync.m3u.handle)
+        {
+            sync.m3u.Close();
+            if (!MoveFileExW(sync.m3u_partial_path.str, sync.m3u_path.str, MOVEFILE_REPLACE_EXISTING))
+            {
+                context->stats[Stage::WriteM3U]->failures++;
+                char const *msg = DQN_LOGGER_E(&context->logger, "MoveFileExW: Failed, could not replace m3u file: %s", WCharToUTF8(&context->allocator, sync.m3u_path.str));
+                global_logger_buf.Push(msg, DqnStr_Len(msg));
+                DqnFile_Delete(sync.m3u_partial_path.str);
+            }
+        }
+        return;
+    }
+
+    if (sync.num_sounds == 0)
+        return;
+
+    WriteM3UFile(context, sync.m3u_file, &sync.m3u_buf);
+}
+
+// Library Scan
+// =================================================================================================
+// Recursively enumerate library roots for audio files. Listing a directory on a network share is a
+// round trip, so the tree is walked by every worker at once. Workers share one stack of pending
+// directories, listing a directory pushes its sub-directories back onto the stack and the scan ends
+// once the stack is empty and no worker is mid-listing (which could still push more work).
+#define LIBRARY_SCAN_CHUNK_SIZE 4096 // Sounds extracted and linked per batch after the scan
+
+FILE_SCOPE char const *const AUDIO_FILE_EXTENSIONS[] =
+{
+    "aac", "aif", "aiff", "ape", "flac", "m4a", "mp3", "mpc", "ogg", "opus", "wav", "wma", "wv",
+};
+
+FILE_SCOPE bool IsAudioFileName(char const *name, i32 name_len)
+{
+    i32 dot_index = name_len - 1;
+    while (dot_index >= 0 && name[dot_index] != '.')
+        dot_index--;
+
+    if (dot_index < 0)
+        return false;
+
+    auto extension = DqnSlice<char const>(name + dot_index + 1, name_len - dot_index - 1);
+    for (char const *audio_extension : AUDIO_FILE_EXTENSIONS)
+    {
+        auto audio_slice = DqnSlice<char const>(audio_extension, DqnStr_Len(audio_extension));
+        if (DQN_SLICE_STRCMP(extension, audio_slice, Dqn::IgnoreCase::Yes))
+            return true;
+    }
+    return false;
+}
+
+struct LibraryScanFile
+{
+    isize       path_offset; // Into LibraryScan::paths
+    DqnFileInfo info;        // Size and last write time from the listing
+};
+
+struct LibraryScan
+{
+    DqnLock                   lock;
+    DqnArray<char *>          pending_dirs; // Heap allocated UTF-8 paths waiting to be listed
+    i32                       num_active;   // Directories popped off pending_dirs but not yet finished
+    DqnArray<char>            paths;        // Packed, null-terminated UTF-8 paths of every audio file found
+    DqnArray<LibraryScanFile> files;
+    i64                       num_dirs;
+    i64                       num_failed_dirs;
+};
+
+FILE_SCOPE char *LibraryScan_JoinPath(char const *dir, i32 dir_len, char const *name, i32 name_len)
+{
+    bool has_separator = (dir_len > 0 && (dir[dir_len - 1] == '\\' || dir[dir_len - 1] == '/'));
+    i32 result_len     = dir_len + (has_separator ? 0 : 1) + name_len;
+    auto *result       = static_cast<char *>(DqnMem_Alloc(result_len + 1));
+    char *ptr          = result;
+
+    DqnMem_Copy(ptr, dir, dir_len);
+    ptr += dir_len;
+    if (!has_separator) *ptr++ = '\\';
+    DqnMem_Copy(ptr, name, name_len);
+    result[result_len] = 0;
+    return result;
+}
+
+FILE_SCOPE void LibraryScan_WorkerJob(DqnJobQueue *, void *user_data)
+{
+    TRACE_SCOPE("library_scan_worker");
+    auto *scan = static_cast<LibraryScan *>(user_data);
+
+    // NOTE(doyle): A worker's results for the directory it's listing are gathered locally and merged
+    // into the scan in one locked section per directory.
+    DqnMemStack list_stack              = DqnMemStack(DQN_KILOBYTE(256), Dqn::ZeroMem::No, 0, DqnMemTracker::Simple);
+    DqnArray<char>            paths     = {}; // Packed, null-terminated "<dir>\<name>"
+    DqnArray<LibraryScanFile> dir_files = {};
+    DqnArray<char *>          subdirs   = {};
+    DQN_DEFER
+    {
+        list_stack.Free();
+        paths.Free();
+        dir_files.Free();
+        subdirs.Free();
+    };
+
+    for (;;)
+    {
+        char *path    = nullptr;
+        bool finished = false;
+        {
+            auto guard = scan->lock.Guard();
+            if (scan->pending_dirs.len > 0)
+            {
+                path = scan->pending_dirs.data[--scan->pending_dirs.len];
+                scan->num_active++;
+            }
+            else
+            {
+                finished = (scan->num_active == 0);
+            }
+        }
+
+        if (finished)
+            break;
+
+        if (!path)
+        {
+            // NOTE(doyle): Another worker is mid-listing and may yet push sub-directories
+            Sleep(1);
+            continue;
+        }
+
+        auto mem_region = list_stack.MemRegionScope();
+        paths.Clear();
+        dir_files.Clear();
+        subdirs.Clear();
+
+        // NOTE(doyle): Sizes and write times validate the library index, Win32 lists them for free
+        i32 path_len        = DqnStr_Len(path);
+        DqnFileDirList list = {};
+        bool listed         = DqnFile_ListDir(path, &list_stack, &list, DqnFileDirList::Info);
+        for (DqnFileDirList::Entry const &entry : list)
+        {
+            // NOTE(doyle): Symlinks and junctions are not followed, they can form cycles and a
+            // library reachable through two paths would be linked twice.
+            if (entry.type == DqnFileDirEntry::Type::Directory)
+            {
+                subdirs.Push(LibraryScan_JoinPath(path, path_len, entry.name.data, entry.name.len));
+            }
+            else if (entry.type == DqnFileDirEntry::Type::File && IsAudioFileName(entry.name.data, entry.name.len))
+            {
+                char *file_path = LibraryScan_JoinPath(path, path_len, entry.name.data, entry.name.len);
+                DQN_DEFER { DqnMem_Free(file_path); };
+
+                LibraryScanFile file           = {};
+                file.path_offset               = paths.len;
+                file.info.size                 = entry.size;
+                file.info.last_write_time_in_s = entry.last_write_time_in_s;
+                dir_files.Push(file);
+                paths.Push(file_path, DqnStr_Len(file_path) + 1);
+            }
+        }
+
+        {
+            auto guard = scan->lock.Guard();
+            scan->num_dirs++;
+            if (!listed) scan->num_failed_dirs++;
+
+            isize base_offset = scan->paths.len;
+            scan->paths.Push(paths.data, paths.len);
+            for (LibraryScanFile file : dir_files)
+            {
+                file.path_offset += base_offset;
+                scan->files.Push(file);
+            }
+
+            scan->pending_dirs.Push(subdirs.data, subdirs.len);
+            scan->num_active--;
+        }
+        LiveMetrics_Add(LiveCounter::EntriesParsed, dir_files.len);
+
+        DqnMem_Free(path);
+    }
+}
+
+FILE_SCOPE bool LibraryScan_FileLessThan(LibraryScanFile const &a, LibraryScanFile const &b, void *user_context)
+{
+    auto const *paths = static_cast<char const *>(user_context);
+    bool result       = DqnStr_Cmp(paths + a.path_offset, paths + b.path_offset) < 0;
+    return result;
+}
+
+// Scan the library roots and sync every audio file found into the output library, appending the
+// files' library relative paths to the M3U buffer
+FILE_SCOPE void ScanLibraries(Context *context, char const *const *roots, isize num_roots, DqnArray<char> *m3u_buf)
+{
+    LibraryScan scan = {};
+    scan.lock.Init();
+    DQN_DEFER
+    {
+        scan.lock.Delete();
+        scan.pending_dirs.Free();
+        scan.paths.Free();
+        scan.files.Free();
+    };
+
+    {
+        STAGE_SCOPE(&context->stats, Stage::LibraryScan);
+        DQN_FOR_EACH(root_index, num_roots)
+            scan.pending_dirs.Push(LibraryScan_JoinPath(roots[root_index], DqnStr_Len(roots[root_index]), "", 0));
+
+        // NOTE(doyle): Each job is a worker that runs until the whole scan is done, the main thread
+        // picks up a job as well while blocking.
+        DQN_FOR_EACH(worker_index, context->num_workers + 1)
+            context->job_queue->AddJob({LibraryScan_WorkerJob, &scan});
+        context->job_queue->BlockAndCompleteAllJobs();
+
+        // NOTE(doyle): Workers finish directories in any order, sort so the output is reproducible
+        DqnQuickSort<LibraryScanFile, LibraryScan_FileLessThan>(scan.files.data, scan.files.len, scan.paths.data);
+
+        context->stats[Stage::LibraryScan]->items    += scan.num_dirs;
+        context->stats[Stage::LibraryScan]->failures += scan.num_failed_dirs;
+    }
+
+    fprintf(stdout, "Scanned %lld directories, found %lld audio files\n", (long long)scan.num_dirs, (long long)scan.files.len);
+
+    for (isize chunk_start = 0; chunk_start < scan.files.len; chunk_start += LIBRARY_SCAN_CHUNK_SIZE)
+    {
+        auto DQN_UNIQUE_NAME(mem_scope) = context->allocator.MemRegionScope();
+        auto DQN_UNIQUE_NAME(mem_scope) = global_func_local_allocator_.MemRegionScope();
+
+        DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> sounds_table(DQN_MEGABYTE(8));
+        DQN_DEFER { sounds_table.Free(); };
+
+        isize chunk_end = DQN_MIN(chunk_start + LIBRARY_SCAN_CHUNK_SIZE, scan.files.len);
+        for (isize file_index = chunk_start; file_index < chunk_end; file_index++)
+        {
+            LibraryScanFile const *file  = scan.files.data + file_index;
+            DqnBuffer<wchar_t> file_path = {};
+            file_path.str                = UTF8ToWChar(&context->allocator, scan.paths.data + file->path_offset, &file_path.len);
+            SoundFile *sound_file        = sounds_table.GetOrMake(file_path);
+            *sound_file                  = {};
+            sound_file->info             = file->info;
+        }
+
+        SyncSoundsToLibrary(context, &sounds_table, m3u_buf);
+    }
+}
+
+// Write the index and map it back in as the previous run's, so syncs after it (smart playlists, watch
+// mode) reuse the metadata just extracted.
+// NOTE(doyle): Tracks not seen this run are carried over so the cache survives partial runs. The
+// old index must be unmapped before it can be overwritten on Win32.
+FILE_SCOPE void WriteLibraryIndex(Context *context, LibraryIndex *index, LibraryIndexBuilder *builder, wchar_t const *file_path)
+{
+    STAGE_SCOPE(&context->stats, Stage::IndexWrite);
+    builder->MergeUnseen(index);
+    SetAlbumLoudness(builder);
+    index->Free();
+    context->index = nullptr;
+
+    context->stats[Stage::IndexWrite]->items += builder->num_tracks;
+    if (!builder->Write(file_path))
+    {
+        context->stats[Stage::IndexWrite]->failures++;
+        char const *msg = DQN_LOGGER_E(&context->logger, "Could not write the library index to: %s", WCharToUTF8(&context->allocator, file_path));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+
+    if (index->Load(file_path))
+    {
+        context->index = index;
+    }
+    else
+    {
+        char const *msg = DQN_LOGGER_E(&context->logger, "Could not load the library index just written: %s", WCharToUTF8(&context->allocator, file_path));
+        global_logger_buf.Push(msg, DqnStr_Len(msg));
+    }
+}
+
+// Smart Playlists
+// =================================================================================================
+// Input\<name>.query files are playlists defined by predicates on the library index, one per line and
+// all of which must hold, the matches are synced to Output\<name>.m3u like any other playlist.
+//
+//   # Comments start with a hash
+//   genre = Rock                         Tag equals value, case-insensitive. != for not equals
+//   artist in Portishead | Massive Attack
+//   date between 1990 1999               On the leading integer of the tag, i.e. the year of a date
+//   added since 2024-01-31               The track entered the index on or after the date
+//
+// Tags are dictionary encoded in the index, so a tag predicate is resolved to the set of matching
+// string ids by checking the column's distinct values once, then the column is scanned for those ids
+// into a bitmap of tracks, 4 tracks per SSE2 compare. Predicates are ANDed together 64 tracks at a
+// time.
+#define QUERY_FILE_EXTENSION ".query"
+
+#define X(Enum, member) #member,
+FILE_SCOPE char const *const LIBRARY_TAG_NAMES[] = {LIBRARY_INDEX_TAGS};
+#undef X
+
+FILE_SCOPE bool IsQueryFileName(char const *name, i32 name_len)
+{
+    i32 ext_len = DQN_CHAR_COUNT(QUERY_FILE_EXTENSION);
+    bool result = (name_len > ext_len && DqnStr_Cmp(name + name_len - ext_len, QUERY_FILE_EXTENSION, ext_len, Dqn::IgnoreCase::Yes) == 0);
+    return result;
+}
+
+struct QueryPredicate
+{
+    enum struct Type
+    {
+        Equals,
+        NotEquals,
+        In,
+        Between,
+        AddedSince,
+    };
+
+    Type                  type;
+    LibraryTag            tag;
+    DqnSlice<char const> *values;     // Equals, NotEquals, In
+    isize                 num_values;
+    i64                   min, max;   // Between, inclusive
+    u64                   since_in_s; // AddedSince
+};
+
+// The distinct string ids of each tag column, a predicate only has to test these instead of every track
+struct QueryTagDictionary
+{
+    DqnArray<u32> ids[(int)LibraryTag::Count];
+
+    void Init(LibraryIndex const *index);
+    void Free() { for (DqnArray<u32> &tag_ids : ids) tag_ids.Free(); }
+};
+
+void QueryTagDictionary::Init(LibraryIndex const *index)
+{
+    *this = {};
+    DqnArray<u8> seen = {};
+    DQN_DEFER { seen.Free(); };
+    u8 const not_seen = 0;
+    seen.Resize(index->header ? index->header->num_strings : 0, &not_seen);
+
+    DQN_FOR_EACH(tag, LibraryTag::Count)
+    {
+        u32 const *column = index->tags[tag];
+        DQN_FOR_EACH(track, index->num_tracks)
+        {
+            u32 id = column[track];
+            if (seen.data[id]) continue;
+            seen.data[id] = 1;
+            ids[tag].Push(id);
+        }
+
+        for (u32 id : ids[tag])
+            seen.data[id] = 0;
+    }
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+FILE_SCOPE i64 DaysFromCivil(i64 year, i64 month, i64 day)
+{
+    year         -= (month <= 2);
+    i64 era       = (year >= 0 ? year : year - 399) / 400;
+    i64 yoe       = year - era * 400;
+    i64 doy       = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    i64 doe       = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    i64 result    = era * 146097 + doe - 719468;
+    return result;
+}
+
+FILE_SCOPE DqnSlice<char const> TrimSlice(char const *str, isize len)
+{
+    while (len > 0 && DqnChar_IsWhitespace(str[0]))       { str++; len--; }
+    while (len > 0 && DqnChar_IsWhitespace(str[len - 1])) { len--; }
+    return DqnSlice<char const>(str, (int)len);
+}
+
+// Split off the next whitespace delimited word, ptr is advanced past it
+FILE_SCOPE DqnSlice<char const> EatWord(char const **ptr)
+{
+    char const *start = *ptr;
+    while (*start && DqnChar_IsWhitespace(*start)) start++;
+    char const *end = start;
+    while (*end && !DqnChar_IsWhitespace(*end) && *end != '=' && *end != '!') end++;
+    if (end == start && (*end == '=' || *end == '!'))
+        end += (end[0] == '!' && end[1] == '=') ? 2 : 1;
+
+    *ptr = end;
+    return DqnSlice<char const>(start, (int)(end - start));
+}
+
+// return: False if the line is malformed, error is set to a description
+FILE_SCOPE bool ParseQueryPredicate(DqnMemStack *allocator, char const *line, QueryPredicate *predicate, char const **error)
+{
+    *predicate                 = {};
+    char const *ptr            = line;
+    DqnSlice<char const> field = EatWord(&ptr);
+    DqnSlice<char const> op    = EatWord(&ptr);
+
+    if (DQN_SLICE_STRCMP(field, DQN_BUFFER_STR_LIT("added"), Dqn::IgnoreCase::Yes))
+    {
+        long long year = 0, month = 0, day = 0;
+        if (!DQN_SLICE_STRCMP(op, DQN_BUFFER_STR_LIT("since"), Dqn::IgnoreCase::Yes) || sscanf(ptr, " %lld-%lld-%lld", &year, &month, &day) != 3)
+        {
+            *error = "expected: added since YYYY-MM-DD";
+            return false;
+        }
+
+        predicate->type       = QueryPredicate::Type::AddedSince;
+        predicate->since_in_s = static_cast<u64>(DQN_MAX(DaysFromCivil(year, month, day), (i64)0) * 86400);
+        return true;
+    }
+
+    bool found_tag = false;
+    DQN_FOR_EACH(tag, LibraryTag::Count)
+    {
+        auto tag_name = DqnSlice<char const>(LIBRARY_TAG_NAMES[tag], DqnStr_Len(LIBRARY_TAG_NAMES[tag]));
+        if (DQN_SLICE_STRCMP(field, tag_name, Dqn::IgnoreCase::Yes))
+        {
+            predicate->tag = static_cast<LibraryTag>(tag);
+            found_tag      = true;
+        }
+    }
+
+    if (!found_tag)
+    {
+        *error = "unknown tag, expected a tag name or 'added'";
+        return false;
+    }
+
+    if (DQN_SLICE_STRCMP(op, DQN_BUFFER_STR_LIT("between"), Dqn::IgnoreCase::Yes))
+    {
+        long long min = 0, max = 0;
+        if (sscanf(ptr, " %lld %lld", &min, &max) != 2)
+        {
+            *error = "expected: <tag> between <min> <max>";
+            return false;
+        }
+
+        predicate->type = QueryPredicate::Type::Between;
+        predicate->min  = min;
+        predicate->max  = max;
+        return true;
+    }
+
+    if      (DQN_SLICE_STRCMP(op, DQN_BUFFER_STR_LIT("="),  Dqn::IgnoreCase::No))  predicate->type = QueryPredicate::Type::Equals;
+    else if (DQN_SLICE_STRCMP(op, DQN_BUFFER_STR_LIT("!="), Dqn::IgnoreCase::No))  predicate->type = QueryPredicate::Type::NotEquals;
+    else if (DQN_SLICE_STRCMP(op, DQN_BUFFER_STR_LIT("in"), Dqn::IgnoreCase::Yes)) predicate->type = QueryPredicate::Type::In;
+    else
+    {
+        *error = "unknown operator, expected =, !=, in or between";
+        return false;
+    }
+
+    // NOTE(doyle): Values are slices into the line, '|' separates the values of 'in'
+    isize max_values      = (predicate->type == QueryPredicate::Type::In) ? 1 : 0;
+    for (char const *scan = ptr; predicate->type == QueryPredicate::Type::In && *scan; scan++)
+        max_values += (*scan == '|');
+
+    predicate->values = DQN_MEMSTACK_PUSH_ARRAY(allocator, DqnSlice<char const>, DQN_MAX(max_values, (isize)1));
+    for (char const *value_start = ptr;;)
+    {
+        char const *value_end = value_start;
+        while (*value_end && (predicate->type != QueryPredicate::Type::In || *value_end != '|')) value_end++;
+
+        DqnSlice<char const> value = TrimSlice(value_start, value_end - value_start);
+        if (value.len > 0) predicate->values[predicate->num_values++] = value;
+        if (*value_end == 0) break;
+        value_start = value_end + 1;
+    }
+
+    if (predicate->num_values == 0)
+    {
+        *error = "expected a value";
+        return false;
+    }
+
+    return true;
+}
+
+// Set a bit per track whose column value is one of the ids
+FILE_SCOPE void ScanColumnForIds(u32 const *column, isize num_tracks, u32 const *ids, isize num_ids, u64 *bits)
+{
+    DQN_ASSERT(num_ids > 0 && num_ids <= 4);
+    __m128i id_vecs[4];
+    DQN_FOR_EACH(id_index, num_ids)
+        id_vecs[id_index] = _mm_set1_epi32(static_cast<int>(ids[id_index]));
+
+    for (isize word_start = 0; word_start < num_tracks; word_start += 64)
+    {
+        isize word_end = DQN_MIN(word_start + 64, num_tracks);
+        u64 word       = 0;
+        isize track    = word_start;
+        for (; track + 4 <= word_end; track += 4)
+        {
+            __m128i values = _mm_loadu_si128(reinterpret_cast<__m128i const *>(column + track));
+            __m128i match  = _mm_cmpeq_epi32(values, id_vecs[0]);
+            for (isize id_index = 1; id_index < num_ids; id_index++)
+                match = _mm_or_si128(match, _mm_cmpeq_epi32(values, id_vecs[id_index]));
+
+            word |= static_cast<u64>(_mm_movemask_ps(_mm_castsi128_ps(match))) << (track - word_start);
+        }
+
+        for (; track < word_end; track++)
+        {
+            bool matched = false;
+            DQN_FOR_EACH(id_index, num_ids)
+                matched |= (column[track] == ids[id_index]);
+            word |= static_cast<u64>(matched) << (track - word_start);
+        }
+
+        bits[word_start / 64] = word;
+    }
+}
+
+// Set a bit per track whose column value is marked in the lookup table of string ids
+FILE_SCOPE void ScanColumnWithLookup(u32 const *column, isize num_tracks, u8 const *id_lookup, u64 *bits)
+{
+    for (isize word_start = 0; word_start < num_tracks; word_start += 64)
+    {
+        isize word_end = DQN_MIN(word_start + 64, num_tracks);
+        u64 word       = 0;
+        for (isize track = word_start; track < word_end; track++)
+            word |= static_cast<u64>(id_lookup[column[track]]) << (track - word_start);
+        bits[word_start / 64] = word;
+    }
+}
+
+FILE_SCOPE bool QueryValueMatches(QueryPredicate const *predicate, char const *str)
+{
+    if (predicate->type == QueryPredicate::Type::Between)
+    {
+        i64 value = Dqn_StrToI64(str, DqnStr_Len(str));
+        return (str[0] && value >= predicate->min && value <= predicate->max);
+    }
+
+    i32 str_len = DqnStr_Len(str);
+    DQN_FOR_EACH(value_index, predicate->num_values)
+    {
+        DqnSlice<char const> value = predicate->values[value_index];
+        if (value.len == str_len && DqnStr_Cmp(str, value.data, value.len, Dqn::IgnoreCase::Yes) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Evaluate the predicates over every track in the index
+// bits: (num_tracks + 63) / 64 words, bit n is set if track n matches every predicate
+FILE_SCOPE void EvaluateQuery(DqnMemStack *allocator, LibraryIndex const *index, QueryTagDictionary const *dictionary,
+                              QueryPredicate const *predicates, isize num_predicates, u64 *bits)
+{
+    auto DQN_UNIQUE_NAME(mem_region) = allocator->MemRegionScope();
+    isize num_tracks = index->num_tracks;
+    isize num_words  = (num_tracks + 63) / 64;
+    DQN_FOR_EACH(word_index, num_words)
+        bits[word_index] = ~(u64)0;
+
+    u64 *predicate_bits = DQN_MEMSTACK_PUSH_ARRAY(allocator, u64, DQN_MAX(num_words, (isize)1));
+    u8 *id_lookup       = nullptr;
+    DQN_FOR_EACH(predicate_index, num_predicates)
+    {
+        QueryPredicate const *predicate = predicates + predicate_index;
+        if (predicate->type == QueryPredicate::Type::AddedSince)
+        {
+            for (isize word_start = 0; word_start < num_tracks; word_start += 64)
+            {
+                isize word_end = DQN_MIN(word_start + 64, num_tracks);
+                u64 word       = 0;
+                for (isize track = word_start; track < word_end; track++)
+                    word |= static_cast<u64>(index->added_time_in_s[track] >= predicate->since_in_s) << (track - word_start);
+                predicate_bits[word_start / 64] = word;
+            }
+        }
+        else
+        {
+            DqnArray<u32> const *tag_ids = dictionary->ids + (int)predicate->tag;
+            u32 matching_ids[4];
+            isize num_matching_ids = 0;
+            for (u32 id : *tag_ids)
+            {
+                if (!QueryValueMatches(predicate, index->String(id)))
+                    continue;
+
+                // NOTE(doyle): Few ids compare directly in SIMD, past that look every id up in a table
+                if (num_matching_ids < DQN_ARRAY_COUNT(matching_ids))
+                {
+                    matching_ids[num_matching_ids++] = id;
+                    continue;
+                }
+
+                // NOTE(doyle): DQN_MEMSTACK_PUSH_ARRAY is more than one statement, it needs the braces
+                if (!id_lookup)
+                {
+                    id_lookup = DQN_MEMSTACK_PUSH_ARRAY(allocator, u8, index->header->num_strings);
+                }
+
+                if (num_matching_ids == DQN_ARRAY_COUNT(matching_ids))
+                {
+                    DqnMem_Clear(id_lookup, 0, index->header->num_strings);
+                    for (u32 matching_id : matching_ids)
+                        id_lookup[matching_id] = 1;
+                    num_matching_ids++;
+                }
+                id_lookup[id] = 1;
+            }
+
+            if (num_matching_ids == 0)                                  DqnMem_Clear(predicate_bits, 0, sizeof(*predicate_bits) * num_words);
+            else if (num_matching_ids <= DQN_ARRAY_COUNT(matching_ids)) ScanColumnForIds(index->tags[(int)predicate->tag], num_tracks, matching_ids, num_matching_ids, predicate_bits);
+            else                                                        ScanColumnWithLookup(index->tags[(int)predicate->tag], num_tracks, id_lookup, predicate_bits);
+
+            if (predicate->type == QueryPredicate::Type::NotEquals)
+            {
+                DQN_FOR_EACH(word_index, num_words)
+                    predicate_bits[word_index] = ~predicate_bits[word_index];
+            }
+        }
+
+        DQN_FOR_EACH(word_index, num_words)
+            bits[word_index] &= predicate_bits[word_index];
+    }
+
+    // NOTE(doyle): Clear the bits past the last track, set by the initial fill or a negation
+    if (num_tracks % 64)
+        bits[num_words - 1] &= (~(u64)0) >> (64 - (num_tracks % 64));
+}
+
+// Evaluate Input\<query_name>.query and sync the matching tracks to Output\<query_name>.m3u
+FILE_SCOPE void SyncSmartPlaylist(Context *context, QueryTagDictionary const *dictionary, char const *query_name)
+{
+    LibraryIndex const *index = context->index;
+    auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+
+    wchar_t const *query_name_w = UTF8ToWChar(&context->allocator, query_name);
+    DqnBuffer<wchar_t> query_file = AllocateSwprintf(&context->allocator, L".\\Input\\%s.query", query_name_w);
+
+    DqnArray<DqnFileOp> stat_ops = {};
+    DQN_DEFER { stat_ops.Free(); };
+    {
+        STAGE_SCOPE(&context->stats, Stage::QueryEval);
+        context->stats[Stage::QueryEval]->items++;
+
+        usize buf_size = 0;
+        u8 *buf        = DqnFile_ReadAll(query_file.str, &buf_size, &global_func_local_allocator_);
+        if (!buf)
+        {
+            context->stats[Stage::QueryEval]->failures++;
+            char const *msg = DQN_LOGGER_W(&context->logger, "DqnFile_ReadAll: Failed, could not read file: %s", query_name);
+            global_logger_buf.Push(msg, DqnStr_Len(msg));
+            return;
+        }
+        context->stats[Stage::QueryEval]->bytes += buf_size;
+
+        char *text = DQN_MEMSTACK_PUSH_ARRAY(&global_func_local_allocator_, char, buf_size + 1);
+        DqnMem_Copy(text, buf, buf_size);
+        text[buf_size] = 0;
+
+        // Skip UTF8-BOM bytes if present
+        char *text_ptr = text;
+        if (buf_size > 3 && (u8)text_ptr[0] == 0xEF && (u8)text_ptr[1] == 0xBB && (u8)text_ptr[2] == 0xBF)
+            text_ptr += 3;
+
+        DqnArray<QueryPredicate> predicates = {};
+        DQN_DEFER { predicates.Free(); };
+        while (char *line = Dqn_EatLine(&text_ptr, nullptr/*line_len*/))
+        {
+            if (line[0] == '#' || line[0] == 0)
+                continue;
+
+            QueryPredicate predicate = {};
+            char const *error        = nullptr;
+            if (!ParseQueryPredicate(&global_func_local_allocator_, line, &predicate, &error))
+            {
+                // NOTE(doyle): Don't sync a playlist that means something other than what was written
+                context->stats[Stage::QueryEval]->failures++;
+                char const *msg = DQN_LOGGER_E(&context->logger, "Smart playlist %s skipped, bad line '%s': %s", query_name, line, error);
+                global_logger_buf.Push(msg, DqnStr_Len(msg));
+                return;
+            }
+            predicates.Push(predicate);
+        }
+
+        isize num_words = (index->num_tracks + 63) / 64;
+        u64 *bits       = DQN_MEMSTACK_PUSH_ARRAY(&global_func_local_allocator_, u64, DQN_MAX(num_words, (isize)1));
+        EvaluateQuery(&global_func_local_allocator_, index, dictionary, predicates.data, predicates.len, bits);
+
+        DQN_FOR_EACH(word_index, num_words)
+        {
+            for (u64 word = bits[word_index]; word; word &= word - 1)
+            {
+                unsigned long bit = 0;
+                _BitScanForward64(&bit, word);
+                isize track  = word_index * 64 + bit;
+                DqnFileOp op = {};
+                op.type      = DqnFileOp::Type::Stat;
+                op.path      = index->String(index->path[track]);
+                stat_ops.Push(op);
+            }
+        }
+    }
+
+    DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> sounds_table = StatSoundPaths(context, &stat_ops);
+    DQN_DEFER { sounds_table.Free(); };
+
+    DqnArray<char> m3u_buf = {};
+    DQN_DEFER { m3u_buf.Free(); };
+    if (sounds_table.num_used_entries > 0)
+        SyncSoundsToLibrary(context, &sounds_table, &m3u_buf);
+
+    WriteM3UFile(context, AllocateSwprintf(&context->allocator, L"%s.m3u", query_name_w).str, &m3u_buf);
+}
+
+// Evaluate every query over the index mapped in context->index and sync its matches
+FILE_SCOPE void SyncSmartPlaylists(Context *context, char const *const *query_names, isize num_queries)
+{
+    QueryTagDictionary dictionary = {};
+    DQN_DEFER { dictionary.Free(); };
+    {
+        STAGE_SCOPE(&context->stats, Stage::QueryEval);
+        dictionary.Init(context->index);
+    }
+
+    DQN_FOR_EACH(query_index, num_queries)
+        SyncSmartPlaylist(context, &dictionary, query_names[query_index]);
+}
+
+// Watch Mode
+// =================================================================================================
+// --watch keeps running after the first sync and syncs again whatever changes in Input or the library
+// roots, as reported by the OS (see DqnFileWatch). The library index, search index and stat cache stay
+// warm in memory between changes so only the affected playlists and sounds are touched, no rescans.
+//
+// - A playlist or query written to Input is synced again.
+// - A sound written under a root has its old link in Output removed, since the link may be to the old
+//   file or named after the old tags, and is synced again by every playlist listing it (or matching a
+//   search: entry). In scan mode it's synced on its own and its line in Library.m3u is updated.
+// - A directory created or moved into a root, or a root whose events overflowed, is scanned again in
+//   scan mode, otherwise every playlist is synced again since any of them may list sounds inside it.
+// - Smart playlists are evaluated again whenever a sound changed, their matches may have changed.
+//
+// A save or copy is several events in quick succession, events are coalesced until the roots have been
+// quiet for WATCH_QUIET_MS (or WATCH_MAX_DELAY_MS has passed) so a change is synced once it's complete.
+#define WATCH_QUIET_MS     50
+#define WATCH_MAX_DELAY_MS 500
+
+struct WatchPlaylist
+{
+    char            *file_name; // Name of the playlist or query in Input, UTF-8, heap allocated
+    bool             is_query;
+    bool             dirty;     // Has to be synced again
+    PlaylistSources  sources;   // Unused for queries
+};
+
+struct LibraryWatch
+{
+    DqnFileWatch            file_watch;
+    DqnArray<WatchPlaylist> playlists;   // Every playlist and query in Input
+    DqnArray<char>          library_m3u; // Contents of Output\Library.m3u in scan mode
+};
+
+struct WatchChange
+{
+    DqnFileWatchEvent::Type type;
+    bool                    is_dir;
+    isize                   path_offset; // Into the batch's packed paths
+    isize                   order;       // Position in the batch, the last change to a path wins
+};
+
+FILE_SCOPE void LibraryWatch_Free(LibraryWatch *watch)
+{
+    watch->file_watch.Free();
+    for (WatchPlaylist &playlist : watch->playlists)
+    {
+        DqnMem_Free(playlist.file_name);
+        playlist.sources.path_hashes.Free();
+    }
+    watch->playlists.Free();
+    watch->library_m3u.Free();
+}
+
+FILE_SCOPE isize LibraryWatch_FindPlaylist(LibraryWatch const *watch, char const *file_name)
+{
+    DQN_FOR_EACH(playlist_index, watch->playlists.len)
+    {
+        if (DqnStr_Cmp(watch->playlists.data[playlist_index].file_name, file_name, -1, Dqn::IgnoreCase::Yes) == 0)
+            return playlist_index;
+    }
+    return -1;
+}
+
+// return: The playlist, valid until the next playlist is added or removed
+FILE_SCOPE WatchPlaylist *LibraryWatch_AddPlaylist(LibraryWatch *watch, char const *file_name, bool is_query)
+{
+    isize playlist_index = LibraryWatch_FindPlaylist(watch, file_name);
+    if (playlist_index != -1)
+        return watch->playlists.data + playlist_index;
+
+    i32 len                = DqnStr_Len(file_name);
+    WatchPlaylist *result  = watch->playlists.Make();
+    *result                = {};
+    result->file_name      = static_cast<char *>(DqnMem_XAlloc(len + 1));
+    result->is_query       = is_query;
+    DqnMem_Copy(result->file_name, file_name, len + 1);
+    return result;
+}
+
+// return: The offset of the line in the M3U buffer, -1 if it's not in it
+FILE_SCOPE isize M3U_FindLine(DqnArray<char> const *buf, char const *line, i32 len)
+{
+    for (isize offset = 0; offset < buf->len;)
+    {
+        char const *line_start = buf->data + offset;
+        auto const *line_end   = static_cast<char const *>(memchr(line_start, '\n', buf->len - offset));
+        isize line_len         = (line_end) ? (line_end - line_start) : (buf->len - offset);
+        if (line_len == len && DqnMem_Cmp(line_start, line, len) == 0)
+            return offset;
+
+        offset += line_len + 1;
+    }
+    return -1;
+}
+
+// Replace old_line with new_line in the M3U buffer. new_line is appended if old_line isn't listed and
+// isn't added twice, old_line is removed if new_line is null or empty.
+FILE_SCOPE void M3U_ReplaceLine(DqnArray<char> *buf, char const *old_line, char const *new_line)
+{
+    i32 old_len      = (old_line) ? DqnStr_Len(old_line) : 0;
+    i32 new_len      = (new_line) ? DqnStr_Len(new_line) : 0;
+    isize old_offset = (old_len > 0) ? M3U_FindLine(buf, old_line, old_len) : -1;
+    isize new_offset = (new_len > 0) ? M3U_FindLine(buf, new_line, new_len) : -1;
+    if (new_offset != -1 && new_offset == old_offset)
+        return;
+
+    isize insert_offset = buf->len;
+    if (old_offset != -1)
+    {
+        isize erase_len = DQN_MIN((isize)old_len + 1, buf->len - old_offset);
+        memmove(buf->data + old_offset, buf->data + old_offset + erase_len, buf->len - old_offset - erase_len);
+        buf->len     -= erase_len;
+        insert_offset = old_offset;
+    }
+
+    if (new_len > 0 && new_offset == -1)
+    {
+        if (insert_offset == buf->len && buf->len > 0 && buf->data[buf->len - 1] != '\n')
+        {
+            buf->Push('\n');
+            insert_offset = buf->len;
+        }
+
+        buf->Insert(insert_offset, new_line, new_len);
+        buf->Insert(insert_offset + new_len, '\n');
+    }
+}
+
+FILE_SCOPE bool WatchChange_LessThan(WatchChange const &a, WatchChange const &b, void *user_context)
+{
+    auto const *paths = static_cast<char const *>(user_context);
+    int compare       = DqnStr_Cmp(paths + a.path_offset, paths + b.path_offset);
+    if (compare != 0) return compare < 0;
+    return a.order < b.order;
+}
+
+// Sync Input and the library roots again as they change, forever
+// roots:     The library roots, the --scan roots in scan mode
+// scan_mode: The roots were scanned and Output\Library.m3u lists every sound in them
+FILE_SCOPE bool TrackPath_LessThan(u32 const &a, u32 const &b, void *user_context)
+{
+    auto const *builder = static_cast<LibraryIndexBuilder const *>(user_context);
+    return DqnStr_Cmp(builder->String(builder->path.data[a]), builder->String(builder->path.data[b]), -1, Dqn::IgnoreCase::Yes) < 0;
+}
+
+// Compare the track's path against "<dir>\", in the order of TrackPath_LessThan
+// return: 0 if the track is under the directory
+FILE_SCOPE i32 TrackPath_CmpDir(LibraryIndexBuilder const *builder, u32 track, char const *dir, i32 dir_len)
+{
+    char const *track_path = builder->String(builder->path.data[track]);
+    i32 result             = DqnStr_Cmp(track_path, dir, dir_len, Dqn::IgnoreCase::Yes);
+    if (result == 0) result = DqnChar_ToLower(track_path[dir_len]) - '\\';
+    return result;
+}
 
-        AVFormatContext *fmt_context = nullptr;
-        if (avformat_open_input(&fmt_context, sound_path_utf8.str, nullptr, nullptr))
+FILE_SCOPE void WatchLibrary(Context *context, LibraryWatch *watch, char const *const *roots, isize num_roots, bool scan_mode,
+                             LibraryIndex *index, LibraryIndexBuilder *builder, wchar_t const *index_path)
+{
+    char const INPUT_DIR[] = ".\\Input";
+    i32 const input_dir_len = (i32)(DQN_CHAR_COUNT(INPUT_DIR));
+    if (!watch->file_watch.Init() || !watch->file_watch.Add(INPUT_DIR))
+    {
+        fprintf(stderr, "Failed to watch Input for changes, watch mode is unavailable\n");
+        return;
+    }
+
+    DQN_FOR_EACH(root_index, num_roots)
+    {
+        if (!watch->file_watch.Add(roots[root_index]))
+            fprintf(stderr, "Failed to watch library root for changes, it won't be synced: %s\n", roots[root_index]);
+    }
+
+    char const *exe_directory = WCharToUTF8(&context->allocator, context->exe_directory.str);
+    fprintf(stdout, "Watching Input and %lld library roots for changes\n", (long long)num_roots);
+
+    DqnArray<WatchChange> changes = {};
+    DqnArray<char> change_paths   = {}; // Null-terminated paths back to back
+    DqnArray<DqnFileOp> sound_ops = {}; // Scan mode: Sounds to sync on their own
+    DqnArray<u32> old_outputs     = {}; // Scan mode: Each sound op's output path before it changed
+    DqnArray<char const *> dirs   = {}; // Scan mode: Directories to scan
+    DqnArray<char const *> queries = {};
+    DqnArray<char> m3u_buf        = {};
+    DqnArray<u32> tracks_by_path  = {}; // Sorted by TrackPath_LessThan when a batch removes a directory
+    DQN_DEFER
+    {
+        tracks_by_path.Free();
+        changes.Free();
+        change_paths.Free();
+        sound_ops.Free();
+        old_outputs.Free();
+        dirs.Free();
+        queries.Free();
+        m3u_buf.Free();
+    };
+
+    for (;;)
+    {
+        // NOTE(doyle): Block until something changes, then keep collecting until it's gone quiet
+        changes.Clear();
+        change_paths.Clear();
+        f64 first_change_ms = 0;
+        for (;;)
         {
-            char const *msg = DQN_LOGGER_E(&context->logger, "avformat_open_input: failed to open file: %s", sound_path_utf8.str);
-            global_logger_buf.Push(msg, DqnStr_Len(msg));
-            continue;
+            u32 timeout_ms = INFINITE;
+            if (changes.len > 0)
+            {
+                f64 elapsed_ms = DqnTimer_NowInMs() - first_change_ms;
+                if (elapsed_ms >= WATCH_MAX_DELAY_MS) break;
+                timeout_ms = (u32)DQN_MIN((f64)WATCH_QUIET_MS, WATCH_MAX_DELAY_MS - elapsed_ms);
+            }
+
+            auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+            DqnFileWatchEvents events        = {};
+            if (!watch->file_watch.Wait(timeout_ms, &context->allocator, &events))
+            {
+                fprintf(stderr, "Failed to wait for changes, watch mode stopped\n");
+                return;
+            }
+
+            if (events.len == 0)
+            {
+                if (changes.len > 0) break;
+                continue;
+            }
+
+            if (changes.len == 0) first_change_ms = DqnTimer_NowInMs();
+            for (DqnFileWatchEvent const &event : events)
+            {
+                WatchChange change = {};
+                change.type        = event.type;
+                change.is_dir      = event.is_dir;
+                change.path_offset = change_paths.len;
+                change.order       = changes.len;
+                changes.Push(change);
+
+                char *path = change_paths.Push(event.path.data, event.path.len + 1);
+                for (char *ptr = path; *ptr; ptr++)
+                {
+                    if (*ptr == '/') *ptr = '\\';
+                }
+            }
         }
-        DQN_DEFER { avformat_close_input(&fmt_context); };
 
-#if 1
-        SoundFile sound_file = {};
-        sound_file.path = CopyWStringToBuffer(&context->allocator, entry.key.str, entry.key.len);
-        for (isize i = sound_file.path.len; i >= 0; --i)
+        u64 batch_start_ns = DqnTimer_NowInNs();
+        auto DQN_UNIQUE_NAME(mem_region) = context->allocator.MemRegionScope();
+        auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+
+        // NOTE(doyle): A path written many times is handled once, as whatever happened to it last
+        DqnQuickSort<WatchChange, WatchChange_LessThan>(changes.data, changes.len, change_paths.data);
+        isize num_changes = 0;
+        DQN_FOR_EACH(change_index, changes.len)
         {
-            if (sound_file.path.str[i] == '.')
+            bool last = (change_index + 1 == changes.len) ||
+                        DqnStr_Cmp(change_paths.data + changes.data[change_index].path_offset, change_paths.data + changes.data[change_index + 1].path_offset) != 0;
+            if (last) changes.data[num_changes++] = changes.data[change_index];
+        }
+        changes.len = num_changes;
+
+        sound_ops.Clear();
+        old_outputs.Clear();
+        dirs.Clear();
+        tracks_by_path.Clear();
+        bool sounds_changed     = false;
+        bool sync_all_playlists = false;
+        bool library_changed    = false;
+
+        auto SoundChanged = [&](char const *path, DqnFileWatchEvent::Type type) {
+            sounds_changed = true;
+            i32 path_len   = DqnStr_Len(path);
+            isize track    = builder->Find(path, path_len);
+            u32 old_output = (track != -1) ? builder->output_path.data[track] : 0;
+
+            bool listed = false;
+            u64 hash    = StatCache_Hash(path, path_len);
+            for (WatchPlaylist &playlist : watch->playlists)
             {
-                sound_file.extension.str = sound_file.path.str + (i + 1);
-                sound_file.extension.len = static_cast<int>(sound_file.path.len - i);
-                break;
+                if (playlist.is_query) continue;
+                bool lists_path = DqnBSearch(playlist.sources.path_hashes.data, playlist.sources.path_hashes.len, hash) != -1;
+                playlist.dirty |= (lists_path || playlist.sources.has_search);
+                listed         |= lists_path;
+            }
+
+            if (type == DqnFileWatchEvent::Type::Changed)
+            {
+                // NOTE(doyle): Only remove the link if it's about to be made again, and not if it's the link of a
+                // near duplicate this sound was listed as
+                if (old_output && (scan_mode || listed) && !IsOutputShared(builder, track, old_output))
+                {
+                    auto DQN_UNIQUE_NAME(mem_region) = global_func_local_allocator_.MemRegionScope();
+                    char const *rel_path = builder->String(old_output);
+                    i32 dest_len         = DqnStr_Len(exe_directory) + (i32)(DQN_CHAR_COUNT("\\Output\\")) + DqnStr_Len(rel_path);
+                    char *dest           = DQN_MEMSTACK_PUSH_ARRAY(&global_func_local_allocator_, char, dest_len + 1);
+                    Dqn_sprintf(dest, "%s\\Output\\%s", exe_directory, rel_path);
+                    DqnFile_Delete(dest);
+                    context->stat_cache->Invalidate(dest, dest_len);
+                }
+
+                if (scan_mode)
+                {
+                    DqnFileOp op = {};
+                    op.type      = DqnFileOp::Type::Stat;
+                    op.path      = path;
+                    sound_ops.Push(op);
+                    old_outputs.Push(old_output);
+                }
+            }
+            else if (scan_mode && old_output && !IsOutputShared(builder, track, old_output))
+            {
+                M3U_ReplaceLine(&watch->library_m3u, builder->String(old_output), nullptr);
+                library_changed = true;
+            }
+        };
+
+        for (WatchChange const &change : changes)
+        {
+            char *path   = change_paths.data + change.path_offset;
+            i32 path_len = DqnStr_Len(path);
+
+            // NOTE(doyle): Playlists and queries directly in Input
+            if (DqnStr_Cmp(path, INPUT_DIR, input_dir_len) == 0 && (path[input_dir_len] == 0 || path[input_dir_len] == '\\'))
+            {
+                if (change.type == DqnFileWatchEvent::Type::Overflow)
+                {
+                    DqnFileDirList input_files = {};
+                    DqnFile_ListDir(INPUT_DIR, &context->allocator, &input_files);
+                    for (DqnFileDirList::Entry const &input_file : input_files)
+                    {
+                        bool is_query = IsQueryFileName(input_file.name.data, input_file.name.len);
+                        if (input_file.type == DqnFileDirEntry::Type::File && (is_query || !scan_mode))
+                            LibraryWatch_AddPlaylist(watch, input_file.name.data, is_query)->dirty = true;
+                    }
+                    continue;
+                }
+
+                char const *file_name = path + input_dir_len + 1;
+                i32 file_name_len     = path_len - input_dir_len - 1;
+                if (file_name_len <= 0 || DqnStr_FindFirstOccurence(file_name, file_name_len, "\\", 1) != -1)
+                    continue;
+
+                if (change.type == DqnFileWatchEvent::Type::Removed)
+                {
+                    isize playlist_index = LibraryWatch_FindPlaylist(watch, file_name);
+                    if (playlist_index != -1)
+                    {
+                        WatchPlaylist *playlist = watch->playlists.data + playlist_index;
+                        DqnMem_Free(playlist->file_name);
+                        playlist->sources.path_hashes.Free();
+                        watch->playlists.EraseStable(playlist_index);
+                    }
+                }
+                else if (!change.is_dir)
+                {
+                    bool is_query = IsQueryFileName(file_name, file_name_len);
+                    if (is_query || !scan_mode)
+                        LibraryWatch_AddPlaylist(watch, file_name, is_query)->dirty = true;
+                }
+                continue;
+            }
+
+            // NOTE(doyle): Sounds and directories in the library roots
+            context->stat_cache->Invalidate(path, path_len);
+            if (change.type == DqnFileWatchEvent::Type::Removed)
+            {
+                // NOTE(doyle): A removed directory isn't reported as one on Win32, every sound under the
+                // path was removed with it. A path that is a track is a file, anything else may have been a
+                // directory and its tracks are found by binary search over the paths sorted once a batch.
+                if (!change.is_dir && builder->Find(path, path_len) != -1)
+                {
+                    SoundChanged(path, DqnFileWatchEvent::Type::Removed);
+                    continue;
+                }
+
+                if (tracks_by_path.len != builder->num_tracks)
+                {
+                    tracks_by_path.Resize(builder->num_tracks);
+                    DQN_FOR_EACH(track, builder->num_tracks)
+                        tracks_by_path.data[track] = (u32)track;
+                    DqnQuickSort<u32, TrackPath_LessThan>(tracks_by_path.data, tracks_by_path.len, builder);
+                }
+
+                isize lo = 0, hi = tracks_by_path.len;
+                while (lo < hi)
+                {
+                    isize mid = lo + (hi - lo) / 2;
+                    if (TrackPath_CmpDir(builder, tracks_by_path.data[mid], path, path_len) < 0) lo = mid + 1;
+                    else                                                                          hi = mid;
+                }
+
+                for (isize index = lo; index < tracks_by_path.len && TrackPath_CmpDir(builder, tracks_by_path.data[index], path, path_len) == 0; index++)
+                    SoundChanged(builder->String(builder->path.data[tracks_by_path.data[index]]), DqnFileWatchEvent::Type::Removed);
+
+                if (!change.is_dir && IsAudioFileName(path, path_len))
+                    SoundChanged(path, DqnFileWatchEvent::Type::Removed);
+            }
+            else if (change.is_dir || change.type == DqnFileWatchEvent::Type::Overflow)
+            {
+                sounds_changed = true;
+                if (scan_mode) dirs.Push(path);
+                else           sync_all_playlists = true;
+            }
+            else if (IsAudioFileName(path, path_len))
+            {
+                SoundChanged(path, DqnFileWatchEvent::Type::Changed);
             }
         }
 
-        if (!sound_file.path)
+        isize num_sounds = sound_ops.len;
+        if (dirs.len > 0)
         {
-            char const *msg = DQN_LOGGER_E(&context->logger, "Could not figure out the file extension for file path: %s", sound_path_utf8.str);
-            global_logger_buf.Push(msg, DqnStr_Len(msg));
-            continue;
+            m3u_buf.Clear();
+            ScanLibraries(context, dirs.data, dirs.len, &m3u_buf);
+
+            // NOTE(doyle): The directory may hold sounds that are already listed, i.e. after an overflow
+            for (isize offset = 0; offset < m3u_buf.len;)
+            {
+                char *line     = m3u_buf.data + offset;
+                auto *line_end = static_cast<char *>(memchr(line, '\n', m3u_buf.len - offset));
+                if (!line_end) break;
+
+                *line_end = 0;
+                M3U_ReplaceLine(&watch->library_m3u, nullptr, line);
+                offset = (line_end - m3u_buf.data) + 1;
+            }
+            library_changed = true;
         }
 
-        for (isize i = sound_file.extension.len; i >= 0; --i)
+        if (sound_ops.len > 0)
         {
-            if (sound_file.path.str[i] == '\\')
+            DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> sounds_table = StatSoundPaths(context, &sound_ops);
+            DQN_DEFER { sounds_table.Free(); };
+
+            m3u_buf.Clear();
+            if (sounds_table.num_used_entries > 0)
+                SyncSoundsToLibrary(context, &sounds_table, &m3u_buf);
+
+            DQN_FOR_EACH(sound_index, sound_ops.len)
             {
-                sound_file.name.str = sound_file.path.str + (i + 1);
-                sound_file.name.len = static_cast<int>(sound_file.path.len - i);
-                break;
+                DqnFileOp const *op = sound_ops.data + sound_index;
+                isize track         = (op->success) ? builder->Find(op->path, DqnStr_Len(op->path)) : -1;
+                u32 old_output      = old_outputs.data[sound_index];
+                u32 new_output      = (track != -1) ? builder->output_path.data[track] : 0;
+                M3U_ReplaceLine(&watch->library_m3u, old_output ? builder->String(old_output) : nullptr, new_output ? builder->String(new_output) : nullptr);
             }
+            library_changed = true;
         }
 
-        if (!sound_file.name)
+        if (library_changed)
+            WriteM3UFile(context, L"Library.m3u", &watch->library_m3u);
+
+        isize num_playlists = 0;
+        for (WatchPlaylist &playlist : watch->playlists)
         {
-            char const *msg = DQN_LOGGER_E(&context->logger, "Could not figure out the file name for file path: %s", sound_path_utf8.str);
-            global_logger_buf.Push(msg, DqnStr_Len(msg));
-            continue;
+            if (playlist.is_query || !(playlist.dirty || sync_all_playlists))
+                continue;
+
+            SyncPlaylistFile(context, playlist.file_name, &playlist.sources);
+            playlist.dirty = false;
+            num_playlists++;
         }
 
-        bool atleast_one_entry_filled = ExtractSoundMetadata(&context->allocator, fmt_context->metadata, &sound_file.metadata);
-        DQN_FOR_EACH(i, fmt_context->nb_streams)
+        // NOTE(doyle): Queries run over the index with this batch's changes, so it's written out first
+        queries.Clear();
+        for (WatchPlaylist &playlist : watch->playlists)
         {
-            AVStream const *stream = fmt_context->streams[i];
-            atleast_one_entry_filled |= ExtractSoundMetadata(&context->allocator, stream->metadata, &sound_file.metadata);
+            if (!playlist.is_query || !(playlist.dirty || sounds_changed))
+                continue;
+
+            i32 name_len     = DqnStr_Len(playlist.file_name) - (i32)(DQN_CHAR_COUNT(QUERY_FILE_EXTENSION));
+            char *query_name = DQN_MEMSTACK_PUSH_ARRAY(&context->allocator, char, name_len + 1);
+            DqnMem_Copy(query_name, playlist.file_name, name_len);
+            query_name[name_len] = 0;
+            queries.Push(query_name);
+            playlist.dirty = false;
         }
 
-        if (!atleast_one_entry_filled)
+        if (sounds_changed || num_playlists > 0 || queries.len > 0)
+            WriteLibraryIndex(context, index, builder, index_path);
+
+        if (queries.len > 0 && context->index)
         {
-            char const *msg = DQN_LOGGER_W(&context->logger, "No metadata could be parsed for file: %s", entry.key.str);
-            global_logger_buf.Push(msg, DqnStr_Len(msg));
-            continue;
+            SyncSmartPlaylists(context, queries.data, queries.len);
+            WriteLibraryIndex(context, index, builder, index_path);
         }
 
-        context->allocator.MemRegionSave(&mem_region);
-        result.Push(sound_file);
-#else
-        av_dump_format(fmt_context, 0, sound_file_path.str, 0);
-#endif
-    }
+        if (context->transcode_cache && (sounds_changed || num_playlists > 0 || queries.len > 0))
+            WriteTranscodeCache(context, context->transcode_cache);
 
-    return result;
+        if (context->waveforms)
+            WriteWaveformStore(context, context->waveforms);
+
+        f64 batch_ms = (DqnTimer_NowInNs() - batch_start_ns) / 1000000.0;
+        fprintf(stdout, "Synced %lld changes: %lld playlists, %lld smart playlists, %lld sounds, %lld directories in %.2fms\n",
+                (long long)changes.len, (long long)num_playlists, (long long)queries.len, (long long)num_sounds, (long long)dirs.len, batch_ms);
+        fprintf(stderr, "%.*s", (int)global_logger_buf.len, global_logger_buf.data);
+        global_logger_buf.Clear(Dqn::ZeroMem::Yes);
+    }
 }
 
-void SanitiseStringForDiskFile(wchar_t *string)
+int main(int argc, char **argv)
 {
-    while(*string++)
+    char const *stats_json_path       = nullptr;
+    DqnFileBatch::Backend file_backend = DqnFileBatch::Backend::Auto;
+    DqnArray<char const *> scan_roots  = {};
+    DqnArray<char const *> watch_roots = {};
+    bool watch                         = false;
+    i64 copy_budget_mb                 = 256;
+    char const *transcode_format       = nullptr;
+    i64 transcode_kbps                 = 256;
+    i64 transcode_cache_mb             = 4096;
+    bool analyse_loudness              = false;
+    bool make_waveforms                = false;
+    bool dedupe                        = false;
+    bool detect_silence                = false;
+    bool store_art                     = false;
+    i64 art_thumbnail_px               = 0;
+    i64 stream_chunk_size              = 0;
+    char const *live_stats_path        = nullptr;
+    i64 live_interval_ms               = 1000;
+    bool progress                      = false;
+    char const *trace_path             = nullptr;
+    DQN_DEFER
     {
-        switch (string[0])
+        scan_roots.Free();
+        watch_roots.Free();
+    };
+    for (int arg_index = 1; arg_index < argc; arg_index++)
+    {
+        if (DqnStr_Cmp(argv[arg_index], "--stats-json") == 0 && arg_index + 1 < argc)
         {
-            case '?':
-            case ':':
-            case '\\':
-            case '/':
-            case '<':
-            case '>':
-            case '*':
-            case '|':
-            case '"':
-                string[0] = ' ';
-                break;
+            stats_json_path = argv[++arg_index];
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--live-stats") == 0 && arg_index + 1 < argc)
+        {
+            live_stats_path = argv[++arg_index];
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--live-interval-ms") == 0 && arg_index + 1 < argc)
+        {
+            char const *interval = argv[++arg_index];
+            live_interval_ms     = Dqn_StrToI64(interval, DqnStr_Len(interval));
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--trace") == 0 && arg_index + 1 < argc)
+        {
+            trace_path = argv[++arg_index];
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--progress") == 0)
+        {
+            progress = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--file-batch") == 0 && arg_index + 1 < argc)
+        {
+            char const *backend = argv[++arg_index];
+            if      (DqnStr_Cmp(backend, "io_uring")    == 0) file_backend = DqnFileBatch::Backend::IoUring;
+            else if (DqnStr_Cmp(backend, "thread_pool") == 0) file_backend = DqnFileBatch::Backend::ThreadPool;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--scan") == 0 && arg_index + 1 < argc)
+        {
+            scan_roots.Push(argv[++arg_index]);
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--copy-budget-mb") == 0 && arg_index + 1 < argc)
+        {
+            char const *budget = argv[++arg_index];
+            copy_budget_mb     = Dqn_StrToI64(budget, DqnStr_Len(budget));
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--transcode") == 0 && arg_index + 1 < argc)
+        {
+            transcode_format = argv[++arg_index];
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--transcode-kbps") == 0 && arg_index + 1 < argc)
+        {
+            char const *kbps = argv[++arg_index];
+            transcode_kbps   = Dqn_StrToI64(kbps, DqnStr_Len(kbps));
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--transcode-cache-mb") == 0 && arg_index + 1 < argc)
+        {
+            char const *cache_mb = argv[++arg_index];
+            transcode_cache_mb   = Dqn_StrToI64(cache_mb, DqnStr_Len(cache_mb));
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--loudness") == 0)
+        {
+            analyse_loudness = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--waveforms") == 0)
+        {
+            make_waveforms = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--silence") == 0)
+        {
+            detect_silence = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--dedupe") == 0)
+        {
+            dedupe = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--art") == 0)
+        {
+            store_art = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--art-thumbnail-px") == 0 && arg_index + 1 < argc)
+        {
+            char const *px   = argv[++arg_index];
+            art_thumbnail_px = Dqn_StrToI64(px, DqnStr_Len(px));
+            store_art        = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--stream-chunk") == 0 && arg_index + 1 < argc)
+        {
+            char const *chunk = argv[++arg_index];
+            stream_chunk_size = Dqn_StrToI64(chunk, DqnStr_Len(chunk));
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--watch") == 0)
+        {
+            watch = true;
+        }
+        else if (DqnStr_Cmp(argv[arg_index], "--watch-root") == 0 && arg_index + 1 < argc)
+        {
+            // NOTE(doyle): Where the sounds the playlists list live, --scan roots are always watched
+            watch_roots.Push(argv[++arg_index]);
         }
     }
-}
 
-int main(int, char)
-{
+    if (trace_path)
+    {
+        Trace_Begin();
+        Trace_NameThread("main");
+    }
+
     Context context              = {};
+    context.stats.start_ns       = DqnTimer_NowInNs();
+    context.start_time_in_s      = static_cast<u64>(time(nullptr));
+    context.copy_budget_bytes    = DQN_MEGABYTE(DQN_MAX(copy_budget_mb, 1));
+    context.stream_chunk_size    = DQN_MAX(stream_chunk_size, (i64)0);
+    context.analyse_loudness     = analyse_loudness;
+    context.detect_silence       = detect_silence;
     context.logger.no_console    = true;
     context.allocator            = DqnMemStack(DQN_MEGABYTE(16), Dqn::ZeroMem::Yes, 0, DqnMemTracker::All);
     global_func_local_allocator_ = DqnMemStack(DQN_MEGABYTE(1), Dqn::ZeroMem::Yes, 0, DqnMemTracker::All);
     DqnWin32_GetExeNameAndDirectory(&context.allocator, &context.exe_name, &context.exe_directory);
     global_logger_buf.LazyInit(DQN_MEGABYTE(16));
 
-    DqnFile_MakeDir("Input");
-    DqnFile_MakeDir("Output");
+    StatCache stat_cache = {};
+    stat_cache.Init();
+    context.stat_cache = &stat_cache;
+    DQN_DEFER { stat_cache.Free(); };
 
-    i32 num_files    = 0;
-    char **dir_files = DqnFile_ListDir(".\\Input\\*", &num_files);
-    DQN_DEFER { DqnFile_ListDirFree(dir_files, num_files); };
-    DQN_FOR_EACH(dir_index, num_files)
+    // NOTE(doyle): Workers spend most of their time blocked on the file system, oversubscribe the cores
     {
-        auto DQN_UNIQUE_NAME(mem_scope) = context.allocator.MemRegionScope();
-        auto DQN_UNIQUE_NAME(mem_scope) = global_func_local_allocator_.MemRegionScope();
+        u32 num_cores = 0, num_threads_per_core = 0;
+        DqnOS_GetThreadsAndCores(&num_cores, &num_threads_per_core);
+        context.num_workers = DQN_MAX(4u, num_cores * DQN_MAX(num_threads_per_core, 1u) * 2);
+        context.job_queue   = &global_job_queue_;
+        if (!context.job_queue->Init(global_jobs_, DQN_ARRAY_COUNT(global_jobs_), context.num_workers))
+        {
+            fprintf(stderr, "Failed to initialise the job queue\n");
+            return 1;
+        }
+    }
+
+    // NOTE(doyle): The thread pool backend runs on the workers above instead of starting its own
+    if (!context.file_batch.Init(256, file_backend, context.job_queue))
+    {
+        fprintf(stderr, "Failed to initialise the file batch, requested backend is unavailable\n");
+        return 1;
+    }
+    DQN_DEFER { context.file_batch.Free(); };
 
-        char const *playlist_file = dir_files[dir_index];
-        DqnBuffer<wchar_t> playlist_file_path = AllocateSwprintf(&context.allocator, L".\\Input\\%s", UTF8ToWChar(&context.allocator, playlist_file));
+    // NOTE(doyle): Runs until the end of the run, or for as long as watch mode does
+    LiveMetricsPublisher live_metrics = {};
+    DQN_DEFER { LiveMetricsPublisher_Stop(&live_metrics); };
+    if (live_stats_path || progress)
+    {
+        u32 interval_ms = static_cast<u32>(DQN_CLAMP(live_interval_ms, (i64)50, (i64)3600000));
+        if (!LiveMetricsPublisher_Start(&live_metrics, &context, live_stats_path, progress, interval_ms))
+            fprintf(stderr, "Failed to start publishing live metrics, continuing without them\n");
+    }
 
-        DqnVHashTable<DqnBuffer<wchar_t>, SoundFile> playlist = ReadPlaylistFile(&context, playlist_file_path.str);
-        DQN_DEFER
+    TranscodeTarget transcode = {};
+    if (transcode_format)
+    {
+        if (!TranscodeTarget_Init(&transcode, transcode_format, DQN_MAX(transcode_kbps, 8)))
         {
-            playlist.Free();
-        };
+            fprintf(stderr, "Failed to initialise transcoding, unknown format or no encoder for: %s\n", transcode_format);
+            return 1;
+        }
+        context.transcode = &transcode;
+    }
 
-        if (playlist.num_used_entries == 0)
+    // NOTE(doyle): A cap of 0 keeps nothing past the run, Output still has its links to the transcodes
+    TranscodeCache transcode_cache = {};
+    DQN_DEFER { transcode_cache.Free(); };
+    if (context.transcode)
+    {
+        if (!transcode_cache.Load(&context, DQN_MEGABYTE(DQN_MAX(transcode_cache_mb, 0))))
         {
-            continue;
+            fprintf(stderr, "Failed to make the transcode cache directory: %s\n", transcode_cache.dir_utf8);
+            return 1;
         }
+        context.transcode_cache = &transcode_cache;
+    }
 
-        DqnArray<SoundFile> sounds = MakeSoundFiles(&context, &playlist);
+    WaveformStore waveforms = {};
+    DQN_DEFER { waveforms.Free(); };
+    if (make_waveforms)
+    {
+        waveforms.Load(&context);
+        context.waveforms = &waveforms;
+    }
 
-        isize sounds_to_rel_path_num = sounds.len;
-        auto *sounds_to_rel_path_mem = DQN_MEMSTACK_PUSH_ARRAY(&context.allocator, DqnBuffer<wchar_t>, sounds_to_rel_path_num);
-        DqnArray<DqnBuffer<wchar_t>> sounds_to_rel_path(sounds_to_rel_path_mem, sounds_to_rel_path_num);
+    FingerprintIndex fingerprints = {};
+    DQN_DEFER { fingerprints.Free(); };
+    if (dedupe)
+    {
+        fingerprints.Init();
+        context.fingerprints = &fingerprints;
+    }
 
-        isize estimated_buf_chars = sounds.len; // for each sound file path, we also need a new line \n
-        for (SoundFile &sound_file : sounds)
+    ArtStore art = {};
+    DQN_DEFER { art.Free(); };
+    if (store_art)
+    {
+        if (!art.Load(&context, static_cast<int>(DQN_CLAMP(art_thumbnail_px, (i64)0, (i64)4096))))
         {
-            CheckAllocatorHasZeroAllocations(&global_func_local_allocator_);
-            wchar_t *artist = (sound_file.metadata.artist) ? sound_file.metadata.artist.str : L"_";
-            wchar_t *album  = (sound_file.metadata.album)  ? sound_file.metadata.album.str : L"_";
-            wchar_t *title  = (sound_file.metadata.title)  ? sound_file.metadata.title.str : sound_file.name.str;
+            fprintf(stderr, "Failed to make the cover art directory: %s\n", art.dir_utf8);
+            return 1;
+        }
+        context.art = &art;
+    }
 
-            // NOTE(doyle): Destructive
-            SanitiseStringForDiskFile(artist);
-            SanitiseStringForDiskFile(album);
-            SanitiseStringForDiskFile(title);
+    DqnFile_MakeDir("Input");
+    DqnFile_MakeDir("Output");
 
-            context.allocator.SetAllocMode(DqnMemStack::AllocMode::Head);
-            DqnBuffer<wchar_t> rel_path = AllocateSwprintf(&context.allocator, L"Files\\%s\\%s\\%s.%s", artist, album, title, sound_file.extension.str);
-            sounds_to_rel_path.Push(rel_path);
-            estimated_buf_chars += rel_path.len;
+    LibraryIndex index                = {};
+    LibraryIndexBuilder index_builder = {};
+    TrigramIndex search_index         = {};
+    DqnBuffer<wchar_t> index_path     = AllocateSwprintf(&context.allocator, L"%s\\WPDLibrary.index", context.exe_directory.str);
+    DQN_DEFER
+    {
+        index.Free();
+        index_builder.Free();
+        search_index.Free();
+    };
 
-            context.allocator.SetAllocMode(DqnMemStack::AllocMode::Tail);
-            DqnBuffer<wchar_t> dest_path = AllocateSwprintf(&context.allocator, L"%s\\Output\\%s", context.exe_directory.str, rel_path.str);
-            context.allocator.SetAllocMode(DqnMemStack::AllocMode::Head);
-            DQN_DEFER { context.allocator.Pop(dest_path.str); };
+    {
+        STAGE_SCOPE(&context.stats, Stage::IndexLoad);
+        if (index.Load(index_path.str))
+            context.stats[Stage::IndexLoad]->items += index.num_tracks;
 
-            if (DqnFile_GetInfo(dest_path.str, nullptr))
-            {
-                continue;
-            }
+        // NOTE(doyle): The builder starts with the whole library so searches see tracks from previous
+        // runs as well, sounds synced this run then update their tracks in place.
+        index_builder.Init();
+        index_builder.MergeUnseen(&index);
+        search_index.Init(&index_builder);
+        context.index         = &index;
+        context.index_builder = &index_builder;
+        context.search_index  = &search_index;
+    }
 
-            DQN_FOR_EACH(buf_index, dest_path.len)
-            {
-                if (dest_path.str[buf_index] == '\\')
-                {
-                    wchar_t tmp = dest_path.str[buf_index+1];
-                    dest_path.str[buf_index+1] = 0;
-                    CreateDirectoryW(dest_path.str, nullptr);
-                    dest_path.str[buf_index+1] = tmp;
-                }
-            }
+    // NOTE(doyle): Smart playlists are evaluated once everything else has been synced so they can see
+    // the tracks added this run, in scan mode the Input playlists are ignored but queries still run.
+    DqnFileDirList input_files = {};
+    DqnArray<char const *> query_names = {};
+    LibraryWatch library_watch         = {};
+    DQN_DEFER
+    {
+        query_names.Free();
+        LibraryWatch_Free(&library_watch);
+    };
+    DqnFile_ListDir(".\\Input", &context.allocator, &input_files, DqnFileDirList::Sort);
+    for (DqnFileDirList::Entry const &input_file : input_files)
+    {
+        if (input_file.type != DqnFileDirEntry::Type::File)
+            continue;
 
-            if (!CreateHardLinkW(dest_path.str, sound_file.path.str, nullptr))
-            {
-                char const *msg = DQN_LOGGER_E(
-                    &context.logger,
-                    "CreateSymbolicLinkW failed: %s. Could not make symbolic link from: %s -> %s",
-                    DqnWin32_GetLastError(),
-                    WCharToUTF8(&context.allocator, sound_file.path.str),
-                    WCharToUTF8(&context.allocator, dest_path.str));
-                global_logger_buf.Push(msg, DqnStr_Len(msg));
-            }
+        if (IsQueryFileName(input_file.name.data, input_file.name.len))
+        {
+            i32 name_len     = input_file.name.len - (i32)(DQN_CHAR_COUNT(QUERY_FILE_EXTENSION));
+            char *query_name = DQN_MEMSTACK_PUSH_ARRAY(&context.allocator, char, name_len + 1);
+            DqnMem_Copy(query_name, input_file.name.data, name_len);
+            query_name[name_len] = 0;
+            query_names.Push(query_name);
+            if (watch)
+                LibraryWatch_AddPlaylist(&library_watch, input_file.name.data, true /*is_query*/);
         }
+    }
 
-        DQN_ASSERT(sounds.len == sounds_to_rel_path.len);
-        // Make M3U8 playlist
+    if (scan_roots.len > 0)
+    {
+        ScanLibraries(&context, scan_roots.data, scan_roots.len, &library_watch.library_m3u);
+        WriteM3UFile(&context, L"Library.m3u", &library_watch.library_m3u);
+    }
+    else
+    {
+        for (DqnFileDirList::Entry const &input_file : input_files)
         {
-            DqnArray<char> m3u_buf = {};
-            m3u_buf.Reserve(estimated_buf_chars + /*safety_margin*/ 1024);
-            for (DqnBuffer<wchar_t> const &output_path : sounds_to_rel_path)
-            {
-                auto DQN_UNIQUE_NAME(mem_scope) = context.allocator.MemRegionScope();
-                DqnBuffer<char> utf8 = {};
-                utf8.str = WCharToUTF8(&context.allocator, output_path.str, &utf8.len);
-
-                m3u_buf.Push(utf8.str, utf8.len - 1);
-                m3u_buf.Push('\n');
-            }
-            m3u_buf.Push('\0');
+            if (input_file.type != DqnFileDirEntry::Type::File || IsQueryFileName(input_file.name.data, input_file.name.len))
+                continue;
 
-            // NOTE(doyle): len - 1, don't write the null terminating byte
-            DqnBuffer<wchar_t> dest_file = AllocateSwprintf(&context.allocator, L"%s\\Output\\%s", context.exe_directory.str, UTF8ToWChar(&context.allocator, playlist_file));
-            if (!DqnFile_WriteAll(dest_file.str, reinterpret_cast<u8 *>(m3u_buf.data), (m3u_buf.len - 1) * sizeof(m3u_buf.data[0])))
-            {
-                char const *msg = DQN_LOGGER_E(&context.logger, "DqnFile_WriteAll failed: Could not write m3u file to destination: %s", WCharToUTF8(&context.allocator, dest_file.str));
-                global_logger_buf.Push(msg, DqnStr_Len(msg));
-            }
+            PlaylistSources *sources = nullptr;
+            if (watch)
+                sources = &LibraryWatch_AddPlaylist(&library_watch, input_file.name.data, false /*is_query*/)->sources;
+            SyncPlaylistFile(&context, input_file.name.data, sources);
         }
     }
 
+    // NOTE(doyle): Queries run over the index just written, it's written back out after as syncing the
+    // matches may have refreshed tracks that changed on disk.
+    WriteLibraryIndex(&context, &index, &index_builder, index_path.str);
+    if (query_names.len > 0 && context.index)
+    {
+        SyncSmartPlaylists(&context, query_names.data, query_names.len);
+        WriteLibraryIndex(&context, &index, &index_builder, index_path.str);
+    }
+    if (context.transcode_cache)
+        WriteTranscodeCache(&context, context.transcode_cache);
+
+    if (context.waveforms)
+        WriteWaveformStore(&context, context.waveforms);
+
+    if (!watch)
+        LiveMetricsPublisher_Stop(&live_metrics);
+
+    fprintf(stdout, "Library index: %lld of %lld tracks reused unchanged metadata\n", (long long)context.num_index_hits, (long long)context.stats[Stage::MetadataExtract]->items);
+    fprintf(stdout, "Stat cache: %lld paths answered from cache, %lld stat'd, %lld directories listed\n", (long long)stat_cache.num_hits, (long long)stat_cache.num_stats, (long long)stat_cache.num_listings);
+    if (context.transcode_cache)
+    {
+        fprintf(stdout, "Transcode cache: %lld hits, %lld transcoded, %lld evicted, %.1fMB of %.1fMB used\n", (long long)transcode_cache.num_hits,
+                (long long)transcode_cache.num_misses, (long long)transcode_cache.num_evicted, transcode_cache.num_bytes / (f64)DQN_MEGABYTE(1),
+                transcode_cache.max_bytes / (f64)DQN_MEGABYTE(1));
+    }
+    if (context.fingerprints)
+        fprintf(stdout, "Duplicates: %lld sounds listed as the output of a near duplicate\n", (long long)fingerprints.num_duplicates);
+    if (context.waveforms)
+        fprintf(stdout, "Waveforms: %lld made, %lld stored\n", (long long)waveforms.num_made, (long long)waveforms.entries.num_used_entries);
+    if (context.art)
+    {
+        fprintf(stdout, "Cover art: %lld stored, %lld reused, %lld thumbnails made, %lld unique images\n", (long long)art.num_stored,
+                (long long)art.num_reused, (long long)art.num_thumbnails, (long long)art.entries.num_used_entries);
+    }
     fprintf(stderr, "%s", global_logger_buf.data);
+    PrintPipelineStats(&context.stats, stdout);
+    if (stats_json_path && !WritePipelineStatsJson(&context.stats, stats_json_path))
+        fprintf(stderr, "Failed to write stats json to: %s\n", stats_json_path);
+
+    // NOTE(doyle): In watch mode the trace is of the initial sync, it's written before watching starts
+    if (trace_path && !Trace_End(trace_path))
+        fprintf(stderr, "Failed to write trace to: %s\n", trace_path);
+
+    if (watch)
+    {
+        global_logger_buf.Clear(Dqn::ZeroMem::Yes);
+        bool scan_mode = (scan_roots.len > 0);
+        DqnArray<char const *> const *roots = (scan_mode) ? &scan_roots : &watch_roots;
+        WatchLibrary(&context, &library_watch, roots->data, roots->len, scan_mode, &index, &index_builder, index_path.str);
+        return 1;
+    }
     return 0;
 }